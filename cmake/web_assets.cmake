@@ -0,0 +1,88 @@
+# Compresses static web assets and emits them as const C arrays (kept in flash).
+#
+# Invoked in script mode:
+#   cmake -DGZIP_EXECUTABLE=... -DSOURCE_DIR=... -DASSETS=app.css,app.js
+#         -DWORK_DIR=... -DOUTPUT=.../web_assets.c -P web_assets.cmake
+#
+# Each asset is served at "/<file name>". gzip runs with -n so the output, and
+# therefore the ETag, depends only on the file contents.
+
+cmake_minimum_required(VERSION 3.13)
+
+foreach(var GZIP_EXECUTABLE SOURCE_DIR ASSETS WORK_DIR OUTPUT)
+    if(NOT DEFINED ${var})
+        message(FATAL_ERROR "web_assets.cmake: ${var} is not set")
+    endif()
+endforeach()
+
+file(MAKE_DIRECTORY ${WORK_DIR})
+string(REPLACE "," ";" asset_list "${ASSETS}")
+
+# CMake regular expressions have no {n} repetition; spell out 12 bytes per line.
+set(row_pattern "")
+foreach(i RANGE 1 12)
+    string(APPEND row_pattern "0x[0-9a-f][0-9a-f],")
+endforeach()
+
+set(arrays "")
+set(table "")
+foreach(name IN LISTS asset_list)
+    set(src "${SOURCE_DIR}/${name}")
+    set(gz "${WORK_DIR}/${name}.gz")
+
+    execute_process(
+        COMMAND ${GZIP_EXECUTABLE} -9 -n -c ${src}
+        OUTPUT_FILE ${gz}
+        RESULT_VARIABLE gzip_result)
+    if(NOT gzip_result EQUAL 0)
+        message(FATAL_ERROR "web_assets.cmake: gzip failed for ${src}")
+    endif()
+
+    if(name MATCHES "\\.css$")
+        set(content_type "text/css; charset=utf-8")
+    elseif(name MATCHES "\\.js$")
+        set(content_type "application/javascript; charset=utf-8")
+    elseif(name MATCHES "\\.html$")
+        set(content_type "text/html; charset=utf-8")
+    else()
+        set(content_type "application/octet-stream")
+    endif()
+
+    file(SHA256 ${gz} digest)
+    string(SUBSTRING "${digest}" 0 16 etag)
+
+    file(READ ${gz} hex HEX)
+    string(LENGTH "${hex}" hex_len)
+    math(EXPR length "${hex_len} / 2")
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+    string(REGEX REPLACE "(${row_pattern})" "\\1\n    " bytes "${bytes}")
+    string(REGEX REPLACE ",\n    $" "," bytes "${bytes}")
+
+    string(MAKE_C_IDENTIFIER "${name}" ident)
+    string(APPEND arrays
+        "// ${name}: ${length} bytes gzip\n"
+        "static const uint8_t k_${ident}_gz[${length}] = {\n    ${bytes}\n};\n\n")
+    string(APPEND table
+        "    {\"/${name}\", k_${ident}_gz, ${length}u, \"${content_type}\", \"${etag}\",\n"
+        "     \"\\\"${etag}\\\"\"},\n")
+endforeach()
+
+string(CONCAT content "// Generated by cmake/web_assets.cmake - do not edit.\n\n"
+    "#include \"web_assets.h\"\n\n"
+    "#include <string.h>\n\n"
+    "${arrays}"
+    "static const web_asset_t k_web_assets[] = {\n${table}};\n\n"
+    "const web_asset_t *web_assets_find(const char *path, size_t path_len) {\n"
+    "    for (size_t i = 0; i < sizeof(k_web_assets) / sizeof(k_web_assets[0]); ++i) {\n"
+    "        const web_asset_t *asset = &k_web_assets[i];\n"
+    "        if (strlen(asset->path) == path_len && memcmp(asset->path, path, path_len) == 0) {\n"
+    "            return asset;\n"
+    "        }\n"
+    "    }\n"
+    "    return NULL;\n"
+    "}\n")
+
+# Only touch the output when it changes so unrelated builds do not recompile it.
+file(WRITE ${OUTPUT}.tmp "${content}")
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different ${OUTPUT}.tmp ${OUTPUT})
+file(REMOVE ${OUTPUT}.tmp)
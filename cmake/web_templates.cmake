@@ -0,0 +1,131 @@
+# Compiles HTML templates into constant segments and slot references.
+#
+# Invoked in script mode:
+#   cmake -DSOURCE_DIR=... -DTEMPLATES=index.html -DOUTPUT_C=.../web_templates.c
+#         -DOUTPUT_H=.../web_templates.h -P web_templates.cmake
+#
+# A template is plain HTML with {{slot_name}} placeholders. Line breaks and the
+# indentation after them are dropped, so keep tags on one line. Each template
+# becomes `web_template_<file stem>` and every slot name a WEB_SLOT_* value.
+
+cmake_minimum_required(VERSION 3.13)
+
+foreach(var SOURCE_DIR TEMPLATES OUTPUT_C OUTPUT_H)
+    if(NOT DEFINED ${var})
+        message(FATAL_ERROR "web_templates.cmake: ${var} is not set")
+    endif()
+endforeach()
+
+function(write_if_changed path content)
+    file(WRITE ${path}.tmp "${content}")
+    execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different ${path}.tmp ${path})
+    file(REMOVE ${path}.tmp)
+endfunction()
+
+# Emits `text` as a C string literal spread over several source lines.
+function(append_c_literal out_var text)
+    set(result "")
+    string(LENGTH "${text}" remaining)
+    set(pos 0)
+    while(remaining GREATER 0)
+        set(take 80)
+        if(remaining LESS take)
+            set(take ${remaining})
+        endif()
+        string(SUBSTRING "${text}" ${pos} ${take} piece)
+        string(REPLACE "\\" "\\\\" piece "${piece}")
+        string(REPLACE "\"" "\\\"" piece "${piece}")
+        string(APPEND result "    \"${piece}\"\n")
+        math(EXPR pos "${pos} + ${take}")
+        math(EXPR remaining "${remaining} - ${take}")
+    endwhile()
+    set(${out_var} "${${out_var}}${result}" PARENT_SCOPE)
+endfunction()
+
+string(REPLACE "," ";" template_list "${TEMPLATES}")
+
+set(slots "")
+set(body "")
+set(declarations "")
+foreach(name IN LISTS template_list)
+    file(READ "${SOURCE_DIR}/${name}" text)
+    string(REGEX REPLACE "\n[ \t]*" "" text "${text}")
+
+    get_filename_component(stem "${name}" NAME_WE)
+    string(MAKE_C_IDENTIFIER "${stem}" ident)
+
+    set(parts "")
+    set(segment 0)
+    set(part_count 0)
+    while(TRUE)
+        string(FIND "${text}" "{{" open)
+        if(open EQUAL -1)
+            set(literal "${text}")
+            set(slot "")
+        else()
+            string(SUBSTRING "${text}" 0 ${open} literal)
+            math(EXPR start "${open} + 2")
+            string(SUBSTRING "${text}" ${start} -1 text)
+            string(FIND "${text}" "}}" close)
+            if(close EQUAL -1)
+                message(FATAL_ERROR "web_templates.cmake: unterminated slot in ${name}")
+            endif()
+            string(SUBSTRING "${text}" 0 ${close} slot)
+            math(EXPR start "${close} + 2")
+            string(SUBSTRING "${text}" ${start} -1 text)
+            if(NOT slot MATCHES "^[a-z][a-z0-9_]*$")
+                message(FATAL_ERROR "web_templates.cmake: bad slot name '${slot}' in ${name}")
+            endif()
+        endif()
+
+        if(NOT literal STREQUAL "")
+            set(seg_name "k_${ident}_seg${segment}")
+            set(c_literal "")
+            append_c_literal(c_literal "${literal}")
+            string(REGEX REPLACE "\n$" ";\n\n" c_literal "${c_literal}")
+            string(APPEND body "static const char ${seg_name}[] =\n${c_literal}")
+            string(APPEND parts
+                "    {${seg_name}, sizeof(${seg_name}) - 1, WEB_TEMPLATE_LITERAL},\n")
+            math(EXPR segment "${segment} + 1")
+            math(EXPR part_count "${part_count} + 1")
+        endif()
+
+        if(slot STREQUAL "")
+            break()
+        endif()
+        list(FIND slots "${slot}" slot_index)
+        if(slot_index EQUAL -1)
+            list(APPEND slots "${slot}")
+        endif()
+        string(TOUPPER "${slot}" slot_upper)
+        string(APPEND parts "    {NULL, 0, WEB_SLOT_${slot_upper}},\n")
+        math(EXPR part_count "${part_count} + 1")
+    endwhile()
+
+    string(APPEND body
+        "static const web_template_part_t k_${ident}_parts[] = {\n${parts}};\n\n"
+        "const web_template_t web_template_${ident} = {k_${ident}_parts, ${part_count}u};\n\n")
+    string(APPEND declarations "extern const web_template_t web_template_${ident};\n")
+endforeach()
+
+set(slot_enum "")
+foreach(slot IN LISTS slots)
+    string(TOUPPER "${slot}" slot_upper)
+    string(APPEND slot_enum "    WEB_SLOT_${slot_upper},\n")
+endforeach()
+
+string(CONCAT header "// Generated by cmake/web_templates.cmake - do not edit.\n\n"
+    "#ifndef WEB_TEMPLATES_H\n"
+    "#define WEB_TEMPLATES_H\n\n"
+    "#include \"web_template.h\"\n\n"
+    "typedef enum {\n${slot_enum}    WEB_SLOT_COUNT\n} web_slot_t;\n\n"
+    "${declarations}\n"
+    "#endif // WEB_TEMPLATES_H\n")
+
+string(CONCAT source "// Generated by cmake/web_templates.cmake - do not edit.\n\n"
+    "#include \"web_templates.h\"\n\n"
+    "#include <stddef.h>\n\n"
+    "${body}")
+
+write_if_changed(${OUTPUT_H} "${header}")
+write_if_changed(${OUTPUT_C} "${source}")
@@ -0,0 +1,352 @@
+// Host benchmarks for the core library (cmake/host_build.cmake).
+//
+//   core_bench [all|page|form|morse|plan|log] [iterations]
+//
+//   page   landing page render: from the model, building the fragment cache,
+//          and from the cache
+//   form   form-body parsing the way the landing page handlers do it
+//   morse  morse_start(): text to timed key events
+//   plan   Si5351 frequency plans compiled to register images, and applied
+//   log    a log call kept, and one skipped by the runtime category mask;
+//          signal_controller_set() with its category on and off. Rebuild with
+//          -DCLOCKGEN_LOG_MIN_LEVEL=... to compare levels; `size` on the
+//          library's objects gives what each level costs in code
+//
+// The Si5351 is the I2C shim's register file. Exits non-zero if any of the
+// work fails.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hal_host.h"
+#include "logging.h"
+#include "morse_player.h"
+#include "si5351.h"
+#include "signal_controller.h"
+#include "webserver_form.h"
+#include "webserver_pages.h"
+
+#define PAGE_MAX 16384
+#define SCRATCH_BYTES 128 // what webserver_utils.c streams slots through
+
+typedef struct {
+    const char *body;
+    bool morse;
+} form_sample_t;
+
+static const form_sample_t k_forms[] = {
+    {"frequency=14070000&drive=8", false},
+    {"action=apply&frequency=7074000&drive=4", false},
+    {"action=toggle-output", false},
+    {"frequency=200000000&drive=2&extra=ignored+field", false},
+    {"text=CQ+CQ+DE+PICO&wpm=20&fwpm=12", true},
+    {"text=%48%69%21&wpm=25&fwpm=", true},
+    {"wpm=18&text=VVV+%3D+TEST+K", true},
+};
+
+#define FORM_COUNT (sizeof(k_forms) / sizeof(k_forms[0]))
+
+static const char *const k_morse_texts[] = {
+    "PARIS", "CQ CQ DE PICO K", "VVV VVV TEST 73", "0123456789?/=+-", "E",
+};
+
+#define MORSE_TEXT_COUNT (sizeof(k_morse_texts) / sizeof(k_morse_texts[0]))
+
+static volatile uint64_t g_sink; // keeps results the compiler would drop
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, unsigned ops, double elapsed, const char *extra) {
+    printf("bench: %-16s %10.0f ns/op %12.0f ops/s  %s\n", name, elapsed * 1e9 / ops,
+           ops / elapsed, extra ? extra : "");
+}
+
+// Streams a template the way a connection does, into out for checking.
+static size_t render(web_slot_resolver_fn resolve, const void *model, char *out, size_t out_len) {
+    web_template_cursor_t cursor;
+    char scratch[SCRATCH_BYTES];
+    const char *data = NULL;
+    size_t len = 0;
+    bool in_flash = false;
+    size_t total = 0;
+
+    web_template_begin(&cursor, webserver_landing_page, resolve, model);
+    while (web_template_next(&cursor, scratch, sizeof(scratch), &data, &len, &in_flash)) {
+        if (total + len <= out_len) {
+            memcpy(out + total, data, len);
+        }
+        total += len;
+    }
+    return total;
+}
+
+static int bench_page(unsigned iterations) {
+    static char page[PAGE_MAX];
+    static char cached_page[PAGE_MAX];
+    static webserver_page_fragments_t fragments;
+
+    webserver_page_model_t model = {
+        .frequency_hz = 14070000,
+        .drive_ma = 8,
+        .output_enabled = true,
+        .morse_wpm = 20,
+        .morse_fwpm = 12,
+        .morse_status = "Idle",
+        .status_message = "Frequency set to 14070000 Hz <ok> & \"saved\"",
+        .morse_text = "CQ DE <PICO>",
+    };
+
+    const size_t expected = web_template_measure(webserver_landing_page,
+                                                 webserver_landing_page_resolve, &model);
+    const size_t size = render(webserver_landing_page_resolve, &model, page, sizeof(page));
+    if (size != expected || size > sizeof(page)) {
+        fprintf(stderr, "page: rendered %zu bytes, measured %zu\n", size, expected);
+        return 1;
+    }
+
+    double start = now_seconds();
+    for (unsigned i = 0; i < iterations; ++i) {
+        g_sink += web_template_measure(webserver_landing_page, webserver_landing_page_resolve,
+                                       &model);
+        g_sink += render(webserver_landing_page_resolve, &model, page, sizeof(page));
+    }
+    char extra[64];
+    snprintf(extra, sizeof(extra), "%zu B, measured then streamed", size);
+    report("page/model", iterations, now_seconds() - start, extra);
+
+    start = now_seconds();
+    for (unsigned i = 0; i < iterations; ++i) {
+        if (!webserver_page_fragments_build(&fragments, &model, i)) {
+            fprintf(stderr, "page: fragments do not fit\n");
+            return 1;
+        }
+    }
+    snprintf(extra, sizeof(extra), "%zu B cached", webserver_page_fragments_size(&fragments));
+    report("page/fragments", iterations, now_seconds() - start, extra);
+
+    start = now_seconds();
+    for (unsigned i = 0; i < iterations; ++i) {
+        g_sink += render(webserver_page_fragments_resolve, &fragments, cached_page,
+                         sizeof(cached_page));
+    }
+    report("page/cached", iterations, now_seconds() - start, NULL);
+
+    if (fragments.content_length != size || memcmp(page, cached_page, size) != 0) {
+        fprintf(stderr, "page: cached render differs from the model render\n");
+        return 1;
+    }
+    return 0;
+}
+
+// The field reads handle_form_submission() and handle_morse_submission() do.
+static bool parse_form(const form_sample_t *form) {
+    char buf[MORSE_MAX_CHARS * 3];
+    uint64_t value = 0;
+    if (form->morse) {
+        bool ok = webserver_form_value(form->body, "text=", buf, sizeof(buf));
+        ok = webserver_form_value(form->body, "wpm=", buf, sizeof(buf)) &&
+             webserver_form_uint64(buf, &value) && ok;
+        webserver_form_value(form->body, "fwpm=", buf, sizeof(buf));
+        return ok;
+    }
+    webserver_form_value(form->body, "action=", buf, sizeof(buf));
+    if (strcmp(buf, "toggle-output") == 0) {
+        return true;
+    }
+    return webserver_form_value(form->body, "frequency=", buf, sizeof(buf)) &&
+           webserver_form_uint64(buf, &value) &&
+           webserver_form_value(form->body, "drive=", buf, sizeof(buf)) &&
+           webserver_form_uint64(buf, &value);
+}
+
+static int bench_form(unsigned iterations) {
+    size_t bytes = 0;
+    for (size_t f = 0; f < FORM_COUNT; ++f) {
+        if (!parse_form(&k_forms[f])) {
+            fprintf(stderr, "form: failed to parse \"%s\"\n", k_forms[f].body);
+            return 1;
+        }
+        bytes += strlen(k_forms[f].body);
+    }
+
+    const double start = now_seconds();
+    for (unsigned i = 0; i < iterations; ++i) {
+        for (size_t f = 0; f < FORM_COUNT; ++f) {
+            g_sink += parse_form(&k_forms[f]);
+        }
+    }
+    const double elapsed = now_seconds() - start;
+    char extra[64];
+    snprintf(extra, sizeof(extra), "%.1f MiB/s of body",
+             (double)bytes * iterations / elapsed / (1024.0 * 1024.0));
+    report("form", iterations * (unsigned)FORM_COUNT, elapsed, extra);
+    return 0;
+}
+
+static int bench_morse(unsigned iterations) {
+    double elapsed = 0.0;
+    for (unsigned i = 0; i < iterations; ++i) {
+        const char *text = k_morse_texts[i % MORSE_TEXT_COUNT];
+        const double start = now_seconds();
+        const bool ok = morse_start(text, (uint8_t)strlen(text), 20, i % 2 ? 12 : -1);
+        elapsed += now_seconds() - start;
+        if (!ok) {
+            fprintf(stderr, "morse: start \"%s\" failed: %s\n", text, morse_last_error());
+            return 1;
+        }
+        // The stop only takes effect on the next tick; neither is timed.
+        morse_stop();
+        morse_tick();
+    }
+    report("morse/start", iterations, elapsed, "incl. keying the output off");
+    return 0;
+}
+
+static int bench_plan(unsigned iterations) {
+    // Log-spaced across the whole range the form accepts.
+    enum { STEPS = 64 };
+    signal_settings_t targets[STEPS];
+    for (unsigned s = 0; s < STEPS; ++s) {
+        double hz = 8000.0;
+        for (unsigned k = 0; k < s; ++k) {
+            hz *= 1.1705; // 8 kHz * 1.1705^63 ~ 200 MHz
+        }
+        targets[s] = (signal_settings_t){
+            .frequency_hz = hz > 200e6 ? 200000000u : (uint64_t)hz,
+            .drive_ma = (uint8_t)(2 + 2 * (s % 4)),
+            .output_enabled = s % 2,
+        };
+    }
+
+    signal_image_t image;
+    hal_host_i2c_stats_t bus;
+    uint8_t before[256];
+    const uint8_t *regs = hal_host_i2c_registers(SI5351_BUS_BASE_ADDR);
+    memcpy(before, regs, sizeof(before));
+    hal_host_i2c_reset_stats();
+    const double start = now_seconds();
+    for (unsigned i = 0; i < iterations; ++i) {
+        const signal_settings_t *to = &targets[i % STEPS];
+        if (!signal_controller_compile(NULL, to, &image)) {
+            fprintf(stderr, "plan: %llu Hz did not compile\n",
+                    (unsigned long long)to->frequency_hz);
+            return 1;
+        }
+        g_sink += image.len;
+    }
+    const double elapsed = now_seconds() - start;
+    hal_host_i2c_stats(&bus);
+    if (memcmp(before, regs, sizeof(before)) != 0) {
+        fprintf(stderr, "plan: compiling changed Si5351 registers\n");
+        return 1;
+    }
+    char extra[64];
+    snprintf(extra, sizeof(extra), "%.1f register reads/plan, nothing written",
+             (double)bus.reads / iterations);
+    report("plan/compile", iterations, elapsed, extra);
+
+    hal_host_i2c_reset_stats();
+    const double apply_start = now_seconds();
+    for (unsigned i = 0; i < iterations; ++i) {
+        if (!signal_controller_apply(&targets[i % STEPS])) {
+            fprintf(stderr, "plan: apply %llu Hz failed\n",
+                    (unsigned long long)targets[i % STEPS].frequency_hz);
+            return 1;
+        }
+    }
+    const double apply_elapsed = now_seconds() - apply_start;
+    hal_host_i2c_stats(&bus);
+    snprintf(extra, sizeof(extra), "%.1f bus writes/apply",
+             (double)bus.writes / iterations);
+    report("plan/apply", iterations, apply_elapsed, extra);
+    return 0;
+}
+
+static const char *const k_level_names[] = {"DEBUG", "INFO", "WARN", "ERROR", "OFF"};
+
+static int bench_log(unsigned iterations) {
+    const uint32_t mask = logging_category_mask();
+    printf("bench: LOG_MIN_LEVEL=%s LOG_CATEGORIES=0x%08x\n", k_level_names[LOG_MIN_LEVEL],
+           (unsigned)(LOG_CATEGORIES));
+
+    double start = now_seconds();
+    for (unsigned i = 0; i < iterations; ++i) {
+        LOG_WARN(LOG_CAT_USER, "bench %u of %u", i, iterations);
+    }
+    report("log/kept", iterations, now_seconds() - start, "LOG_WARN into the ring");
+
+    logging_set_category_mask(mask & ~(1u << LOG_CAT_USER));
+    start = now_seconds();
+    for (unsigned i = 0; i < iterations; ++i) {
+        LOG_WARN(LOG_CAT_USER, "bench %u of %u", i, iterations);
+    }
+    report("log/masked", iterations, now_seconds() - start, "category off at run time");
+
+    // Alternating, so every call retunes and logs what it did.
+    for (int pass = 0; pass < 2; ++pass) {
+        const bool on = pass == 0;
+        logging_set_category_mask(on ? mask : mask & ~(1u << LOG_CAT_SI5351));
+        hal_host_i2c_reset_stats();
+        start = now_seconds();
+        for (unsigned i = 0; i < iterations; ++i) {
+            if (!signal_controller_set(i % 2 ? 7030000u : 14060000u, 4)) {
+                fprintf(stderr, "log: signal_controller_set failed\n");
+                logging_set_category_mask(mask);
+                return 1;
+            }
+        }
+        const double elapsed = now_seconds() - start;
+        hal_host_i2c_stats_t bus;
+        hal_host_i2c_stats(&bus);
+        char extra[64];
+        snprintf(extra, sizeof(extra), "si5351 logs %s, %.1f bus ops/call", on ? "on" : "off",
+                 (double)(bus.writes + bus.reads) / iterations);
+        report(on ? "log/set-on" : "log/set-off", iterations, elapsed, extra);
+    }
+    logging_set_category_mask(mask);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *mode = argc > 1 ? argv[1] : "all";
+    const unsigned count = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 10) : 0;
+    const bool all = strcmp(mode, "all") == 0;
+
+    if (!all && strcmp(mode, "page") != 0 && strcmp(mode, "form") != 0 &&
+        strcmp(mode, "morse") != 0 && strcmp(mode, "plan") != 0 && strcmp(mode, "log") != 0) {
+        fprintf(stderr, "usage: %s [all|page|form|morse|plan|log] [iterations]\n", argv[0]);
+        return 2;
+    }
+
+    hal_host_i2c_attach(SI5351_BUS_BASE_ADDR);
+    if (!signal_controller_init()) {
+        fprintf(stderr, "signal controller did not initialize\n");
+        return 1;
+    }
+
+    int rc = 0;
+    if (all || strcmp(mode, "page") == 0) {
+        rc |= bench_page(count ? count : 20000);
+    }
+    if (all || strcmp(mode, "form") == 0) {
+        rc |= bench_form(count ? count : 200000);
+    }
+    if (all || strcmp(mode, "morse") == 0) {
+        rc |= bench_morse(count ? count : 20000);
+    }
+    if (all || strcmp(mode, "plan") == 0) {
+        rc |= bench_plan(count ? count : 20000);
+    }
+    if (all || strcmp(mode, "log") == 0) {
+        rc |= bench_log(count ? count : 200000);
+    }
+    return rc;
+}
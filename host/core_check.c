@@ -0,0 +1,185 @@
+// Host checks for the core library (cmake/host_build.cmake), run by ctest.
+//
+//   core_check
+//
+// The Si5351 is the I2C shim's register file and the control task is run
+// inline, the way main.c does it. Prints every failed check and exits
+// non-zero if there was one.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/time.h"
+
+#include "control_coalesce.h"
+#include "control_queue.h"
+#include "debug.h"
+#include "hal_host.h"
+#include "logging.h"
+#include "scheduler.h"
+#include "scpi.h"
+#include "sequence.h"
+#include "si5351.h"
+#include "signal_controller.h"
+
+#define CHECK(cond)                                                                                \
+    do {                                                                                           \
+        if (!(cond)) {                                                                             \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);               \
+            g_failures++;                                                                          \
+        }                                                                                          \
+    } while (0)
+
+static int g_failures = 0;
+static scpi_session_t *g_scpi = NULL;
+static char g_reply[SCPI_OUTPUT_MAX + 1];
+
+static void scpi_resume(scpi_session_t *session, void *user) {
+    (void)session;
+    (void)user;
+}
+
+// What control_task() in main.c does, until the queue is empty.
+static void run_control(void) {
+    control_job_t job;
+    while (control_queue_pop(&job)) {
+        control_queue_run(&job);
+        if (job.done) {
+            job.done(&job);
+        }
+    }
+    control_coalesce_task();
+    scpi_task();
+}
+
+// Feeds one program message and returns what the session answered.
+static const char *scpi(const char *message) {
+    size_t len = strlen(message);
+    for (unsigned rounds = 0; rounds < 100; ++rounds) {
+        const size_t used = scpi_session_feed(g_scpi, message, len);
+        message += used;
+        len -= used;
+        run_control();
+        if (len == 0 && !scpi_session_waiting(g_scpi)) {
+            break;
+        }
+    }
+    size_t out_len = 0;
+    const char *out = scpi_session_output(g_scpi, &out_len);
+    memcpy(g_reply, out, out_len);
+    g_reply[out_len] = '\0';
+    scpi_session_consume_output(g_scpi, out_len);
+    return g_reply;
+}
+
+static void check_log_categories(void) {
+    CHECK(strcmp(scpi("SYST:LOG:CAT MORSE, http\n"), "") == 0);
+    CHECK(logging_category_mask() == ((1u << LOG_CAT_MORSE) | (1u << LOG_CAT_HTTP)));
+    CHECK(strcmp(scpi("SYST:LOG:CAT?\n"), "\"morse,http\"\n") == 0);
+
+    // Masked categories are dropped before anything reaches the ring.
+    uint32_t written = debug_records_written();
+    LOG_ERROR(LOG_CAT_SI5351, "masked");
+    CHECK(debug_records_written() == written);
+    LOG_ERROR(LOG_CAT_MORSE, "kept");
+    CHECK(debug_records_written() == written + 1);
+
+    CHECK(strcmp(scpi("SYST:LOG:CAT NONE;:SYST:LOG:CAT?\n"), "\"\"\n") == 0);
+    CHECK(strcmp(scpi("SYST:LOG:CAT BOGUS;:SYST:ERR?\n"),
+                 "-224,\"Illegal parameter value\"\n") == 0);
+    CHECK(logging_category_mask() == 0);
+    CHECK(strcmp(scpi("SYST:LOG:CAT ALL;:SYST:LOG:CAT?\n"),
+                 "\"system,si5351,morse,http,dhcp,user\"\n") == 0);
+}
+
+// Rewriting what the chip already holds costs only the reads that find out.
+static void check_unchanged_reapply(void) {
+    hal_host_i2c_stats_t stats;
+    const uint8_t reg = SI5351_CLK0_CTRL;
+
+    hal_host_i2c_reset_stats();
+    si5351_batch_begin();
+    const uint8_t value = si5351_read(reg);
+    si5351_write(reg, value);
+    uint8_t transfers = 0xFF;
+    CHECK(si5351_batch_commit(&transfers));
+    hal_host_i2c_stats(&stats);
+    CHECK(transfers == 0);
+    CHECK(stats.writes == 1 && stats.reads == 1); // the register pointer, then the value
+    CHECK(stats.bytes == 2);
+
+    // The same through the controller, forced to rewrite every setting by
+    // compiling an image first.
+    const signal_settings_t settings = {
+        .frequency_hz = 10000000,
+        .drive_ma = 4,
+        .output_enabled = true,
+    };
+    CHECK(signal_controller_apply(&settings));
+    uint8_t before[256];
+    memcpy(before, hal_host_i2c_registers(SI5351_BUS_BASE_ADDR), sizeof(before));
+    signal_image_t image;
+    CHECK(signal_controller_compile(NULL, &settings, &image));
+
+    hal_host_i2c_stats_t full;
+    hal_host_i2c_reset_stats();
+    CHECK(signal_controller_apply(&settings));
+    hal_host_i2c_stats(&full);
+    CHECK(memcmp(before, hal_host_i2c_registers(SI5351_BUS_BASE_ADDR), sizeof(before)) == 0);
+    // Only the PLL A and multisynth 0 parameters, which are written without
+    // reading them first, go out again: two 9-byte transfers. The control and
+    // output enable registers are read back and left alone.
+    CHECK(full.writes - full.reads == 2);
+    CHECK(full.bytes == 2 * 9 + 2 * full.reads);
+}
+
+// A manual setting ends a running sequence before its next step, so the
+// program never overwrites what was set by hand.
+static void check_manual_stops_sequence(void) {
+    static const char program[] = "loop; freq 1000000; wait 2ms; freq 2000000; wait 2ms; end";
+    CHECK(sequence_parse(program, strlen(program)) == NULL);
+    CHECK(sequence_load() == NULL);
+    sequence_tick();
+    CHECK(sequence_active());
+    CHECK(signal_controller_get_frequency_hz() == 1000000);
+
+    CHECK(strcmp(scpi("FREQ 3000000\n"), "") == 0);
+    CHECK(signal_controller_get_frequency_hz() == 3000000);
+    uint8_t manual[256];
+    memcpy(manual, hal_host_i2c_registers(SI5351_BUS_BASE_ADDR), sizeof(manual));
+
+    for (int i = 0; i < 5; ++i) {
+        sleep_ms(2);
+        sequence_tick();
+    }
+    CHECK(!sequence_active());
+    CHECK(sequence_status() == SEQUENCE_STATUS_STOPPED);
+    CHECK(signal_controller_get_frequency_hz() == 3000000);
+    CHECK(memcmp(manual, hal_host_i2c_registers(SI5351_BUS_BASE_ADDR), sizeof(manual)) == 0);
+}
+
+int main(void) {
+    scheduler_init();
+    control_queue_init();
+    logging_init();
+    hal_host_i2c_attach(SI5351_BUS_BASE_ADDR);
+    if (!signal_controller_init()) {
+        fprintf(stderr, "signal controller did not initialize\n");
+        return 1;
+    }
+    scpi_init();
+    g_scpi = scpi_session_open(scpi_resume, NULL);
+
+    check_log_categories();
+    check_unchanged_reapply();
+    check_manual_stops_sequence();
+
+    if (g_failures) {
+        fprintf(stderr, "%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    printf("core_check: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,12 @@
+#include "metrics.h"
+#include "webserver.h"
+
+// metrics.c reads lwIP's pools and stays on the target. The modules in the
+// host library only feed it, so its recording hooks end here.
+void metrics_observe_morse_edge(uint32_t late_us) { (void)late_us; }
+
+void metrics_observe_loop(uint32_t busy_us) { (void)busy_us; }
+
+// The Morse hold belongs to the landing page in webserver.c; nothing on the
+// host takes it.
+bool webserver_morse_hold_active(void) { return false; }
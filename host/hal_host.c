@@ -0,0 +1,173 @@
+#include "hal_host.h"
+
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+#include "hardware/flash.h"
+#include "hardware/i2c.h"
+#include "hardware/timer.h"
+#include "pico/rand.h"
+#include "pico/time.h"
+
+typedef struct {
+    bool attached;
+    uint8_t addr;
+    uint8_t pointer;
+    uint8_t regs[256];
+} hal_host_i2c_device_t;
+
+i2c_inst_t i2c0_inst = {.index = 0};
+i2c_inst_t i2c1_inst = {.index = 1};
+
+static hal_host_i2c_device_t g_devices[HAL_HOST_I2C_DEVICES];
+static hal_host_i2c_stats_t g_i2c_stats;
+
+static uint8_t g_flash[PICO_FLASH_SIZE_BYTES];
+static bool g_flash_ready = false;
+
+static uint64_t g_boot_ns = 0;
+static uint32_t g_rand_state = 0x2545F491u;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t time_us_64(void) {
+    const uint64_t now = monotonic_ns();
+    if (g_boot_ns == 0) {
+        g_boot_ns = now;
+    }
+    return (now - g_boot_ns) / 1000u;
+}
+
+void sleep_us(uint64_t us) {
+    struct timespec ts = {
+        .tv_sec = (time_t)(us / 1000000u),
+        .tv_nsec = (long)(us % 1000000u) * 1000,
+    };
+    while (nanosleep(&ts, &ts) != 0) {
+    }
+}
+
+void sleep_ms(uint32_t ms) { sleep_us((uint64_t)ms * 1000u); }
+
+bool best_effort_wfe_or_timeout(absolute_time_t timeout_timestamp) {
+    const int64_t left = absolute_time_diff_us(get_absolute_time(), timeout_timestamp);
+    if (left > 0) {
+        sleep_us(left < 1000 ? (uint64_t)left : 1000u);
+    }
+    return time_reached(timeout_timestamp);
+}
+
+uint32_t get_rand_32(void) {
+    // xorshift32
+    uint32_t x = g_rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    g_rand_state = x;
+    return x;
+}
+
+static hal_host_i2c_device_t *find_device(uint8_t addr) {
+    for (size_t i = 0; i < HAL_HOST_I2C_DEVICES; ++i) {
+        if (g_devices[i].attached && g_devices[i].addr == addr) {
+            return &g_devices[i];
+        }
+    }
+    return NULL;
+}
+
+bool hal_host_i2c_attach(uint8_t addr) {
+    if (find_device(addr)) {
+        return true;
+    }
+    for (size_t i = 0; i < HAL_HOST_I2C_DEVICES; ++i) {
+        if (!g_devices[i].attached) {
+            g_devices[i] = (hal_host_i2c_device_t){.attached = true, .addr = addr};
+            return true;
+        }
+    }
+    return false;
+}
+
+void hal_host_i2c_detach_all(void) { memset(g_devices, 0, sizeof(g_devices)); }
+
+uint8_t *hal_host_i2c_registers(uint8_t addr) {
+    hal_host_i2c_device_t *device = find_device(addr);
+    return device ? device->regs : NULL;
+}
+
+void hal_host_i2c_stats(hal_host_i2c_stats_t *out) { *out = g_i2c_stats; }
+
+void hal_host_i2c_reset_stats(void) { memset(&g_i2c_stats, 0, sizeof(g_i2c_stats)); }
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate) {
+    i2c->baudrate = baudrate;
+    return baudrate;
+}
+
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len,
+                       bool nostop) {
+    (void)i2c;
+    (void)nostop;
+    hal_host_i2c_device_t *device = find_device(addr);
+    if (!device || len == 0) {
+        g_i2c_stats.naks++;
+        return PICO_ERROR_GENERIC;
+    }
+    device->pointer = src[0];
+    for (size_t i = 1; i < len; ++i) {
+        device->regs[device->pointer++] = src[i];
+    }
+    g_i2c_stats.writes++;
+    g_i2c_stats.bytes += len;
+    return (int)len;
+}
+
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop) {
+    (void)i2c;
+    (void)nostop;
+    hal_host_i2c_device_t *device = find_device(addr);
+    if (!device || len == 0) {
+        g_i2c_stats.naks++;
+        return PICO_ERROR_GENERIC;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        dst[i] = device->regs[device->pointer++];
+    }
+    g_i2c_stats.reads++;
+    g_i2c_stats.bytes += len;
+    return (int)len;
+}
+
+static void flash_prepare(void) {
+    if (!g_flash_ready) {
+        memset(g_flash, 0xFF, sizeof(g_flash));
+        g_flash_ready = true;
+    }
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+    assert(flash_offs % FLASH_SECTOR_SIZE == 0 && count % FLASH_SECTOR_SIZE == 0);
+    assert(flash_offs + count <= PICO_FLASH_SIZE_BYTES);
+    flash_prepare();
+    memset(g_flash + flash_offs, 0xFF, count);
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count) {
+    assert(flash_offs % FLASH_PAGE_SIZE == 0 && count % FLASH_PAGE_SIZE == 0);
+    assert(flash_offs + count <= PICO_FLASH_SIZE_BYTES);
+    flash_prepare();
+    for (size_t i = 0; i < count; ++i) {
+        g_flash[flash_offs + i] &= data[i];
+    }
+}
+
+const uint8_t *hal_host_flash(void) {
+    flash_prepare();
+    return g_flash;
+}
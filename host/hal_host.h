@@ -0,0 +1,35 @@
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The host side of the shim headers under host/include: what a Linux
+// program needs to stand in for the board before calling into the core.
+
+// I2C: each attached address answers with a 256-byte register file, the way
+// a Si5351 does. A write sets the register pointer and stores the bytes after
+// it; a read returns bytes from the pointer on. Registers start at zero.
+#define HAL_HOST_I2C_DEVICES 4
+
+bool hal_host_i2c_attach(uint8_t addr);
+void hal_host_i2c_detach_all(void);
+// NULL if nothing is attached at addr.
+uint8_t *hal_host_i2c_registers(uint8_t addr);
+
+typedef struct {
+    uint32_t writes; // transactions, not bytes
+    uint32_t reads;
+    uint32_t naks;
+    uint64_t bytes;
+} hal_host_i2c_stats_t;
+
+void hal_host_i2c_stats(hal_host_i2c_stats_t *out);
+void hal_host_i2c_reset_stats(void);
+
+// Flash: the image flash_range_erase() and flash_range_program() work on,
+// PICO_FLASH_SIZE_BYTES long and erased at start.
+const uint8_t *hal_host_flash(void);
+
+#endif // HAL_HOST_H
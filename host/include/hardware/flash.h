@@ -0,0 +1,20 @@
+#ifndef HOST_HARDWARE_FLASH_H
+#define HOST_HARDWARE_FLASH_H
+
+#include "pico/types.h"
+
+#define FLASH_PAGE_SIZE (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+#define FLASH_BLOCK_SIZE (1u << 16)
+
+#ifndef PICO_FLASH_SIZE_BYTES
+#define PICO_FLASH_SIZE_BYTES (2u * 1024u * 1024u)
+#endif
+
+// A RAM image with NOR rules: erase sets whole sectors to 0xFF, programming
+// whole pages can only clear bits. Offsets and counts must be aligned as on
+// the target. Read it back through hal_host_flash() instead of XIP_BASE.
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
+
+#endif // HOST_HARDWARE_FLASH_H
@@ -0,0 +1,24 @@
+#ifndef HOST_HARDWARE_GPIO_H
+#define HOST_HARDWARE_GPIO_H
+
+#include "pico/types.h"
+
+typedef enum gpio_function {
+    GPIO_FUNC_XIP = 0,
+    GPIO_FUNC_SPI = 1,
+    GPIO_FUNC_UART = 2,
+    GPIO_FUNC_I2C = 3,
+    GPIO_FUNC_PWM = 4,
+    GPIO_FUNC_SIO = 5,
+    GPIO_FUNC_NULL = 0x1f,
+} gpio_function_t;
+
+// Pins have nothing behind them on the host.
+static inline void gpio_set_function(uint gpio, gpio_function_t fn) {
+    (void)gpio;
+    (void)fn;
+}
+
+static inline void gpio_pull_up(uint gpio) { (void)gpio; }
+
+#endif // HOST_HARDWARE_GPIO_H
@@ -0,0 +1,11 @@
+#ifndef HOST_HARDWARE_TIMER_H
+#define HOST_HARDWARE_TIMER_H
+
+#include "pico/types.h"
+
+// CLOCK_MONOTONIC, counted from the first call.
+uint64_t time_us_64(void);
+
+static inline uint32_t time_us_32(void) { return (uint32_t)time_us_64(); }
+
+#endif // HOST_HARDWARE_TIMER_H
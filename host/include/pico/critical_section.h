@@ -0,0 +1,21 @@
+#ifndef HOST_PICO_CRITICAL_SECTION_H
+#define HOST_PICO_CRITICAL_SECTION_H
+
+#include "hardware/sync.h"
+
+// The host library runs on one thread with no interrupts to mask.
+typedef struct {
+    uint32_t save;
+} critical_section_t;
+
+static inline void critical_section_init(critical_section_t *crit_sec) { crit_sec->save = 0; }
+
+static inline void critical_section_enter_blocking(critical_section_t *crit_sec) {
+    crit_sec->save = save_and_disable_interrupts();
+}
+
+static inline void critical_section_exit(critical_section_t *crit_sec) {
+    restore_interrupts(crit_sec->save);
+}
+
+#endif // HOST_PICO_CRITICAL_SECTION_H
@@ -0,0 +1,9 @@
+#ifndef HOST_PICO_RAND_H
+#define HOST_PICO_RAND_H
+
+#include "pico/types.h"
+
+// Not for anything secret: a fixed-seed generator, so host runs repeat.
+uint32_t get_rand_32(void);
+
+#endif // HOST_PICO_RAND_H
@@ -0,0 +1,9 @@
+#ifndef HOST_PICO_STDIO_USB_H
+#define HOST_PICO_STDIO_USB_H
+
+#include "pico/types.h"
+
+// No host ever attaches, so logging keeps its records in RAM.
+static inline bool stdio_usb_connected(void) { return false; }
+
+#endif // HOST_PICO_STDIO_USB_H
@@ -0,0 +1,12 @@
+#ifndef HOST_PICO_STDLIB_H
+#define HOST_PICO_STDLIB_H
+
+#include <stdio.h>
+
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "pico/time.h"
+#include "pico/types.h"
+
+#endif // HOST_PICO_STDLIB_H
@@ -0,0 +1,43 @@
+#ifndef HOST_PICO_TIME_H
+#define HOST_PICO_TIME_H
+
+#include "hardware/timer.h"
+#include "pico/types.h"
+
+#define at_the_end_of_time ((absolute_time_t)UINT64_MAX)
+#define nil_time ((absolute_time_t)0)
+
+static inline uint64_t to_us_since_boot(absolute_time_t t) { return t; }
+static inline absolute_time_t from_us_since_boot(uint64_t us) { return us; }
+static inline absolute_time_t get_absolute_time(void) { return time_us_64(); }
+
+static inline absolute_time_t delayed_by_us(absolute_time_t t, uint64_t us) {
+    const uint64_t when = t + us;
+    return when < t ? at_the_end_of_time : when;
+}
+
+static inline absolute_time_t delayed_by_ms(absolute_time_t t, uint32_t ms) {
+    return delayed_by_us(t, (uint64_t)ms * 1000u);
+}
+
+static inline absolute_time_t make_timeout_time_us(uint64_t us) {
+    return delayed_by_us(get_absolute_time(), us);
+}
+
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms) {
+    return delayed_by_ms(get_absolute_time(), ms);
+}
+
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {
+    return (int64_t)(to - from);
+}
+
+static inline bool time_reached(absolute_time_t t) { return time_us_64() >= t; }
+
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+// There is no event to wait for on the host; this only sleeps, at most a
+// millisecond at a time, and says whether the timeout has passed.
+bool best_effort_wfe_or_timeout(absolute_time_t timeout_timestamp);
+
+#endif // HOST_PICO_TIME_H
@@ -0,0 +1,34 @@
+#include "app_state.h"
+
+#include <stdio.h>
+
+#include "pico/critical_section.h"
+#include "pico/rand.h"
+
+#include "scheduler.h"
+
+static critical_section_t g_lock;
+static volatile uint32_t g_generation = 0;
+static uint32_t g_boot_salt = 0;
+
+void app_state_init(void) {
+    critical_section_init(&g_lock);
+    g_boot_salt = get_rand_32();
+    g_generation = 1;
+}
+
+void app_state_bump(void) {
+    // Bumped from lwIP callbacks, the main loop and core 1 during init.
+    critical_section_enter_blocking(&g_lock);
+    g_generation++;
+    critical_section_exit(&g_lock);
+    // Subscribers are pushed the new state from thread context.
+    scheduler_notify(SCHEDULER_TASK_EVENTS);
+}
+
+uint32_t app_state_generation(void) { return g_generation; }
+
+void app_state_etag(uint32_t generation, char *out, size_t out_len) {
+    snprintf(out, out_len, "\"%08lx-%lx\"", (unsigned long)g_boot_salt,
+             (unsigned long)generation);
+}
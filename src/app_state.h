@@ -0,0 +1,17 @@
+#ifndef APP_STATE_H
+#define APP_STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Anything that changes what a page or status endpoint shows bumps the state
+// generation. Caches and ETags compare generations instead of re-rendering.
+void app_state_init(void);
+void app_state_bump(void);
+uint32_t app_state_generation(void);
+
+// Quoted strong validator for the current generation. A per-boot salt keeps
+// ETags from a previous boot from matching after a restart.
+void app_state_etag(uint32_t generation, char *out, size_t out_len);
+
+#endif // APP_STATE_H
@@ -0,0 +1,48 @@
+#include "boot_profile.h"
+
+#include "hardware/timer.h"
+
+#include "logging.h"
+
+static volatile uint64_t g_phase_us[BOOT_PHASE_COUNT];
+
+static const char *const k_phase_names[BOOT_PHASE_COUNT] = {
+    [BOOT_PHASE_STDIO_READY] = "stdio_ready",
+    [BOOT_PHASE_SI5351_READY] = "si5351_ready",
+    [BOOT_PHASE_WIFI_READY] = "wifi_ready",
+    [BOOT_PHASE_AP_READY] = "ap_ready",
+    [BOOT_PHASE_NETWORK_READY] = "network_ready",
+    [BOOT_PHASE_USB_CONNECTED] = "usb_connected",
+    [BOOT_PHASE_FIRST_HTTP_RESPONSE] = "first_http_response",
+};
+
+void boot_profile_mark(boot_phase_t phase) {
+    if (phase >= BOOT_PHASE_COUNT || g_phase_us[phase] != 0) {
+        return;
+    }
+    g_phase_us[phase] = time_us_64();
+}
+
+uint64_t boot_profile_get_us(boot_phase_t phase) {
+    if (phase >= BOOT_PHASE_COUNT) {
+        return 0;
+    }
+    return g_phase_us[phase];
+}
+
+const char *boot_profile_phase_name(boot_phase_t phase) {
+    if (phase >= BOOT_PHASE_COUNT) {
+        return "unknown";
+    }
+    return k_phase_names[phase];
+}
+
+void boot_profile_log_summary(void) {
+    LOG_INFO(LOG_CAT_SYSTEM,
+             "[BOOT] stdio=%llu us si5351=%llu us wifi=%llu us ap=%llu us ready=%llu us",
+             (unsigned long long)g_phase_us[BOOT_PHASE_STDIO_READY],
+             (unsigned long long)g_phase_us[BOOT_PHASE_SI5351_READY],
+             (unsigned long long)g_phase_us[BOOT_PHASE_WIFI_READY],
+             (unsigned long long)g_phase_us[BOOT_PHASE_AP_READY],
+             (unsigned long long)g_phase_us[BOOT_PHASE_NETWORK_READY]);
+}
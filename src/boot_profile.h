@@ -0,0 +1,24 @@
+#ifndef BOOT_PROFILE_H
+#define BOOT_PROFILE_H
+
+#include <stdint.h>
+
+typedef enum {
+    BOOT_PHASE_STDIO_READY = 0,
+    BOOT_PHASE_SI5351_READY,
+    BOOT_PHASE_WIFI_READY,
+    BOOT_PHASE_AP_READY,
+    BOOT_PHASE_NETWORK_READY,
+    BOOT_PHASE_USB_CONNECTED,
+    BOOT_PHASE_FIRST_HTTP_RESPONSE,
+    BOOT_PHASE_COUNT
+} boot_phase_t;
+
+// Records the time since power-on the first time a phase is reached; later
+// calls for the same phase are ignored, so it is cheap to call on hot paths.
+void boot_profile_mark(boot_phase_t phase);
+uint64_t boot_profile_get_us(boot_phase_t phase);
+const char *boot_profile_phase_name(boot_phase_t phase);
+void boot_profile_log_summary(void);
+
+#endif // BOOT_PROFILE_H
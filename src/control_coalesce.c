@@ -0,0 +1,100 @@
+#include "control_coalesce.h"
+
+#include <string.h>
+
+#include "morse_player.h"
+#include "signal_controller.h"
+#include "webserver.h"
+
+typedef struct {
+    control_coalescer_t *owner;
+    uint8_t generation;
+    control_result_t result;
+    _Alignas(8) unsigned char request[CONTROL_COALESCE_REQUEST_MAX];
+} control_coalesce_job_t;
+
+_Static_assert(sizeof(control_coalesce_job_t) <= CONTROL_JOB_DATA_MAX,
+               "coalesced job exceeds the job payload");
+
+static control_signal_state_t g_state;
+
+void control_coalesce_apply_settings(const control_signal_request_t *request,
+                                     control_result_t *result) {
+    if (!request->tune && !request->drive) {
+        return;
+    }
+    const uint64_t frequency =
+        request->tune ? request->frequency_hz : signal_controller_get_frequency_hz();
+    const uint8_t drive = request->drive ? request->drive_ma : signal_controller_get_drive_ma();
+    if (!signal_controller_set(frequency, drive)) {
+        result->signal = CONTROL_STATUS_BUS;
+    }
+}
+
+void control_coalesce_apply_key(const control_signal_request_t *request,
+                                control_result_t *result) {
+    if (!request->key) {
+        return;
+    }
+    if (morse_is_playing() || webserver_morse_hold_active()) {
+        result->key = CONTROL_STATUS_LOCKED;
+    } else if (!signal_controller_enable_output(request->key_on)) {
+        result->key = CONTROL_STATUS_BUS;
+    }
+}
+
+void control_coalesce_apply_signal(const void *request, control_result_t *result) {
+    const control_signal_request_t *signal = (const control_signal_request_t *)request;
+    control_coalesce_apply_settings(signal, result);
+    control_coalesce_apply_key(signal, result);
+}
+
+// Main loop, lwIP lock not held.
+static void control_coalesce_run(control_job_t *job) {
+    control_coalesce_job_t *data = (control_coalesce_job_t *)job->data;
+    data->result = (control_result_t){0};
+    data->owner->apply(data->request, &data->result);
+}
+
+// With the lwIP lock held: report what was applied, then queue whatever
+// arrived in the meantime.
+static void control_coalesce_done(control_job_t *job) {
+    const control_coalesce_job_t *data = (const control_coalesce_job_t *)job->data;
+    control_coalescer_t *c = data->owner;
+    control_coalesce_task();
+    if (c->generation != data->generation) {
+        return; // the producer went away while the job ran
+    }
+    c->queued = false;
+    if (c->done) {
+        c->done(c, &data->result);
+    }
+    control_coalesce_post(c);
+}
+
+void control_coalesce_post(control_coalescer_t *c) {
+    if (c->queued || !c->recorded) {
+        return;
+    }
+    control_coalesce_job_t data = {.owner = c, .generation = c->generation};
+    memcpy(data.request, c->request, c->request_size);
+    if (!control_queue_post(control_coalesce_run, control_coalesce_done, 0, &data,
+                            sizeof(data))) {
+        return;
+    }
+    c->queued = true;
+    c->recorded = false;
+    memset(c->request, 0, c->request_size);
+    if (c->posted) {
+        c->posted(c);
+    }
+}
+
+const control_signal_state_t *control_coalesce_state(void) { return &g_state; }
+
+void control_coalesce_task(void) {
+    g_state.frequency_hz = (uint32_t)signal_controller_get_frequency_hz();
+    g_state.drive_ma = signal_controller_get_drive_ma();
+    g_state.output_enabled = signal_controller_is_output_enabled();
+    g_state.morse_playing = morse_is_playing();
+}
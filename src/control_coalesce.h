@@ -0,0 +1,87 @@
+#ifndef CONTROL_COALESCE_H
+#define CONTROL_COALESCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "control_queue.h"
+
+// Latest-wins control for the remote interfaces (control WebSocket, UDP,
+// SCPI). Commands only record the newest value of each setting; one job per
+// producer is in flight at a time, and what arrives meanwhile coalesces into
+// the next, so a burst costs one bus update per job instead of one per command.
+
+// Latest request per setting; anything older is simply overwritten.
+typedef struct {
+    bool tune;
+    bool drive;
+    bool key;
+    bool key_on;
+    uint8_t drive_ma;
+    uint64_t frequency_hz;
+} control_signal_request_t;
+
+typedef enum {
+    CONTROL_STATUS_OK = 0,
+    CONTROL_STATUS_BUS,    // Si5351 programming failed
+    CONTROL_STATUS_LOCKED, // refused: Morse playback holds the output
+    CONTROL_STATUS_FAILED, // refused for a reason of the producer's own
+} control_status_t;
+
+// The outcome of each part of a job, so every command can be answered for
+// the part it asked for and not for what else shared its bus update.
+typedef struct {
+    uint8_t signal; // frequency and drive
+    uint8_t key;    // output on/off
+    uint8_t other;  // whatever else the producer's apply does
+} control_result_t;
+
+#define CONTROL_COALESCE_REQUEST_MAX 64
+
+typedef struct control_coalescer control_coalescer_t;
+
+// All callbacks but apply run with the lwIP lock held.
+struct control_coalescer {
+    void *request;        // the producer's request, recorded since the last job
+    uint8_t request_size; // at most CONTROL_COALESCE_REQUEST_MAX
+    bool recorded;        // set by the producer when request holds something new
+    bool queued;          // at most one job at a time; the rest coalesces
+    uint8_t generation;   // bumped by the producer to disown a job in flight
+    // Main loop, lwIP lock not held: carries out a copy of the request.
+    void (*apply)(const void *request, control_result_t *result);
+    // The recorded request was handed to the queue and request cleared.
+    void (*posted)(control_coalescer_t *c);
+    // The job finished; the next one is posted after this returns.
+    void (*done)(control_coalescer_t *c, const control_result_t *result);
+    void *user;
+};
+
+// Hands the recorded request to the control queue unless a job is still in
+// flight; its completion posts again. A full queue leaves it recorded, so
+// call this again from the control task. Call with the lwIP lock held.
+void control_coalesce_post(control_coalescer_t *c);
+
+// apply for a plain control_signal_request_t: frequency and drive first,
+// then the output.
+void control_coalesce_apply_signal(const void *request, control_result_t *result);
+// The two halves, for producers that do more in between.
+void control_coalesce_apply_settings(const control_signal_request_t *request,
+                                     control_result_t *result);
+void control_coalesce_apply_key(const control_signal_request_t *request,
+                                control_result_t *result);
+
+// What replies and queries report. Refreshed from the main loop, so lwIP
+// callbacks never read the controller while it is being updated.
+typedef struct {
+    uint32_t frequency_hz;
+    uint8_t drive_ma;
+    bool output_enabled;
+    bool morse_playing;
+} control_signal_state_t;
+
+const control_signal_state_t *control_coalesce_state(void);
+// Refreshes the state; jobs do it when they finish. Call from the control
+// task with the lwIP lock held.
+void control_coalesce_task(void);
+
+#endif // CONTROL_COALESCE_H
@@ -0,0 +1,103 @@
+#include "control_queue.h"
+
+#include <string.h>
+
+#include "hardware/timer.h"
+#include "pico/critical_section.h"
+
+#include "logging.h"
+#include "scheduler.h"
+
+static critical_section_t g_lock;
+static control_job_t g_jobs[CONTROL_QUEUE_DEPTH];
+static uint8_t g_head = 0; // next to pop
+static uint8_t g_count = 0;
+static control_queue_stats_t g_stats;
+
+void control_queue_init(void) {
+    critical_section_init(&g_lock);
+    g_head = 0;
+    g_count = 0;
+    g_stats = (control_queue_stats_t){0};
+}
+
+bool control_queue_post(control_job_fn run, control_job_fn done, uint32_t owner, const void *data,
+                        size_t data_len) {
+    if (!run || data_len > CONTROL_JOB_DATA_MAX) {
+        return false;
+    }
+
+    critical_section_enter_blocking(&g_lock);
+    if (g_count == CONTROL_QUEUE_DEPTH) {
+        g_stats.rejected++;
+        critical_section_exit(&g_lock);
+        LOG_WARN(LOG_CAT_SYSTEM, "control queue full; job rejected");
+        return false;
+    }
+    control_job_t *job = &g_jobs[(g_head + g_count) % CONTROL_QUEUE_DEPTH];
+    job->run = run;
+    job->done = done;
+    job->owner = owner;
+    job->posted_us = time_us_64();
+    if (data_len) {
+        memcpy(job->data, data, data_len);
+    }
+    g_count++;
+    g_stats.posted++;
+    g_stats.depth = g_count;
+    if (g_count > g_stats.max_depth) {
+        g_stats.max_depth = g_count;
+    }
+    critical_section_exit(&g_lock);
+
+    scheduler_notify(SCHEDULER_TASK_CONTROL);
+    return true;
+}
+
+// One job per call, so Morse timing and the other tasks get a turn between
+// bus transactions; the task is woken again while work remains.
+bool control_queue_pop(control_job_t *out) {
+    critical_section_enter_blocking(&g_lock);
+    const bool found = g_count > 0;
+    if (found) {
+        *out = g_jobs[g_head];
+        g_head = (uint8_t)((g_head + 1) % CONTROL_QUEUE_DEPTH);
+        g_count--;
+        g_stats.depth = g_count;
+    }
+    const bool more = g_count > 0;
+    critical_section_exit(&g_lock);
+
+    if (more) {
+        scheduler_notify(SCHEDULER_TASK_CONTROL);
+    }
+    return found;
+}
+
+static uint32_t clamp_us(uint64_t us) { return us > UINT32_MAX ? UINT32_MAX : (uint32_t)us; }
+
+void control_queue_run(control_job_t *job) {
+    const uint64_t start = time_us_64();
+    job->run(job);
+    const uint64_t end = time_us_64();
+    const uint32_t wait_us = clamp_us(start - job->posted_us);
+    const uint32_t run_us = clamp_us(end - start);
+
+    critical_section_enter_blocking(&g_lock);
+    g_stats.completed++;
+    g_stats.total_wait_us += wait_us;
+    g_stats.total_run_us += run_us;
+    if (wait_us > g_stats.max_wait_us) {
+        g_stats.max_wait_us = wait_us;
+    }
+    if (run_us > g_stats.max_run_us) {
+        g_stats.max_run_us = run_us;
+    }
+    critical_section_exit(&g_lock);
+}
+
+void control_queue_get_stats(control_queue_stats_t *out) {
+    critical_section_enter_blocking(&g_lock);
+    *out = g_stats;
+    critical_section_exit(&g_lock);
+}
@@ -0,0 +1,52 @@
+#ifndef CONTROL_QUEUE_H
+#define CONTROL_QUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CONTROL_QUEUE_DEPTH 8
+#define CONTROL_JOB_DATA_MAX 128
+
+// Work that touches the I2C bus, posted from lwIP callbacks and carried out
+// by the control task. run executes in the main loop without the lwIP lock,
+// so TCP keeps moving while the Si5351 is programmed; done follows with the
+// lock held to answer whoever asked.
+typedef struct control_job control_job_t;
+typedef void (*control_job_fn)(control_job_t *job);
+
+struct control_job {
+    control_job_fn run;
+    control_job_fn done; // may be NULL
+    uint32_t owner;      // opaque to the queue, e.g. a connection handle
+    uint64_t posted_us;
+    _Alignas(8) unsigned char data[CONTROL_JOB_DATA_MAX];
+};
+
+typedef struct {
+    uint32_t posted;
+    uint32_t completed;
+    uint32_t rejected; // queue full
+    uint16_t depth;
+    uint16_t max_depth;
+    uint64_t total_wait_us; // posted until run starts
+    uint32_t max_wait_us;
+    uint64_t total_run_us;
+    uint32_t max_run_us;
+} control_queue_stats_t;
+
+void control_queue_init(void);
+
+// Copies data into the job and wakes the control task. Safe from IRQ context
+// and either core. Returns false, leaving nothing queued, when full.
+bool control_queue_post(control_job_fn run, control_job_fn done, uint32_t owner, const void *data,
+                        size_t data_len);
+
+// Main loop only: takes the oldest job, or returns false when none is queued.
+bool control_queue_pop(control_job_t *out);
+// Runs a popped job's run step and records how long it waited and took.
+void control_queue_run(control_job_t *job);
+
+void control_queue_get_stats(control_queue_stats_t *out);
+
+#endif // CONTROL_QUEUE_H
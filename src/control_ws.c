@@ -0,0 +1,235 @@
+#include "control_ws.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "control_coalesce.h"
+#include "logging.h"
+#include "sequence.h"
+#include "sweep.h"
+#include "webserver_utils.h"
+#include "websocket.h"
+
+#define CONTROL_FREQ_MIN_HZ 8000ull
+#define CONTROL_FREQ_MAX_HZ 200000000ull
+#define CONTROL_VALUE_DIGITS_MAX 12
+
+// Parts of a request a client asked for, so it is answered for those alone.
+#define CONTROL_PART_SIGNAL 0x01u
+#define CONTROL_PART_KEY 0x02u
+
+typedef struct {
+    bool in_use;
+    bool reply_pending;    // reply formatted but not yet accepted by TCP
+    uint8_t parts_pending; // recorded but not yet handed to the queue
+    uint8_t parts_due;     // in the job being applied
+    uint32_t seq;
+    uint32_t due_seq; // newest sequence number the queued job covers
+    websocket_t *ws;
+    char reply[48];
+} control_client_t;
+
+static void control_posted(control_coalescer_t *c);
+static void control_done(control_coalescer_t *c, const control_result_t *result);
+
+static control_client_t g_clients[WEBSOCKET_MAX_CLIENTS];
+static control_signal_request_t g_request;
+static control_coalescer_t g_coalescer = {
+    .request = &g_request,
+    .request_size = sizeof(g_request),
+    .apply = control_coalesce_apply_signal,
+    .posted = control_posted,
+    .done = control_done,
+};
+
+static bool parse_digits(const char *text, size_t len, uint64_t *out) {
+    if (len == 0 || len > CONTROL_VALUE_DIGITS_MAX) {
+        return false;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (text[i] < '0' || text[i] > '9') {
+            return false;
+        }
+        value = value * 10u + (uint64_t)(text[i] - '0');
+    }
+    *out = value;
+    return true;
+}
+
+// Rejections go out right away; only a full send buffer defers them.
+static void control_reply_error(control_client_t *client, const char *reason) {
+    char reply[sizeof(client->reply)];
+    const int len =
+        snprintf(reply, sizeof(reply), "e %lu %s", (unsigned long)client->seq, reason);
+    if (len > 0 && websocket_send_text(client->ws, reply, (size_t)len) == ERR_MEM) {
+        memcpy(client->reply, reply, sizeof(reply));
+        client->reply_pending = true;
+    }
+}
+
+static void control_on_message(websocket_t *ws, const char *data, size_t len) {
+    control_client_t *client = (control_client_t *)websocket_user(ws);
+    if (!client || len < 2) {
+        return;
+    }
+
+    const char *tag = memchr(data, '@', len);
+    const size_t value_len = (tag ? (size_t)(tag - data) : len) - 1;
+    uint64_t value = 0;
+    uint64_t seq = client->seq;
+    uint8_t part = CONTROL_PART_SIGNAL;
+    if (tag && !parse_digits(tag + 1, len - (size_t)(tag - data) - 1, &seq)) {
+        control_reply_error(client, "bad sequence");
+        return;
+    }
+    client->seq = (uint32_t)seq;
+    if (!parse_digits(data + 1, value_len, &value)) {
+        control_reply_error(client, "bad value");
+        return;
+    }
+
+    switch (data[0]) {
+    case 't':
+        if (value < CONTROL_FREQ_MIN_HZ || value > CONTROL_FREQ_MAX_HZ) {
+            control_reply_error(client, "frequency out of range");
+            return;
+        }
+        sweep_stop();
+        g_request.tune = true;
+        g_request.frequency_hz = value;
+        break;
+    case 'd':
+        if (value != 2 && value != 4 && value != 6 && value != 8) {
+            control_reply_error(client, "drive must be 2, 4, 6 or 8");
+            return;
+        }
+        g_request.drive = true;
+        g_request.drive_ma = (uint8_t)value;
+        break;
+    case 'k':
+        if (value > 1) {
+            control_reply_error(client, "bad value");
+            return;
+        }
+        g_request.key = true;
+        g_request.key_on = value == 1;
+        part = CONTROL_PART_KEY;
+        break;
+    default:
+        control_reply_error(client, "unknown command");
+        return;
+    }
+
+    sequence_stop();
+    client->parts_pending |= part;
+    g_coalescer.recorded = true;
+    control_coalesce_post(&g_coalescer);
+}
+
+static void control_flush_reply(control_client_t *client) {
+    // A full send buffer leaves the reply pending; on_writable retries it.
+    if (client->reply_pending &&
+        websocket_send_text(client->ws, client->reply, strlen(client->reply)) != ERR_MEM) {
+        client->reply_pending = false;
+    }
+}
+
+static void control_on_writable(websocket_t *ws) {
+    control_client_t *client = (control_client_t *)websocket_user(ws);
+    if (client) {
+        control_flush_reply(client);
+    }
+}
+
+static void control_on_close(websocket_t *ws) {
+    control_client_t *client = (control_client_t *)websocket_user(ws);
+    if (client) {
+        client->in_use = false;
+        client->ws = NULL;
+    }
+}
+
+static const websocket_handlers_t k_control_handlers = {
+    .on_message = control_on_message,
+    .on_writable = control_on_writable,
+    .on_close = control_on_close,
+};
+
+err_t control_ws_open(struct tcp_pcb *pcb, const char *request) {
+    control_client_t *client = NULL;
+    for (size_t i = 0; i < WEBSOCKET_MAX_CLIENTS; ++i) {
+        if (!g_clients[i].in_use) {
+            client = &g_clients[i];
+            break;
+        }
+    }
+    if (!client) {
+        return ERR_MEM;
+    }
+
+    *client = (control_client_t){.in_use = true};
+    err_t err = websocket_accept(pcb, request, &k_control_handlers, client, &client->ws);
+    if (err != ERR_OK) {
+        client->in_use = false;
+    }
+    return err;
+}
+
+// The reason the parts a client asked for failed, or NULL when they went through.
+static const char *control_failure(uint8_t parts, const control_result_t *result) {
+    if ((parts & CONTROL_PART_SIGNAL) && result->signal != CONTROL_STATUS_OK) {
+        return "failed to program Si5351";
+    }
+    if ((parts & CONTROL_PART_KEY) && result->key == CONTROL_STATUS_LOCKED) {
+        return "output locked for Morse";
+    }
+    if ((parts & CONTROL_PART_KEY) && result->key != CONTROL_STATUS_OK) {
+        return "failed to switch output";
+    }
+    return NULL;
+}
+
+static void control_posted(control_coalescer_t *c) {
+    (void)c;
+    for (size_t i = 0; i < WEBSOCKET_MAX_CLIENTS; ++i) {
+        control_client_t *client = &g_clients[i];
+        if (client->in_use && client->parts_pending) {
+            client->parts_due |= client->parts_pending;
+            client->parts_pending = 0;
+            client->due_seq = client->seq;
+        }
+    }
+}
+
+static void control_done(control_coalescer_t *c, const control_result_t *result) {
+    (void)c;
+    const control_signal_state_t *state = control_coalesce_state();
+    const char *failure = control_failure(CONTROL_PART_SIGNAL | CONTROL_PART_KEY, result);
+    if (failure) {
+        LOG_WARN(LOG_CAT_USER, "ws control: %s", failure);
+    }
+
+    for (size_t i = 0; i < WEBSOCKET_MAX_CLIENTS; ++i) {
+        control_client_t *client = &g_clients[i];
+        if (!client->in_use || !client->parts_due) {
+            continue;
+        }
+        failure = control_failure(client->parts_due, result);
+        client->parts_due = 0;
+        if (failure) {
+            snprintf(client->reply, sizeof(client->reply), "e %lu %s",
+                     (unsigned long)client->due_seq, failure);
+        } else {
+            snprintf(client->reply, sizeof(client->reply), "a %lu %lu %u %u",
+                     (unsigned long)client->due_seq, (unsigned long)state->frequency_hz,
+                     (unsigned)state->drive_ma, state->output_enabled ? 1u : 0u);
+        }
+        client->reply_pending = true;
+        control_flush_reply(client);
+    }
+}
+
+void control_ws_task(void) { control_coalesce_post(&g_coalescer); }
@@ -0,0 +1,23 @@
+#ifndef CONTROL_WS_H
+#define CONTROL_WS_H
+
+#include "lwip/tcp.h"
+
+// WebSocket control channel on /ws for continuous tuning. Each text message is
+// one command, optionally tagged with a sequence number:
+//
+//   t<hz>[@seq]   tune CLK0          d<ma>[@seq]   drive strength 2/4/6/8
+//   k<0|1>[@seq]  output on/off
+//
+// Commands only record the latest request; the control task applies them in
+// one go, so a burst of tune messages costs a single Si5351 update. Every
+// client with commands pending then gets "a <seq> <hz> <ma> <0|1>", where seq
+// is its newest sequence number covered, or "e <seq> <reason>" when a command
+// of its own failed.
+err_t control_ws_open(struct tcp_pcb *pcb, const char *request);
+
+// Hands a request the full control queue turned away to it again; call from
+// the control task with the lwIP lock held.
+void control_ws_task(void);
+
+#endif // CONTROL_WS_H
@@ -1,120 +1,581 @@
 #include "debug.h"
 
-#include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 
+#include "hardware/sync.h"
+#include "pico/critical_section.h"
 #include "pico/stdlib.h"
 
-static char debug_buffer[DEBUG_BUFFER_SIZE];
-static size_t debug_buffer_index = 0;
+#define DEBUG_LINE_MAX 320
+#define DEBUG_SPEC_MAX 24
+#define DEBUG_RECORD_TRUNCATED 0x80u
+
+typedef struct {
+    uint64_t timestamp_us;
+    volatile uint32_t seq; // sequence number + 1 once committed, 0 while being written
+    const char *format;
+    const char *color;
+    const char *tag;
+    uint8_t level;
+    uint8_t payload_len;
+    uint8_t payload[DEBUG_RECORD_PAYLOAD];
+} debug_record_t;
+
+typedef enum {
+    ARG_NONE,
+    ARG_INT,
+    ARG_LONG,
+    ARG_LLONG,
+    ARG_SIZE,
+    ARG_PTR,
+    ARG_DOUBLE,
+    ARG_STRING,
+    ARG_INVALID
+} arg_kind_t;
+
+typedef struct {
+    const char *start;
+    size_t len;
+    arg_kind_t kind;
+    uint8_t stars;
+} format_spec_t;
+
+static debug_record_t debug_ring[DEBUG_RING_RECORDS];
+static volatile uint32_t debug_head = 0;
+static critical_section_t debug_ring_lock;
+static debug_reader_t usb_reader;
 static DebugMode current_debug_mode = DEBUG_NONE;
+static void (*flush_callback)(void) = NULL;
+
+static const char *const level_labels[] = {
+    [DEBUG_LEVEL_PLAIN] = "",
+    [DEBUG_LEVEL_DEBUG] = "[DEBUG] ",
+    [DEBUG_LEVEL_INFO] = "[INFO] ",
+    [DEBUG_LEVEL_WARN] = "[WARN] ",
+    [DEBUG_LEVEL_ERROR] = "[ERROR] ",
+};
 
 void init_debug(void) {
-    debug_buffer_index = 0;
+    critical_section_init(&debug_ring_lock);
+    debug_head = 0;
+    memset(debug_ring, 0, sizeof(debug_ring));
+    debug_reader_init(&usb_reader, true);
     current_debug_mode = DEBUG_NONE;
 }
 
 void set_debug_mode(DebugMode mode) { current_debug_mode = mode; }
 
-static void append_to_buffer(const char *timestamp, const char *color, const char *message) {
-    if (debug_buffer_index >= DEBUG_BUFFER_SIZE) {
-        return;
-    }
+void set_debug_flush_callback(void (*callback)(void)) { flush_callback = callback; }
 
-    int written = snprintf(&debug_buffer[debug_buffer_index],
-                           DEBUG_BUFFER_SIZE - debug_buffer_index, "%s", timestamp);
-    if (written > 0) {
-        debug_buffer_index += (size_t)written;
-    }
+uint32_t debug_records_written(void) { return debug_head; }
 
-    if (color && *color) {
-        written = snprintf(&debug_buffer[debug_buffer_index],
-                           DEBUG_BUFFER_SIZE - debug_buffer_index, "%s", color);
-        if (written > 0) {
-            debug_buffer_index += (size_t)written;
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+// Parses one conversion starting at '%'. Returns the character after it.
+static const char *parse_spec(const char *p, format_spec_t *spec) {
+    enum { LEN_NONE, LEN_SHORT, LEN_LONG, LEN_LLONG, LEN_SIZE, LEN_LDOUBLE } length = LEN_NONE;
+
+    spec->start = p++;
+    spec->stars = 0;
+    spec->kind = ARG_INVALID;
+
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0') {
+        ++p;
+    }
+    if (*p == '*') {
+        spec->stars++;
+        ++p;
+    }
+    while (is_digit(*p)) {
+        ++p;
+    }
+    if (*p == '.') {
+        ++p;
+        if (*p == '*') {
+            spec->stars++;
+            ++p;
+        }
+        while (is_digit(*p)) {
+            ++p;
         }
     }
 
-    written = snprintf(&debug_buffer[debug_buffer_index], DEBUG_BUFFER_SIZE - debug_buffer_index,
-                       "%s", message);
-    if (written > 0) {
-        debug_buffer_index += (size_t)written;
+    switch (*p) {
+    case 'h':
+        length = LEN_SHORT;
+        p += (p[1] == 'h') ? 2 : 1;
+        break;
+    case 'l':
+        length = (p[1] == 'l') ? LEN_LLONG : LEN_LONG;
+        p += (p[1] == 'l') ? 2 : 1;
+        break;
+    case 'j':
+        length = LEN_LLONG;
+        ++p;
+        break;
+    case 'z':
+    case 't':
+        length = LEN_SIZE;
+        ++p;
+        break;
+    case 'L':
+        length = LEN_LDOUBLE;
+        ++p;
+        break;
+    default:
+        break;
     }
 
-    if (color && *color) {
-        written = snprintf(&debug_buffer[debug_buffer_index],
-                           DEBUG_BUFFER_SIZE - debug_buffer_index, "%s", COLOR_RESET);
-        if (written > 0) {
-            debug_buffer_index += (size_t)written;
-        }
+    const char conv = *p;
+    if (conv) {
+        ++p;
     }
 
-    if (debug_buffer_index >= DEBUG_BUFFER_SIZE) {
-        debug_buffer_index = DEBUG_BUFFER_SIZE - 1;
+    switch (conv) {
+    case 'd':
+    case 'i':
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'c':
+        spec->kind = length == LEN_LLONG  ? ARG_LLONG
+                     : length == LEN_LONG ? ARG_LONG
+                     : length == LEN_SIZE ? ARG_SIZE
+                                          : ARG_INT;
+        break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        spec->kind = length == LEN_LDOUBLE ? ARG_INVALID : ARG_DOUBLE;
+        break;
+    case 's':
+        spec->kind = ARG_STRING;
+        break;
+    case 'p':
+        spec->kind = ARG_PTR;
+        break;
+    case '%':
+        spec->kind = ARG_NONE;
+        break;
+    default:
+        spec->kind = ARG_INVALID;
+        break;
     }
+
+    spec->len = (size_t)(p - spec->start);
+    return p;
 }
 
-static void format_timestamp(char *out, size_t out_len) {
-    const uint64_t timestamp_us = time_us_64();
-    if (timestamp_us < 10000) {
-        snprintf(out, out_len, "\033[1m[%llu us]\033[0m ", (unsigned long long)timestamp_us);
-    } else {
-        snprintf(out, out_len, "\033[1m[%llu ms]\033[0m ",
-                 (unsigned long long)(timestamp_us / 1000));
+static bool payload_put(debug_record_t *rec, const void *value, size_t size) {
+    if (rec->payload_len + size > DEBUG_RECORD_PAYLOAD) {
+        return false;
     }
+    memcpy(&rec->payload[rec->payload_len], value, size);
+    rec->payload_len += (uint8_t)size;
+    return true;
 }
 
-void debug_log(const char *format, ...) {
-    va_list args;
-    va_start(args, format);
+static bool payload_put_string(debug_record_t *rec, const char *str) {
+    const size_t room = DEBUG_RECORD_PAYLOAD - rec->payload_len;
+    if (room < 1) {
+        return false;
+    }
+    if (!str) {
+        str = "(null)";
+    }
+    size_t len = strnlen(str, room - 1);
+    memcpy(&rec->payload[rec->payload_len], str, len);
+    rec->payload[rec->payload_len + len] = '\0';
+    rec->payload_len += (uint8_t)(len + 1);
+    return true;
+}
 
-    char message[256];
-    vsnprintf(message, sizeof(message), format, args);
+// Copies the raw arguments named by the format into the record; strings are
+// copied by value because callers often pass stack buffers.
+static void capture_args(debug_record_t *rec, const char *format, va_list args) {
+    const char *p = format;
+    while (*p) {
+        if (*p != '%') {
+            ++p;
+            continue;
+        }
+        format_spec_t spec;
+        p = parse_spec(p, &spec);
 
-    char timestamp[32];
-    format_timestamp(timestamp, sizeof timestamp);
+        bool ok = true;
+        for (uint8_t i = 0; i < spec.stars && ok; ++i) {
+            int star = va_arg(args, int);
+            ok = payload_put(rec, &star, sizeof(star));
+        }
 
-    if (current_debug_mode == DEBUG_REALTIME || current_debug_mode == DEBUG_BOTH) {
-        printf("%s", timestamp);
-        printf("%s", message);
+        switch (spec.kind) {
+        case ARG_INT: {
+            int v = va_arg(args, int);
+            ok = ok && payload_put(rec, &v, sizeof(v));
+            break;
+        }
+        case ARG_LONG: {
+            long v = va_arg(args, long);
+            ok = ok && payload_put(rec, &v, sizeof(v));
+            break;
+        }
+        case ARG_LLONG: {
+            long long v = va_arg(args, long long);
+            ok = ok && payload_put(rec, &v, sizeof(v));
+            break;
+        }
+        case ARG_SIZE: {
+            size_t v = va_arg(args, size_t);
+            ok = ok && payload_put(rec, &v, sizeof(v));
+            break;
+        }
+        case ARG_PTR: {
+            void *v = va_arg(args, void *);
+            ok = ok && payload_put(rec, &v, sizeof(v));
+            break;
+        }
+        case ARG_DOUBLE: {
+            double v = va_arg(args, double);
+            ok = ok && payload_put(rec, &v, sizeof(v));
+            break;
+        }
+        case ARG_STRING: {
+            const char *v = va_arg(args, const char *);
+            ok = ok && payload_put_string(rec, v);
+            break;
+        }
+        case ARG_NONE:
+            break;
+        case ARG_INVALID:
+        default:
+            ok = false;
+            break;
+        }
+
+        if (!ok) {
+            rec->level |= DEBUG_RECORD_TRUNCATED;
+            return;
+        }
     }
+}
+
+void debug_vlog(DebugLevel level, const char *tag, const char *color_code, const char *format,
+                va_list args) {
+    const DebugMode mode = current_debug_mode;
+    if (mode == DEBUG_NONE || !format) {
+        return;
+    }
+
+    // The RP2040's Cortex-M0+ has no exclusive load/store, so the sequence number
+    // is claimed under the hardware spin lock; the record itself is written
+    // without holding anything and published by storing its sequence last.
+    critical_section_enter_blocking(&debug_ring_lock);
+    const uint32_t seq = debug_head;
+    debug_head = seq + 1;
+    critical_section_exit(&debug_ring_lock);
+
+    debug_record_t *rec = &debug_ring[seq & (DEBUG_RING_RECORDS - 1)];
+    rec->seq = 0;
+    __dmb();
+
+    rec->timestamp_us = time_us_64();
+    rec->format = format;
+    rec->color = color_code;
+    rec->tag = tag;
+    rec->level = (uint8_t)level;
+    rec->payload_len = 0;
 
-    if (current_debug_mode == DEBUG_BUFFERED || current_debug_mode == DEBUG_BOTH) {
-        append_to_buffer(timestamp, NULL, message);
+    va_list copy;
+    va_copy(copy, args);
+    capture_args(rec, format, copy);
+    va_end(copy);
+
+    __dmb();
+    rec->seq = seq + 1;
+
+    // Buffered records still have readers (HTTP log streams), so wake the drain
+    // in every mode rather than only when printing in realtime.
+    if (mode != DEBUG_NONE && flush_callback) {
+        flush_callback();
     }
+}
 
+void debug_log(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    debug_vlog(DEBUG_LEVEL_PLAIN, NULL, NULL, format, args);
     va_end(args);
 }
 
 void debug_log_with_color(const char *color_code, const char *format, ...) {
     va_list args;
     va_start(args, format);
+    debug_vlog(DEBUG_LEVEL_PLAIN, NULL, color_code, format, args);
+    va_end(args);
+}
 
-    char message[256];
-    vsnprintf(message, sizeof(message), format, args);
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t len;
+} line_writer_t;
 
-    char timestamp[32];
-    format_timestamp(timestamp, sizeof timestamp);
+static void line_advance(line_writer_t *w, int written) {
+    if (written <= 0) {
+        return;
+    }
+    w->len += (size_t)written;
+    if (w->len >= w->cap) {
+        w->len = w->cap - 1;
+    }
+}
 
-    if (current_debug_mode == DEBUG_REALTIME || current_debug_mode == DEBUG_BOTH) {
-        printf("%s", timestamp);
-        printf("%s", color_code ? color_code : "");
-        printf("%s", message);
-        if (color_code && *color_code) {
-            printf("%s", COLOR_RESET);
+static void line_append(line_writer_t *w, const char *text, size_t len) {
+    const size_t room = w->cap - 1 - w->len;
+    if (len > room) {
+        len = room;
+    }
+    memcpy(w->buf + w->len, text, len);
+    w->len += len;
+    w->buf[w->len] = '\0';
+}
+
+static bool payload_get(const debug_record_t *rec, size_t *offset, void *out, size_t size) {
+    if (*offset + size > rec->payload_len) {
+        return false;
+    }
+    memcpy(out, &rec->payload[*offset], size);
+    *offset += size;
+    return true;
+}
+
+#define FORMAT_ARG(value)                                                                          \
+    (spec.stars == 0   ? snprintf(dst, room, spec_buf, value)                                      \
+     : spec.stars == 1 ? snprintf(dst, room, spec_buf, stars[0], value)                            \
+                       : snprintf(dst, room, spec_buf, stars[0], stars[1], value))
+
+static void format_message(const debug_record_t *rec, line_writer_t *w) {
+    const char *p = rec->format;
+    size_t offset = 0;
+
+    while (*p) {
+        const char *literal = p;
+        while (*p && *p != '%') {
+            ++p;
+        }
+        line_append(w, literal, (size_t)(p - literal));
+        if (!*p) {
+            break;
+        }
+
+        format_spec_t spec;
+        p = parse_spec(p, &spec);
+        if (spec.kind == ARG_NONE) {
+            line_append(w, "%", 1);
+            continue;
+        }
+
+        int stars[2] = {0, 0};
+        bool ok = spec.kind != ARG_INVALID && spec.len < DEBUG_SPEC_MAX;
+        for (uint8_t i = 0; i < spec.stars && ok; ++i) {
+            ok = payload_get(rec, &offset, &stars[i], sizeof(int));
+        }
+        if (!ok) {
+            line_append(w, "...", 3);
+            return;
+        }
+
+        char spec_buf[DEBUG_SPEC_MAX];
+        memcpy(spec_buf, spec.start, spec.len);
+        spec_buf[spec.len] = '\0';
+
+        char *dst = w->buf + w->len;
+        const size_t room = w->cap - w->len;
+        int written = -1;
+        switch (spec.kind) {
+        case ARG_INT: {
+            int v;
+            if (payload_get(rec, &offset, &v, sizeof(v))) {
+                written = FORMAT_ARG(v);
+            }
+            break;
+        }
+        case ARG_LONG: {
+            long v;
+            if (payload_get(rec, &offset, &v, sizeof(v))) {
+                written = FORMAT_ARG(v);
+            }
+            break;
+        }
+        case ARG_LLONG: {
+            long long v;
+            if (payload_get(rec, &offset, &v, sizeof(v))) {
+                written = FORMAT_ARG(v);
+            }
+            break;
+        }
+        case ARG_SIZE: {
+            size_t v;
+            if (payload_get(rec, &offset, &v, sizeof(v))) {
+                written = FORMAT_ARG(v);
+            }
+            break;
+        }
+        case ARG_PTR: {
+            void *v;
+            if (payload_get(rec, &offset, &v, sizeof(v))) {
+                written = FORMAT_ARG(v);
+            }
+            break;
+        }
+        case ARG_DOUBLE: {
+            double v;
+            if (payload_get(rec, &offset, &v, sizeof(v))) {
+                written = FORMAT_ARG(v);
+            }
+            break;
+        }
+        case ARG_STRING: {
+            if (offset < rec->payload_len) {
+                const char *v = (const char *)&rec->payload[offset];
+                offset += strnlen(v, rec->payload_len - offset) + 1;
+                written = FORMAT_ARG(v);
+            }
+            break;
         }
+        default:
+            break;
+        }
+
+        if (written < 0) {
+            line_append(w, "...", 3);
+            return;
+        }
+        line_advance(w, written);
     }
 
-    if (current_debug_mode == DEBUG_BUFFERED || current_debug_mode == DEBUG_BOTH) {
-        append_to_buffer(timestamp, color_code, message);
+    if (rec->level & DEBUG_RECORD_TRUNCATED) {
+        line_append(w, "...", 3);
     }
+}
 
-    va_end(args);
+static size_t format_record(const debug_record_t *rec, char *out, size_t out_len,
+                            bool with_color) {
+    line_writer_t w = {.buf = out, .cap = out_len, .len = 0};
+    out[0] = '\0';
+
+    const uint64_t ts = rec->timestamp_us;
+    const bool use_us = ts < 10000;
+    const unsigned long long shown = use_us ? ts : ts / 1000;
+    line_advance(&w, snprintf(out, out_len,
+                              with_color ? "\033[1m[%llu %s]\033[0m " : "[%llu %s] ", shown,
+                              use_us ? "us" : "ms"));
+
+    const uint8_t level = rec->level & (uint8_t)~DEBUG_RECORD_TRUNCATED;
+    const char *color = (with_color && rec->color && *rec->color) ? rec->color : NULL;
+    if (color) {
+        line_append(&w, color, strlen(color));
+    }
+    if (level < sizeof(level_labels) / sizeof(level_labels[0])) {
+        line_append(&w, level_labels[level], strlen(level_labels[level]));
+    }
+    if (rec->tag) {
+        line_append(&w, rec->tag, strlen(rec->tag));
+    }
+
+    format_message(rec, &w);
+    while (w.len > 0 && (w.buf[w.len - 1] == '\n' || w.buf[w.len - 1] == '\r')) {
+        w.buf[--w.len] = '\0';
+    }
+
+    // Keep room for the colour reset and newline even when the message was cut.
+    const size_t tail = color ? strlen(COLOR_RESET) + 1 : 1;
+    if (w.len + tail >= w.cap) {
+        w.len = w.cap > tail + 1 ? w.cap - tail - 1 : 0;
+    }
+    if (color) {
+        line_append(&w, COLOR_RESET, strlen(COLOR_RESET));
+    }
+    line_append(&w, "\n", 1);
+    return w.len;
+}
+
+void debug_reader_init(debug_reader_t *reader, bool include_backlog) {
+    if (!reader) {
+        return;
+    }
+    const uint32_t head = debug_head;
+    reader->lost = 0;
+    if (!include_backlog) {
+        reader->next_seq = head;
+    } else {
+        reader->next_seq = head > DEBUG_RING_RECORDS ? head - DEBUG_RING_RECORDS : 0;
+    }
+}
+
+size_t debug_reader_next(debug_reader_t *reader, char *out, size_t out_len, bool with_color) {
+    if (!reader || !out || out_len == 0) {
+        return 0;
+    }
+
+    while (true) {
+        const uint32_t head = debug_head;
+        if (reader->next_seq == head) {
+            return 0;
+        }
+        if (head - reader->next_seq > DEBUG_RING_RECORDS) {
+            reader->lost += head - reader->next_seq - DEBUG_RING_RECORDS;
+            reader->next_seq = head - DEBUG_RING_RECORDS;
+        }
+
+        const debug_record_t *slot = &debug_ring[reader->next_seq & (DEBUG_RING_RECORDS - 1)];
+        const uint32_t expected = reader->next_seq + 1;
+        const uint32_t before = slot->seq;
+        __dmb();
+
+        if (before != expected) {
+            if ((int32_t)(before - expected) > 0) {
+                // Already overwritten by a newer record.
+                reader->lost++;
+                reader->next_seq++;
+                continue;
+            }
+            if (debug_head - reader->next_seq > DEBUG_RING_RECORDS) {
+                continue;
+            }
+            // Claimed but not yet published; pick it up on the next drain.
+            return 0;
+        }
+
+        debug_record_t copy;
+        memcpy(&copy, (const void *)slot, sizeof(copy));
+        __dmb();
+        if (slot->seq != before) {
+            reader->lost++;
+            reader->next_seq++;
+            continue;
+        }
+
+        reader->next_seq++;
+        return format_record(&copy, out, out_len, with_color);
+    }
 }
 
 void transmit_debug_logs(void) {
-    if (current_debug_mode == DEBUG_BUFFERED || current_debug_mode == DEBUG_BOTH) {
-        printf("%s", debug_buffer);
-        debug_buffer_index = 0;
+    char line[DEBUG_LINE_MAX];
+    size_t len;
+    while ((len = debug_reader_next(&usb_reader, line, sizeof(line), true)) > 0) {
+        if (usb_reader.lost) {
+            printf("[%lu log records lost]\n", (unsigned long)usb_reader.lost);
+            usb_reader.lost = 0;
+        }
+        printf("%.*s", (int)len, line);
     }
 }
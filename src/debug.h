@@ -1,17 +1,47 @@
 #ifndef DEBUG_H
 #define DEBUG_H
 
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
-#define DEBUG_BUFFER_SIZE 4096
+// Log calls store a compact binary record (timestamp, level, format pointer and
+// raw arguments) in a RAM ring; formatting happens only when a reader drains it.
+// Format strings must therefore be string literals.
+#define DEBUG_RING_RECORDS 128 // must be a power of two
+#define DEBUG_RECORD_PAYLOAD 38
 
 typedef enum { DEBUG_NONE, DEBUG_REALTIME, DEBUG_BUFFERED, DEBUG_BOTH } DebugMode;
 
+typedef enum {
+    DEBUG_LEVEL_PLAIN = 0,
+    DEBUG_LEVEL_DEBUG,
+    DEBUG_LEVEL_INFO,
+    DEBUG_LEVEL_WARN,
+    DEBUG_LEVEL_ERROR
+} DebugLevel;
+
+typedef struct {
+    uint32_t next_seq;
+    uint32_t lost;
+} debug_reader_t;
+
 void init_debug(void);
 void set_debug_mode(DebugMode mode);
 void debug_log(const char *format, ...);
 void debug_log_with_color(const char *color_code, const char *format, ...);
+// tag, when set, must be a string literal and is printed after the level label.
+void debug_vlog(DebugLevel level, const char *tag, const char *color_code, const char *format,
+                va_list args);
 void transmit_debug_logs(void);
+void set_debug_flush_callback(void (*callback)(void));
+
+// Each reader keeps its own cursor. Records a reader falls too far behind on are
+// overwritten by producers and reported through reader->lost instead.
+void debug_reader_init(debug_reader_t *reader, bool include_backlog);
+size_t debug_reader_next(debug_reader_t *reader, char *out, size_t out_len, bool with_color);
+uint32_t debug_records_written(void);
 
 #define COLOR_RESET "\033[0m"
 #define COLOR_RED "\033[31m"
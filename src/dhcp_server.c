@@ -0,0 +1,523 @@
+#include "dhcp_server.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "hardware/timer.h"
+#include "lwip/def.h"
+#include "lwip/ip.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+
+#include "logging.h"
+
+#define DHCP_SERVER_PORT 67
+#define DHCP_CLIENT_PORT 68
+
+// BOOTP header offsets (RFC 2131, section 2).
+#define DHCP_OP 0
+#define DHCP_HTYPE 1
+#define DHCP_HLEN 2
+#define DHCP_XID 4
+#define DHCP_FLAGS 10
+#define DHCP_CIADDR 12
+#define DHCP_YIADDR 16
+#define DHCP_SIADDR 20
+#define DHCP_GIADDR 24
+#define DHCP_CHADDR 28
+#define DHCP_COOKIE 236
+#define DHCP_OPTIONS 240
+#define DHCP_REPLY_LEN 300 // BOOTP minimum; our options fit well inside
+
+#define DHCP_BOOTREQUEST 1
+#define DHCP_BOOTREPLY 2
+#define DHCP_HTYPE_ETH 1
+#define DHCP_MAGIC 0x63825363u
+
+#define DHCP_OPT_PAD 0
+#define DHCP_OPT_SUBNET_MASK 1
+#define DHCP_OPT_ROUTER 3
+#define DHCP_OPT_DNS 6
+#define DHCP_OPT_REQUESTED_IP 50
+#define DHCP_OPT_LEASE_TIME 51
+#define DHCP_OPT_MSG_TYPE 53
+#define DHCP_OPT_SERVER_ID 54
+#define DHCP_OPT_T1 58
+#define DHCP_OPT_T2 59
+#define DHCP_OPT_END 255
+
+typedef enum {
+    DHCP_DISCOVER = 1,
+    DHCP_OFFER = 2,
+    DHCP_REQUEST = 3,
+    DHCP_DECLINE = 4,
+    DHCP_ACK = 5,
+    DHCP_NAK = 6,
+    DHCP_RELEASE = 7,
+} dhcp_msg_type_t;
+
+typedef enum {
+    LEASE_FREE = 0,
+    LEASE_OFFERED,
+    LEASE_BOUND,
+    LEASE_DECLINED,
+} lease_state_t;
+
+typedef struct {
+    uint8_t mac[6];
+    uint8_t state;  // lease_state_t
+    bool has_owner; // mac is valid and the lease is in the MAC index
+    uint32_t expires_s;
+} dhcp_lease_t;
+
+typedef struct {
+    uint8_t type;
+    bool has_requested_ip;
+    bool has_server_id;
+    uint32_t requested_ip; // network order, like every address here
+    uint32_t server_id;
+} dhcp_options_t;
+
+// MAC to lease, open addressing with linear probing. Entries hold the lease
+// number plus one; released slots become tombstones so probe chains survive.
+#define DHCP_INDEX_SIZE 64 // power of two above the pool size
+#define DHCP_INDEX_EMPTY 0u
+#define DHCP_INDEX_TOMBSTONE 0xffu
+
+_Static_assert(DHCP_SERVER_POOL_SIZE < DHCP_INDEX_SIZE, "MAC index must exceed the pool");
+_Static_assert(DHCP_SERVER_POOL_FIRST + DHCP_SERVER_POOL_SIZE <= 255, "pool must fit a /24");
+
+static struct udp_pcb *g_pcb = NULL;
+static uint32_t g_server_ip;
+static uint32_t g_netmask;
+static dhcp_lease_t g_leases[DHCP_SERVER_POOL_SIZE];
+static uint8_t g_index[DHCP_INDEX_SIZE];
+static dhcp_server_stats_t g_stats;
+
+static uint32_t dhcp_now_s(void) { return (uint32_t)(time_us_64() / 1000000u); }
+
+static uint32_t dhcp_mac_hash(const uint8_t *mac) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < 6; ++i) {
+        hash = (hash ^ mac[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static size_t dhcp_lease_number(const dhcp_lease_t *lease) { return (size_t)(lease - g_leases); }
+
+static uint32_t dhcp_lease_ip(const dhcp_lease_t *lease) {
+    const uint32_t host = DHCP_SERVER_POOL_FIRST + (uint32_t)dhcp_lease_number(lease);
+    return (g_server_ip & PP_HTONL(0xffffff00u)) | lwip_htonl(host);
+}
+
+static dhcp_lease_t *dhcp_lease_for_ip(uint32_t ip) {
+    if ((ip & PP_HTONL(0xffffff00u)) != (g_server_ip & PP_HTONL(0xffffff00u))) {
+        return NULL;
+    }
+    const uint32_t host = lwip_ntohl(ip) & 0xffu;
+    if (host < DHCP_SERVER_POOL_FIRST || host >= DHCP_SERVER_POOL_FIRST + DHCP_SERVER_POOL_SIZE) {
+        return NULL;
+    }
+    return &g_leases[host - DHCP_SERVER_POOL_FIRST];
+}
+
+static dhcp_lease_t *dhcp_index_find(const uint8_t *mac) {
+    const uint32_t home = dhcp_mac_hash(mac);
+    for (uint32_t i = 0; i < DHCP_INDEX_SIZE; ++i) {
+        const uint8_t entry = g_index[(home + i) & (DHCP_INDEX_SIZE - 1)];
+        if (entry == DHCP_INDEX_EMPTY) {
+            return NULL;
+        }
+        if (entry != DHCP_INDEX_TOMBSTONE && memcmp(g_leases[entry - 1].mac, mac, 6) == 0) {
+            return &g_leases[entry - 1];
+        }
+    }
+    return NULL;
+}
+
+static void dhcp_index_remove(dhcp_lease_t *lease) {
+    const uint8_t wanted = (uint8_t)(dhcp_lease_number(lease) + 1);
+    const uint32_t home = dhcp_mac_hash(lease->mac);
+    for (uint32_t i = 0; i < DHCP_INDEX_SIZE; ++i) {
+        uint8_t *entry = &g_index[(home + i) & (DHCP_INDEX_SIZE - 1)];
+        if (*entry == DHCP_INDEX_EMPTY) {
+            break;
+        }
+        if (*entry == wanted) {
+            *entry = DHCP_INDEX_TOMBSTONE;
+            break;
+        }
+    }
+    lease->has_owner = false;
+}
+
+// The index always has room: it is larger than the pool and every lease
+// holds at most one entry.
+static void dhcp_lease_assign(dhcp_lease_t *lease, const uint8_t *mac) {
+    if (lease->has_owner) {
+        dhcp_index_remove(lease);
+    }
+    memcpy(lease->mac, mac, 6);
+    lease->has_owner = true;
+    const uint32_t home = dhcp_mac_hash(mac);
+    for (uint32_t i = 0; i < DHCP_INDEX_SIZE; ++i) {
+        uint8_t *entry = &g_index[(home + i) & (DHCP_INDEX_SIZE - 1)];
+        if (*entry == DHCP_INDEX_EMPTY || *entry == DHCP_INDEX_TOMBSTONE) {
+            *entry = (uint8_t)(dhcp_lease_number(lease) + 1);
+            return;
+        }
+    }
+}
+
+static bool dhcp_lease_available(const dhcp_lease_t *lease, uint32_t now) {
+    return lease->state == LEASE_FREE || (int32_t)(now - lease->expires_s) >= 0;
+}
+
+// A lease nobody else can claim: this MAC's own, or one free for the taking.
+static bool dhcp_lease_usable(const dhcp_lease_t *lease, const uint8_t *mac, uint32_t now) {
+    if (lease->has_owner && memcmp(lease->mac, mac, 6) == 0) {
+        return lease->state != LEASE_DECLINED || dhcp_lease_available(lease, now);
+    }
+    return dhcp_lease_available(lease, now);
+}
+
+// A new client gets the address it asks for if that is free, otherwise the
+// first free one from its MAC's home slot on. Addresses remembered for an
+// absent client are only taken when nothing else is left.
+static dhcp_lease_t *dhcp_lease_allocate(const uint8_t *mac, const dhcp_options_t *options,
+                                         uint32_t now) {
+    if (options->has_requested_ip) {
+        dhcp_lease_t *requested = dhcp_lease_for_ip(options->requested_ip);
+        if (requested && dhcp_lease_usable(requested, mac, now)) {
+            return requested;
+        }
+    }
+    const uint32_t home = dhcp_mac_hash(mac) % DHCP_SERVER_POOL_SIZE;
+    dhcp_lease_t *remembered = NULL;
+    for (uint32_t i = 0; i < DHCP_SERVER_POOL_SIZE; ++i) {
+        dhcp_lease_t *lease = &g_leases[(home + i) % DHCP_SERVER_POOL_SIZE];
+        if (!dhcp_lease_available(lease, now)) {
+            continue;
+        }
+        if (!lease->has_owner) {
+            return lease;
+        }
+        if (!remembered) {
+            remembered = lease;
+        }
+    }
+    return remembered;
+}
+
+static bool dhcp_parse_options(const uint8_t *msg, size_t len, dhcp_options_t *out) {
+    *out = (dhcp_options_t){0};
+    size_t pos = DHCP_OPTIONS;
+    while (pos < len) {
+        const uint8_t code = msg[pos++];
+        if (code == DHCP_OPT_PAD) {
+            continue;
+        }
+        if (code == DHCP_OPT_END) {
+            break;
+        }
+        if (pos >= len || pos + 1 + msg[pos] > len) {
+            return false;
+        }
+        const uint8_t opt_len = msg[pos++];
+        const uint8_t *value = msg + pos;
+        pos += opt_len;
+        switch (code) {
+        case DHCP_OPT_MSG_TYPE:
+            if (opt_len == 1) {
+                out->type = value[0];
+            }
+            break;
+        case DHCP_OPT_REQUESTED_IP:
+            if (opt_len == 4) {
+                memcpy(&out->requested_ip, value, 4);
+                out->has_requested_ip = true;
+            }
+            break;
+        case DHCP_OPT_SERVER_ID:
+            if (opt_len == 4) {
+                memcpy(&out->server_id, value, 4);
+                out->has_server_id = true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return out->type != 0;
+}
+
+static uint8_t *dhcp_put_option(uint8_t *cursor, uint8_t code, const void *value, uint8_t len) {
+    *cursor++ = code;
+    *cursor++ = len;
+    memcpy(cursor, value, len);
+    return cursor + len;
+}
+
+static uint8_t *dhcp_put_u32(uint8_t *cursor, uint8_t code, uint32_t host_order) {
+    const uint32_t value = lwip_htonl(host_order);
+    return dhcp_put_option(cursor, code, &value, 4);
+}
+
+// Builds the reply straight into the outgoing pbuf and sends it. yiaddr is 0
+// for a NAK, which also carries no lease parameters.
+static void dhcp_reply(const uint8_t *request, dhcp_msg_type_t type, uint32_t yiaddr) {
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, DHCP_REPLY_LEN, PBUF_RAM);
+    if (!p) {
+        LOG_WARN(LOG_CAT_DHCP, "no memory for a reply");
+        return;
+    }
+    uint8_t *msg = (uint8_t *)p->payload;
+    memset(msg, 0, DHCP_REPLY_LEN);
+    msg[DHCP_OP] = DHCP_BOOTREPLY;
+    msg[DHCP_HTYPE] = DHCP_HTYPE_ETH;
+    msg[DHCP_HLEN] = 6;
+    memcpy(msg + DHCP_XID, request + DHCP_XID, 4);
+    memcpy(msg + DHCP_FLAGS, request + DHCP_FLAGS, 2);
+    if (type != DHCP_NAK) {
+        memcpy(msg + DHCP_CIADDR, request + DHCP_CIADDR, 4);
+        memcpy(msg + DHCP_YIADDR, &yiaddr, 4);
+        memcpy(msg + DHCP_SIADDR, &g_server_ip, 4);
+    }
+    memcpy(msg + DHCP_GIADDR, request + DHCP_GIADDR, 4);
+    memcpy(msg + DHCP_CHADDR, request + DHCP_CHADDR, 16);
+    const uint32_t magic = PP_HTONL(DHCP_MAGIC);
+    memcpy(msg + DHCP_COOKIE, &magic, 4);
+
+    uint8_t *cursor = msg + DHCP_OPTIONS;
+    const uint8_t msg_type = (uint8_t)type;
+    cursor = dhcp_put_option(cursor, DHCP_OPT_MSG_TYPE, &msg_type, 1);
+    cursor = dhcp_put_option(cursor, DHCP_OPT_SERVER_ID, &g_server_ip, 4);
+    if (type != DHCP_NAK) {
+        cursor = dhcp_put_u32(cursor, DHCP_OPT_LEASE_TIME, DHCP_SERVER_LEASE_S);
+        cursor = dhcp_put_u32(cursor, DHCP_OPT_T1, DHCP_SERVER_LEASE_S / 2);
+        cursor = dhcp_put_u32(cursor, DHCP_OPT_T2, DHCP_SERVER_LEASE_S / 8 * 7);
+        cursor = dhcp_put_option(cursor, DHCP_OPT_SUBNET_MASK, &g_netmask, 4);
+        cursor = dhcp_put_option(cursor, DHCP_OPT_ROUTER, &g_server_ip, 4);
+        cursor = dhcp_put_option(cursor, DHCP_OPT_DNS, &g_server_ip, 4);
+    }
+    *cursor = DHCP_OPT_END;
+
+    // A client with an address can take a unicast; one without cannot be
+    // reached before it has one, so it gets a broadcast, as does every NAK.
+    uint32_t ciaddr;
+    memcpy(&ciaddr, request + DHCP_CIADDR, 4);
+    ip_addr_t dst;
+    if (type != DHCP_NAK && ciaddr != 0) {
+        ip4_addr_set_u32(ip_2_ip4(&dst), ciaddr);
+    } else {
+        ip_addr_copy(dst, *IP_ADDR_BROADCAST);
+    }
+    const err_t err = udp_sendto(g_pcb, p, &dst, DHCP_CLIENT_PORT);
+    if (err != ERR_OK) {
+        LOG_WARN(LOG_CAT_DHCP, "reply failed: %d", err);
+    }
+    pbuf_free(p);
+}
+
+static void dhcp_log_lease(const char *what, const dhcp_lease_t *lease) {
+    const uint32_t host = lwip_ntohl(dhcp_lease_ip(lease));
+    LOG_INFO(LOG_CAT_DHCP, "%s .%lu, client %02x:%02x:%02x:%02x:%02x:%02x", what,
+             (unsigned long)(host & 0xffu), lease->mac[0], lease->mac[1], lease->mac[2],
+             lease->mac[3], lease->mac[4], lease->mac[5]);
+}
+
+static void dhcp_handle_discover(const uint8_t *msg, const uint8_t *mac,
+                                 const dhcp_options_t *options, uint32_t now) {
+    g_stats.discovers++;
+    dhcp_lease_t *lease = dhcp_index_find(mac);
+    if (!lease || !dhcp_lease_usable(lease, mac, now)) {
+        lease = dhcp_lease_allocate(mac, options, now);
+    }
+    if (!lease) {
+        g_stats.exhausted++;
+        LOG_WARN(LOG_CAT_DHCP, "pool exhausted; DISCOVER ignored");
+        return;
+    }
+    if (!lease->has_owner || memcmp(lease->mac, mac, 6) != 0) {
+        dhcp_lease_assign(lease, mac);
+    }
+    if (lease->state != LEASE_BOUND || dhcp_lease_available(lease, now)) {
+        lease->state = LEASE_OFFERED;
+        lease->expires_s = now + DHCP_SERVER_OFFER_HOLD_S;
+    }
+    g_stats.offers++;
+    dhcp_reply(msg, DHCP_OFFER, dhcp_lease_ip(lease));
+}
+
+static void dhcp_handle_request(const uint8_t *msg, const uint8_t *mac,
+                                const dhcp_options_t *options, uint32_t now) {
+    g_stats.requests++;
+    if (options->has_server_id && options->server_id != g_server_ip) {
+        // The client took another server's offer; ours is free again.
+        dhcp_lease_t *offered = dhcp_index_find(mac);
+        if (offered && offered->state == LEASE_OFFERED) {
+            offered->state = LEASE_FREE;
+        }
+        return;
+    }
+
+    // Selecting and rebooting clients name the address in option 50;
+    // renewing and rebinding ones are already using it as ciaddr.
+    uint32_t wanted;
+    if (options->has_requested_ip) {
+        wanted = options->requested_ip;
+    } else {
+        memcpy(&wanted, msg + DHCP_CIADDR, 4);
+    }
+
+    dhcp_lease_t *lease = dhcp_lease_for_ip(wanted);
+    dhcp_lease_t *own = dhcp_index_find(mac);
+    bool grant = lease && (lease == own ? lease->state != LEASE_DECLINED
+                                        : dhcp_lease_usable(lease, mac, now));
+    if (!grant) {
+        const uint32_t host = lwip_ntohl(wanted);
+        g_stats.naks++;
+        LOG_INFO(LOG_CAT_DHCP, "NAK for %lu.%lu.%lu.%lu", (unsigned long)(host >> 24),
+                 (unsigned long)((host >> 16) & 0xffu), (unsigned long)((host >> 8) & 0xffu),
+                 (unsigned long)(host & 0xffu));
+        dhcp_reply(msg, DHCP_NAK, 0);
+        return;
+    }
+    if (own && own != lease) {
+        // One address per client: coming back on another free address gives
+        // up the old one.
+        own->state = LEASE_FREE;
+        dhcp_index_remove(own);
+    }
+
+    if (!lease->has_owner || memcmp(lease->mac, mac, 6) != 0) {
+        dhcp_lease_assign(lease, mac);
+    }
+    const bool renewal = lease->state == LEASE_BOUND;
+    lease->state = LEASE_BOUND;
+    lease->expires_s = now + DHCP_SERVER_LEASE_S;
+    g_stats.acks++;
+    if (!renewal) {
+        dhcp_log_lease("lease", lease);
+    }
+    dhcp_reply(msg, DHCP_ACK, dhcp_lease_ip(lease));
+}
+
+// The client found the address in use; it is held back for a while and the
+// client will DISCOVER again.
+static void dhcp_handle_decline(const uint8_t *mac, const dhcp_options_t *options, uint32_t now) {
+    g_stats.declines++;
+    dhcp_lease_t *lease = options->has_requested_ip ? dhcp_lease_for_ip(options->requested_ip)
+                                                    : NULL;
+    if (!lease || !lease->has_owner || memcmp(lease->mac, mac, 6) != 0) {
+        return;
+    }
+    dhcp_log_lease("declined", lease);
+    dhcp_index_remove(lease);
+    lease->state = LEASE_DECLINED;
+    lease->expires_s = now + DHCP_SERVER_DECLINE_HOLD_S;
+}
+
+// The MAC stays attached, so the client gets the same address back if it
+// returns before someone else needs it.
+static void dhcp_handle_release(const uint8_t *msg, const uint8_t *mac) {
+    g_stats.releases++;
+    uint32_t ciaddr;
+    memcpy(&ciaddr, msg + DHCP_CIADDR, 4);
+    dhcp_lease_t *lease = dhcp_lease_for_ip(ciaddr);
+    if (lease && lease->has_owner && memcmp(lease->mac, mac, 6) == 0 &&
+        lease->state == LEASE_BOUND) {
+        dhcp_log_lease("released", lease);
+        lease->state = LEASE_FREE;
+    }
+}
+
+static void dhcp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr,
+                      u16_t port) {
+    (void)arg;
+    (void)pcb;
+    (void)addr;
+    (void)port;
+    if (!p) {
+        return;
+    }
+    // A DHCP message always fits one pool buffer, so it is parsed in place.
+    const uint8_t *msg = (const uint8_t *)p->payload;
+    const size_t len = p->len;
+    uint32_t magic = 0;
+    if (len > DHCP_OPTIONS) {
+        memcpy(&magic, msg + DHCP_COOKIE, 4);
+    }
+    dhcp_options_t options;
+    if (p->len != p->tot_len || len <= DHCP_OPTIONS || msg[DHCP_OP] != DHCP_BOOTREQUEST ||
+        msg[DHCP_HTYPE] != DHCP_HTYPE_ETH || msg[DHCP_HLEN] != 6 ||
+        magic != PP_HTONL(DHCP_MAGIC) || !dhcp_parse_options(msg, len, &options)) {
+        g_stats.malformed++;
+        pbuf_free(p);
+        return;
+    }
+
+    const uint8_t *mac = msg + DHCP_CHADDR;
+    const uint32_t now = dhcp_now_s();
+    switch (options.type) {
+    case DHCP_DISCOVER:
+        dhcp_handle_discover(msg, mac, &options, now);
+        break;
+    case DHCP_REQUEST:
+        dhcp_handle_request(msg, mac, &options, now);
+        break;
+    case DHCP_DECLINE:
+        dhcp_handle_decline(mac, &options, now);
+        break;
+    case DHCP_RELEASE:
+        dhcp_handle_release(msg, mac);
+        break;
+    default:
+        break;
+    }
+    pbuf_free(p);
+}
+
+bool dhcp_server_start(const ip4_addr_t *server, const ip4_addr_t *netmask) {
+    if (!server || !netmask) {
+        return false;
+    }
+    g_server_ip = ip4_addr_get_u32(server);
+    g_netmask = ip4_addr_get_u32(netmask);
+    memset(g_leases, 0, sizeof(g_leases));
+    memset(g_index, 0, sizeof(g_index));
+    g_stats = (dhcp_server_stats_t){0};
+
+    g_pcb = udp_new_ip_type(IPADDR_TYPE_V4);
+    if (!g_pcb) {
+        LOG_ERROR(LOG_CAT_DHCP, "Failed to allocate UDP PCB");
+        return false;
+    }
+    if (udp_bind(g_pcb, IP_ADDR_ANY, DHCP_SERVER_PORT) != ERR_OK) {
+        LOG_ERROR(LOG_CAT_DHCP, "bind failed on port %u", (unsigned)DHCP_SERVER_PORT);
+        udp_remove(g_pcb);
+        g_pcb = NULL;
+        return false;
+    }
+    ip_set_option(g_pcb, SOF_BROADCAST);
+    udp_recv(g_pcb, dhcp_recv, NULL);
+    LOG_INFO(LOG_CAT_DHCP, "server listening on port %u, %u leases from .%u",
+             (unsigned)DHCP_SERVER_PORT, (unsigned)DHCP_SERVER_POOL_SIZE,
+             (unsigned)DHCP_SERVER_POOL_FIRST);
+    return true;
+}
+
+void dhcp_server_get_stats(dhcp_server_stats_t *out) {
+    if (!out) {
+        return;
+    }
+    *out = g_stats;
+    out->bound = 0;
+    const uint32_t now = dhcp_now_s();
+    for (size_t i = 0; i < DHCP_SERVER_POOL_SIZE; ++i) {
+        if (g_leases[i].state == LEASE_BOUND && !dhcp_lease_available(&g_leases[i], now)) {
+            out->bound++;
+        }
+    }
+}
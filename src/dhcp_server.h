@@ -0,0 +1,35 @@
+#ifndef DHCP_SERVER_H
+#define DHCP_SERVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lwip/ip4_addr.h"
+
+// Leases hand out host numbers .100 to .150 of the server's /24.
+#define DHCP_SERVER_POOL_FIRST 100
+#define DHCP_SERVER_POOL_SIZE 51
+#define DHCP_SERVER_LEASE_S 86400
+#define DHCP_SERVER_OFFER_HOLD_S 30    // an offered address is kept this long
+#define DHCP_SERVER_DECLINE_HOLD_S 600 // a declined address is in use by someone else
+
+typedef struct {
+    uint32_t discovers;
+    uint32_t offers;
+    uint32_t requests;
+    uint32_t acks;
+    uint32_t naks;
+    uint32_t releases;
+    uint32_t declines;
+    uint32_t exhausted; // DISCOVER left unanswered, no address free
+    uint32_t malformed;
+    uint16_t bound; // leases currently held
+} dhcp_server_stats_t;
+
+// Serves leases on UDP port 67 for clients of the access point. Each client
+// keeps its address across renewals, and a MAC is steered to the same address
+// every time it is free, so benches come back where they were after a reboot.
+bool dhcp_server_start(const ip4_addr_t *server, const ip4_addr_t *netmask);
+void dhcp_server_get_stats(dhcp_server_stats_t *out);
+
+#endif // DHCP_SERVER_H
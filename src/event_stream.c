@@ -0,0 +1,80 @@
+#include "event_stream.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "app_state.h"
+#include "webserver_utils.h"
+
+#define EVENT_STREAM_PREFIX "event: state\ndata: "
+#define EVENT_STREAM_RETRY "retry: 2000\n"
+
+typedef struct {
+    bool in_use;
+    bool greeted;
+    uint32_t generation; // last one sent; 0 is never a live generation
+    event_stream_format_fn format;
+} event_stream_client_t;
+
+static event_stream_client_t g_clients[EVENT_STREAM_MAX_CLIENTS];
+
+static size_t event_stream_fill(void *ctx, char *out, size_t out_len) {
+    event_stream_client_t *client = (event_stream_client_t *)ctx;
+    // Read the generation before the state it describes, as for the page ETag.
+    const uint32_t generation = app_state_generation();
+    if (generation == client->generation) {
+        return 0;
+    }
+
+    size_t used = 0;
+    if (!client->greeted) {
+        memcpy(out, EVENT_STREAM_RETRY, sizeof(EVENT_STREAM_RETRY) - 1);
+        used = sizeof(EVENT_STREAM_RETRY) - 1;
+    }
+    memcpy(out + used, EVENT_STREAM_PREFIX, sizeof(EVENT_STREAM_PREFIX) - 1);
+    used += sizeof(EVENT_STREAM_PREFIX) - 1;
+
+    const size_t json_len = client->format(out + used, out_len - used - 2);
+    if (json_len == 0) {
+        return 0;
+    }
+    used += json_len;
+    memcpy(out + used, "\n\n", 2);
+    client->generation = generation;
+    client->greeted = true;
+    return used + 2;
+}
+
+static void event_stream_close(void *ctx) {
+    event_stream_client_t *client = (event_stream_client_t *)ctx;
+    client->in_use = false;
+}
+
+err_t event_stream_open(struct tcp_pcb *pcb, event_stream_format_fn format) {
+    if (!format) {
+        return ERR_VAL;
+    }
+    event_stream_client_t *client = NULL;
+    for (size_t i = 0; i < EVENT_STREAM_MAX_CLIENTS; ++i) {
+        if (!g_clients[i].in_use) {
+            client = &g_clients[i];
+            break;
+        }
+    }
+    if (!client) {
+        return ERR_MEM;
+    }
+
+    *client = (event_stream_client_t){
+        .in_use = true,
+        .format = format,
+    };
+    // The first pump sends the current state straight away.
+    err_t err = webserver_stream_open(pcb, "text/event-stream", event_stream_fill,
+                                      event_stream_close, client);
+    if (err != ERR_OK) {
+        client->in_use = false;
+    }
+    return err;
+}
@@ -0,0 +1,19 @@
+#ifndef EVENT_STREAM_H
+#define EVENT_STREAM_H
+
+#include <stddef.h>
+
+#include "lwip/tcp.h"
+
+#define EVENT_STREAM_MAX_CLIENTS 3
+
+// Writes the current state as one line of JSON; returns its length, or 0 if
+// it did not fit.
+typedef size_t (*event_stream_format_fn)(char *out, size_t out_len);
+
+// Serves "event: state" messages as text/event-stream. A message goes out only
+// when the app_state generation moved since the client's last one, so bursts
+// of changes coalesce and an idle stream costs nothing.
+err_t event_stream_open(struct tcp_pcb *pcb, event_stream_format_fn format);
+
+#endif // EVENT_STREAM_H
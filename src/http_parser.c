@@ -0,0 +1,281 @@
+#include "http_parser.h"
+
+#include <string.h>
+
+#define HTTP_PARSER_TARGET_MAX 512
+
+enum {
+    HP_METHOD = 0,
+    HP_TARGET,
+    HP_VERSION,
+    HP_LINE_LF,
+    HP_HEADER_START,
+    HP_HEADER_NAME,
+    HP_VALUE_SPACE,
+    HP_VALUE,
+    HP_HEADER_LF,
+    HP_HEAD_END_LF,
+    HP_BODY,
+    HP_DONE,
+    HP_ERROR,
+};
+
+void http_parser_init(http_parser_t *parser, uint16_t max_head, uint32_t max_message) {
+    memset(parser, 0, sizeof(*parser));
+    parser->max_head = max_head;
+    parser->max_message = max_message;
+}
+
+void http_parser_reset(http_parser_t *parser) {
+    http_parser_init(parser, parser->max_head, parser->max_message);
+}
+
+static bool is_token_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           (c != '\0' && strchr("!#$%&'*+-.^_`|~", c) != NULL);
+}
+
+static char lower(char c) { return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c; }
+
+static bool fail(http_parser_t *parser, http_parse_error_t error) {
+    parser->state = HP_ERROR;
+    parser->error = (uint8_t)error;
+    return false;
+}
+
+static bool value_has_token(const http_parser_t *parser, const char *token) {
+    const size_t token_len = strlen(token);
+    for (size_t i = 0; i + token_len <= parser->value_len; ++i) {
+        bool match = true;
+        for (size_t j = 0; j < token_len && match; ++j) {
+            match = lower(parser->value[i + j]) == token[j];
+        }
+        if (match) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Acts on a completed header line; only a handful of headers matter here.
+static bool finish_header(http_parser_t *parser) {
+    if (parser->name_overflow) {
+        return true;
+    }
+    const char *name = parser->name;
+    if (parser->name_len == 14 && memcmp(name, "content-length", 14) == 0) {
+        uint32_t length = 0;
+        if (parser->value_len == 0 || parser->value_len > 9) {
+            return fail(parser, parser->value_len > 9 ? HTTP_PARSE_ERR_BODY_TOO_LARGE
+                                                      : HTTP_PARSE_ERR_BAD_REQUEST);
+        }
+        for (uint8_t i = 0; i < parser->value_len; ++i) {
+            const char c = parser->value[i];
+            if (c < '0' || c > '9') {
+                return fail(parser, HTTP_PARSE_ERR_BAD_REQUEST);
+            }
+            length = length * 10u + (uint32_t)(c - '0');
+        }
+        // Conflicting lengths would let two parties frame the stream differently.
+        if (parser->has_length && parser->content_length != length) {
+            return fail(parser, HTTP_PARSE_ERR_BAD_REQUEST);
+        }
+        parser->has_length = true;
+        parser->content_length = length;
+    } else if (parser->name_len == 10 && memcmp(name, "connection", 10) == 0) {
+        parser->conn_close |= value_has_token(parser, "close");
+        parser->conn_keep_alive |= value_has_token(parser, "keep-alive");
+    } else if (parser->name_len == 17 && memcmp(name, "transfer-encoding", 17) == 0) {
+        parser->chunked = true;
+    }
+    return true;
+}
+
+static bool finish_request_line(http_parser_t *parser) {
+    if (parser->version_len != 8 || memcmp(parser->version, "HTTP/1.", 7) != 0) {
+        return fail(parser, HTTP_PARSE_ERR_VERSION);
+    }
+    if (parser->version[7] != '0' && parser->version[7] != '1') {
+        return fail(parser, HTTP_PARSE_ERR_VERSION);
+    }
+    parser->http11 = parser->version[7] == '1';
+    return true;
+}
+
+static bool finish_head(http_parser_t *parser) {
+    if (parser->chunked) {
+        return fail(parser, HTTP_PARSE_ERR_LENGTH_REQUIRED);
+    }
+    if (parser->head_len > parser->max_message ||
+        parser->content_length > parser->max_message - parser->head_len) {
+        return fail(parser, HTTP_PARSE_ERR_BODY_TOO_LARGE);
+    }
+    parser->body_remaining = parser->content_length;
+    parser->state = parser->body_remaining ? HP_BODY : HP_DONE;
+    return true;
+}
+
+// One byte of the request line or headers.
+static bool step(http_parser_t *parser, char c) {
+    switch (parser->state) {
+    case HP_METHOD:
+        if (c == ' ' && parser->method_len > 0) {
+            parser->state = HP_TARGET;
+        } else if (is_token_char(c) && parser->method_len < sizeof(parser->method) - 1) {
+            parser->method[parser->method_len++] = c;
+        } else {
+            return fail(parser, HTTP_PARSE_ERR_BAD_REQUEST);
+        }
+        return true;
+    case HP_TARGET:
+        if (c == ' ' && parser->target_len > 0) {
+            parser->state = HP_VERSION;
+        } else if ((unsigned char)c <= ' ' || c == 0x7F) {
+            return fail(parser, HTTP_PARSE_ERR_BAD_REQUEST);
+        } else if (++parser->target_len > HTTP_PARSER_TARGET_MAX) {
+            return fail(parser, HTTP_PARSE_ERR_URI_TOO_LONG);
+        }
+        return true;
+    case HP_VERSION:
+        if (c == '\r' || c == '\n') {
+            parser->state = (c == '\r') ? HP_LINE_LF : HP_HEADER_START;
+            return finish_request_line(parser);
+        }
+        if (parser->version_len >= sizeof(parser->version)) {
+            return fail(parser, HTTP_PARSE_ERR_VERSION);
+        }
+        parser->version[parser->version_len++] = c;
+        return true;
+    case HP_LINE_LF:
+    case HP_HEADER_LF:
+        if (c != '\n') {
+            return fail(parser, HTTP_PARSE_ERR_BAD_REQUEST);
+        }
+        parser->state = HP_HEADER_START;
+        return true;
+    case HP_HEADER_START:
+        if (c == '\r') {
+            parser->state = HP_HEAD_END_LF;
+            return true;
+        }
+        if (c == '\n') {
+            return finish_head(parser);
+        }
+        // Obsolete line folding and empty names are both rejected.
+        if (!is_token_char(c)) {
+            return fail(parser, HTTP_PARSE_ERR_BAD_REQUEST);
+        }
+        parser->name_len = 0;
+        parser->value_len = 0;
+        parser->name_overflow = false;
+        parser->state = HP_HEADER_NAME;
+        // fall through
+    case HP_HEADER_NAME:
+        if (c == ':') {
+            parser->state = HP_VALUE_SPACE;
+        } else if (!is_token_char(c)) {
+            return fail(parser, HTTP_PARSE_ERR_BAD_REQUEST);
+        } else if (parser->name_len < sizeof(parser->name)) {
+            parser->name[parser->name_len++] = lower(c);
+        } else {
+            parser->name_overflow = true;
+        }
+        return true;
+    case HP_VALUE_SPACE:
+        if (c == ' ' || c == '\t') {
+            return true;
+        }
+        parser->state = HP_VALUE;
+        // fall through
+    case HP_VALUE:
+        if (c == '\r' || c == '\n') {
+            while (parser->value_len > 0 && (parser->value[parser->value_len - 1] == ' ' ||
+                                             parser->value[parser->value_len - 1] == '\t')) {
+                parser->value_len--;
+            }
+            parser->state = (c == '\r') ? HP_HEADER_LF : HP_HEADER_START;
+            return finish_header(parser);
+        }
+        if (parser->value_len < sizeof(parser->value)) {
+            parser->value[parser->value_len++] = c;
+        } else if (!parser->name_overflow && parser->name_len == 14 &&
+                   memcmp(parser->name, "content-length", 14) == 0) {
+            return fail(parser, HTTP_PARSE_ERR_BAD_REQUEST);
+        }
+        return true;
+    case HP_HEAD_END_LF:
+        if (c != '\n') {
+            return fail(parser, HTTP_PARSE_ERR_BAD_REQUEST);
+        }
+        return finish_head(parser);
+    default:
+        return fail(parser, HTTP_PARSE_ERR_BAD_REQUEST);
+    }
+}
+
+size_t http_parser_feed(http_parser_t *parser, const char *data, size_t len,
+                        http_parse_status_t *status) {
+    size_t used = 0;
+    while (used < len && parser->state < HP_BODY) {
+        if (parser->head_len >= parser->max_head) {
+            fail(parser, parser->state <= HP_TARGET ? HTTP_PARSE_ERR_URI_TOO_LONG
+                                                    : HTTP_PARSE_ERR_HEADERS_TOO_LARGE);
+            break;
+        }
+        parser->head_len++;
+        if (!step(parser, data[used++])) {
+            break;
+        }
+    }
+
+    // The body is only counted, never inspected.
+    if (parser->state == HP_BODY) {
+        const size_t take = (len - used) < parser->body_remaining ? (len - used)
+                                                                  : parser->body_remaining;
+        used += take;
+        parser->body_remaining -= (uint32_t)take;
+        if (parser->body_remaining == 0) {
+            parser->state = HP_DONE;
+        }
+    }
+
+    *status = parser->state == HP_DONE    ? HTTP_PARSE_DONE
+              : parser->state == HP_ERROR ? HTTP_PARSE_ERROR
+                                          : HTTP_PARSE_INCOMPLETE;
+    return used;
+}
+
+bool http_parser_in_body(const http_parser_t *parser) { return parser->state == HP_BODY; }
+
+bool http_parser_keep_alive(const http_parser_t *parser) {
+    if (parser->conn_close) {
+        return false;
+    }
+    return parser->http11 || parser->conn_keep_alive;
+}
+
+size_t http_parser_message_len(const http_parser_t *parser) {
+    return (size_t)parser->head_len + parser->content_length;
+}
+
+int http_parser_error_status(const http_parser_t *parser, const char **reason) {
+    static const struct {
+        int status;
+        const char *reason;
+    } k_errors[] = {
+        [HTTP_PARSE_ERR_NONE] = {200, "OK"},
+        [HTTP_PARSE_ERR_BAD_REQUEST] = {400, "Bad Request"},
+        [HTTP_PARSE_ERR_URI_TOO_LONG] = {414, "URI Too Long"},
+        [HTTP_PARSE_ERR_HEADERS_TOO_LARGE] = {431, "Request Header Fields Too Large"},
+        [HTTP_PARSE_ERR_BODY_TOO_LARGE] = {413, "Payload Too Large"},
+        [HTTP_PARSE_ERR_LENGTH_REQUIRED] = {411, "Length Required"},
+        [HTTP_PARSE_ERR_VERSION] = {505, "HTTP Version Not Supported"},
+    };
+    const uint8_t error = parser->error < sizeof(k_errors) / sizeof(k_errors[0])
+                              ? parser->error
+                              : HTTP_PARSE_ERR_BAD_REQUEST;
+    if (reason) {
+        *reason = k_errors[error].reason;
+    }
+    return k_errors[error].status;
+}
@@ -0,0 +1,78 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Resumable HTTP/1.x request framer. Bytes are fed in whatever pieces the
+// network delivers (typically pbuf payloads, in place); nothing is buffered or
+// rescanned. It finds where each request ends, including its Content-Length
+// body, and collects the few facts the server acts on before the request is
+// handed to a route. Plain C without lwIP, so it also builds on the host.
+
+typedef enum {
+    HTTP_PARSE_INCOMPLETE = 0, // everything fed was consumed; feed more
+    HTTP_PARSE_DONE,           // one full request ends at the returned offset
+    HTTP_PARSE_ERROR,          // see http_parser_error_status(); the connection must close
+} http_parse_status_t;
+
+typedef enum {
+    HTTP_PARSE_ERR_NONE = 0,
+    HTTP_PARSE_ERR_BAD_REQUEST,
+    HTTP_PARSE_ERR_URI_TOO_LONG,
+    HTTP_PARSE_ERR_HEADERS_TOO_LARGE,
+    HTTP_PARSE_ERR_BODY_TOO_LARGE,
+    HTTP_PARSE_ERR_LENGTH_REQUIRED,
+    HTTP_PARSE_ERR_VERSION,
+} http_parse_error_t;
+
+#define HTTP_PARSER_METHOD_MAX 8
+#define HTTP_PARSER_NAME_MAX 24
+#define HTTP_PARSER_VALUE_MAX 48
+
+typedef struct {
+    uint8_t state;
+    uint8_t error;
+    bool http11;
+    bool has_length;
+    bool conn_close;
+    bool conn_keep_alive;
+    bool chunked;
+    uint8_t method_len;
+    uint8_t version_len;
+    uint8_t name_len;   // bytes kept of the current header name (lower case)
+    uint8_t value_len;  // bytes kept of the current header value
+    bool name_overflow; // name longer than any header we look at
+    uint16_t target_len;
+    uint16_t head_len; // request line and headers, including the blank line
+    uint16_t max_head;
+    uint32_t max_message; // head plus body
+    uint32_t content_length;
+    uint32_t body_remaining;
+    char method[HTTP_PARSER_METHOD_MAX];
+    char version[8];
+    char name[HTTP_PARSER_NAME_MAX];
+    char value[HTTP_PARSER_VALUE_MAX];
+} http_parser_t;
+
+void http_parser_init(http_parser_t *parser, uint16_t max_head, uint32_t max_message);
+// Ready for the next request on the same connection.
+void http_parser_reset(http_parser_t *parser);
+
+// Consumes up to len bytes and returns how many were used. On DONE the
+// remainder belongs to the next (pipelined) request.
+size_t http_parser_feed(http_parser_t *parser, const char *data, size_t len,
+                        http_parse_status_t *status);
+
+// True once the head is complete and body bytes are still expected.
+bool http_parser_in_body(const http_parser_t *parser);
+
+// Valid once a request is DONE.
+bool http_parser_keep_alive(const http_parser_t *parser);
+size_t http_parser_message_len(const http_parser_t *parser);
+
+// Response status for a parse error, with its reason phrase.
+int http_parser_error_status(const http_parser_t *parser, const char **reason);
+
+#endif // HTTP_PARSER_H
@@ -0,0 +1,515 @@
+#include "json.h"
+
+#include <string.h>
+
+static void json_put(json_writer_t *w, const char *data, size_t len) {
+    if (w->overflow) {
+        return;
+    }
+    // One byte always stays free for the terminator.
+    if (len >= w->cap - w->len) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(w->out + w->len, data, len);
+    w->len += len;
+}
+
+// Separator before a value: a comma between members, nothing after a key.
+static void json_begin_value(json_writer_t *w) {
+    if (w->after_key) {
+        w->after_key = false;
+        return;
+    }
+    if (w->depth == 0) {
+        return;
+    }
+    const uint8_t bit = (uint8_t)(1u << (w->depth - 1));
+    if (w->has_members & bit) {
+        json_put(w, ",", 1);
+    }
+    w->has_members |= bit;
+}
+
+// Escaped form of one byte; returns its length.
+static size_t json_escape(char c, char escaped[6]) {
+    static const char k_hex[] = "0123456789abcdef";
+    switch (c) {
+    case '"':
+    case '\\':
+        escaped[0] = '\\';
+        escaped[1] = c;
+        return 2;
+    case '\n':
+        memcpy(escaped, "\\n", 2);
+        return 2;
+    case '\r':
+        memcpy(escaped, "\\r", 2);
+        return 2;
+    case '\t':
+        memcpy(escaped, "\\t", 2);
+        return 2;
+    default:
+        break;
+    }
+    if ((unsigned char)c < 0x20) {
+        memcpy(escaped, "\\u00", 4);
+        escaped[4] = k_hex[(unsigned char)c >> 4];
+        escaped[5] = k_hex[(unsigned char)c & 0x0f];
+        return 6;
+    }
+    escaped[0] = c;
+    return 1;
+}
+
+void json_writer_init(json_writer_t *w, char *out, size_t cap) {
+    *w = (json_writer_t){
+        .out = out,
+        .cap = cap,
+        .overflow = cap == 0,
+    };
+}
+
+void json_writer_begin_object(json_writer_t *w) {
+    json_begin_value(w);
+    if (w->depth >= JSON_WRITER_MAX_DEPTH) {
+        w->overflow = true;
+        return;
+    }
+    json_put(w, "{", 1);
+    w->depth++;
+    w->has_members &= (uint8_t)~(1u << (w->depth - 1));
+}
+
+void json_writer_end_object(json_writer_t *w) {
+    if (w->depth == 0) {
+        w->overflow = true;
+        return;
+    }
+    w->depth--;
+    json_put(w, "}", 1);
+}
+
+void json_writer_begin_array(json_writer_t *w) {
+    json_writer_begin_object(w);
+    if (!w->overflow) {
+        w->out[w->len - 1] = '[';
+    }
+}
+
+void json_writer_end_array(json_writer_t *w) {
+    if (w->depth == 0) {
+        w->overflow = true;
+        return;
+    }
+    w->depth--;
+    json_put(w, "]", 1);
+}
+
+void json_writer_key(json_writer_t *w, const char *key) {
+    json_writer_string(w, key);
+    json_put(w, ":", 1);
+    w->after_key = true;
+}
+
+void json_writer_string(json_writer_t *w, const char *value) {
+    json_begin_value(w);
+    json_put(w, "\"", 1);
+    for (const char *c = value ? value : ""; *c && !w->overflow; ++c) {
+        char escaped[6];
+        json_put(w, escaped, json_escape(*c, escaped));
+    }
+    json_put(w, "\"", 1);
+}
+
+void json_writer_string_clipped(json_writer_t *w, const char *value, size_t reserve) {
+    json_begin_value(w);
+    json_put(w, "\"", 1);
+    for (const char *c = value ? value : ""; *c && !w->overflow; ++c) {
+        char escaped[6];
+        const size_t n = json_escape(*c, escaped);
+        // Room for this byte, the closing quote, the reserve and the terminator.
+        if (w->len + n + 1 + reserve >= w->cap) {
+            break;
+        }
+        json_put(w, escaped, n);
+    }
+    json_put(w, "\"", 1);
+}
+
+void json_writer_uint(json_writer_t *w, uint64_t value) {
+    char digits[20];
+    size_t n = 0;
+    do {
+        digits[sizeof(digits) - ++n] = (char)('0' + value % 10u);
+        value /= 10u;
+    } while (value);
+    json_begin_value(w);
+    json_put(w, digits + sizeof(digits) - n, n);
+}
+
+void json_writer_int(json_writer_t *w, int64_t value) {
+    if (value >= 0) {
+        json_writer_uint(w, (uint64_t)value);
+        return;
+    }
+    json_begin_value(w);
+    json_put(w, "-", 1);
+    // Negate in unsigned arithmetic so INT64_MIN survives; no separator follows.
+    w->after_key = true;
+    json_writer_uint(w, 0u - (uint64_t)value);
+}
+
+void json_writer_bool(json_writer_t *w, bool value) {
+    json_begin_value(w);
+    json_put(w, value ? "true" : "false", value ? 4 : 5);
+}
+
+void json_writer_null(json_writer_t *w) {
+    json_begin_value(w);
+    json_put(w, "null", 4);
+}
+
+size_t json_writer_finish(json_writer_t *w) {
+    if (w->overflow || w->depth != 0) {
+        if (w->cap) {
+            w->out[0] = '\0';
+        }
+        return 0;
+    }
+    w->out[w->len] = '\0';
+    return w->len;
+}
+
+static void json_skip_space(json_reader_t *r) {
+    while (r->pos < r->end &&
+           (*r->pos == ' ' || *r->pos == '\t' || *r->pos == '\r' || *r->pos == '\n')) {
+        r->pos++;
+    }
+}
+
+static bool json_is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static bool json_read_string(json_reader_t *r, json_value_t *out) {
+    const char *start = ++r->pos;
+    while (r->pos < r->end && *r->pos != '"') {
+        if ((unsigned char)*r->pos < 0x20) {
+            return false;
+        }
+        if (*r->pos == '\\') {
+            r->pos++;
+            if (r->pos >= r->end) {
+                return false;
+            }
+        }
+        r->pos++;
+    }
+    if (r->pos >= r->end) {
+        return false;
+    }
+    *out = (json_value_t){JSON_VALUE_STRING, start, (size_t)(r->pos - start)};
+    r->pos++;
+    return true;
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+static bool json_read_number(json_reader_t *r, json_value_t *out) {
+    const char *p = r->pos;
+    if (p < r->end && *p == '-') {
+        p++;
+    }
+    if (p >= r->end || !json_is_digit(*p)) {
+        return false;
+    }
+    if (*p == '0') {
+        p++;
+    } else {
+        while (p < r->end && json_is_digit(*p)) {
+            p++;
+        }
+    }
+    if (p < r->end && *p == '.') {
+        if (++p >= r->end || !json_is_digit(*p)) {
+            return false;
+        }
+        while (p < r->end && json_is_digit(*p)) {
+            p++;
+        }
+    }
+    if (p < r->end && (*p == 'e' || *p == 'E')) {
+        if (++p < r->end && (*p == '+' || *p == '-')) {
+            p++;
+        }
+        if (p >= r->end || !json_is_digit(*p)) {
+            return false;
+        }
+        while (p < r->end && json_is_digit(*p)) {
+            p++;
+        }
+    }
+    *out = (json_value_t){JSON_VALUE_NUMBER, r->pos, (size_t)(p - r->pos)};
+    r->pos = p;
+    return true;
+}
+
+static bool json_read_literal(json_reader_t *r, const char *word, json_value_type_t type,
+                              json_value_t *out) {
+    const size_t n = strlen(word);
+    if ((size_t)(r->end - r->pos) < n || memcmp(r->pos, word, n) != 0) {
+        return false;
+    }
+    *out = (json_value_t){type, r->pos, n};
+    r->pos += n;
+    return true;
+}
+
+static bool json_read_value(json_reader_t *r, json_value_t *out) {
+    if (r->pos >= r->end) {
+        return false;
+    }
+    switch (*r->pos) {
+    case '"':
+        return json_read_string(r, out);
+    case 't':
+        return json_read_literal(r, "true", JSON_VALUE_TRUE, out);
+    case 'f':
+        return json_read_literal(r, "false", JSON_VALUE_FALSE, out);
+    case 'n':
+        return json_read_literal(r, "null", JSON_VALUE_NULL, out);
+    default:
+        return json_read_number(r, out);
+    }
+}
+
+void json_reader_init(json_reader_t *r, const char *text, size_t len) {
+    *r = (json_reader_t){
+        .pos = text,
+        .end = text + len,
+        .error = text == NULL,
+    };
+}
+
+static bool json_reader_fail(json_reader_t *r) {
+    r->error = true;
+    return false;
+}
+
+bool json_reader_next(json_reader_t *r, json_value_t *key, json_value_t *value) {
+    if (r->error || r->done) {
+        return false;
+    }
+    json_skip_space(r);
+    if (!r->started) {
+        if (r->pos >= r->end || *r->pos != '{') {
+            return json_reader_fail(r);
+        }
+        r->pos++;
+        r->started = true;
+        json_skip_space(r);
+        if (r->pos < r->end && *r->pos == '}') {
+            r->pos++;
+            r->done = true;
+            return false;
+        }
+    } else if (r->pos < r->end && *r->pos == ',') {
+        r->pos++;
+        json_skip_space(r);
+    } else if (r->pos < r->end && *r->pos == '}') {
+        r->pos++;
+        r->done = true;
+        return false;
+    } else {
+        return json_reader_fail(r);
+    }
+
+    if (r->pos >= r->end || *r->pos != '"' || !json_read_string(r, key)) {
+        return json_reader_fail(r);
+    }
+    json_skip_space(r);
+    if (r->pos >= r->end || *r->pos != ':') {
+        return json_reader_fail(r);
+    }
+    r->pos++;
+    json_skip_space(r);
+    if (!json_read_value(r, value)) {
+        return json_reader_fail(r);
+    }
+    return true;
+}
+
+bool json_reader_next_object(json_reader_t *r, json_reader_t *element) {
+    if (r->error || r->done) {
+        return false;
+    }
+    json_skip_space(r);
+    if (r->in_element) {
+        r->in_element = false;
+        if (element->error || !element->done) {
+            return json_reader_fail(r);
+        }
+        r->pos = element->pos;
+        json_skip_space(r);
+        if (r->pos < r->end && *r->pos == ']') {
+            r->pos++;
+            r->done = true;
+            return false;
+        }
+        if (r->pos >= r->end || *r->pos != ',') {
+            return json_reader_fail(r);
+        }
+        r->pos++;
+        json_skip_space(r);
+    } else {
+        if (r->started || r->pos >= r->end || *r->pos != '[') {
+            return json_reader_fail(r);
+        }
+        r->pos++;
+        r->started = true;
+        json_skip_space(r);
+        if (r->pos < r->end && *r->pos == ']') {
+            r->pos++;
+            r->done = true;
+            return false;
+        }
+    }
+    if (r->pos >= r->end || *r->pos != '{') {
+        return json_reader_fail(r);
+    }
+    json_reader_init(element, r->pos, (size_t)(r->end - r->pos));
+    r->in_element = true;
+    return true;
+}
+
+bool json_reader_ok(const json_reader_t *r) {
+    if (r->error || !r->done) {
+        return false;
+    }
+    json_reader_t tail = *r;
+    json_skip_space(&tail);
+    return tail.pos == tail.end;
+}
+
+bool json_value_equals(const json_value_t *v, const char *literal) {
+    const size_t n = strlen(literal);
+    return v->type == JSON_VALUE_STRING && v->len == n && memcmp(v->start, literal, n) == 0;
+}
+
+bool json_value_uint(const json_value_t *v, uint64_t *out) {
+    if (v->type != JSON_VALUE_NUMBER || v->len == 0 || v->len > 20) {
+        return false;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < v->len; ++i) {
+        const char c = v->start[i];
+        if (!json_is_digit(c)) {
+            return false; // sign, fraction or exponent
+        }
+        const uint64_t digit = (uint64_t)(c - '0');
+        if (value > (UINT64_MAX - digit) / 10u) {
+            return false;
+        }
+        value = value * 10u + digit;
+    }
+    *out = value;
+    return true;
+}
+
+bool json_value_bool(const json_value_t *v, bool *out) {
+    if (v->type != JSON_VALUE_TRUE && v->type != JSON_VALUE_FALSE) {
+        return false;
+    }
+    *out = v->type == JSON_VALUE_TRUE;
+    return true;
+}
+
+static int json_hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return 10 + (c - 'a');
+    }
+    if (c >= 'A' && c <= 'F') {
+        return 10 + (c - 'A');
+    }
+    return -1;
+}
+
+bool json_value_copy_string(const json_value_t *v, char *out, size_t out_len, size_t *len_out) {
+    if (v->type != JSON_VALUE_STRING || out_len == 0) {
+        return false;
+    }
+    size_t used = 0;
+    for (size_t i = 0; i < v->len; ++i) {
+        char utf8[3];
+        size_t n = 1;
+        utf8[0] = v->start[i];
+        if (utf8[0] == '\\') {
+            const char e = v->start[++i];
+            switch (e) {
+            case '"':
+            case '\\':
+            case '/':
+                utf8[0] = e;
+                break;
+            case 'b':
+                utf8[0] = '\b';
+                break;
+            case 'f':
+                utf8[0] = '\f';
+                break;
+            case 'n':
+                utf8[0] = '\n';
+                break;
+            case 'r':
+                utf8[0] = '\r';
+                break;
+            case 't':
+                utf8[0] = '\t';
+                break;
+            case 'u': {
+                if (v->len - i < 5) {
+                    return false;
+                }
+                unsigned code = 0;
+                for (size_t k = 1; k <= 4; ++k) {
+                    const int digit = json_hex_value(v->start[i + k]);
+                    if (digit < 0) {
+                        return false;
+                    }
+                    code = (code << 4) | (unsigned)digit;
+                }
+                i += 4;
+                if (code == 0 || (code >= 0xd800 && code <= 0xdfff)) {
+                    return false;
+                }
+                if (code < 0x80) {
+                    utf8[0] = (char)code;
+                } else if (code < 0x800) {
+                    utf8[0] = (char)(0xc0 | (code >> 6));
+                    utf8[1] = (char)(0x80 | (code & 0x3f));
+                    n = 2;
+                } else {
+                    utf8[0] = (char)(0xe0 | (code >> 12));
+                    utf8[1] = (char)(0x80 | ((code >> 6) & 0x3f));
+                    utf8[2] = (char)(0x80 | (code & 0x3f));
+                    n = 3;
+                }
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        if (used + n >= out_len) {
+            return false;
+        }
+        memcpy(out + used, utf8, n);
+        used += n;
+    }
+    out[used] = '\0';
+    if (len_out) {
+        *len_out = used;
+    }
+    return true;
+}
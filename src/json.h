@@ -0,0 +1,82 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define JSON_WRITER_MAX_DEPTH 8
+
+// Appends a JSON document to a caller buffer as values are written; nothing
+// is built up front. Strings are escaped. Once a value does not fit the
+// writer stops and json_writer_finish() reports 0.
+typedef struct {
+    char *out;
+    size_t cap;
+    size_t len;
+    bool overflow;
+    bool after_key;
+    uint8_t depth;
+    uint8_t has_members; // bit per nesting level
+} json_writer_t;
+
+void json_writer_init(json_writer_t *w, char *out, size_t cap);
+void json_writer_begin_object(json_writer_t *w);
+void json_writer_end_object(json_writer_t *w);
+void json_writer_begin_array(json_writer_t *w);
+void json_writer_end_array(json_writer_t *w);
+void json_writer_key(json_writer_t *w, const char *key);
+void json_writer_string(json_writer_t *w, const char *value);
+// Writes as much of value as fits while keeping reserve bytes free for the
+// rest of the document; the string is cut short instead of overflowing.
+void json_writer_string_clipped(json_writer_t *w, const char *value, size_t reserve);
+void json_writer_uint(json_writer_t *w, uint64_t value);
+void json_writer_int(json_writer_t *w, int64_t value);
+void json_writer_bool(json_writer_t *w, bool value);
+void json_writer_null(json_writer_t *w);
+// NUL-terminates and returns the document length, or 0 if it did not fit.
+size_t json_writer_finish(json_writer_t *w);
+
+typedef enum {
+    JSON_VALUE_STRING,
+    JSON_VALUE_NUMBER,
+    JSON_VALUE_TRUE,
+    JSON_VALUE_FALSE,
+    JSON_VALUE_NULL,
+} json_value_type_t;
+
+// A span of the input. Strings exclude the quotes and are still escaped.
+typedef struct {
+    json_value_type_t type;
+    const char *start;
+    size_t len;
+} json_value_t;
+
+// Walks the members of one flat object in place, or the objects of an array
+// of them. Other nesting is rejected, which is all the API needs.
+typedef struct {
+    const char *pos;
+    const char *end;
+    bool started;
+    bool done;
+    bool error;
+    bool in_element;
+} json_reader_t;
+
+void json_reader_init(json_reader_t *r, const char *text, size_t len);
+// Returns the next member, or false at the end of the object or on error.
+bool json_reader_next(json_reader_t *r, json_value_t *key, json_value_t *value);
+// Steps through an array of flat objects. element reads the members of the
+// next one and must be read to its end before the following call.
+bool json_reader_next_object(json_reader_t *r, json_reader_t *element);
+// True once the whole input was one well-formed object or array.
+bool json_reader_ok(const json_reader_t *r);
+
+bool json_value_equals(const json_value_t *v, const char *literal);
+bool json_value_uint(const json_value_t *v, uint64_t *out);
+bool json_value_bool(const json_value_t *v, bool *out);
+// Unescapes a string value into out. Fails if it does not fit or uses
+// code points outside the Basic Multilingual Plane.
+bool json_value_copy_string(const json_value_t *v, char *out, size_t out_len, size_t *len_out);
+
+#endif // JSON_H
@@ -0,0 +1,96 @@
+#include "log_stream.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "debug.h"
+#include "webserver_utils.h"
+
+#define LOG_STREAM_LINE_MAX 200
+#define LOG_STREAM_EVENT_OVERHEAD 8 // "data: " + "\n\n"
+
+typedef struct {
+    bool in_use;
+    debug_reader_t reader;
+    size_t line_len; // formatted record waiting for room in the send buffer
+    char line[LOG_STREAM_LINE_MAX];
+} log_stream_client_t;
+
+static log_stream_client_t g_clients[LOG_STREAM_MAX_CLIENTS];
+
+static size_t log_stream_fill(void *ctx, char *out, size_t out_len) {
+    log_stream_client_t *client = (log_stream_client_t *)ctx;
+    size_t used = 0;
+    if (out_len <= LOG_STREAM_EVENT_OVERHEAD) {
+        return 0; // no room for even a clipped line
+    }
+
+    // Pack as many whole events as fit so each TCP segment carries several lines.
+    while (true) {
+        if (client->line_len == 0) {
+            client->line_len =
+                debug_reader_next(&client->reader, client->line, sizeof(client->line), false);
+            if (client->line_len > 0 && client->line[client->line_len - 1] == '\n') {
+                client->line_len--;
+            }
+        }
+
+        if (client->reader.lost > 0) {
+            char marker[40];
+            int n = snprintf(marker, sizeof(marker), "event: lost\ndata: %lu\n\n",
+                             (unsigned long)client->reader.lost);
+            if (n <= 0 || (size_t)n > out_len - used) {
+                break;
+            }
+            memcpy(out + used, marker, (size_t)n);
+            used += (size_t)n;
+            client->reader.lost = 0;
+        }
+
+        if (client->line_len == 0) {
+            break;
+        }
+        size_t len = client->line_len;
+        if (used + len + LOG_STREAM_EVENT_OVERHEAD > out_len) {
+            if (used > 0) {
+                break;
+            }
+            len = out_len - LOG_STREAM_EVENT_OVERHEAD;
+        }
+        memcpy(out + used, "data: ", 6);
+        memcpy(out + used + 6, client->line, len);
+        memcpy(out + used + 6 + len, "\n\n", 2);
+        used += len + LOG_STREAM_EVENT_OVERHEAD;
+        client->line_len = 0;
+    }
+    return used;
+}
+
+static void log_stream_close(void *ctx) {
+    log_stream_client_t *client = (log_stream_client_t *)ctx;
+    client->in_use = false;
+}
+
+err_t log_stream_open(struct tcp_pcb *pcb) {
+    log_stream_client_t *client = NULL;
+    for (size_t i = 0; i < LOG_STREAM_MAX_CLIENTS; ++i) {
+        if (!g_clients[i].in_use) {
+            client = &g_clients[i];
+            break;
+        }
+    }
+    if (!client) {
+        return ERR_MEM;
+    }
+
+    client->in_use = true;
+    client->line_len = 0;
+    debug_reader_init(&client->reader, true);
+    err_t err = webserver_stream_open(pcb, "text/event-stream", log_stream_fill, log_stream_close,
+                                      client);
+    if (err != ERR_OK) {
+        client->in_use = false;
+    }
+    return err;
+}
@@ -0,0 +1,13 @@
+#ifndef LOG_STREAM_H
+#define LOG_STREAM_H
+
+#include "lwip/tcp.h"
+
+#define LOG_STREAM_MAX_CLIENTS 2
+
+// Serves the debug ring as text/event-stream: the RAM backlog first, then live
+// records. A client that falls behind gets an "event: lost" with the number of
+// records it missed; loggers never wait on a slow connection.
+err_t log_stream_open(struct tcp_pcb *pcb);
+
+#endif // LOG_STREAM_H
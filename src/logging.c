@@ -1,51 +1,101 @@
 #include "logging.h"
 
 #include <stdarg.h>
-#include <stdio.h>
-#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
 
+#include "pico/stdio_usb.h"
+
+#include "boot_profile.h"
 #include "debug.h"
+#include "scheduler.h"
+
+#define LOGGING_USB_POLL_MS 250
+
+volatile uint32_t g_log_category_mask = 0xFFFFFFFFu;
+
+static bool g_usb_attached = false;
+static volatile bool g_usb_muted = false;
+
+static const char *const k_category_names[LOG_CAT_COUNT] = {
+    [LOG_CAT_SYSTEM] = "system", [LOG_CAT_SI5351] = "si5351", [LOG_CAT_MORSE] = "morse",
+    [LOG_CAT_HTTP] = "http",     [LOG_CAT_DHCP] = "dhcp",     [LOG_CAT_USER] = "user",
+};
+
+// Prefix printed after the level label; system messages carry none.
+static const char *const k_category_tags[LOG_CAT_COUNT] = {
+    [LOG_CAT_SYSTEM] = NULL,       [LOG_CAT_SI5351] = "[SI5351] ", [LOG_CAT_MORSE] = "[MORSE] ",
+    [LOG_CAT_HTTP] = "[HTTP] ",    [LOG_CAT_DHCP] = "[DHCP] ",     [LOG_CAT_USER] = "[USER] ",
+};
+
+static void logging_request_flush(void) { scheduler_notify(SCHEDULER_TASK_LOGGING); }
 
 void logging_init(void) {
     init_debug();
-    set_debug_mode(DEBUG_REALTIME);
+    set_debug_flush_callback(logging_request_flush);
+    // Boot does not wait for a USB host; output is held in RAM until one
+    // attaches and then switches to realtime printing.
+    set_debug_mode(DEBUG_BUFFERED);
 }
 
-void logging_poll(void) { transmit_debug_logs(); }
-
-static void log_vinternal(const char *label, const char *color, const char *fmt, va_list args) {
-    char message[256];
-    vsnprintf(message, sizeof(message), fmt, args);
-
-    size_t len = strlen(message);
-    if (len > 0 && message[len - 1] == '\n') {
-        message[len - 1] = '\0';
+void logging_poll(void) {
+    if (!g_usb_attached) {
+        if (!stdio_usb_connected()) {
+            scheduler_wake_at(SCHEDULER_TASK_LOGGING, make_timeout_time_ms(LOGGING_USB_POLL_MS));
+            return;
+        }
+        g_usb_attached = true;
+        boot_profile_mark(BOOT_PHASE_USB_CONNECTED);
+        transmit_debug_logs();
+        set_debug_mode(DEBUG_REALTIME);
     }
-
-    if (color) {
-        debug_log_with_color(color, "%s%s\n", label, message);
-    } else {
-        debug_log("%s%s\n", label, message);
+    if (g_usb_muted) {
+        return;
     }
+    transmit_debug_logs();
 }
 
-void log_info(const char *fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    log_vinternal("[INFO] ", NULL, fmt, args);
-    va_end(args);
+void logging_set_usb_muted(bool muted) {
+    g_usb_muted = muted;
+    if (!muted) {
+        logging_request_flush();
+    }
 }
 
-void log_warn(const char *fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    log_vinternal("[WARN] ", COLOR_BOLD_YELLOW, fmt, args);
-    va_end(args);
+void logging_set_category_mask(uint32_t mask) { g_log_category_mask = mask; }
+
+uint32_t logging_category_mask(void) { return g_log_category_mask; }
+
+const char *logging_category_name(log_category_t category) {
+    if (category >= LOG_CAT_COUNT) {
+        return "unknown";
+    }
+    return k_category_names[category];
 }
 
-void log_error(const char *fmt, ...) {
+void log_write(int level, log_category_t category, const char *fmt, ...) {
+    DebugLevel debug_level = DEBUG_LEVEL_INFO;
+    const char *color = NULL;
+    switch (level) {
+    case LOG_LEVEL_DEBUG:
+        debug_level = DEBUG_LEVEL_DEBUG;
+        break;
+    case LOG_LEVEL_WARN:
+        debug_level = DEBUG_LEVEL_WARN;
+        color = COLOR_BOLD_YELLOW;
+        break;
+    case LOG_LEVEL_ERROR:
+        debug_level = DEBUG_LEVEL_ERROR;
+        color = COLOR_BOLD_RED;
+        break;
+    default:
+        break;
+    }
+
+    const char *tag = category < LOG_CAT_COUNT ? k_category_tags[category] : NULL;
+
     va_list args;
     va_start(args, fmt);
-    log_vinternal("[ERROR] ", COLOR_BOLD_RED, fmt, args);
+    debug_vlog(debug_level, tag, color, fmt, args);
     va_end(args);
 }
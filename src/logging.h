@@ -2,11 +2,64 @@
 #define LOGGING_H
 
 #include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_OFF 4
+
+// Calls below LOG_MIN_LEVEL or outside LOG_CATEGORIES are removed by the
+// compiler together with the expressions that build their arguments.
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#endif
+
+#ifndef LOG_CATEGORIES
+#define LOG_CATEGORIES 0xFFFFFFFFu
+#endif
+
+typedef enum {
+    LOG_CAT_SYSTEM = 0,
+    LOG_CAT_SI5351,
+    LOG_CAT_MORSE,
+    LOG_CAT_HTTP,
+    LOG_CAT_DHCP,
+    LOG_CAT_USER,
+    LOG_CAT_COUNT
+} log_category_t;
+
+extern volatile uint32_t g_log_category_mask;
+
+#define LOG_ENABLED(level, cat)                                                                    \
+    ((level) >= LOG_MIN_LEVEL && ((LOG_CATEGORIES) & (1u << (cat))) != 0 &&                       \
+     (g_log_category_mask & (1u << (cat))) != 0)
+
+#define LOG_AT(level, cat, ...)                                                                    \
+    do {                                                                                           \
+        if (LOG_ENABLED(level, cat)) {                                                             \
+            log_write((level), (cat), __VA_ARGS__);                                                \
+        }                                                                                          \
+    } while (0)
+
+#define LOG_DEBUG(cat, ...) LOG_AT(LOG_LEVEL_DEBUG, cat, __VA_ARGS__)
+#define LOG_INFO(cat, ...) LOG_AT(LOG_LEVEL_INFO, cat, __VA_ARGS__)
+#define LOG_WARN(cat, ...) LOG_AT(LOG_LEVEL_WARN, cat, __VA_ARGS__)
+#define LOG_ERROR(cat, ...) LOG_AT(LOG_LEVEL_ERROR, cat, __VA_ARGS__)
 
 void logging_init(void);
 void logging_poll(void);
-void log_info(const char *fmt, ...);
-void log_warn(const char *fmt, ...);
-void log_error(const char *fmt, ...);
+
+// Holds records in the ring instead of printing them while something else
+// owns the USB console; unmuting prints what was held.
+void logging_set_usb_muted(bool muted);
+void log_write(int level, log_category_t category, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+void logging_set_category_mask(uint32_t mask);
+uint32_t logging_category_mask(void);
+const char *logging_category_name(log_category_t category);
 
 #endif // LOGGING_H
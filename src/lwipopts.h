@@ -22,12 +22,13 @@
 #define MEM_SIZE 4000
 #define MEMP_NUM_TCP_SEG 64 // Doubled for larger TCP window
 #define MEMP_NUM_ARP_QUEUE 10
+#define MEMP_NUM_TCP_PCB 10 // page connections, event/log streams and WebSockets; see webserver.c
 #define PBUF_POOL_SIZE 48 // Doubled for larger receive buffers
 #define LWIP_ARP 1
 #define LWIP_ETHERNET 1
 #define LWIP_ICMP 1
 #define LWIP_RAW 1
-#define TCP_WND (32 * TCP_MSS) // Increased from 8 to handle large transfers like weathermap (775KB)
+#define TCP_WND (32 * TCP_MSS) // Far above any request we accept; GET /memory shows real pool use
 #define TCP_MSS 1460
 #define TCP_SND_BUF (8 * TCP_MSS)
 #define TCP_SND_QUEUELEN ((4 * (TCP_SND_BUF) + (TCP_MSS - 1)) / (TCP_MSS))
@@ -35,9 +36,10 @@
 #define LWIP_NETIF_LINK_CALLBACK 1
 #define LWIP_NETIF_HOSTNAME 1
 #define LWIP_NETCONN 0
-#define MEM_STATS 0
+#define LWIP_STATS 1 // heap and pool usage for /metrics
+#define MEM_STATS 1
 #define SYS_STATS 0
-#define MEMP_STATS 0
+#define MEMP_STATS 1
 #define LINK_STATS 0
 // #define ETH_PAD_SIZE 2
 #define LWIP_CHKSUM_ALGORITHM 3
@@ -56,7 +58,6 @@
 
 #ifndef NDEBUG
 #define LWIP_DEBUG 1
-#define LWIP_STATS 1
 #define LWIP_STATS_DISPLAY 1
 #endif
 
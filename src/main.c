@@ -1,92 +1,66 @@
 #include <stdint.h>
 #include <stdio.h>
-#include <string.h>
 
 #include "pico/cyw43_arch.h"
-#include "pico/stdio_usb.h"
+#include "pico/multicore.h"
 #include "pico/stdlib.h"
 
 #include "lwip/ip4_addr.h"
 #include "lwip/netif.h"
-#include "lwip/pbuf.h"
-#include "lwip/udp.h"
 
+#include "app_state.h"
+#include "boot_profile.h"
+#include "control_coalesce.h"
+#include "control_queue.h"
+#include "control_ws.h"
+#include "dhcp_server.h"
 #include "logging.h"
+#include "memory_stats.h"
 #include "morse_player.h"
+#include "scheduler.h"
+#include "scpi.h"
+#include "scpi_server.h"
+#include "sequence.h"
 #include "signal_controller.h"
+#include "sweep.h"
+#include "udp_control.h"
 #include "webserver.h"
+#include "webserver_utils.h"
 
-static void start_dhcp_server(void);
-static void dhcp_recv_cb(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr,
-                         u16_t port);
-static bool wait_for_usb_connection(uint32_t timeout_ms);
-
-static const uint8_t dhcp_offer_template[] = {
-    0x02, 0x01, 0x06, 0x00, // BOOTP: op, htype, hlen, hops
-    0x00, 0x00, 0x00, 0x00, // XID (Transaction ID)
-    0x00, 0x00, 0x00, 0x00, // SECS, FLAGS
-    0, 0, 0, 0,             // CIADDR (Client IP)
-    192, 168, 4, 100,       // YIADDR (Your IP)
-    192, 168, 4, 1,         // SIADDR (Server IP)
-    0x00, 0x00, 0x00, 0x00, // GIADDR (Gateway IP)
-    // CHADDR (Client HW addr)
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    // CHADDR padding
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    // SNAME (64 bytes)
-    [44] = 0, [107] = 0,
-    // FILE (128 bytes)
-    [108] = 0, [235] = 0,
-    // MAGIC COOKIE
-    99, 130, 83, 99,
-    // DHCP Options
-    53, 1, 2,                      // Offer
-    54, 4, 192, 168, 4, 1,         // Server Identifier
-    51, 4, 0x00, 0x01, 0x51, 0x80, // Lease time = 86400
-    58, 4, 0x00, 0x00, 0x01, 0x2C, // Renewal (T1) = 300s
-    59, 4, 0x00, 0x00, 0x01, 0xE0, // Rebinding (T2) = 480s
-    1, 4, 255, 255, 255, 0,        // Subnet mask
-    3, 4, 192, 168, 4, 1,          // Router
-    6, 4, 192, 168, 4, 1,          // DNS
-    255};
-
-static const uint8_t
-    dhcp_ack_template[] =
-        {
-            0x02, 0x01, 0x06, 0x00, 0x00, 0x00,     0x00,      0x00,      0x00,      0x00, 0x00,
-            0x00, 0,    0,    0,    0,    192,      168,       4,         100,       192,  168,
-            4,    1,    0x00, 0x00, 0x00, 0x00,     0,         0,         0,         0,    0,
-            0,    0,    0,    0,    0,    0,        0,         0,         0,         0,    0,
-            0,    0,    0,    0,    0,    0,        0,         0,         0,         0,    0,
-            0,    0,    0,    0,    0,    [44] = 0, [107] = 0, [108] = 0, [235] = 0, 99,   130,
-            83,   99,   53,   1,    5, // ACK
-            54,   4,    192,  168,  4,    1,        51,        4,         0x00,      0x01, 0x51,
-            0x80, 58,   4,    0x00, 0x00, 0x01,     0x2C,      59,        4,         0x00, 0x00,
-            0x01, 0xE0, 1,    4,    255,  255,      255,       0,         3,         4,    192,
-            168,  4,    1,    6,    4,    192,      168,       4,         1,         255};
+static void logging_task(void);
+static void events_task(void);
+static void control_task(void);
+static void core1_signal_controller_init(void);
+static bool wait_for_signal_controller_init(uint32_t timeout_ms);
+static void poll_late_signal_controller_init(void);
+
+#define SI5351_INIT_TIMEOUT_MS 1000
+#define SI5351_INIT_POLL_MS 100
+
+// Core 1 was still probing when boot stopped waiting; its answer comes later.
+static bool g_si5351_init_late = false;
 
 int main(void) {
+    memory_stats_init();
     stdio_init_all();
-    if (wait_for_usb_connection(2000)) {
-        printf("USB connected\n");
-    } else {
-        printf("USB timeout\n");
-    }
+    scheduler_init();
+    control_queue_init();
+    app_state_init();
     logging_init();
+    boot_profile_mark(BOOT_PHASE_STDIO_READY);
 
-    log_info("Clock generator web firmware booting");
+    LOG_INFO(LOG_CAT_SYSTEM, "Clock generator web firmware booting");
 
-    if (!signal_controller_init()) {
-        log_warn("Si5351 init failed; outputs will remain inactive");
-        webserver_set_status("Si5351 not found - check hardware", true);
-    } else {
-        webserver_set_status(NULL, false);
-    }
+    // The Si5351 probe, SYS_INIT wait and reset run on core 1 while core 0
+    // loads the CYW43 firmware; the two are joined before the webserver starts.
+    memory_stats_paint_core1();
+    multicore_launch_core1(core1_signal_controller_init);
 
     if (cyw43_arch_init_with_country(CYW43_COUNTRY_WORLDWIDE)) {
-        log_error("Failed to initialize CYW43");
+        LOG_ERROR(LOG_CAT_SYSTEM, "Failed to initialize CYW43");
         return 1;
     }
+    boot_profile_mark(BOOT_PHASE_WIFI_READY);
 
     const char *ssid = "clockgen";
     const char *password = "12345678";
@@ -102,99 +76,111 @@ int main(void) {
     if (netif) {
         netif_set_addr(netif, &ip, &netmask, &gw);
     }
+    boot_profile_mark(BOOT_PHASE_AP_READY);
 
-    start_dhcp_server();
-    webserver_init();
-
-    log_info("Access point ready: SSID=%s, IP=192.168.4.1", ssid);
+    dhcp_server_start(&ip, &netmask);
 
-    while (true) {
-        cyw43_arch_poll();
-        morse_tick();
-        logging_poll();
-        sleep_ms(5);
+    if (!wait_for_signal_controller_init(SI5351_INIT_TIMEOUT_MS)) {
+        LOG_WARN(LOG_CAT_SYSTEM, "Si5351 init failed; outputs will remain inactive");
+        webserver_set_status("Si5351 not found - check hardware", true);
+    } else {
+        webserver_set_status(NULL, false);
     }
+
+    webserver_init();
+    udp_control_start();
+    scpi_server_start();
+    boot_profile_mark(BOOT_PHASE_NETWORK_READY);
+
+    LOG_INFO(LOG_CAT_SYSTEM, "Access point ready: SSID=%s, IP=192.168.4.1", ssid);
+    boot_profile_log_summary();
+
+    // lwIP and the CYW43 driver are serviced from the background IRQ, so the
+    // main loop only runs tasks that are notified or whose deadline expired.
+    scheduler_register(SCHEDULER_TASK_MORSE, "morse", morse_tick);
+    scheduler_register(SCHEDULER_TASK_SEQUENCE, "sequence", sequence_tick);
+    scheduler_register(SCHEDULER_TASK_LOGGING, "logging", logging_task);
+    scheduler_register(SCHEDULER_TASK_EVENTS, "events", events_task);
+    scheduler_register(SCHEDULER_TASK_CONTROL, "control", control_task);
+    scheduler_register(SCHEDULER_TASK_SCPI, "scpi", scpi_server_usb_task);
+    scheduler_notify(SCHEDULER_TASK_LOGGING);
+    scheduler_run();
 }
 
-static bool wait_for_usb_connection(uint32_t timeout_ms) {
-    absolute_time_t deadline = make_timeout_time_ms(timeout_ms);
-    while (!time_reached(deadline)) {
-        if (stdio_usb_connected()) {
-            return true;
-        }
-        sleep_ms(10);
-    }
-    return stdio_usb_connected();
+// New log records wake this task; it feeds both the USB console and any HTTP
+// log streams, whose lwIP calls need the lock from thread context.
+static void logging_task(void) {
+    logging_poll();
+    cyw43_arch_lwip_begin();
+    webserver_stream_pump_all();
+    cyw43_arch_lwip_end();
 }
 
-static void start_dhcp_server(void) {
-    struct udp_pcb *pcb = udp_new_ip_type(IPADDR_TYPE_V4);
-    if (!pcb) {
-        log_error("Failed to allocate UDP PCB for DHCP");
-        return;
-    }
+// Woken by every app_state change; open /events streams send the new state.
+static void events_task(void) {
+    cyw43_arch_lwip_begin();
+    webserver_stream_pump_all();
+    cyw43_arch_lwip_end();
+}
 
-    if (udp_bind(pcb, IP_ADDR_ANY, 67) != ERR_OK) {
-        log_error("DHCP bind failed");
-        udp_remove(pcb);
-        return;
+// Carries out one queued control job. The bus work runs without the lwIP
+// lock so TCP keeps moving; only the answer is sent with it held.
+static void control_task(void) {
+    control_job_t job;
+    const bool ran = control_queue_pop(&job);
+    if (ran) {
+        control_queue_run(&job);
     }
-
-    udp_recv(pcb, dhcp_recv_cb, NULL);
-    log_info("DHCP server listening on port 67");
+    cyw43_arch_lwip_begin();
+    if (ran && job.done) {
+        job.done(&job);
+    }
+    poll_late_signal_controller_init();
+    control_coalesce_task();
+    control_ws_task();
+    udp_control_task();
+    sweep_task();
+    scpi_task();
+    cyw43_arch_lwip_end();
 }
 
-static void dhcp_recv_cb(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr,
-                         u16_t port) {
-    (void)arg;
-    if (!p || p->len < 240) {
-        if (p) {
-            pbuf_free(p);
-        }
-        return;
+static void core1_signal_controller_init(void) {
+    bool ok = signal_controller_init();
+    if (ok) {
+        boot_profile_mark(BOOT_PHASE_SI5351_READY);
     }
+    multicore_fifo_push_blocking(ok ? 1u : 0u);
+}
 
-    const uint8_t *request = (const uint8_t *)p->payload;
-
-    uint8_t msg_type = 0;
-    for (int i = 240; i < p->len - 2; i++) {
-        if (request[i] == 53 && request[i + 1] == 1) {
-            msg_type = request[i + 2];
-            break;
-        }
+static bool wait_for_signal_controller_init(uint32_t timeout_ms) {
+    uint32_t result = 0;
+    if (!multicore_fifo_pop_timeout_us((uint64_t)timeout_ms * 1000u, &result)) {
+        // Resetting core 1 now could cut an I2C transfer short or leave a lock
+        // it holds taken. Let it finish; the control task collects the answer.
+        LOG_ERROR(LOG_CAT_SI5351, "init did not finish within %u ms", (unsigned)timeout_ms);
+        g_si5351_init_late = true;
+        scheduler_wake_at(SCHEDULER_TASK_CONTROL, make_timeout_time_ms(SI5351_INIT_POLL_MS));
+        return false;
     }
+    // Core 1 is parked again so it is in a known state for later users.
+    multicore_reset_core1();
+    return result != 0;
+}
 
-    const uint8_t *template = NULL;
-    size_t template_len = 0;
-
-    switch (msg_type) {
-    case 1: // Discover
-        template = dhcp_offer_template;
-        template_len = sizeof(dhcp_offer_template);
-        break;
-    case 3: // Request
-        template = dhcp_ack_template;
-        template_len = sizeof(dhcp_ack_template);
-        break;
-    default:
-        pbuf_free(p);
+// Runs in the control task with the lwIP lock held.
+static void poll_late_signal_controller_init(void) {
+    if (!g_si5351_init_late) {
         return;
     }
-
-    uint8_t response[300] = {0};
-    memcpy(response, template, template_len);
-    memcpy(response + 4, request + 4, 4);    // XID
-    memcpy(response + 28, request + 28, 16); // CHADDR
-
-    struct pbuf *resp_buf = pbuf_alloc(PBUF_TRANSPORT, template_len, PBUF_RAM);
-    if (!resp_buf) {
-        pbuf_free(p);
+    if (!multicore_fifo_rvalid()) {
+        scheduler_wake_at(SCHEDULER_TASK_CONTROL, make_timeout_time_ms(SI5351_INIT_POLL_MS));
         return;
     }
-
-    memcpy(resp_buf->payload, response, template_len);
-    udp_sendto(pcb, resp_buf, addr, port);
-
-    pbuf_free(resp_buf);
-    pbuf_free(p);
+    const uint32_t result = multicore_fifo_pop_blocking();
+    multicore_reset_core1();
+    g_si5351_init_late = false;
+    if (result) {
+        LOG_INFO(LOG_CAT_SI5351, "init finished late");
+        webserver_set_status(NULL, false);
+    }
 }
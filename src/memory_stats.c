@@ -0,0 +1,163 @@
+#include "memory_stats.h"
+
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lwip/memp.h"
+#include "lwip/stats.h"
+
+#define MEMORY_STACK_PAINT 0x5354434bu // "STCK"
+#define MEMORY_STACK_MARGIN_WORDS 16    // left alone below the painting frame
+
+// Provided by the SDK's linker script.
+extern uint32_t __StackBottom;
+extern uint32_t __StackTop;
+extern uint32_t __StackOneBottom;
+extern uint32_t __StackOneTop;
+extern char end;
+extern char __StackLimit; // the heap may grow up to here
+
+static const char *const k_pool_names[MEMP_MAX] = {
+#define LWIP_MEMPOOL(name, num, size, desc) #name,
+#include "lwip/priv/memp_std.h"
+};
+
+typedef struct {
+    uint32_t used;
+    uint32_t peak;
+    uint32_t size;
+    uint32_t errors;
+} memory_usage_t;
+
+typedef struct {
+    memory_usage_t stacks[2];
+    memory_usage_t heap;
+    memory_usage_t lwip_heap;
+    memory_usage_t pools[MEMP_MAX];
+} memory_snapshot_t;
+
+static void memory_paint(uint32_t *from, uint32_t *to) {
+    for (uint32_t *word = from; word < to; ++word) {
+        *word = MEMORY_STACK_PAINT;
+    }
+}
+
+void memory_stats_init(void) {
+    // Everything below this frame is unused yet; painting stops short of it.
+    volatile uint32_t marker = 0;
+    uint32_t *limit = (uint32_t *)&marker - MEMORY_STACK_MARGIN_WORDS;
+    memory_paint(&__StackBottom, limit);
+}
+
+void memory_stats_paint_core1(void) { memory_paint(&__StackOneBottom, &__StackOneTop); }
+
+// Stacks grow down, so the first overwritten word from the bottom marks the
+// deepest point reached.
+static uint32_t memory_stack_peak(const uint32_t *bottom, const uint32_t *top) {
+    const uint32_t *word = bottom;
+    while (word < top && *word == MEMORY_STACK_PAINT) {
+        ++word;
+    }
+    return (uint32_t)((top - word) * sizeof(uint32_t));
+}
+
+uint32_t memory_stats_stack_peak(unsigned core) {
+    return core == 0 ? memory_stack_peak(&__StackBottom, &__StackTop)
+                     : memory_stack_peak(&__StackOneBottom, &__StackOneTop);
+}
+
+static memory_usage_t memory_lwip_usage(const struct stats_mem *mem) {
+    if (!mem) {
+        return (memory_usage_t){0};
+    }
+    return (memory_usage_t){
+        .used = mem->used,
+        .peak = mem->max,
+        .size = mem->avail,
+        .errors = mem->err,
+    };
+}
+
+size_t memory_stats_snapshot(void *out, size_t out_len) {
+    if (!out || out_len < sizeof(memory_snapshot_t)) {
+        return 0;
+    }
+    memory_snapshot_t *s = (memory_snapshot_t *)out;
+    memset(s, 0, sizeof(*s));
+
+    s->stacks[0].size = (uint32_t)((&__StackTop - &__StackBottom) * sizeof(uint32_t));
+    s->stacks[0].peak = memory_stats_stack_peak(0);
+    s->stacks[1].size = (uint32_t)((&__StackOneTop - &__StackOneBottom) * sizeof(uint32_t));
+    s->stacks[1].peak = memory_stats_stack_peak(1);
+
+    // newlib never gives memory back, so the arena is the heap's high-water mark.
+    const struct mallinfo heap = mallinfo();
+    s->heap.used = (uint32_t)heap.uordblks;
+    s->heap.peak = (uint32_t)heap.arena;
+    s->heap.size = (uint32_t)(&__StackLimit - &end);
+
+    s->lwip_heap = memory_lwip_usage(&lwip_stats.mem);
+    for (size_t i = 0; i < MEMP_MAX; ++i) {
+        s->pools[i] = memory_lwip_usage(lwip_stats.memp[i]);
+    }
+    return sizeof(*s);
+}
+
+static size_t memory_format(char *out, size_t out_len, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static size_t memory_format(char *out, size_t out_len, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    const int len = vsnprintf(out, out_len, fmt, args);
+    va_end(args);
+    return (len > 0 && (size_t)len < out_len) ? (size_t)len : 0;
+}
+
+static size_t memory_usage_line(char *out, size_t out_len, const char *name,
+                                const memory_usage_t *usage, bool last) {
+    return memory_format(out, out_len,
+                         "\"%s\":{\"size\":%lu,\"used\":%lu,\"peak\":%lu,\"errors\":%lu}%s\n",
+                         name, (unsigned long)usage->size, (unsigned long)usage->used,
+                         (unsigned long)usage->peak, (unsigned long)usage->errors,
+                         last ? "" : ",");
+}
+
+// One JSON document, a few members per line: the stacks, the two heaps, then
+// one line per pool.
+size_t memory_stats_line(const void *snapshot, uint16_t index, char *out, size_t out_len) {
+    if (!snapshot || !out) {
+        return 0;
+    }
+    const memory_snapshot_t *s = (const memory_snapshot_t *)snapshot;
+    switch (index) {
+    case 0:
+        return memory_format(out, out_len, "{\"stacks\":{\n");
+    case 1:
+        return memory_format(out, out_len, "\"core0\":{\"size\":%lu,\"peak\":%lu},\n",
+                             (unsigned long)s->stacks[0].size, (unsigned long)s->stacks[0].peak);
+    case 2:
+        return memory_format(out, out_len, "\"core1\":{\"size\":%lu,\"peak\":%lu}},\n",
+                             (unsigned long)s->stacks[1].size, (unsigned long)s->stacks[1].peak);
+    case 3:
+        return memory_usage_line(out, out_len, "heap", &s->heap, false);
+    case 4:
+        return memory_usage_line(out, out_len, "lwip_heap", &s->lwip_heap, false);
+    case 5:
+        return memory_format(out, out_len, "\"pools\":{\n");
+    default:
+        break;
+    }
+    const size_t pool = (size_t)index - 6;
+    if (pool < MEMP_MAX) {
+        return memory_usage_line(out, out_len, k_pool_names[pool], &s->pools[pool],
+                                 pool + 1 == MEMP_MAX);
+    }
+    if (pool == MEMP_MAX) {
+        return memory_format(out, out_len, "}}\n");
+    }
+    return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef MEMORY_STATS_H
+#define MEMORY_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fills the unused part of core 0's stack with a known pattern. Call first
+// thing in main(), before anything has gone deep.
+void memory_stats_init(void);
+// The same for core 1's stack; call before multicore_launch_core1().
+void memory_stats_paint_core1(void);
+
+// Deepest use of a stack so far: bytes no longer holding the pattern.
+uint32_t memory_stats_stack_peak(unsigned core);
+
+// Copies the high-water marks of both stacks, the C heap, the lwIP heap and
+// every lwIP memp pool (pbufs included). Returns the bytes used, or 0 if
+// out_len is too small. Call with the lwIP lock held.
+size_t memory_stats_snapshot(void *out, size_t out_len);
+// Renders line index of the snapshot as part of one JSON document. Returns 0
+// past the last line.
+size_t memory_stats_line(const void *snapshot, uint16_t index, char *out, size_t out_len);
+
+#endif // MEMORY_STATS_H
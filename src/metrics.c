@@ -0,0 +1,410 @@
+#include "metrics.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hardware/timer.h"
+#include "lwip/stats.h"
+
+#include "control_queue.h"
+#include "scheduler.h"
+#include "scpi_server.h"
+#include "si5351.h"
+#include "webserver_utils.h"
+#include "websocket.h"
+
+#define METRICS_BOUNDS (METRICS_BUCKETS - 1)
+
+typedef struct {
+    uint32_t bounds_us[METRICS_BOUNDS];
+    const char *le[METRICS_BOUNDS]; // the same bounds in seconds
+} metrics_scale_t;
+
+static const metrics_scale_t k_request_scale = {
+    {500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 1000000},
+    {"0.0005", "0.001", "0.0025", "0.005", "0.01", "0.025", "0.05", "0.1", "0.25", "1"},
+};
+
+static const metrics_scale_t k_edge_scale = {
+    {10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000},
+    {"0.00001", "0.000025", "0.00005", "0.0001", "0.00025", "0.0005", "0.001", "0.0025", "0.005",
+     "0.01"},
+};
+
+static const metrics_scale_t k_loop_scale = {
+    {50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 100000},
+    {"0.00005", "0.0001", "0.00025", "0.0005", "0.001", "0.0025", "0.005", "0.01", "0.025", "0.1"},
+};
+
+static const char *const k_route_names[METRICS_ROUTE_COUNT] = {
+    [METRICS_ROUTE_OTHER] = "other",   [METRICS_ROUTE_PAGE] = "page",
+    [METRICS_ROUTE_ASSET] = "asset",   [METRICS_ROUTE_API] = "api",
+    [METRICS_ROUTE_STATUS] = "status", [METRICS_ROUTE_STREAM] = "stream",
+    [METRICS_ROUTE_METRICS] = "metrics",
+};
+
+static const struct {
+    memp_t pool;
+    const char *name;
+} k_pools[] = {
+    {MEMP_TCP_PCB, "tcp_pcb"}, {MEMP_TCP_PCB_LISTEN, "tcp_pcb_listen"},
+    {MEMP_TCP_SEG, "tcp_seg"}, {MEMP_UDP_PCB, "udp_pcb"},
+    {MEMP_PBUF, "pbuf"},       {MEMP_PBUF_POOL, "pbuf_pool"},
+};
+#define METRICS_POOL_COUNT (sizeof(k_pools) / sizeof(k_pools[0]))
+
+typedef struct {
+    uint32_t used;
+    uint32_t max;
+    uint32_t size;
+    uint32_t errors;
+} metrics_pool_t;
+
+typedef struct {
+    const char *name;
+    uint32_t runs;
+    uint32_t max_us;
+    uint64_t total_us;
+} metrics_task_t;
+
+typedef struct {
+    uint64_t uptime_us;
+    uint64_t idle_us;
+    uint32_t wakeups;
+    webserver_http_stats_t http;
+    uint32_t websocket_timeouts;
+    scpi_server_stats_t scpi;
+    control_queue_stats_t queue;
+    struct Si5351BusStats i2c;
+    metrics_pool_t heap;
+    metrics_pool_t pools[METRICS_POOL_COUNT];
+    metrics_task_t tasks[SCHEDULER_TASK_COUNT];
+    metrics_histogram_t requests[METRICS_ROUTE_COUNT];
+    metrics_histogram_t morse_edge;
+    metrics_histogram_t loop;
+} metrics_snapshot_t;
+
+_Static_assert(sizeof(metrics_snapshot_t) <= WEBSERVER_RESPONSE_EXTRA_MAX,
+               "metrics snapshot must fit a response slot");
+
+static metrics_histogram_t g_requests[METRICS_ROUTE_COUNT];
+static metrics_histogram_t g_morse_edge;
+static metrics_histogram_t g_loop;
+
+static void metrics_observe(metrics_histogram_t *histogram, const metrics_scale_t *scale,
+                            uint32_t us) {
+    size_t bucket = 0;
+    while (bucket < METRICS_BOUNDS && us > scale->bounds_us[bucket]) {
+        bucket++;
+    }
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->sum_us += us;
+}
+
+uint32_t metrics_now_us(void) { return time_us_32(); }
+
+void metrics_observe_request(metrics_route_t route, uint32_t elapsed_us) {
+    if (route >= METRICS_ROUTE_COUNT) {
+        route = METRICS_ROUTE_OTHER;
+    }
+    metrics_observe(&g_requests[route], &k_request_scale, elapsed_us);
+}
+
+void metrics_observe_morse_edge(uint32_t late_us) {
+    metrics_observe(&g_morse_edge, &k_edge_scale, late_us);
+}
+
+void metrics_observe_loop(uint32_t busy_us) { metrics_observe(&g_loop, &k_loop_scale, busy_us); }
+
+static metrics_pool_t metrics_pool(const struct stats_mem *mem) {
+    if (!mem) {
+        return (metrics_pool_t){0};
+    }
+    return (metrics_pool_t){
+        .used = mem->used,
+        .max = mem->max,
+        .size = mem->avail,
+        .errors = mem->err,
+    };
+}
+
+size_t metrics_snapshot(void *out, size_t out_len) {
+    if (!out || out_len < sizeof(metrics_snapshot_t)) {
+        return 0;
+    }
+    metrics_snapshot_t *s = (metrics_snapshot_t *)out;
+    memset(s, 0, sizeof(*s));
+    s->uptime_us = time_us_64();
+    s->idle_us = scheduler_idle_us();
+    s->wakeups = scheduler_wakeups();
+    webserver_http_get_stats(&s->http);
+    s->websocket_timeouts = websocket_timeouts();
+    scpi_server_get_stats(&s->scpi);
+    control_queue_get_stats(&s->queue);
+    si5351_get_bus_stats(&s->i2c);
+    s->heap = metrics_pool(&lwip_stats.mem);
+    for (size_t i = 0; i < METRICS_POOL_COUNT; ++i) {
+        s->pools[i] = metrics_pool(lwip_stats.memp[k_pools[i].pool]);
+    }
+    for (size_t i = 0; i < SCHEDULER_TASK_COUNT; ++i) {
+        scheduler_task_stats_t task;
+        if (scheduler_get_task_stats((scheduler_task_id_t)i, &task)) {
+            s->tasks[i] = (metrics_task_t){
+                .name = task.name ? task.name : "unnamed",
+                .runs = task.runs,
+                .max_us = task.max_us,
+                .total_us = task.total_us,
+            };
+        }
+    }
+    memcpy(s->requests, g_requests, sizeof(s->requests));
+    s->morse_edge = g_morse_edge;
+    s->loop = g_loop;
+    return sizeof(*s);
+}
+
+// Rendering walks every line in order and formats only the one asked for, so
+// the output needs no state beyond the snapshot and a line number.
+typedef struct {
+    uint16_t target;
+    uint16_t at;
+    char *out;
+    size_t out_len;
+    size_t len;
+} metrics_cursor_t;
+
+static bool metrics_want(metrics_cursor_t *c) { return c->at++ == c->target; }
+
+static void metrics_printf(metrics_cursor_t *c, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    const int len = vsnprintf(c->out, c->out_len, fmt, args);
+    va_end(args);
+    c->len = (len > 0 && (size_t)len < c->out_len) ? (size_t)len : 0;
+}
+
+// Microsecond figures are exposed in seconds.
+static const char *metrics_value(char *buf, size_t buf_len, uint64_t value, bool micros) {
+    if (micros) {
+        snprintf(buf, buf_len, "%llu.%06lu", (unsigned long long)(value / 1000000u),
+                 (unsigned long)(value % 1000000u));
+    } else {
+        snprintf(buf, buf_len, "%llu", (unsigned long long)value);
+    }
+    return buf;
+}
+
+static uint64_t metrics_field(const void *base, size_t offset, size_t width) {
+    const unsigned char *p = (const unsigned char *)base + offset;
+    if (width == sizeof(uint16_t)) {
+        uint16_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    if (width == sizeof(uint32_t)) {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void metrics_type(metrics_cursor_t *c, const char *name, const char *type) {
+    if (metrics_want(c)) {
+        metrics_printf(c, "# TYPE %s %s\n", name, type);
+    }
+}
+
+typedef struct {
+    const char *name;
+    const char *type;
+    const char *labels; // written as is after the name
+    uint16_t offset;
+    uint8_t width;
+    bool micros;
+} metrics_scalar_t;
+
+#define METRICS_FIELD(field)                                                                      \
+    offsetof(metrics_snapshot_t, field), sizeof(((metrics_snapshot_t *)0)->field)
+#define METRICS_COUNTER(name, labels, field) {name, "counter", labels, METRICS_FIELD(field), false}
+#define METRICS_GAUGE(name, field) {name, "gauge", "", METRICS_FIELD(field), false}
+#define METRICS_SECONDS(name, type, field) {name, type, "", METRICS_FIELD(field), true}
+
+// Consecutive entries with one name form a family under a single TYPE line.
+static const metrics_scalar_t k_scalars[] = {
+    METRICS_SECONDS("clockgen_uptime_seconds", "gauge", uptime_us),
+    METRICS_SECONDS("clockgen_idle_seconds_total", "counter", idle_us),
+    METRICS_COUNTER("clockgen_wakeups_total", "", wakeups),
+    METRICS_COUNTER("clockgen_http_connections_accepted_total", "", http.accepted),
+    METRICS_COUNTER("clockgen_http_connections_refused_total", "", http.rejected),
+    METRICS_GAUGE("clockgen_http_connections_active", http.active),
+    METRICS_COUNTER("clockgen_http_connections_closed_total", "{reason=\"idle\"}",
+                    http.idle_closed),
+    METRICS_COUNTER("clockgen_http_connections_closed_total", "{reason=\"header_timeout\"}",
+                    http.header_timeouts),
+    METRICS_COUNTER("clockgen_http_connections_closed_total", "{reason=\"body_timeout\"}",
+                    http.body_timeouts),
+    METRICS_COUNTER("clockgen_http_connections_aborted_total", "{reason=\"send_stall\"}",
+                    http.send_stalls),
+    METRICS_COUNTER("clockgen_http_connections_aborted_total", "{reason=\"stream_stall\"}",
+                    http.stream_stalls),
+    METRICS_COUNTER("clockgen_http_connections_aborted_total", "{reason=\"reclaimed\"}",
+                    http.reclaimed),
+    METRICS_COUNTER("clockgen_http_connections_aborted_total", "{reason=\"websocket_timeout\"}",
+                    websocket_timeouts),
+    METRICS_COUNTER("clockgen_scpi_connections_closed_total", "{reason=\"idle\"}",
+                    scpi.idle_closed),
+    METRICS_COUNTER("clockgen_scpi_connections_aborted_total", "{reason=\"send_stall\"}",
+                    scpi.send_stalls),
+    METRICS_COUNTER("clockgen_http_requests_reused_total", "", http.reused),
+    METRICS_COUNTER("clockgen_http_responses_oversized_total", "", http.oversized),
+    METRICS_COUNTER("clockgen_http_sent_bytes_total", "", http.bytes_sent),
+    METRICS_COUNTER("clockgen_http_received_bytes_total", "", http.bytes_received),
+    METRICS_COUNTER("clockgen_i2c_transactions_total", "", i2c.transactions),
+    METRICS_COUNTER("clockgen_i2c_bytes_total", "", i2c.bytes),
+    METRICS_COUNTER("clockgen_i2c_errors_total", "", i2c.errors),
+    METRICS_SECONDS("clockgen_i2c_busy_seconds_total", "counter", i2c.bus_us),
+    METRICS_COUNTER("clockgen_control_jobs_total", "", queue.completed),
+    METRICS_COUNTER("clockgen_control_jobs_rejected_total", "", queue.rejected),
+    METRICS_GAUGE("clockgen_control_queue_depth", queue.depth),
+    METRICS_GAUGE("clockgen_control_queue_max_depth", queue.max_depth),
+    METRICS_SECONDS("clockgen_control_wait_seconds_total", "counter", queue.total_wait_us),
+    METRICS_SECONDS("clockgen_control_run_seconds_total", "counter", queue.total_run_us),
+    METRICS_GAUGE("clockgen_lwip_heap_used_bytes", heap.used),
+    METRICS_GAUGE("clockgen_lwip_heap_max_used_bytes", heap.max),
+    METRICS_GAUGE("clockgen_lwip_heap_size_bytes", heap.size),
+    METRICS_COUNTER("clockgen_lwip_heap_errors_total", "", heap.errors),
+};
+
+static void metrics_walk_scalars(metrics_cursor_t *c, const metrics_snapshot_t *s) {
+    const char *family = NULL;
+    for (size_t i = 0; i < sizeof(k_scalars) / sizeof(k_scalars[0]); ++i) {
+        const metrics_scalar_t *scalar = &k_scalars[i];
+        if (!family || strcmp(family, scalar->name) != 0) {
+            family = scalar->name;
+            metrics_type(c, scalar->name, scalar->type);
+        }
+        if (metrics_want(c)) {
+            char value[24];
+            metrics_printf(c, "%s%s %s\n", scalar->name, scalar->labels,
+                           metrics_value(value, sizeof(value),
+                                         metrics_field(s, scalar->offset, scalar->width),
+                                         scalar->micros));
+        }
+    }
+}
+
+typedef enum { METRICS_ITEMS_POOL, METRICS_ITEMS_TASK } metrics_items_t;
+
+typedef struct {
+    const char *name;
+    const char *type;
+    metrics_items_t items;
+    uint16_t offset; // within one pool or task
+    uint8_t width;
+    bool micros;
+} metrics_item_family_t;
+
+#define METRICS_POOL(name, type, field)                                                           \
+    {name, type, METRICS_ITEMS_POOL, offsetof(metrics_pool_t, field),                             \
+     sizeof(((metrics_pool_t *)0)->field), false}
+#define METRICS_TASK(name, type, field, micros)                                                   \
+    {name, type, METRICS_ITEMS_TASK, offsetof(metrics_task_t, field),                             \
+     sizeof(((metrics_task_t *)0)->field), micros}
+
+static const metrics_item_family_t k_item_families[] = {
+    METRICS_POOL("clockgen_lwip_pool_used", "gauge", used),
+    METRICS_POOL("clockgen_lwip_pool_max_used", "gauge", max),
+    METRICS_POOL("clockgen_lwip_pool_size", "gauge", size),
+    METRICS_POOL("clockgen_lwip_pool_errors_total", "counter", errors),
+    METRICS_TASK("clockgen_task_runs_total", "counter", runs, false),
+    METRICS_TASK("clockgen_task_busy_seconds_total", "counter", total_us, true),
+    METRICS_TASK("clockgen_task_max_seconds", "gauge", max_us, true),
+};
+
+static void metrics_walk_items(metrics_cursor_t *c, const metrics_snapshot_t *s) {
+    for (size_t f = 0; f < sizeof(k_item_families) / sizeof(k_item_families[0]); ++f) {
+        const metrics_item_family_t *family = &k_item_families[f];
+        const bool pools = family->items == METRICS_ITEMS_POOL;
+        const size_t count = pools ? METRICS_POOL_COUNT : SCHEDULER_TASK_COUNT;
+        metrics_type(c, family->name, family->type);
+        for (size_t i = 0; i < count; ++i) {
+            if (!metrics_want(c)) {
+                continue;
+            }
+            const void *item = pools ? (const void *)&s->pools[i] : (const void *)&s->tasks[i];
+            char value[24];
+            metrics_printf(c, "%s{%s=\"%s\"} %s\n", family->name, pools ? "pool" : "task",
+                           pools ? k_pools[i].name : s->tasks[i].name,
+                           metrics_value(value, sizeof(value),
+                                         metrics_field(item, family->offset, family->width),
+                                         family->micros));
+        }
+    }
+}
+
+// One series: the buckets, cumulative, then _sum and _count. label is either
+// empty or a complete key="value" pair.
+static void metrics_walk_histogram(metrics_cursor_t *c, const char *name, const char *label,
+                                   const metrics_histogram_t *histogram,
+                                   const metrics_scale_t *scale) {
+    const char *sep = label[0] ? "," : "";
+    uint32_t cumulative = 0;
+    for (size_t b = 0; b < METRICS_BUCKETS; ++b) {
+        cumulative += histogram->buckets[b];
+        if (metrics_want(c)) {
+            metrics_printf(c, "%s_bucket{%s%sle=\"%s\"} %lu\n", name, label, sep,
+                           b < METRICS_BOUNDS ? scale->le[b] : "+Inf", (unsigned long)cumulative);
+        }
+    }
+    const char *open = label[0] ? "{" : "";
+    const char *close = label[0] ? "}" : "";
+    if (metrics_want(c)) {
+        char value[24];
+        metrics_printf(c, "%s_sum%s%s%s %s\n", name, open, label, close,
+                       metrics_value(value, sizeof(value), histogram->sum_us, true));
+    }
+    if (metrics_want(c)) {
+        metrics_printf(c, "%s_count%s%s%s %lu\n", name, open, label, close,
+                       (unsigned long)histogram->count);
+    }
+}
+
+static void metrics_walk_histograms(metrics_cursor_t *c, const metrics_snapshot_t *s) {
+    static const char k_requests[] = "clockgen_http_request_duration_seconds";
+    metrics_type(c, k_requests, "histogram");
+    for (size_t r = 0; r < METRICS_ROUTE_COUNT; ++r) {
+        char label[32];
+        snprintf(label, sizeof(label), "route=\"%s\"", k_route_names[r]);
+        metrics_walk_histogram(c, k_requests, label, &s->requests[r], &k_request_scale);
+    }
+
+    static const char k_edges[] = "clockgen_morse_edge_lateness_seconds";
+    metrics_type(c, k_edges, "histogram");
+    metrics_walk_histogram(c, k_edges, "", &s->morse_edge, &k_edge_scale);
+
+    static const char k_loop[] = "clockgen_loop_busy_seconds";
+    metrics_type(c, k_loop, "histogram");
+    metrics_walk_histogram(c, k_loop, "", &s->loop, &k_loop_scale);
+}
+
+size_t metrics_line(const void *snapshot, uint16_t index, char *out, size_t out_len) {
+    if (!snapshot || !out || out_len == 0) {
+        return 0;
+    }
+    metrics_cursor_t c = {.target = index, .out = out, .out_len = out_len};
+    const metrics_snapshot_t *s = (const metrics_snapshot_t *)snapshot;
+    metrics_walk_scalars(&c, s);
+    if (c.at <= index) {
+        metrics_walk_items(&c, s);
+    }
+    if (c.at <= index) {
+        metrics_walk_histograms(&c, s);
+    }
+    return c.len;
+}
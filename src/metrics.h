@@ -0,0 +1,43 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// What a request is counted under; handlers tag their connection with it.
+typedef enum {
+    METRICS_ROUTE_OTHER = 0, // untagged: not found, malformed or timed out
+    METRICS_ROUTE_PAGE,      // the landing page and its form posts
+    METRICS_ROUTE_ASSET,
+    METRICS_ROUTE_API,
+    METRICS_ROUTE_STATUS, // /morse/status and /boot
+    METRICS_ROUTE_STREAM, // /events, /logs and /ws, up to the handover
+    METRICS_ROUTE_METRICS,
+    METRICS_ROUTE_COUNT
+} metrics_route_t;
+
+#define METRICS_BUCKETS 11 // ten bounds and +Inf
+
+typedef struct {
+    uint32_t buckets[METRICS_BUCKETS]; // per bucket; made cumulative when rendered
+    uint32_t count;
+    uint64_t sum_us;
+} metrics_histogram_t;
+
+// Recording is a bucket search and three increments: no lock, no formatting.
+// Each histogram has a single writer; a scrape that interrupts an update may
+// see it half applied.
+uint32_t metrics_now_us(void);
+void metrics_observe_request(metrics_route_t route, uint32_t elapsed_us); // lwIP context
+void metrics_observe_morse_edge(uint32_t late_us);                        // main loop
+void metrics_observe_loop(uint32_t busy_us);                              // main loop
+
+// Copies every figure /metrics shows into out, so a scrape renders from one
+// consistent snapshot. Returns the bytes used, or 0 if out_len is too small.
+// Call with the lwIP lock held.
+size_t metrics_snapshot(void *out, size_t out_len);
+// Renders line index of the exposition from a snapshot, newline included.
+// Returns 0 past the last line, or for a line longer than out_len.
+size_t metrics_line(const void *snapshot, uint16_t index, char *out, size_t out_len);
+
+#endif // METRICS_H
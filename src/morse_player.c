@@ -6,7 +6,10 @@
 
 #include "pico/time.h"
 
+#include "app_state.h"
 #include "logging.h"
+#include "metrics.h"
+#include "scheduler.h"
 #include "signal_controller.h"
 
 #define MORSE_MAX_EVENTS 512
@@ -89,6 +92,7 @@ static void reset_playback(bool cancelled) {
     g_morse.event_count = 0;
     g_morse.next_deadline = get_absolute_time();
     g_morse.status = cancelled ? MORSE_STATUS_STOPPED : MORSE_STATUS_IDLE;
+    app_state_bump();
 }
 
 static bool build_events(const morse_char_entry_t *entries, uint8_t count) {
@@ -166,6 +170,7 @@ bool morse_start(const char *text, uint8_t len, uint16_t wpm, int16_t farnsworth
 
     g_morse.last_wpm = wpm;
     g_morse.last_fwpm = farnsworth_wpm;
+    app_state_bump();
 
     morse_char_entry_t entries[MORSE_MAX_CHARS] = {0};
     uint8_t entry_count = 0;
@@ -243,31 +248,37 @@ bool morse_start(const char *text, uint8_t len, uint16_t wpm, int16_t farnsworth
     g_morse.last_wpm = wpm;
     g_morse.last_fwpm = effective_fw;
     memset(g_morse.error_msg, 0, sizeof(g_morse.error_msg));
+    app_state_bump();
 
-    uint32_t total_ms = 0;
-    for (uint8_t i = 0; i < g_morse.event_count; ++i) {
-        total_ms += g_morse.events[i].duration_ms;
-    }
+    if (LOG_ENABLED(LOG_LEVEL_INFO, LOG_CAT_MORSE)) {
+        uint32_t total_ms = 0;
+        for (uint8_t i = 0; i < g_morse.event_count; ++i) {
+            total_ms += g_morse.events[i].duration_ms;
+        }
 
-    char fwpm_buf[16];
-    if (effective_fw > 0) {
-        snprintf(fwpm_buf, sizeof(fwpm_buf), "%d", effective_fw);
-    } else {
-        snprintf(fwpm_buf, sizeof(fwpm_buf), "off");
-    }
+        char fwpm_buf[16];
+        if (effective_fw > 0) {
+            snprintf(fwpm_buf, sizeof(fwpm_buf), "%d", effective_fw);
+        } else {
+            snprintf(fwpm_buf, sizeof(fwpm_buf), "off");
+        }
 
-    log_info("[MORSE] start text=\"%s\" wpm=%u fwpm=%s total_ms=%u", g_morse.last_text,
-             (unsigned)wpm, fwpm_buf, (unsigned)total_ms);
+        LOG_INFO(LOG_CAT_MORSE, "start text=\"%s\" wpm=%u fwpm=%s total_ms=%u",
+                 g_morse.last_text, (unsigned)wpm, fwpm_buf, (unsigned)total_ms);
+    }
+    scheduler_notify(SCHEDULER_TASK_MORSE);
     return true;
 }
 
 void morse_stop(void) {
     if (!g_morse.playing) {
         g_morse.status = MORSE_STATUS_STOPPED;
+        app_state_bump();
         return;
     }
     g_morse.cancelled = true;
     g_morse.next_deadline = get_absolute_time();
+    scheduler_notify(SCHEDULER_TASK_MORSE);
 }
 
 bool morse_is_playing(void) { return g_morse.playing; }
@@ -278,21 +289,26 @@ void morse_tick(void) {
     }
 
     if (!time_reached(g_morse.next_deadline)) {
+        scheduler_wake_at(SCHEDULER_TASK_MORSE, g_morse.next_deadline);
         return;
     }
 
     if (g_morse.cancelled) {
-        log_info("[MORSE] stopped");
+        LOG_INFO(LOG_CAT_MORSE, "stopped");
         reset_playback(true);
         return;
     }
 
     if (g_morse.event_index >= g_morse.event_count) {
-        log_info("[MORSE] done");
+        LOG_INFO(LOG_CAT_MORSE, "done");
         reset_playback(false);
         return;
     }
 
+    // How late this edge is against its deadline, before keying adds I2C time.
+    const int64_t late_us = absolute_time_diff_us(g_morse.next_deadline, get_absolute_time());
+    metrics_observe_morse_edge(late_us > (int64_t)UINT32_MAX ? UINT32_MAX : (uint32_t)late_us);
+
     morse_event_t event = g_morse.events[g_morse.event_index++];
     signal_controller_key(event.key_on);
 
@@ -301,6 +317,7 @@ void morse_tick(void) {
     } else {
         g_morse.next_deadline = make_timeout_time_ms(event.duration_ms);
     }
+    scheduler_wake_at(SCHEDULER_TASK_MORSE, g_morse.next_deadline);
 }
 
 const char *morse_status_text(void) {
@@ -0,0 +1,139 @@
+#include "scheduler.h"
+
+#include <stddef.h>
+
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "pico/critical_section.h"
+
+#include "metrics.h"
+
+typedef struct {
+    const char *name;
+    scheduler_task_fn fn;
+    uint64_t deadline_us;
+    uint32_t runs;
+    uint64_t total_us;
+    uint32_t max_us;
+} scheduler_task_t;
+
+#define SCHEDULER_NO_DEADLINE UINT64_MAX
+
+static scheduler_task_t g_tasks[SCHEDULER_TASK_COUNT];
+static critical_section_t g_lock;
+static volatile uint32_t g_pending = 0;
+static uint64_t g_idle_us = 0;
+static uint32_t g_wakeups = 0;
+
+void scheduler_init(void) {
+    critical_section_init(&g_lock);
+    for (size_t i = 0; i < SCHEDULER_TASK_COUNT; ++i) {
+        g_tasks[i] = (scheduler_task_t){.deadline_us = SCHEDULER_NO_DEADLINE};
+    }
+    g_pending = 0;
+}
+
+void scheduler_register(scheduler_task_id_t id, const char *name, scheduler_task_fn fn) {
+    if (id >= SCHEDULER_TASK_COUNT) {
+        return;
+    }
+    g_tasks[id].name = name;
+    g_tasks[id].fn = fn;
+}
+
+void scheduler_notify(scheduler_task_id_t id) {
+    if (id >= SCHEDULER_TASK_COUNT) {
+        return;
+    }
+    critical_section_enter_blocking(&g_lock);
+    g_pending |= 1u << id;
+    critical_section_exit(&g_lock);
+    __sev();
+}
+
+void scheduler_wake_at(scheduler_task_id_t id, absolute_time_t deadline) {
+    if (id >= SCHEDULER_TASK_COUNT) {
+        return;
+    }
+    const uint64_t deadline_us = to_us_since_boot(deadline);
+    critical_section_enter_blocking(&g_lock);
+    if (deadline_us < g_tasks[id].deadline_us) {
+        g_tasks[id].deadline_us = deadline_us;
+    }
+    critical_section_exit(&g_lock);
+    __sev();
+}
+
+static void run_task(scheduler_task_t *task) {
+    if (!task->fn) {
+        return;
+    }
+    const uint64_t start = time_us_64();
+    task->fn();
+    const uint64_t elapsed = time_us_64() - start;
+
+    task->runs++;
+    task->total_us += elapsed;
+    if (elapsed > task->max_us) {
+        task->max_us = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+    }
+}
+
+void scheduler_run(void) {
+    while (true) {
+        const uint64_t now = time_us_64();
+        uint64_t next_deadline = SCHEDULER_NO_DEADLINE;
+
+        // Deadlines are one-shot: a task that wants to run again re-arms itself.
+        critical_section_enter_blocking(&g_lock);
+        uint32_t due = g_pending;
+        g_pending = 0;
+        for (size_t i = 0; i < SCHEDULER_TASK_COUNT; ++i) {
+            scheduler_task_t *task = &g_tasks[i];
+            if (task->deadline_us <= now) {
+                due |= 1u << i;
+            }
+            if (due & (1u << i)) {
+                task->deadline_us = SCHEDULER_NO_DEADLINE;
+            } else if (task->deadline_us < next_deadline) {
+                next_deadline = task->deadline_us;
+            }
+        }
+        critical_section_exit(&g_lock);
+
+        if (due) {
+            for (size_t i = 0; i < SCHEDULER_TASK_COUNT; ++i) {
+                if (due & (1u << i)) {
+                    run_task(&g_tasks[i]);
+                }
+            }
+            metrics_observe_loop((uint32_t)(time_us_64() - now));
+            continue;
+        }
+
+        // Anything that notifies us after the snapshot above issues a SEV, so the
+        // WFE inside returns immediately instead of missing the event.
+        const absolute_time_t wake = next_deadline == SCHEDULER_NO_DEADLINE
+                                         ? at_the_end_of_time
+                                         : from_us_since_boot(next_deadline);
+        best_effort_wfe_or_timeout(wake);
+        g_idle_us += time_us_64() - now;
+        g_wakeups++;
+    }
+}
+
+bool scheduler_get_task_stats(scheduler_task_id_t id, scheduler_task_stats_t *out) {
+    if (id >= SCHEDULER_TASK_COUNT || !out) {
+        return false;
+    }
+    const scheduler_task_t *task = &g_tasks[id];
+    out->name = task->name;
+    out->runs = task->runs;
+    out->total_us = task->total_us;
+    out->max_us = task->max_us;
+    return true;
+}
+
+uint64_t scheduler_idle_us(void) { return g_idle_us; }
+
+uint32_t scheduler_wakeups(void) { return g_wakeups; }
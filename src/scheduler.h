@@ -0,0 +1,41 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pico/time.h"
+
+typedef enum {
+    SCHEDULER_TASK_MORSE = 0,
+    SCHEDULER_TASK_SEQUENCE,
+    SCHEDULER_TASK_LOGGING,
+    SCHEDULER_TASK_EVENTS,
+    SCHEDULER_TASK_CONTROL,
+    SCHEDULER_TASK_SCPI,
+    SCHEDULER_TASK_COUNT
+} scheduler_task_id_t;
+
+typedef void (*scheduler_task_fn)(void);
+
+typedef struct {
+    const char *name;
+    uint32_t runs;
+    uint64_t total_us;
+    uint32_t max_us;
+} scheduler_task_stats_t;
+
+void scheduler_init(void);
+void scheduler_register(scheduler_task_id_t id, const char *name, scheduler_task_fn fn);
+
+// Both are safe to call from IRQ context and from either core.
+void scheduler_notify(scheduler_task_id_t id);
+void scheduler_wake_at(scheduler_task_id_t id, absolute_time_t deadline);
+
+void scheduler_run(void);
+
+bool scheduler_get_task_stats(scheduler_task_id_t id, scheduler_task_stats_t *out);
+uint64_t scheduler_idle_us(void);
+uint32_t scheduler_wakeups(void);
+
+#endif // SCHEDULER_H
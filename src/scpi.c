@@ -0,0 +1,926 @@
+#include "scpi.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "build_info.h"
+#include "control_coalesce.h"
+#include "logging.h"
+#include "morse_player.h"
+#include "sequence.h"
+#include "sweep.h"
+
+#define SCPI_FREQ_MIN_HZ 8000u
+#define SCPI_FREQ_MAX_HZ 200000000u
+#define SCPI_WPM_MAX 1000u
+#define SCPI_WPM_DEFAULT 15u
+#define SCPI_RESPONSE_MAX 96 // output room a query needs before it runs
+#define SCPI_ERROR_QUEUE 8
+#define SCPI_MANTISSA_MAX 100000000000000000ull // 10^17, keeps x10 within 64 bits
+
+enum {
+    SCPI_ERR_NONE = 0,
+    SCPI_ERR_SYNTAX = -102,
+    SCPI_ERR_PARAM_NOT_ALLOWED = -108,
+    SCPI_ERR_MISSING_PARAM = -109,
+    SCPI_ERR_UNDEFINED_HEADER = -113,
+    SCPI_ERR_EXECUTION = -200,
+    SCPI_ERR_SETTINGS_CONFLICT = -221,
+    SCPI_ERR_OUT_OF_RANGE = -222,
+    SCPI_ERR_ILLEGAL_VALUE = -224,
+    SCPI_ERR_HARDWARE = -240,
+    SCPI_ERR_QUEUE_OVERFLOW = -350,
+    SCPI_ERR_INPUT_OVERRUN = -363,
+};
+
+typedef struct {
+    int16_t code;
+    const char *text;
+} scpi_error_text_t;
+
+static const scpi_error_text_t k_error_texts[] = {
+    {SCPI_ERR_NONE, "No error"},
+    {SCPI_ERR_SYNTAX, "Syntax error"},
+    {SCPI_ERR_PARAM_NOT_ALLOWED, "Parameter not allowed"},
+    {SCPI_ERR_MISSING_PARAM, "Missing parameter"},
+    {SCPI_ERR_UNDEFINED_HEADER, "Undefined header"},
+    {SCPI_ERR_EXECUTION, "Execution error"},
+    {SCPI_ERR_SETTINGS_CONFLICT, "Settings conflict"},
+    {SCPI_ERR_OUT_OF_RANGE, "Data out of range"},
+    {SCPI_ERR_ILLEGAL_VALUE, "Illegal parameter value"},
+    {SCPI_ERR_HARDWARE, "Hardware error"},
+    {SCPI_ERR_QUEUE_OVERFLOW, "Queue overflow"},
+    {SCPI_ERR_INPUT_OVERRUN, "Input buffer overrun"},
+};
+
+// The job applies the signal, stops Morse, keys the output and then starts
+// Morse, so "MORS:STAT OFF;OUTP ON" works.
+typedef struct {
+    control_signal_request_t signal;
+    bool morse_stop;
+    bool morse_start;
+    uint8_t text_len;
+    uint16_t wpm;
+    char text[MORSE_MAX_CHARS + 1];
+} scpi_request_t;
+
+struct scpi_session {
+    bool in_use;
+    bool line_ready; // line holds a complete message, run up to line_pos
+    bool overrun;    // the current message outgrew the line buffer
+    bool responded;  // the current message has answered a query already
+    uint8_t error_head;
+    uint8_t error_count;
+    uint16_t line_len;
+    uint16_t line_pos;
+    uint16_t out_len;
+    uint16_t morse_wpm;
+    int16_t errors[SCPI_ERROR_QUEUE];
+    sweep_plan_t sweep;
+    control_coalescer_t control;
+    scpi_request_t request;
+    scpi_resume_fn resume;
+    void *user;
+    char line[SCPI_LINE_MAX];
+    char out[SCPI_OUTPUT_MAX];
+};
+
+typedef int16_t (*scpi_handler_fn)(scpi_session_t *s, const char *arg, size_t len);
+
+typedef struct {
+    const char *pattern; // upper case is the short form; [:NODE] may be left out
+    scpi_handler_fn set;
+    scpi_handler_fn query;
+    bool set_waits; // the setter needs everything before it applied first
+} scpi_command_t;
+
+typedef struct {
+    const char *name;
+    int8_t exponent;
+} scpi_unit_t;
+
+static const scpi_unit_t k_frequency_units[] = {
+    {"HZ", 0}, {"KHZ", 3}, {"MHZ", 6}, {NULL, 0},
+};
+
+static const scpi_unit_t k_time_units[] = {
+    {"S", 0}, {"MS", -3}, {"US", -6}, {NULL, 0},
+};
+
+static const scpi_unit_t k_no_units[] = {{NULL, 0}};
+
+static scpi_session_t g_sessions[SCPI_SESSIONS_MAX];
+
+static void scpi_apply(const void *request, control_result_t *result);
+static void scpi_done(control_coalescer_t *c, const control_result_t *result);
+
+static char upper(char c) { return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c; }
+
+static bool is_space(char c) { return c == ' ' || c == '\t'; }
+
+static void trim(const char **text, size_t *len) {
+    while (*len && is_space(**text)) {
+        ++*text;
+        --*len;
+    }
+    while (*len && is_space((*text)[*len - 1])) {
+        --*len;
+    }
+}
+
+static bool equals_nocase(const char *a, size_t a_len, const char *b, size_t b_len) {
+    if (a_len != b_len) {
+        return false;
+    }
+    for (size_t i = 0; i < a_len; ++i) {
+        if (upper(a[i]) != upper(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void scpi_push_error(scpi_session_t *s, int16_t code) {
+    if (s->error_count == SCPI_ERROR_QUEUE) {
+        // The newest entry turns into the overflow marker, as SCPI asks.
+        s->errors[(s->error_head + SCPI_ERROR_QUEUE - 1) % SCPI_ERROR_QUEUE] =
+            SCPI_ERR_QUEUE_OVERFLOW;
+        return;
+    }
+    s->errors[(s->error_head + s->error_count) % SCPI_ERROR_QUEUE] = code;
+    s->error_count++;
+}
+
+static const char *scpi_error_text(int16_t code) {
+    for (size_t i = 0; i < sizeof(k_error_texts) / sizeof(k_error_texts[0]); ++i) {
+        if (k_error_texts[i].code == code) {
+            return k_error_texts[i].text;
+        }
+    }
+    return "Unknown error";
+}
+
+static void scpi_respond(scpi_session_t *s, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// Answers to several queries in one message share a line, separated by ';'.
+static void scpi_respond(scpi_session_t *s, const char *fmt, ...) {
+    size_t room = SCPI_OUTPUT_MAX - s->out_len;
+    if (s->responded && room > 1) {
+        s->out[s->out_len++] = ';';
+        room--;
+    }
+    va_list args;
+    va_start(args, fmt);
+    const int len = vsnprintf(s->out + s->out_len, room, fmt, args);
+    va_end(args);
+    if (len > 0) {
+        s->out_len += (uint16_t)((size_t)len < room ? (size_t)len : room - 1);
+    }
+    s->responded = true;
+}
+
+// <decimal>[E<exponent>][<unit>], scaled by 10^scale and rounded to an
+// integer, so "7.03MHZ" gives 7030000 and "20 MS" at scale 6 gives 20000.
+static int16_t scpi_parse_number(const char *text, size_t len, int scale,
+                                 const scpi_unit_t *units, uint64_t *out) {
+    trim(&text, &len);
+    if (len == 0) {
+        return SCPI_ERR_MISSING_PARAM;
+    }
+    size_t i = 0;
+    if (text[i] == '+') {
+        i++;
+    }
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    bool digits = false;
+    bool fraction = false;
+    for (; i < len; ++i) {
+        if (text[i] == '.' && !fraction) {
+            fraction = true;
+            continue;
+        }
+        if (text[i] < '0' || text[i] > '9') {
+            break;
+        }
+        digits = true;
+        if (mantissa < SCPI_MANTISSA_MAX) {
+            mantissa = mantissa * 10u + (uint64_t)(text[i] - '0');
+            exponent -= fraction ? 1 : 0;
+        } else if (!fraction) {
+            exponent++; // digits beyond the precision kept only scale the value
+        }
+    }
+    if (!digits) {
+        return SCPI_ERR_ILLEGAL_VALUE;
+    }
+    if (i < len && upper(text[i]) == 'E' && i + 1 < len &&
+        (text[i + 1] == '-' || text[i + 1] == '+' || (text[i + 1] >= '0' && text[i + 1] <= '9'))) {
+        i++;
+        const bool negative = text[i] == '-';
+        if (text[i] == '-' || text[i] == '+') {
+            i++;
+        }
+        int value = 0;
+        bool exponent_digits = false;
+        for (; i < len && text[i] >= '0' && text[i] <= '9'; ++i) {
+            value = value < 100 ? value * 10 + (text[i] - '0') : value;
+            exponent_digits = true;
+        }
+        if (!exponent_digits) {
+            return SCPI_ERR_SYNTAX;
+        }
+        exponent += negative ? -value : value;
+    }
+    while (i < len && is_space(text[i])) {
+        i++;
+    }
+    if (i < len) {
+        const scpi_unit_t *unit = units;
+        while (unit->name && !equals_nocase(text + i, len - i, unit->name, strlen(unit->name))) {
+            unit++;
+        }
+        if (!unit->name) {
+            return SCPI_ERR_ILLEGAL_VALUE;
+        }
+        exponent += unit->exponent;
+    }
+
+    exponent += scale;
+    for (; exponent > 0; --exponent) {
+        if (mantissa > UINT64_MAX / 10u) {
+            return SCPI_ERR_OUT_OF_RANGE;
+        }
+        mantissa *= 10u;
+    }
+    for (; exponent < 0 && mantissa; ++exponent) {
+        mantissa = exponent == -1 ? (mantissa + 5u) / 10u : mantissa / 10u;
+    }
+    *out = mantissa;
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_parse_bool(const char *text, size_t len, bool *out) {
+    trim(&text, &len);
+    if (len == 0) {
+        return SCPI_ERR_MISSING_PARAM;
+    }
+    if (equals_nocase(text, len, "ON", 2) || equals_nocase(text, len, "1", 1)) {
+        *out = true;
+    } else if (equals_nocase(text, len, "OFF", 3) || equals_nocase(text, len, "0", 1)) {
+        *out = false;
+    } else {
+        return SCPI_ERR_ILLEGAL_VALUE;
+    }
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_parse_frequency(const char *text, size_t len, uint32_t *out) {
+    uint64_t hz = 0;
+    const int16_t err = scpi_parse_number(text, len, 0, k_frequency_units, &hz);
+    if (err) {
+        return err;
+    }
+    if (hz < SCPI_FREQ_MIN_HZ || hz > SCPI_FREQ_MAX_HZ) {
+        return SCPI_ERR_OUT_OF_RANGE;
+    }
+    *out = (uint32_t)hz;
+    return SCPI_ERR_NONE;
+}
+
+static void scpi_record(scpi_session_t *s) { s->control.recorded = true; }
+
+// --- Command handlers --------------------------------------------------------
+
+static int16_t scpi_idn_query(scpi_session_t *s, const char *arg, size_t len) {
+    (void)arg;
+    (void)len;
+    scpi_respond(s, "clockgen,web_clockgen,0,%s", BUILD_GIT_COMMIT);
+    return SCPI_ERR_NONE;
+}
+
+// Reached only after everything before it has been applied.
+static int16_t scpi_opc_query(scpi_session_t *s, const char *arg, size_t len) {
+    (void)arg;
+    (void)len;
+    scpi_respond(s, "1");
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_wait_set(scpi_session_t *s, const char *arg, size_t len) {
+    (void)s;
+    (void)arg;
+    (void)len;
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_cls_set(scpi_session_t *s, const char *arg, size_t len) {
+    (void)arg;
+    (void)len;
+    s->error_count = 0;
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_error_query(scpi_session_t *s, const char *arg, size_t len) {
+    (void)arg;
+    (void)len;
+    int16_t code = SCPI_ERR_NONE;
+    if (s->error_count) {
+        code = s->errors[s->error_head];
+        s->error_head = (uint8_t)((s->error_head + 1) % SCPI_ERROR_QUEUE);
+        s->error_count--;
+    }
+    scpi_respond(s, "%d,\"%s\"", code, scpi_error_text(code));
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_frequency_set(scpi_session_t *s, const char *arg, size_t len) {
+    uint32_t hz = 0;
+    const int16_t err = scpi_parse_frequency(arg, len, &hz);
+    if (err) {
+        return err;
+    }
+    sweep_stop();
+    sequence_stop();
+    s->request.signal.tune = true;
+    s->request.signal.frequency_hz = hz;
+    scpi_record(s);
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_frequency_query(scpi_session_t *s, const char *arg, size_t len) {
+    (void)arg;
+    (void)len;
+    scpi_respond(s, "%lu", (unsigned long)control_coalesce_state()->frequency_hz);
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_output_set(scpi_session_t *s, const char *arg, size_t len) {
+    bool on = false;
+    const int16_t err = scpi_parse_bool(arg, len, &on);
+    if (err) {
+        return err;
+    }
+    sequence_stop();
+    s->request.signal.key = true;
+    s->request.signal.key_on = on;
+    scpi_record(s);
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_output_query(scpi_session_t *s, const char *arg, size_t len) {
+    (void)arg;
+    (void)len;
+    scpi_respond(s, "%d", control_coalesce_state()->output_enabled ? 1 : 0);
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_drive_set(scpi_session_t *s, const char *arg, size_t len) {
+    uint64_t ma = 0;
+    const int16_t err = scpi_parse_number(arg, len, 0, k_no_units, &ma);
+    if (err) {
+        return err;
+    }
+    if (ma != 2 && ma != 4 && ma != 6 && ma != 8) {
+        return SCPI_ERR_ILLEGAL_VALUE;
+    }
+    sequence_stop();
+    s->request.signal.drive = true;
+    s->request.signal.drive_ma = (uint8_t)ma;
+    scpi_record(s);
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_drive_query(scpi_session_t *s, const char *arg, size_t len) {
+    (void)arg;
+    (void)len;
+    scpi_respond(s, "%u", (unsigned)control_coalesce_state()->drive_ma);
+    return SCPI_ERR_NONE;
+}
+
+// Takes a quoted string; a bare word is accepted too.
+static int16_t scpi_morse_text_set(scpi_session_t *s, const char *arg, size_t len) {
+    trim(&arg, &len);
+    if (len == 0) {
+        return SCPI_ERR_MISSING_PARAM;
+    }
+    if (arg[0] == '"' || arg[0] == '\'') {
+        if (len < 2 || arg[len - 1] != arg[0]) {
+            return SCPI_ERR_SYNTAX;
+        }
+        arg++;
+        len -= 2;
+    }
+    if (len == 0 || len > MORSE_MAX_CHARS) {
+        return SCPI_ERR_OUT_OF_RANGE;
+    }
+    memcpy(s->request.text, arg, len);
+    s->request.text[len] = '\0';
+    s->request.text_len = (uint8_t)len;
+    s->request.wpm = s->morse_wpm;
+    s->request.morse_start = true;
+    s->request.morse_stop = false;
+    scpi_record(s);
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_morse_state_set(scpi_session_t *s, const char *arg, size_t len) {
+    bool on = false;
+    const int16_t err = scpi_parse_bool(arg, len, &on);
+    if (err) {
+        return err;
+    }
+    if (on) {
+        return SCPI_ERR_ILLEGAL_VALUE; // playback starts with MORSe <text>
+    }
+    s->request.morse_stop = true;
+    s->request.morse_start = false;
+    scpi_record(s);
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_morse_state_query(scpi_session_t *s, const char *arg, size_t len) {
+    (void)arg;
+    (void)len;
+    scpi_respond(s, "%d", control_coalesce_state()->morse_playing ? 1 : 0);
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_morse_wpm_set(scpi_session_t *s, const char *arg, size_t len) {
+    uint64_t wpm = 0;
+    const int16_t err = scpi_parse_number(arg, len, 0, k_no_units, &wpm);
+    if (err) {
+        return err;
+    }
+    if (wpm < 1 || wpm > SCPI_WPM_MAX) {
+        return SCPI_ERR_OUT_OF_RANGE;
+    }
+    s->morse_wpm = (uint16_t)wpm;
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_morse_wpm_query(scpi_session_t *s, const char *arg, size_t len) {
+    (void)arg;
+    (void)len;
+    scpi_respond(s, "%u", (unsigned)s->morse_wpm);
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_sweep_start_set(scpi_session_t *s, const char *arg, size_t len) {
+    return scpi_parse_frequency(arg, len, &s->sweep.start_hz);
+}
+
+static int16_t scpi_sweep_start_query(scpi_session_t *s, const char *arg, size_t len) {
+    (void)arg;
+    (void)len;
+    scpi_respond(s, "%lu", (unsigned long)s->sweep.start_hz);
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_sweep_stop_set(scpi_session_t *s, const char *arg, size_t len) {
+    return scpi_parse_frequency(arg, len, &s->sweep.stop_hz);
+}
+
+static int16_t scpi_sweep_stop_query(scpi_session_t *s, const char *arg, size_t len) {
+    (void)arg;
+    (void)len;
+    scpi_respond(s, "%lu", (unsigned long)s->sweep.stop_hz);
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_sweep_step_set(scpi_session_t *s, const char *arg, size_t len) {
+    uint64_t hz = 0;
+    const int16_t err = scpi_parse_number(arg, len, 0, k_frequency_units, &hz);
+    if (err) {
+        return err;
+    }
+    if (hz == 0 || hz > SCPI_FREQ_MAX_HZ) {
+        return SCPI_ERR_OUT_OF_RANGE;
+    }
+    s->sweep.step_hz = (uint32_t)hz;
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_sweep_step_query(scpi_session_t *s, const char *arg, size_t len) {
+    (void)arg;
+    (void)len;
+    scpi_respond(s, "%lu", (unsigned long)s->sweep.step_hz);
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_sweep_dwell_set(scpi_session_t *s, const char *arg, size_t len) {
+    uint64_t us = 0;
+    const int16_t err = scpi_parse_number(arg, len, 6, k_time_units, &us);
+    if (err) {
+        return err;
+    }
+    if (us < SWEEP_DWELL_MIN_US || us > UINT32_MAX) {
+        return SCPI_ERR_OUT_OF_RANGE;
+    }
+    s->sweep.dwell_us = (uint32_t)us;
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_sweep_dwell_query(scpi_session_t *s, const char *arg, size_t len) {
+    (void)arg;
+    (void)len;
+    scpi_respond(s, "%lu.%06lu", (unsigned long)(s->sweep.dwell_us / 1000000u),
+                 (unsigned long)(s->sweep.dwell_us % 1000000u));
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_sweep_state_set(scpi_session_t *s, const char *arg, size_t len) {
+    bool on = false;
+    const int16_t err = scpi_parse_bool(arg, len, &on);
+    if (err) {
+        return err;
+    }
+    if (!on) {
+        sweep_stop();
+        return SCPI_ERR_NONE;
+    }
+    return sweep_start(&s->sweep) ? SCPI_ERR_NONE : SCPI_ERR_SETTINGS_CONFLICT;
+}
+
+static int16_t scpi_sweep_state_query(scpi_session_t *s, const char *arg, size_t len) {
+    (void)arg;
+    (void)len;
+    scpi_respond(s, "%d", sweep_active() ? 1 : 0);
+    return SCPI_ERR_NONE;
+}
+
+// Takes category names separated by commas, ALL or NONE. The mask applies at
+// once: calls outside it are skipped before their arguments are evaluated.
+static int16_t scpi_log_categories_set(scpi_session_t *s, const char *arg, size_t len) {
+    (void)s;
+    trim(&arg, &len);
+    if (len >= 2 && (arg[0] == '"' || arg[0] == '\'') && arg[len - 1] == arg[0]) {
+        arg++;
+        len -= 2;
+        trim(&arg, &len);
+    }
+    if (len == 0) {
+        return SCPI_ERR_MISSING_PARAM;
+    }
+    if (equals_nocase(arg, len, "ALL", 3)) {
+        logging_set_category_mask(0xFFFFFFFFu);
+        return SCPI_ERR_NONE;
+    }
+    if (equals_nocase(arg, len, "NONE", 4)) {
+        logging_set_category_mask(0);
+        return SCPI_ERR_NONE;
+    }
+    uint32_t mask = 0;
+    while (len) {
+        size_t item_len = 0;
+        while (item_len < len && arg[item_len] != ',') {
+            item_len++;
+        }
+        const char *item = arg;
+        size_t trimmed = item_len;
+        trim(&item, &trimmed);
+        log_category_t category = 0;
+        while (category < LOG_CAT_COUNT) {
+            const char *name = logging_category_name(category);
+            if (equals_nocase(item, trimmed, name, strlen(name))) {
+                break;
+            }
+            category++;
+        }
+        if (category == LOG_CAT_COUNT) {
+            return SCPI_ERR_ILLEGAL_VALUE;
+        }
+        mask |= 1u << category;
+        arg += item_len < len ? item_len + 1 : item_len;
+        len -= item_len < len ? item_len + 1 : item_len;
+    }
+    logging_set_category_mask(mask);
+    return SCPI_ERR_NONE;
+}
+
+static int16_t scpi_log_categories_query(scpi_session_t *s, const char *arg, size_t len) {
+    (void)arg;
+    (void)len;
+    char names[SCPI_RESPONSE_MAX - 2];
+    size_t used = 0;
+    const uint32_t mask = logging_category_mask();
+    names[0] = '\0';
+    for (log_category_t category = 0; category < LOG_CAT_COUNT; ++category) {
+        if (mask & (1u << category)) {
+            used += (size_t)snprintf(names + used, sizeof(names) - used, "%s%s",
+                                     used ? "," : "", logging_category_name(category));
+        }
+    }
+    scpi_respond(s, "\"%s\"", names);
+    return SCPI_ERR_NONE;
+}
+
+static const scpi_command_t k_commands[] = {
+    {"*IDN", NULL, scpi_idn_query, false},
+    {"*OPC", scpi_wait_set, scpi_opc_query, true},
+    {"*WAI", scpi_wait_set, NULL, true},
+    {"*CLS", scpi_cls_set, NULL, false},
+    {"SYSTem:ERRor[:NEXT]", NULL, scpi_error_query, false},
+    {"SYSTem:LOG:CATegory", scpi_log_categories_set, scpi_log_categories_query, false},
+    {"FREQuency[:CW]", scpi_frequency_set, scpi_frequency_query, false},
+    {"OUTPut[:STATe]", scpi_output_set, scpi_output_query, false},
+    {"DRIVe", scpi_drive_set, scpi_drive_query, false},
+    {"MORSe:STATe", scpi_morse_state_set, scpi_morse_state_query, false},
+    {"MORSe:WPM", scpi_morse_wpm_set, scpi_morse_wpm_query, false},
+    {"MORSe[:TEXT]", scpi_morse_text_set, NULL, false},
+    {"SWEep:STARt", scpi_sweep_start_set, scpi_sweep_start_query, false},
+    {"SWEep:STOP", scpi_sweep_stop_set, scpi_sweep_stop_query, false},
+    {"SWEep:STEP", scpi_sweep_step_set, scpi_sweep_step_query, false},
+    {"SWEep:DWELl", scpi_sweep_dwell_set, scpi_sweep_dwell_query, false},
+    {"SWEep[:STATe]", scpi_sweep_state_set, scpi_sweep_state_query, true},
+};
+
+#define SCPI_COMMAND_COUNT (sizeof(k_commands) / sizeof(k_commands[0]))
+
+// --- Parsing and execution ---------------------------------------------------
+
+// A header node matches the node's short form (its upper-case prefix) or the
+// whole node, in any case.
+static bool scpi_node_matches(const char *node, size_t node_len, const char *text,
+                              size_t text_len) {
+    size_t short_len = 0;
+    while (short_len < node_len && !(node[short_len] >= 'a' && node[short_len] <= 'z')) {
+        short_len++;
+    }
+    return equals_nocase(node, short_len, text, text_len) ||
+           equals_nocase(node, node_len, text, text_len);
+}
+
+static bool scpi_header_matches(const char *pattern, const char *header, size_t len) {
+    const char *h = header;
+    const char *const end = header + len;
+    if (h < end && *h == ':') {
+        h++;
+    }
+    const char *p = pattern;
+    while (*p) {
+        const bool optional = *p == '[';
+        if (optional) {
+            p++;
+        }
+        if (*p == ':') {
+            p++;
+        }
+        const char *node = p;
+        while (*p && *p != ':' && *p != '[' && *p != ']') {
+            p++;
+        }
+        const size_t node_len = (size_t)(p - node);
+        if (*p == ']') {
+            p++;
+        }
+
+        const char *text = h;
+        while (h < end && *h != ':') {
+            h++;
+        }
+        if (h > text && scpi_node_matches(node, node_len, text, (size_t)(h - text))) {
+            if (h < end) {
+                h++;
+                if (h == end) {
+                    return false; // trailing ':'
+                }
+            }
+            continue;
+        }
+        if (!optional) {
+            return false;
+        }
+        h = text;
+    }
+    return h == end;
+}
+
+static bool scpi_can_continue(scpi_session_t *s) {
+    control_coalesce_post(&s->control);
+    return !s->control.recorded && !s->control.queued;
+}
+
+// Runs one command. Returns false, having changed nothing, when it has to
+// wait for earlier settings to be applied or for output room.
+static bool scpi_execute(scpi_session_t *s, const char *text, size_t len) {
+    trim(&text, &len);
+    if (len == 0) {
+        return true;
+    }
+    size_t header_len = 0;
+    while (header_len < len && !is_space(text[header_len])) {
+        header_len++;
+    }
+    const char *arg = text + header_len;
+    size_t arg_len = len - header_len;
+    trim(&arg, &arg_len);
+    const bool query = text[header_len - 1] == '?';
+    if (query) {
+        header_len--;
+    }
+
+    const scpi_command_t *command = NULL;
+    for (size_t i = 0; i < SCPI_COMMAND_COUNT; ++i) {
+        if (scpi_header_matches(k_commands[i].pattern, text, header_len)) {
+            command = &k_commands[i];
+            break;
+        }
+    }
+    const scpi_handler_fn handler = command ? (query ? command->query : command->set) : NULL;
+    if (!handler) {
+        scpi_push_error(s, SCPI_ERR_UNDEFINED_HEADER);
+        return true;
+    }
+    if (query && arg_len) {
+        scpi_push_error(s, SCPI_ERR_PARAM_NOT_ALLOWED);
+        return true;
+    }
+    if ((query || command->set_waits) && !scpi_can_continue(s)) {
+        return false;
+    }
+    if (query && SCPI_OUTPUT_MAX - s->out_len < SCPI_RESPONSE_MAX + 2) {
+        return false;
+    }
+    const int16_t err = handler(s, arg, arg_len);
+    if (err) {
+        scpi_push_error(s, err);
+    }
+    return true;
+}
+
+// Runs the current message from line_pos on. Returns false when a command
+// has to wait; the same command runs again on the next call.
+static bool scpi_run_line(scpi_session_t *s) {
+    if (s->overrun) {
+        scpi_push_error(s, SCPI_ERR_INPUT_OVERRUN);
+        s->line_pos = s->line_len + 1;
+    }
+    while (s->line_pos <= s->line_len) {
+        size_t end = s->line_pos;
+        char quote = 0;
+        while (end < s->line_len && (quote || s->line[end] != ';')) {
+            if (s->line[end] == '"' || s->line[end] == '\'') {
+                quote = quote == s->line[end] ? 0 : (quote ? quote : s->line[end]);
+            }
+            end++;
+        }
+        if (!scpi_execute(s, s->line + s->line_pos, end - s->line_pos)) {
+            return false;
+        }
+        s->line_pos = (uint16_t)(end + 1);
+    }
+    if (s->responded && s->out_len < SCPI_OUTPUT_MAX) {
+        s->out[s->out_len++] = '\n';
+    }
+    s->line_ready = false;
+    s->overrun = false;
+    s->responded = false;
+    s->line_len = 0;
+    s->line_pos = 0;
+    return true;
+}
+
+size_t scpi_session_feed(scpi_session_t *s, const char *data, size_t len) {
+    if (!s || !s->in_use) {
+        return len;
+    }
+    size_t used = 0;
+    for (;;) {
+        if (s->line_ready && !scpi_run_line(s)) {
+            break;
+        }
+        if (used == len) {
+            // Input ran dry: whatever was recorded goes to the control task now.
+            control_coalesce_post(&s->control);
+            break;
+        }
+        const char c = data[used++];
+        if (c == '\n') {
+            s->line_ready = true;
+        } else if (c != '\r') {
+            if (s->line_len < SCPI_LINE_MAX) {
+                s->line[s->line_len++] = c;
+            } else {
+                s->overrun = true;
+            }
+        }
+    }
+    return used;
+}
+
+bool scpi_session_waiting(const scpi_session_t *s) { return s && s->line_ready; }
+
+const char *scpi_session_output(const scpi_session_t *s, size_t *len) {
+    *len = s ? s->out_len : 0;
+    return s ? s->out : NULL;
+}
+
+void scpi_session_consume_output(scpi_session_t *s, size_t len) {
+    if (!s || len == 0) {
+        return;
+    }
+    if (len >= s->out_len) {
+        s->out_len = 0;
+        return;
+    }
+    memmove(s->out, s->out + len, s->out_len - len);
+    s->out_len = (uint16_t)(s->out_len - len);
+}
+
+// --- Applying settings -------------------------------------------------------
+
+// Main loop, lwIP lock not held.
+static void scpi_apply(const void *request, control_result_t *result) {
+    const scpi_request_t *r = (const scpi_request_t *)request;
+    control_coalesce_apply_settings(&r->signal, result);
+    if (r->morse_stop && morse_is_playing()) {
+        morse_stop();
+    }
+    control_coalesce_apply_key(&r->signal, result);
+    if (r->morse_start) {
+        if (morse_is_playing()) {
+            result->other = CONTROL_STATUS_LOCKED;
+        } else if (!morse_start(r->text, r->text_len, r->wpm, -1)) {
+            result->other = CONTROL_STATUS_FAILED;
+        }
+    }
+}
+
+static int16_t scpi_error_for(uint8_t status) {
+    switch (status) {
+    case CONTROL_STATUS_OK:
+        return SCPI_ERR_NONE;
+    case CONTROL_STATUS_BUS:
+        return SCPI_ERR_HARDWARE;
+    case CONTROL_STATUS_LOCKED:
+        return SCPI_ERR_SETTINGS_CONFLICT;
+    default:
+        return SCPI_ERR_EXECUTION;
+    }
+}
+
+// Queues an error for each part that failed, then lets the session go on.
+static void scpi_done(control_coalescer_t *c, const control_result_t *result) {
+    scpi_session_t *s = (scpi_session_t *)c->user;
+    const uint8_t parts[] = {result->signal, result->key, result->other};
+    for (size_t i = 0; i < sizeof(parts); ++i) {
+        if (parts[i] != CONTROL_STATUS_OK) {
+            scpi_push_error(s, scpi_error_for(parts[i]));
+        }
+    }
+    if (s->resume) {
+        s->resume(s, s->user);
+    }
+}
+
+void scpi_init(void) { memset(g_sessions, 0, sizeof(g_sessions)); }
+
+void scpi_task(void) {
+    for (size_t i = 0; i < SCPI_SESSIONS_MAX; ++i) {
+        if (g_sessions[i].in_use) {
+            control_coalesce_post(&g_sessions[i].control);
+        }
+    }
+}
+
+scpi_session_t *scpi_session_open(scpi_resume_fn resume, void *user) {
+    for (size_t i = 0; i < SCPI_SESSIONS_MAX; ++i) {
+        scpi_session_t *s = &g_sessions[i];
+        if (s->in_use) {
+            continue;
+        }
+        // Jobs of an earlier session on this slot are disowned by generation.
+        const uint8_t generation = s->control.generation;
+        memset(s, 0, sizeof(*s));
+        s->in_use = true;
+        s->control = (control_coalescer_t){
+            .request = &s->request,
+            .request_size = sizeof(s->request),
+            .generation = generation,
+            .apply = scpi_apply,
+            .done = scpi_done,
+            .user = s,
+        };
+        s->morse_wpm = SCPI_WPM_DEFAULT;
+        s->sweep = (sweep_plan_t){
+            .start_hz = 1000000u,
+            .stop_hz = 2000000u,
+            .step_hz = 10000u,
+            .dwell_us = 10000u,
+        };
+        s->resume = resume;
+        s->user = user;
+        return s;
+    }
+    return NULL;
+}
+
+void scpi_session_close(scpi_session_t *s) {
+    if (s) {
+        s->in_use = false;
+        s->control.generation++;
+    }
+}
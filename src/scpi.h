@@ -0,0 +1,57 @@
+#ifndef SCPI_H
+#define SCPI_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A SCPI subset for lab automation:
+//
+//   *IDN?  *OPC?  *OPC  *WAI  *CLS  SYSTem:ERRor[:NEXT]?
+//   SYSTem:LOG:CATegory <name>[,<name>...]|ALL|NONE   SYSTem:LOG:CATegory?
+//   FREQuency[:CW] <hz>[HZ|KHZ|MHZ]     FREQuency[:CW]?
+//   OUTPut[:STATe] ON|OFF|1|0           OUTPut[:STATe]?
+//   DRIVe 2|4|6|8                       DRIVe?
+//   MORSe[:TEXT] "<text>"               MORSe:STATe OFF, MORSe:STATe?
+//   MORSe:WPM <n>                       MORSe:WPM?
+//   SWEep:STARt|STOP|STEP <hz>          SWEep:DWELl <s>[S|MS|US]
+//   SWEep[:STATe] ON|OFF                and a query form of each
+//
+// Input is a byte stream of newline-terminated program messages, with
+// commands separated by ';'. Every header starts from the root. Settings are
+// recorded as they arrive and applied together by the control task, so a
+// script can stream thousands of them without waiting for replies. Queries,
+// *OPC? and anything that depends on the applied state wait until
+// everything before them has been carried out. Errors go to a per-session
+// queue read with SYSTem:ERRor?.
+#define SCPI_SESSIONS_MAX 3
+#define SCPI_LINE_MAX 128
+#define SCPI_OUTPUT_MAX 256
+
+typedef struct scpi_session scpi_session_t;
+
+// Called with the lwIP lock held when a session that was waiting for the
+// control task or for output room can go on.
+typedef void (*scpi_resume_fn)(scpi_session_t *session, void *user);
+
+void scpi_init(void);
+
+// Sessions come from a static pool; returns NULL when all are in use.
+scpi_session_t *scpi_session_open(scpi_resume_fn resume, void *user);
+void scpi_session_close(scpi_session_t *session);
+
+// Runs as much input as possible and returns how many bytes were taken. Less
+// than len means the session is waiting; feed the rest again once resumed.
+// A NULL or empty feed just continues where the session left off.
+size_t scpi_session_feed(scpi_session_t *session, const char *data, size_t len);
+bool scpi_session_waiting(const scpi_session_t *session);
+
+// Responses ready to send, and how many of them the transport took.
+const char *scpi_session_output(const scpi_session_t *session, size_t *len);
+void scpi_session_consume_output(scpi_session_t *session, size_t len);
+
+// Refreshes the state queries report and retries posts the full control
+// queue turned away; call from the control task with the lwIP lock held.
+void scpi_task(void);
+
+#endif // SCPI_H
@@ -0,0 +1,325 @@
+#include "scpi_server.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "lwip/pbuf.h"
+#include "lwip/sys.h"
+#include "lwip/tcp.h"
+#include "pico/cyw43_arch.h"
+#include "pico/stdio_usb.h"
+#include "pico/stdlib.h"
+
+#include "logging.h"
+#include "scheduler.h"
+#include "scpi.h"
+
+#define SCPI_USB_READ_MAX 64
+#define SCPI_POLL_INTERVAL 4 // tcp_poll ticks of 500 ms
+
+typedef struct {
+    bool in_use;
+    struct tcp_pcb *pcb;
+    struct pbuf *rx; // received but not yet taken by the session
+    scpi_session_t *session;
+    u32_t progress_ms; // last input, or last reply bytes acknowledged
+} scpi_conn_t;
+
+static scpi_conn_t g_conns[SCPI_SERVER_TCP_CLIENTS];
+static scpi_server_stats_t g_stats;
+
+static scpi_session_t *g_usb_session = NULL;
+static char g_usb_rx[SCPI_USB_READ_MAX];
+static size_t g_usb_rx_len = 0;
+static size_t g_usb_rx_pos = 0;
+static uint64_t g_usb_last_input_us = 0;
+
+// Returns true when closing failed and the pcb was aborted instead; a
+// callback of that pcb must then return ERR_ABRT.
+static bool scpi_conn_close(scpi_conn_t *conn, bool close_pcb) {
+    if (!conn->in_use) {
+        return false;
+    }
+    bool aborted = false;
+    struct tcp_pcb *pcb = conn->pcb;
+    if (pcb) {
+        tcp_arg(pcb, NULL);
+        tcp_recv(pcb, NULL);
+        tcp_sent(pcb, NULL);
+        tcp_err(pcb, NULL);
+        tcp_poll(pcb, NULL, 0);
+        // Input the session never took is still unacknowledged, and lwIP
+        // resets rather than closes a connection with a shrunken window.
+        if (conn->rx) {
+            tcp_recved(pcb, conn->rx->tot_len);
+        }
+        if (close_pcb && tcp_close(pcb) != ERR_OK) {
+            tcp_abort(pcb);
+            aborted = true;
+        }
+    }
+    if (conn->rx) {
+        pbuf_free(conn->rx);
+    }
+    scpi_session_close(conn->session);
+    *conn = (scpi_conn_t){0};
+    return aborted;
+}
+
+static void scpi_conn_flush(scpi_conn_t *conn) {
+    size_t len = 0;
+    const char *out = scpi_session_output(conn->session, &len);
+    const u16_t room = tcp_sndbuf(conn->pcb);
+    if (len > room) {
+        len = room;
+    }
+    if (len && tcp_write(conn->pcb, out, (u16_t)len, TCP_WRITE_FLAG_COPY) == ERR_OK) {
+        scpi_session_consume_output(conn->session, len);
+        tcp_output(conn->pcb);
+    }
+}
+
+// Feeds buffered input until the session has to wait. Only what it took is
+// acknowledged, so the TCP window opens as fast as commands are carried out.
+static void scpi_conn_service(scpi_conn_t *conn) {
+    scpi_conn_flush(conn);
+    for (;;) {
+        const size_t avail = conn->rx ? conn->rx->len : 0;
+        const size_t used =
+            scpi_session_feed(conn->session, conn->rx ? (const char *)conn->rx->payload : NULL,
+                              avail);
+        if (used) {
+            conn->rx = pbuf_free_header(conn->rx, (u16_t)used);
+            tcp_recved(conn->pcb, (u16_t)used);
+        }
+        scpi_conn_flush(conn);
+        if (!conn->rx || used == 0 || used < avail) {
+            break;
+        }
+    }
+}
+
+static void scpi_conn_resume(scpi_session_t *session, void *user) {
+    (void)session;
+    scpi_conn_t *conn = (scpi_conn_t *)user;
+    if (conn->in_use && conn->pcb) {
+        scpi_conn_service(conn);
+    }
+}
+
+static err_t scpi_conn_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
+    scpi_conn_t *conn = (scpi_conn_t *)arg;
+    if (!p || err != ERR_OK) {
+        if (p) {
+            tcp_recved(pcb, p->tot_len);
+            pbuf_free(p);
+        }
+        return scpi_conn_close(conn, true) ? ERR_ABRT : ERR_OK;
+    }
+    conn->progress_ms = sys_now();
+    if (conn->rx) {
+        pbuf_cat(conn->rx, p);
+    } else {
+        conn->rx = p;
+    }
+    scpi_conn_service(conn);
+    return ERR_OK;
+}
+
+static err_t scpi_conn_sent(void *arg, struct tcp_pcb *pcb, u16_t len) {
+    (void)pcb;
+    (void)len;
+    scpi_conn_t *conn = (scpi_conn_t *)arg;
+    if (conn && conn->in_use) {
+        conn->progress_ms = sys_now();
+        scpi_conn_service(conn);
+    }
+    return ERR_OK;
+}
+
+// A client that vanished would otherwise keep its slot forever. One whose
+// replies stopped being acknowledged is aborted; one merely silent, with
+// nothing in progress, is closed.
+static err_t scpi_conn_poll(void *arg, struct tcp_pcb *pcb) {
+    scpi_conn_t *conn = (scpi_conn_t *)arg;
+    if (!conn || !conn->in_use) {
+        return ERR_OK;
+    }
+    const u32_t silent_ms = sys_now() - conn->progress_ms;
+    size_t pending = 0;
+    scpi_session_output(conn->session, &pending);
+    if ((pending || tcp_sndqueuelen(pcb)) && silent_ms >= SCPI_SERVER_SEND_STALL_MS) {
+        LOG_WARN(LOG_CAT_SYSTEM, "scpi: aborting connection, replies not read");
+        g_stats.send_stalls++;
+        scpi_conn_close(conn, false);
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    if (!pending && !scpi_session_waiting(conn->session) &&
+        silent_ms >= SCPI_SERVER_TCP_IDLE_MS) {
+        LOG_INFO(LOG_CAT_SYSTEM, "scpi: closing idle connection");
+        g_stats.idle_closed++;
+        return scpi_conn_close(conn, true) ? ERR_ABRT : ERR_OK;
+    }
+    scpi_conn_service(conn);
+    return ERR_OK;
+}
+
+static void scpi_conn_err(void *arg, err_t err) {
+    (void)err;
+    scpi_conn_t *conn = (scpi_conn_t *)arg;
+    if (conn) {
+        conn->pcb = NULL;
+        scpi_conn_close(conn, false);
+    }
+}
+
+static err_t scpi_accept(void *arg, struct tcp_pcb *pcb, err_t err) {
+    (void)arg;
+    if (err != ERR_OK || !pcb) {
+        return ERR_VAL;
+    }
+    scpi_conn_t *conn = NULL;
+    for (size_t i = 0; i < SCPI_SERVER_TCP_CLIENTS; ++i) {
+        if (!g_conns[i].in_use) {
+            conn = &g_conns[i];
+            break;
+        }
+    }
+    scpi_session_t *session = conn ? scpi_session_open(scpi_conn_resume, conn) : NULL;
+    if (!session) {
+        LOG_WARN(LOG_CAT_SYSTEM, "scpi: no free session; connection refused");
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+
+    *conn = (scpi_conn_t){
+        .in_use = true,
+        .pcb = pcb,
+        .session = session,
+        .progress_ms = sys_now(),
+    };
+    // Replies are short and scripts wait for them; don't let Nagle hold them.
+    tcp_nagle_disable(pcb);
+    tcp_arg(pcb, conn);
+    tcp_recv(pcb, scpi_conn_recv);
+    tcp_sent(pcb, scpi_conn_sent);
+    tcp_err(pcb, scpi_conn_err);
+    tcp_poll(pcb, scpi_conn_poll, SCPI_POLL_INTERVAL);
+    LOG_INFO(LOG_CAT_SYSTEM, "scpi client connected");
+    return ERR_OK;
+}
+
+static void scpi_usb_resume(scpi_session_t *session, void *user) {
+    (void)session;
+    (void)user;
+    scheduler_notify(SCHEDULER_TASK_SCPI);
+}
+
+static void scpi_usb_chars_available(void *param) {
+    (void)param;
+    scheduler_notify(SCHEDULER_TASK_SCPI);
+}
+
+static void scpi_usb_end(void) {
+    scpi_session_close(g_usb_session);
+    g_usb_session = NULL;
+    g_usb_rx_len = 0;
+    g_usb_rx_pos = 0;
+    logging_set_usb_muted(false);
+}
+
+// Input opens the USB session; from then on the console belongs to it.
+static void scpi_usb_read(void) {
+    g_usb_rx_len = 0;
+    g_usb_rx_pos = 0;
+    int c;
+    while (g_usb_rx_len < SCPI_USB_READ_MAX && (c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT) {
+        g_usb_rx[g_usb_rx_len++] = (char)c;
+    }
+    if (g_usb_rx_len == 0) {
+        return;
+    }
+    g_usb_last_input_us = time_us_64();
+    if (!g_usb_session) {
+        g_usb_session = scpi_session_open(scpi_usb_resume, NULL);
+        if (!g_usb_session) {
+            g_usb_rx_len = 0;
+            return;
+        }
+        logging_set_usb_muted(true);
+    }
+}
+
+static void scpi_usb_flush(void) {
+    size_t len = 0;
+    const char *out = scpi_session_output(g_usb_session, &len);
+    if (len) {
+        fwrite(out, 1, len, stdout);
+        fflush(stdout);
+        scpi_session_consume_output(g_usb_session, len);
+    }
+}
+
+void scpi_server_usb_task(void) {
+    const bool connected = stdio_usb_connected();
+    cyw43_arch_lwip_begin();
+    if (!connected) {
+        if (g_usb_session) {
+            scpi_usb_end();
+        }
+        cyw43_arch_lwip_end();
+        return;
+    }
+
+    do {
+        if (g_usb_rx_pos == g_usb_rx_len) {
+            scpi_usb_read();
+        }
+        if (!g_usb_session) {
+            break;
+        }
+        g_usb_rx_pos += scpi_session_feed(g_usb_session, g_usb_rx + g_usb_rx_pos,
+                                          g_usb_rx_len - g_usb_rx_pos);
+        scpi_usb_flush();
+    } while (g_usb_rx_len && g_usb_rx_pos == g_usb_rx_len);
+
+    if (g_usb_session && !scpi_session_waiting(g_usb_session)) {
+        const uint64_t idle_until = g_usb_last_input_us + (uint64_t)SCPI_SERVER_USB_IDLE_MS * 1000u;
+        if (time_us_64() >= idle_until) {
+            scpi_usb_end();
+        } else {
+            scheduler_wake_at(SCHEDULER_TASK_SCPI, from_us_since_boot(idle_until));
+        }
+    }
+    cyw43_arch_lwip_end();
+}
+
+void scpi_server_get_stats(scpi_server_stats_t *out) {
+    if (out) {
+        *out = g_stats;
+    }
+}
+
+bool scpi_server_start(void) {
+    scpi_init();
+    stdio_set_chars_available_callback(scpi_usb_chars_available, NULL);
+
+    struct tcp_pcb *pcb = tcp_new_ip_type(IPADDR_TYPE_V4);
+    if (!pcb) {
+        LOG_ERROR(LOG_CAT_SYSTEM, "scpi: failed to allocate PCB");
+        return false;
+    }
+    err_t err = tcp_bind(pcb, IP_ADDR_ANY, SCPI_SERVER_PORT);
+    if (err != ERR_OK) {
+        LOG_ERROR(LOG_CAT_SYSTEM, "scpi: bind failed on port %u: %d", (unsigned)SCPI_SERVER_PORT,
+                  err);
+        tcp_close(pcb);
+        return false;
+    }
+    pcb = tcp_listen_with_backlog(pcb, SCPI_SERVER_TCP_CLIENTS);
+    tcp_accept(pcb, scpi_accept);
+    LOG_INFO(LOG_CAT_SYSTEM, "scpi listening on port %u and USB", (unsigned)SCPI_SERVER_PORT);
+    return true;
+}
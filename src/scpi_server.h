@@ -0,0 +1,30 @@
+#ifndef SCPI_SERVER_H
+#define SCPI_SERVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SCPI_SERVER_PORT 5025
+#define SCPI_SERVER_TCP_CLIENTS 2
+#define SCPI_SERVER_USB_IDLE_MS 10000
+#define SCPI_SERVER_TCP_IDLE_MS 300000  // TCP client sending nothing; closed
+#define SCPI_SERVER_SEND_STALL_MS 10000 // replies not acknowledged; aborted
+
+typedef struct {
+    uint32_t idle_closed;
+    uint32_t send_stalls;
+} scpi_server_stats_t;
+
+// Serves SCPI (see scpi.h) on raw TCP port 5025 and on the USB CDC console.
+// The first byte typed on USB opens a session there; the log drain to USB is
+// held back until the session has been idle for SCPI_SERVER_USB_IDLE_MS or
+// the host goes away, so log lines never interleave with replies.
+bool scpi_server_start(void);
+
+// Reads the USB console and answers there; runs as its own scheduler task
+// and takes the lwIP lock itself.
+void scpi_server_usb_task(void);
+
+void scpi_server_get_stats(scpi_server_stats_t *out);
+
+#endif // SCPI_SERVER_H
@@ -0,0 +1,579 @@
+#include "sequence.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "pico/time.h"
+
+#include "logging.h"
+#include "morse_player.h"
+#include "scheduler.h"
+#include "signal_controller.h"
+
+#define SEQUENCE_FREQ_MIN_HZ 8000ull
+#define SEQUENCE_FREQ_MAX_HZ 200000000ull
+#define SEQUENCE_LOOP_PASSES_MAX 65535u
+
+#define SEQUENCE_NO_IMAGE 0xFFu
+#define SEQUENCE_LOOP_END 0xFEu
+
+typedef enum {
+    SEQ_OP_FREQ = 0,
+    SEQ_OP_DRIVE,
+    SEQ_OP_KEY,
+    SEQ_OP_PRESET,
+    SEQ_OP_WAIT,
+    SEQ_OP_LOOP,
+    SEQ_OP_END,
+} sequence_op_t;
+
+typedef struct {
+    uint8_t op;
+    uint16_t line;
+    uint32_t value; // loop: passes, 0 for forever
+} sequence_statement_t;
+
+// One boundary of the compiled program: an image to write, or none, and the
+// time until the next boundary. Entries that close a loop jump back instead.
+typedef struct {
+    uint8_t image;   // index into images, SEQUENCE_NO_IMAGE or SEQUENCE_LOOP_END
+    uint8_t loop_to; // loop ends: first entry of the loop
+    uint16_t passes; // loop ends: 0 for forever
+    uint16_t line;
+    uint32_t delay_us;
+} sequence_entry_t;
+
+typedef struct {
+    uint8_t entry_count;
+    uint8_t image_count;
+    sequence_entry_t entries[SEQUENCE_ENTRIES_MAX];
+    signal_image_t images[SEQUENCE_IMAGES_MAX];
+} sequence_program_t;
+
+typedef struct {
+    uint32_t runs;
+    uint32_t max_late_us;
+    uint64_t total_late_us;
+} sequence_timing_t;
+
+typedef struct {
+    volatile bool running;
+    volatile bool cancelled;
+    uint8_t pc;
+    absolute_time_t next_deadline;
+    uint16_t passes[SEQUENCE_ENTRIES_MAX];
+} sequence_run_t;
+
+typedef struct {
+    signal_settings_t target;  // what the statements so far ask for
+    signal_settings_t written; // what the last image leaves behind
+    bool known;                // false at loop heads, where two paths meet
+    bool dirty;
+    uint8_t depth;
+    uint8_t heads[SEQUENCE_LOOP_DEPTH];
+    uint16_t passes[SEQUENCE_LOOP_DEPTH];
+} sequence_compiler_t;
+
+typedef struct {
+    const char *name;
+    uint32_t scale;
+} sequence_unit_t;
+
+static const struct {
+    const char *name;
+    uint8_t op;
+} k_sequence_commands[] = {
+    {"freq", SEQ_OP_FREQ}, {"drive", SEQ_OP_DRIVE}, {"key", SEQ_OP_KEY}, {"preset", SEQ_OP_PRESET},
+    {"wait", SEQ_OP_WAIT}, {"loop", SEQ_OP_LOOP},   {"end", SEQ_OP_END},
+};
+
+// The first unit is the one assumed when none is given.
+static const sequence_unit_t k_plain_units[] = {{"", 1u}};
+static const sequence_unit_t k_frequency_units[] = {
+    {"", 1u}, {"hz", 1u}, {"khz", 1000u}, {"mhz", 1000000u}};
+static const sequence_unit_t k_time_units[] = {
+    {"", 1000u}, {"us", 1u}, {"ms", 1000u}, {"s", 1000000u}};
+
+static sequence_statement_t g_statements[SEQUENCE_STATEMENTS_MAX];
+static uint8_t g_statement_count = 0;
+static volatile bool g_staged = false; // parsed and not yet taken by sequence_load()
+static char g_parse_error[48];
+
+static sequence_program_t g_program;
+static sequence_timing_t g_timing[SEQUENCE_ENTRIES_MAX];
+static sequence_run_t g_run;
+static volatile sequence_status_t g_status = SEQUENCE_STATUS_IDLE;
+static char g_error[48];
+
+static const char *parse_fail(uint16_t line, const char *why) {
+    snprintf(g_parse_error, sizeof(g_parse_error), "line %u: %s", (unsigned)line, why);
+    return g_parse_error;
+}
+
+// Reads "<digits>[.<digits>][ ]<unit>" and scales it by the unit.
+static bool parse_value(const char *p, const char *end, const sequence_unit_t *units,
+                        size_t unit_count, uint64_t *out) {
+    uint64_t whole = 0;
+    uint64_t frac = 0;
+    uint64_t frac_div = 1;
+    bool digits = false;
+    while (p < end && isdigit((unsigned char)*p)) {
+        whole = whole * 10u + (uint64_t)(*p++ - '0');
+        if (whole > UINT32_MAX) {
+            return false;
+        }
+        digits = true;
+    }
+    if (p < end && *p == '.') {
+        ++p;
+        while (p < end && isdigit((unsigned char)*p)) {
+            if (frac_div < 1000000u) {
+                frac = frac * 10u + (uint64_t)(*p - '0');
+                frac_div *= 10u;
+            }
+            ++p;
+            digits = true;
+        }
+    }
+    while (p < end && *p == ' ') {
+        ++p;
+    }
+    if (!digits) {
+        return false;
+    }
+    const size_t unit_len = (size_t)(end - p);
+    for (size_t i = 0; i < unit_count; ++i) {
+        if (strlen(units[i].name) == unit_len && strncasecmp(units[i].name, p, unit_len) == 0) {
+            *out = whole * units[i].scale + frac * units[i].scale / frac_div;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool word_is(const char *p, const char *end, const char *word) {
+    const size_t len = strlen(word);
+    return (size_t)(end - p) == len && strncasecmp(p, word, len) == 0;
+}
+
+// Parses one trimmed, non-empty statement into g_statements.
+static const char *parse_statement(const char *p, const char *end, uint16_t line) {
+    const char *word_end = p;
+    while (word_end < end && isalpha((unsigned char)*word_end)) {
+        ++word_end;
+    }
+    const char *arg = word_end;
+    while (arg < end && *arg == ' ') {
+        ++arg;
+    }
+    if (arg == word_end && arg < end) {
+        return parse_fail(line, "unknown command");
+    }
+
+    int op = -1;
+    for (size_t i = 0; i < sizeof(k_sequence_commands) / sizeof(k_sequence_commands[0]); ++i) {
+        if (word_is(p, word_end, k_sequence_commands[i].name)) {
+            op = k_sequence_commands[i].op;
+            break;
+        }
+    }
+    if (op < 0) {
+        return parse_fail(line, "unknown command");
+    }
+    if (g_statement_count == SEQUENCE_STATEMENTS_MAX) {
+        return parse_fail(line, "too many statements");
+    }
+
+    uint64_t value = 0;
+    const bool has_arg = arg < end;
+    switch (op) {
+    case SEQ_OP_FREQ:
+        if (!parse_value(arg, end, k_frequency_units, 4, &value)) {
+            return parse_fail(line, "bad frequency");
+        }
+        if (value < SEQUENCE_FREQ_MIN_HZ || value > SEQUENCE_FREQ_MAX_HZ) {
+            return parse_fail(line, "frequency out of range");
+        }
+        break;
+    case SEQ_OP_DRIVE:
+        if (!parse_value(arg, end, k_plain_units, 1, &value) ||
+            (value != 2 && value != 4 && value != 6 && value != 8)) {
+            return parse_fail(line, "drive must be 2, 4, 6 or 8");
+        }
+        break;
+    case SEQ_OP_KEY:
+        if (word_is(arg, end, "on") || word_is(arg, end, "1")) {
+            value = 1;
+        } else if (!word_is(arg, end, "off") && !word_is(arg, end, "0")) {
+            return parse_fail(line, "key must be on or off");
+        }
+        break;
+    case SEQ_OP_PRESET:
+        if (!parse_value(arg, end, k_plain_units, 1, &value) ||
+            value >= SIGNAL_PRESET_COUNT) {
+            return parse_fail(line, "no such preset slot");
+        }
+        break;
+    case SEQ_OP_WAIT:
+        if (!parse_value(arg, end, k_time_units, 4, &value)) {
+            return parse_fail(line, "bad wait");
+        }
+        if (value < SEQUENCE_WAIT_MIN_US || value > UINT32_MAX) {
+            return parse_fail(line, "wait out of range");
+        }
+        break;
+    case SEQ_OP_LOOP:
+        if (has_arg && (!parse_value(arg, end, k_plain_units, 1, &value) || value == 0 ||
+                        value > SEQUENCE_LOOP_PASSES_MAX)) {
+            return parse_fail(line, "passes must be 1-65535");
+        }
+        break;
+    case SEQ_OP_END:
+    default:
+        if (has_arg) {
+            return parse_fail(line, "end takes no value");
+        }
+        break;
+    }
+
+    g_statements[g_statement_count++] =
+        (sequence_statement_t){.op = (uint8_t)op, .line = line, .value = (uint32_t)value};
+    return NULL;
+}
+
+const char *sequence_parse(const char *text, size_t len) {
+    if (g_staged) {
+        return "an earlier upload is still loading";
+    }
+    if (!text) {
+        len = 0;
+    }
+    g_statement_count = 0;
+
+    uint8_t depth = 0;
+    uint16_t loop_lines[SEQUENCE_LOOP_DEPTH];
+    bool loop_waits[SEQUENCE_LOOP_DEPTH];
+    uint16_t line = 1;
+    const char *p = text;
+    const char *end = text + len;
+    while (p < end) {
+        const char *stop = p;
+        while (stop < end && *stop != ';' && *stop != '\n' && *stop != '#') {
+            ++stop;
+        }
+        const char *last = stop;
+        if (stop < end && *stop == '#') {
+            // A comment runs to the end of its line.
+            while (stop < end && *stop != '\n') {
+                ++stop;
+            }
+        }
+        while (p < last && (*p == ' ' || *p == '\t')) {
+            ++p;
+        }
+        while (last > p && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r')) {
+            --last;
+        }
+
+        if (p < last) {
+            const char *error = parse_statement(p, last, line);
+            if (error) {
+                return error;
+            }
+            const sequence_statement_t *statement = &g_statements[g_statement_count - 1];
+            if (statement->op == SEQ_OP_LOOP) {
+                if (depth == SEQUENCE_LOOP_DEPTH) {
+                    return parse_fail(line, "loops nest too deep");
+                }
+                loop_lines[depth] = line;
+                loop_waits[depth++] = false;
+            } else if (statement->op == SEQ_OP_END) {
+                if (depth == 0) {
+                    return parse_fail(line, "end without loop");
+                }
+                // A loop that never waits would spin the main loop.
+                if (!loop_waits[--depth]) {
+                    return parse_fail(loop_lines[depth], "loop has no wait");
+                }
+            } else if (statement->op == SEQ_OP_WAIT) {
+                for (uint8_t i = 0; i < depth; ++i) {
+                    loop_waits[i] = true;
+                }
+            }
+        }
+
+        if (stop < end && *stop == '\n') {
+            ++line;
+        }
+        p = stop < end ? stop + 1 : end;
+    }
+    if (depth > 0) {
+        return parse_fail(loop_lines[depth - 1], "loop without end");
+    }
+    if (g_statement_count == 0) {
+        return "program is empty";
+    }
+    g_staged = true;
+    return NULL;
+}
+
+void sequence_discard(void) { g_staged = false; }
+
+static bool settings_equal(const signal_settings_t *a, const signal_settings_t *b) {
+    return a->frequency_hz == b->frequency_hz && a->drive_ma == b->drive_ma &&
+           a->output_enabled == b->output_enabled;
+}
+
+static const char *load_fail(uint16_t line, const char *why) {
+    snprintf(g_error, sizeof(g_error), "line %u: %s", (unsigned)line, why);
+    return g_error;
+}
+
+// Closes a boundary: an image for whatever changed since the last one, if
+// anything did, and the delay until the next boundary.
+static const char *compile_boundary(sequence_compiler_t *c, uint16_t line, uint32_t delay_us) {
+    uint8_t image = SEQUENCE_NO_IMAGE;
+    if (c->dirty && (!c->known || !settings_equal(&c->written, &c->target))) {
+        if (g_program.image_count == SEQUENCE_IMAGES_MAX) {
+            return load_fail(line, "too many distinct steps");
+        }
+        signal_image_t *compiled = &g_program.images[g_program.image_count];
+        memset(compiled, 0, sizeof(*compiled));
+        if (!signal_controller_compile(c->known ? &c->written : NULL, &c->target, compiled)) {
+            return load_fail(line, "Si5351 cannot produce this step");
+        }
+        // Steps that write the same bytes share one image.
+        image = g_program.image_count;
+        for (uint8_t i = 0; i < g_program.image_count; ++i) {
+            if (memcmp(&g_program.images[i], compiled, sizeof(*compiled)) == 0) {
+                image = i;
+                break;
+            }
+        }
+        if (image == g_program.image_count) {
+            g_program.image_count++;
+        }
+        c->written = c->target;
+        c->known = true;
+    }
+    c->dirty = false;
+    if (image == SEQUENCE_NO_IMAGE && delay_us == 0) {
+        return NULL;
+    }
+    if (g_program.entry_count == SEQUENCE_ENTRIES_MAX) {
+        return load_fail(line, "program too long");
+    }
+    g_program.entries[g_program.entry_count++] =
+        (sequence_entry_t){.image = image, .line = line, .delay_us = delay_us};
+    return NULL;
+}
+
+static const char *compile_program(void) {
+    memset(&g_program, 0, sizeof(g_program));
+    // The first image carries every setting: the chip may not be where the
+    // library last left it if an earlier program was compiled.
+    sequence_compiler_t c = {.known = false};
+    signal_controller_get(&c.target);
+    c.written = c.target;
+
+    for (uint8_t i = 0; i < g_statement_count; ++i) {
+        const sequence_statement_t *s = &g_statements[i];
+        const char *error = NULL;
+        switch (s->op) {
+        case SEQ_OP_FREQ:
+            c.target.frequency_hz = s->value;
+            c.dirty = true;
+            break;
+        case SEQ_OP_DRIVE:
+            c.target.drive_ma = (uint8_t)s->value;
+            c.dirty = true;
+            break;
+        case SEQ_OP_KEY:
+            c.target.output_enabled = s->value != 0;
+            c.dirty = true;
+            break;
+        case SEQ_OP_PRESET:
+            if (!signal_controller_preset_get((uint8_t)s->value, &c.target)) {
+                return load_fail(s->line, "preset slot is empty");
+            }
+            c.dirty = true;
+            break;
+        case SEQ_OP_WAIT:
+            error = compile_boundary(&c, s->line, s->value);
+            break;
+        case SEQ_OP_LOOP:
+            error = compile_boundary(&c, s->line, 0);
+            c.heads[c.depth] = g_program.entry_count;
+            c.passes[c.depth++] = (uint16_t)s->value;
+            c.known = false;
+            break;
+        case SEQ_OP_END:
+            error = compile_boundary(&c, s->line, 0);
+            if (!error && g_program.entry_count == SEQUENCE_ENTRIES_MAX) {
+                error = load_fail(s->line, "program too long");
+            }
+            if (!error) {
+                --c.depth;
+                g_program.entries[g_program.entry_count++] = (sequence_entry_t){
+                    .image = SEQUENCE_LOOP_END,
+                    .loop_to = c.heads[c.depth],
+                    .passes = c.passes[c.depth],
+                    .line = s->line,
+                };
+            }
+            break;
+        default:
+            break;
+        }
+        if (error) {
+            return error;
+        }
+    }
+    return compile_boundary(&c, g_statements[g_statement_count - 1].line, 0);
+}
+
+static void finish(sequence_status_t status) {
+    g_run.running = false;
+    g_run.cancelled = false;
+    g_status = status;
+    LOG_INFO(LOG_CAT_USER, "sequence %s", sequence_status_text());
+}
+
+const char *sequence_load(void) {
+    if (!g_staged) {
+        return "no program uploaded";
+    }
+    if (g_run.running) {
+        finish(SEQUENCE_STATUS_STOPPED);
+    }
+    const char *error = compile_program();
+    g_staged = false;
+    if (error) {
+        g_status = SEQUENCE_STATUS_FAILED;
+        LOG_WARN(LOG_CAT_USER, "sequence not loaded: %s", error);
+        return error;
+    }
+
+    memset(g_timing, 0, sizeof(g_timing));
+    memset(g_run.passes, 0, sizeof(g_run.passes));
+    g_error[0] = '\0';
+    g_run.pc = 0;
+    g_run.cancelled = false;
+    g_run.next_deadline = get_absolute_time();
+    g_run.running = true;
+    g_status = SEQUENCE_STATUS_RUNNING;
+    LOG_INFO(LOG_CAT_USER, "sequence started: %u entries, %u images",
+             (unsigned)g_program.entry_count, (unsigned)g_program.image_count);
+    scheduler_notify(SCHEDULER_TASK_SEQUENCE);
+    return NULL;
+}
+
+void sequence_stop(void) {
+    if (!g_run.running) {
+        return;
+    }
+    g_run.cancelled = true;
+    scheduler_notify(SCHEDULER_TASK_SEQUENCE);
+}
+
+bool sequence_active(void) { return g_run.running; }
+
+static void record_timing(uint8_t entry, absolute_time_t now) {
+    const int64_t late_us = absolute_time_diff_us(g_run.next_deadline, now);
+    const uint32_t late = late_us <= 0                        ? 0u
+                          : late_us > (int64_t)UINT32_MAX ? UINT32_MAX
+                                                          : (uint32_t)late_us;
+    sequence_timing_t *timing = &g_timing[entry];
+    timing->runs++;
+    timing->total_late_us += late;
+    if (late > timing->max_late_us) {
+        timing->max_late_us = late;
+    }
+}
+
+void sequence_tick(void) {
+    if (!g_run.running) {
+        return;
+    }
+    if (g_run.cancelled) {
+        finish(SEQUENCE_STATUS_STOPPED);
+        return;
+    }
+    if (morse_is_playing()) {
+        snprintf(g_error, sizeof(g_error), "Morse keying took the output");
+        finish(SEQUENCE_STATUS_STOPPED);
+        return;
+    }
+
+    // Every boundary that is due runs now; zero delays chain into the next
+    // entry within the same deadline. Loops always wait, so this ends.
+    while (time_reached(g_run.next_deadline)) {
+        if (g_run.pc >= g_program.entry_count) {
+            finish(SEQUENCE_STATUS_DONE);
+            return;
+        }
+        const uint8_t pc = g_run.pc;
+        const sequence_entry_t *entry = &g_program.entries[pc];
+        if (entry->image == SEQUENCE_LOOP_END) {
+            if (entry->passes == 0 || ++g_run.passes[pc] < entry->passes) {
+                g_run.pc = entry->loop_to;
+            } else {
+                g_run.passes[pc] = 0;
+                g_run.pc++;
+            }
+            continue;
+        }
+
+        // Lateness is taken before the image adds its I2C time.
+        record_timing(pc, get_absolute_time());
+        if (entry->image != SEQUENCE_NO_IMAGE &&
+            !signal_controller_write_image(&g_program.images[entry->image])) {
+            snprintf(g_error, sizeof(g_error), "line %u: Si5351 write failed",
+                     (unsigned)entry->line);
+            finish(SEQUENCE_STATUS_FAILED);
+            return;
+        }
+        g_run.next_deadline = delayed_by_us(g_run.next_deadline, entry->delay_us);
+        g_run.pc++;
+    }
+    scheduler_wake_at(SCHEDULER_TASK_SEQUENCE, g_run.next_deadline);
+}
+
+sequence_status_t sequence_status(void) { return g_status; }
+
+const char *sequence_status_text(void) {
+    switch (g_status) {
+    case SEQUENCE_STATUS_RUNNING:
+        return g_run.cancelled ? "stopping" : "running";
+    case SEQUENCE_STATUS_DONE:
+        return "done";
+    case SEQUENCE_STATUS_STOPPED:
+        return "stopped";
+    case SEQUENCE_STATUS_FAILED:
+        return "failed";
+    case SEQUENCE_STATUS_IDLE:
+    default:
+        return "idle";
+    }
+}
+
+const char *sequence_last_error(void) { return g_error; }
+
+size_t sequence_entry_count(void) { return g_program.entry_count; }
+
+size_t sequence_image_count(void) { return g_program.image_count; }
+
+bool sequence_get_step_timing(size_t entry, sequence_step_timing_t *out) {
+    if (entry >= g_program.entry_count || !out ||
+        g_program.entries[entry].image == SEQUENCE_LOOP_END) {
+        return false;
+    }
+    const sequence_timing_t *timing = &g_timing[entry];
+    out->line = g_program.entries[entry].line;
+    out->runs = timing->runs;
+    out->mean_late_us = timing->runs ? (uint32_t)(timing->total_late_us / timing->runs) : 0u;
+    out->max_late_us = timing->max_late_us;
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Timed programs for CLK0, one statement per line or separated by ';':
+//
+//   freq <hz>[hz|khz|mhz]   drive 2|4|6|8   key on|off   preset <slot>
+//   wait <n>[us|ms|s]       loop [passes] ... end    (no passes: forever)
+//
+// Settings given between two waits take effect together at the next one.
+// A program is checked when uploaded, then compiled into Si5351 register
+// images each paired with the delay to the next boundary, and played by its
+// own scheduler task on absolute deadlines, so a late step does not shift
+// the ones after it. The output stays as the last step left it, and a
+// setting changed by hand stops the program (sequence_stop()).
+#define SEQUENCE_STATEMENTS_MAX 64
+#define SEQUENCE_ENTRIES_MAX 64
+#define SEQUENCE_IMAGES_MAX 24
+#define SEQUENCE_LOOP_DEPTH 4
+#define SEQUENCE_WAIT_MIN_US 1000u
+
+typedef enum {
+    SEQUENCE_STATUS_IDLE = 0,
+    SEQUENCE_STATUS_RUNNING,
+    SEQUENCE_STATUS_DONE,
+    SEQUENCE_STATUS_STOPPED,
+    SEQUENCE_STATUS_FAILED
+} sequence_status_t;
+
+// How far behind its deadline one boundary of the compiled program ran.
+typedef struct {
+    uint16_t line;
+    uint32_t runs;
+    uint32_t mean_late_us;
+    uint32_t max_late_us;
+} sequence_step_timing_t;
+
+// Checks program text and keeps it for sequence_load(). Returns NULL, or why
+// the text was refused. Call with the lwIP lock held.
+const char *sequence_parse(const char *text, size_t len);
+// Drops a parsed program that is not going to be loaded.
+void sequence_discard(void);
+
+// Compiles the parsed program and starts it, replacing one that is running.
+// Compiling reads Si5351 registers, so this runs as a control job. Returns
+// NULL, or why the program could not start.
+const char *sequence_load(void);
+void sequence_stop(void);
+bool sequence_active(void);
+void sequence_tick(void);
+
+sequence_status_t sequence_status(void);
+const char *sequence_status_text(void);
+const char *sequence_last_error(void);
+size_t sequence_entry_count(void);
+size_t sequence_image_count(void);
+// False for entries that only close a loop.
+bool sequence_get_step_timing(size_t entry, sequence_step_timing_t *out);
+
+#endif // SEQUENCE_H
@@ -0,0 +1,86 @@
+#include "sha1.h"
+
+#include <string.h>
+
+static uint32_t rol32(uint32_t value, unsigned bits) {
+    return (value << bits) | (value >> (32u - bits));
+}
+
+static void sha1_block(uint32_t state[5], const uint8_t block[64]) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+               ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; ++i) {
+        w[i] = rol32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t e = state[4];
+    for (int i = 0; i < 80; ++i) {
+        uint32_t f;
+        uint32_t k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999u;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1u;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDCu;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6u;
+        }
+        const uint32_t temp = rol32(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rol32(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+void sha1(const void *data, size_t len, uint8_t digest[SHA1_DIGEST_SIZE]) {
+    uint32_t state[5] = {0x67452301u, 0xEFCDAB89u, 0x98BADCFEu, 0x10325476u, 0xC3D2E1F0u};
+    const uint8_t *bytes = (const uint8_t *)data;
+    size_t remaining = len;
+
+    while (remaining >= 64) {
+        sha1_block(state, bytes);
+        bytes += 64;
+        remaining -= 64;
+    }
+
+    // Final block(s): 0x80, zero padding, then the bit length big-endian.
+    uint8_t tail[128] = {0};
+    memcpy(tail, bytes, remaining);
+    tail[remaining] = 0x80;
+    const size_t tail_len = (remaining < 56) ? 64 : 128;
+    const uint64_t bit_len = (uint64_t)len * 8u;
+    for (int i = 0; i < 8; ++i) {
+        tail[tail_len - 1 - i] = (uint8_t)(bit_len >> (8 * i));
+    }
+    sha1_block(state, tail);
+    if (tail_len == 128) {
+        sha1_block(state, tail + 64);
+    }
+
+    for (int i = 0; i < 5; ++i) {
+        digest[i * 4] = (uint8_t)(state[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(state[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(state[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)state[i];
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef SHA1_H
+#define SHA1_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA1_DIGEST_SIZE 20
+
+// One-shot SHA-1, only for the WebSocket handshake. Not for anything that
+// needs collision resistance.
+void sha1(const void *data, size_t len, uint8_t digest[SHA1_DIGEST_SIZE]);
+
+#endif // SHA1_H
@@ -1,5 +1,6 @@
 #include "signal_controller.h"
 
+#include "app_state.h"
 #include "logging.h"
 #include "si5351.h"
 
@@ -9,13 +10,24 @@ typedef struct {
     bool output_enabled;
 } signal_state_t;
 
-static bool g_initialized = false;
+static volatile bool g_initialized = false;
+static volatile bool g_init_running = false;
 static signal_state_t g_state = {
     .frequency_hz = 1008000,
     .drive_ma = 4,
     .output_enabled = false,
 };
 
+static signal_settings_t g_presets[SIGNAL_PRESET_COUNT]; // frequency 0 marks an empty slot
+
+// Set once images were compiled: the library's idea of the PLL then follows
+// the compiled program rather than the chip, so the next apply rewrites it all.
+static bool g_resync = false;
+
+static uint8_t valid_drive(uint8_t drive_ma) {
+    return (drive_ma == 2 || drive_ma == 4 || drive_ma == 6 || drive_ma == 8) ? drive_ma : 4;
+}
+
 static enum si5351_drive map_drive(uint8_t drive_ma) {
     switch (drive_ma) {
     case 2:
@@ -31,62 +43,109 @@ static enum si5351_drive map_drive(uint8_t drive_ma) {
     }
 }
 
-bool signal_controller_init(void) {
-    if (g_initialized) {
-        return true;
-    }
-
-    log_info("[SI5351] controller init requested");
+static bool init_chip(void) {
+    LOG_INFO(LOG_CAT_SI5351, "controller init requested");
 
     bool ok = si5351_init(SI5351_BUS_BASE_ADDR, SI5351_CRYSTAL_LOAD_8PF, SI5351_XTAL_FREQ, 0);
     if (!ok) {
-        log_error("[SI5351] init failed");
+        LOG_ERROR(LOG_CAT_SI5351, "init failed");
         return false;
     }
 
     uint64_t scaled = g_state.frequency_hz * SI5351_FREQ_MULT;
     if (si5351_set_freq(scaled, SI5351_CLK0) != 0) {
-        log_error("[SI5351] default frequency set failed");
+        LOG_ERROR(LOG_CAT_SI5351, "default frequency set failed");
         return false;
     }
     si5351_drive_strength(SI5351_CLK0, map_drive(g_state.drive_ma));
     si5351_output_enable(SI5351_CLK0, 0);
 
     g_initialized = true;
-    log_info("[SI5351] initialized (freq=%llu Hz, drive=%u mA)",
+    LOG_INFO(LOG_CAT_SI5351, "initialized (freq=%llu Hz, drive=%u mA)",
              (unsigned long long)g_state.frequency_hz, g_state.drive_ma);
     return true;
 }
 
-bool signal_controller_set(uint64_t frequency_hz, uint8_t drive_strength_ma) {
-    if (!g_initialized && !signal_controller_init()) {
+bool signal_controller_init(void) {
+    if (g_initialized) {
+        return true;
+    }
+    // Boot probes on core 1 and may still be at it when core 0 gives up
+    // waiting; a second probe would share the bus with it.
+    if (g_init_running) {
         return false;
     }
+    g_init_running = true;
+    const bool ok = init_chip();
+    g_init_running = false;
+    return ok;
+}
 
-    uint8_t drive = drive_strength_ma;
-    if (drive != 2 && drive != 4 && drive != 6 && drive != 8) {
-        drive = 4;
+bool signal_controller_set(uint64_t frequency_hz, uint8_t drive_strength_ma) {
+    const signal_settings_t settings = {
+        .frequency_hz = frequency_hz,
+        .drive_ma = drive_strength_ma,
+        .output_enabled = g_state.output_enabled,
+    };
+    return signal_controller_apply(&settings);
+}
+
+bool signal_controller_apply(const signal_settings_t *settings) {
+    if (!settings || (!g_initialized && !signal_controller_init())) {
+        return false;
     }
 
-    const bool freq_changed = (g_state.frequency_hz != frequency_hz);
+    const uint8_t drive = valid_drive(settings->drive_ma);
+    const bool resync = g_resync;
+    const bool freq_changed = resync || (g_state.frequency_hz != settings->frequency_hz);
     const bool drive_changed = (g_state.drive_ma != drive);
+    const bool output_changed = resync || (g_state.output_enabled != settings->output_enabled);
+    if (!freq_changed && !drive_changed && !output_changed) {
+        return true;
+    }
 
+    // Multisynth parameters, drive and output enable leave in one flush
+    // instead of a read-modify-write transaction per setting.
+    si5351_batch_begin();
+    if (resync) {
+        set_pll(SI5351_PLL_FIXED, SI5351_PLLA);
+    }
     if (freq_changed || drive_changed) {
-        const uint64_t scaled = frequency_hz * SI5351_FREQ_MULT;
+        const uint64_t scaled = settings->frequency_hz * SI5351_FREQ_MULT;
         if (si5351_set_freq(scaled, SI5351_CLK0) != 0) {
-            log_error("[SI5351] failed to set frequency %llu Hz", (unsigned long long)frequency_hz);
+            si5351_batch_cancel();
+            LOG_ERROR(LOG_CAT_SI5351, "failed to set frequency %llu Hz",
+                      (unsigned long long)settings->frequency_hz);
             return false;
         }
-
         si5351_drive_strength(SI5351_CLK0, map_drive(drive));
+    }
+    if (output_changed) {
+        si5351_output_enable(SI5351_CLK0, settings->output_enabled ? 1 : 0);
+    }
+    uint8_t transfers = 0;
+    if (!si5351_batch_commit(&transfers)) {
+        LOG_ERROR(LOG_CAT_SI5351, "register flush failed");
+        return false;
+    }
 
-        uint8_t ctrl_reg = si5351_read(SI5351_CLK0_CTRL);
-        log_info("[SI5351] CLK0 control=0x%02X (requested %u mA)", ctrl_reg, drive);
+    // The register read-back only exists for diagnostics and compiles away
+    // together with the call unless debug logging is built in.
+    LOG_DEBUG(LOG_CAT_SI5351, "CLK0 control=0x%02X (requested %u mA, %u transfers)",
+              si5351_read(SI5351_CLK0_CTRL), drive, (unsigned)transfers);
 
-        g_state.frequency_hz = frequency_hz;
-        g_state.drive_ma = drive;
+    g_resync = false;
+    g_state.frequency_hz = settings->frequency_hz;
+    g_state.drive_ma = drive;
+    g_state.output_enabled = settings->output_enabled;
+    app_state_bump();
 
-        log_info("[USER] freq=%llu Hz, drive=%u mA", (unsigned long long)frequency_hz, drive);
+    if (freq_changed || drive_changed) {
+        LOG_INFO(LOG_CAT_USER, "freq=%llu Hz, drive=%u mA",
+                 (unsigned long long)settings->frequency_hz, drive);
+    }
+    if (output_changed) {
+        LOG_INFO(LOG_CAT_USER, "output=%s", settings->output_enabled ? "on" : "off");
     }
     return true;
 }
@@ -99,7 +158,8 @@ bool signal_controller_enable_output(bool enable) {
     si5351_output_enable(SI5351_CLK0, enable ? 1 : 0);
     if (g_state.output_enabled != enable) {
         g_state.output_enabled = enable;
-        log_info("[USER] output=%s", enable ? "on" : "off");
+        app_state_bump();
+        LOG_INFO(LOG_CAT_USER, "output=%s", enable ? "on" : "off");
     }
     return true;
 }
@@ -124,3 +184,79 @@ uint64_t signal_controller_get_frequency_hz(void) { return g_state.frequency_hz;
 uint8_t signal_controller_get_drive_ma(void) { return g_state.drive_ma; }
 
 bool signal_controller_is_output_enabled(void) { return g_state.output_enabled; }
+
+void signal_controller_get(signal_settings_t *out) {
+    if (out) {
+        out->frequency_hz = g_state.frequency_hz;
+        out->drive_ma = g_state.drive_ma;
+        out->output_enabled = g_state.output_enabled;
+    }
+}
+
+bool signal_controller_preset_store(uint8_t slot, const signal_settings_t *settings) {
+    if (slot >= SIGNAL_PRESET_COUNT || !settings || settings->frequency_hz == 0) {
+        return false;
+    }
+    g_presets[slot] = *settings;
+    return true;
+}
+
+bool signal_controller_preset_get(uint8_t slot, signal_settings_t *out) {
+    if (slot >= SIGNAL_PRESET_COUNT || !out || g_presets[slot].frequency_hz == 0) {
+        return false;
+    }
+    *out = g_presets[slot];
+    return true;
+}
+
+bool signal_controller_compile(const signal_settings_t *from, const signal_settings_t *to,
+                               signal_image_t *out) {
+    if (!to || !out || (!g_initialized && !signal_controller_init())) {
+        return false;
+    }
+
+    const uint8_t drive = valid_drive(to->drive_ma);
+    const bool retune = !from || from->frequency_hz != to->frequency_hz ||
+                        valid_drive(from->drive_ma) != drive;
+    const bool rekey = !from || from->output_enabled != to->output_enabled;
+
+    // Compiling runs si5351_set_freq() in program order, so the library
+    // tracks the PLL the program leaves behind. Below 100 MHz the output
+    // shares the fixed PLL frequency; put it back when it may have moved.
+    si5351_batch_begin();
+    if (retune) {
+        if (!from || from->frequency_hz > SI5351_MULTISYNTH_SHARE_MAX) {
+            set_pll(SI5351_PLL_FIXED, SI5351_PLLA);
+        }
+        if (si5351_set_freq(to->frequency_hz * SI5351_FREQ_MULT, SI5351_CLK0) != 0) {
+            si5351_batch_cancel();
+            return false;
+        }
+        si5351_drive_strength(SI5351_CLK0, map_drive(drive));
+    }
+    if (rekey) {
+        si5351_output_enable(SI5351_CLK0, to->output_enabled ? 1 : 0);
+    }
+    // Placed as if written over the opposite output state, so enabling goes
+    // last and disabling first whatever the image follows.
+    const uint8_t oe_before =
+        rekey ? (uint8_t)(si5351_read(SI5351_OUTPUT_ENABLE_CTRL) ^ (1u << SI5351_CLK0)) : 0;
+    g_resync = true;
+    if (!si5351_batch_export(oe_before, out->bytes, sizeof(out->bytes), &out->len)) {
+        return false;
+    }
+    out->settings = *to;
+    out->settings.drive_ma = drive;
+    return true;
+}
+
+bool signal_controller_write_image(const signal_image_t *image) {
+    if (!image || !g_initialized || !si5351_write_image(image->bytes, image->len, NULL)) {
+        return false;
+    }
+    g_state.frequency_hz = image->settings.frequency_hz;
+    g_state.drive_ma = image->settings.drive_ma;
+    g_state.output_enabled = image->settings.output_enabled;
+    app_state_bump();
+    return true;
+}
@@ -4,6 +4,13 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+typedef struct {
+    uint64_t frequency_hz;
+    uint8_t drive_ma;
+    bool output_enabled;
+} signal_settings_t;
+
+// Fails without touching the bus while another call is still probing.
 bool signal_controller_init(void);
 bool signal_controller_set(uint64_t frequency_hz, uint8_t drive_strength_ma);
 bool signal_controller_enable_output(bool enable);
@@ -12,5 +19,30 @@ void signal_controller_restore_output(void);
 uint64_t signal_controller_get_frequency_hz(void);
 uint8_t signal_controller_get_drive_ma(void);
 bool signal_controller_is_output_enabled(void);
+void signal_controller_get(signal_settings_t *out);
+// Moves to settings with one coalesced register flush; only what differs
+// from the current state is written. Nothing changes if the flush fails.
+bool signal_controller_apply(const signal_settings_t *settings);
+
+// Numbered settings remote clients can store and jump back to. They live in
+// RAM only; getting a slot nothing was stored in fails.
+#define SIGNAL_PRESET_COUNT 8
+bool signal_controller_preset_store(uint8_t slot, const signal_settings_t *settings);
+bool signal_controller_preset_get(uint8_t slot, signal_settings_t *out);
+
+// Register images for programs that run on their own (sequence.c). Compiling
+// reads registers but writes nothing; writing replays the bytes with no math.
+// from is the state the image will be written over, or NULL when that is not
+// known; the image then carries every setting.
+#define SIGNAL_IMAGE_MAX 32
+typedef struct {
+    signal_settings_t settings; // what the output shows once written
+    uint8_t len;
+    uint8_t bytes[SIGNAL_IMAGE_MAX];
+} signal_image_t;
+
+bool signal_controller_compile(const signal_settings_t *from, const signal_settings_t *to,
+                               signal_image_t *out);
+bool signal_controller_write_image(const signal_image_t *image);
 
 #endif // SIGNAL_CONTROLLER_H
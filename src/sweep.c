@@ -0,0 +1,113 @@
+#include "sweep.h"
+
+#include "hardware/timer.h"
+
+#include "control_queue.h"
+#include "logging.h"
+#include "scheduler.h"
+#include "sequence.h"
+#include "signal_controller.h"
+
+#define SWEEP_FREQ_MIN_HZ 8000u
+#define SWEEP_FREQ_MAX_HZ 200000000u
+
+typedef struct {
+    bool active;
+    bool down;
+    uint32_t next_hz;
+    uint32_t stop_hz;
+    uint32_t step_hz;
+    uint32_t dwell_us;
+    uint64_t next_us;
+} sweep_state_t;
+
+static sweep_state_t g_sweep;
+static bool g_step_queued = false; // a step still waiting for the bus is not queued twice
+static bool g_step_pending = false;
+static uint32_t g_pending_hz = 0;
+
+static bool frequency_valid(uint32_t hz) {
+    return hz >= SWEEP_FREQ_MIN_HZ && hz <= SWEEP_FREQ_MAX_HZ;
+}
+
+bool sweep_start(const sweep_plan_t *plan) {
+    if (!plan || !frequency_valid(plan->start_hz) || !frequency_valid(plan->stop_hz) ||
+        plan->step_hz == 0 || plan->dwell_us < SWEEP_DWELL_MIN_US) {
+        return false;
+    }
+    g_sweep = (sweep_state_t){
+        .active = true,
+        .down = plan->stop_hz < plan->start_hz,
+        .next_hz = plan->start_hz,
+        .stop_hz = plan->stop_hz,
+        .step_hz = plan->step_hz,
+        .dwell_us = plan->dwell_us,
+        .next_us = time_us_64(),
+    };
+    sequence_stop();
+    LOG_INFO(LOG_CAT_USER, "sweep %lu..%lu Hz, step %lu Hz, dwell %lu us",
+             (unsigned long)plan->start_hz, (unsigned long)plan->stop_hz,
+             (unsigned long)plan->step_hz, (unsigned long)plan->dwell_us);
+    scheduler_notify(SCHEDULER_TASK_CONTROL);
+    return true;
+}
+
+void sweep_stop(void) {
+    g_sweep.active = false;
+    g_step_pending = false;
+}
+
+bool sweep_active(void) { return g_sweep.active; }
+
+// Main loop, lwIP lock not held.
+static void sweep_job_run(control_job_t *job) {
+    const uint32_t hz = *(const uint32_t *)job->data;
+    signal_controller_set(hz, signal_controller_get_drive_ma());
+}
+
+static void sweep_job_done(control_job_t *job) {
+    (void)job;
+    g_step_queued = false;
+}
+
+// A step that finds the previous one still queued replaces it instead of
+// queueing behind it.
+static void sweep_post(void) {
+    if (g_step_queued || !g_step_pending) {
+        return;
+    }
+    if (control_queue_post(sweep_job_run, sweep_job_done, 0, &g_pending_hz,
+                           sizeof(g_pending_hz))) {
+        g_step_queued = true;
+        g_step_pending = false;
+    }
+}
+
+void sweep_task(void) {
+    sweep_post();
+    if (!g_sweep.active) {
+        return;
+    }
+    const uint64_t now = time_us_64();
+    if (now < g_sweep.next_us) {
+        scheduler_wake_at(SCHEDULER_TASK_CONTROL, from_us_since_boot(g_sweep.next_us));
+        return;
+    }
+    g_pending_hz = g_sweep.next_hz;
+    g_step_pending = true;
+    sweep_post();
+    if (g_sweep.next_hz == g_sweep.stop_hz) {
+        g_sweep.active = false;
+        return;
+    }
+    const uint32_t left =
+        g_sweep.down ? g_sweep.next_hz - g_sweep.stop_hz : g_sweep.stop_hz - g_sweep.next_hz;
+    const uint32_t step = left < g_sweep.step_hz ? left : g_sweep.step_hz;
+    g_sweep.next_hz = g_sweep.down ? g_sweep.next_hz - step : g_sweep.next_hz + step;
+    g_sweep.next_us += g_sweep.dwell_us;
+    if (g_sweep.next_us <= now) {
+        // Fell a whole dwell behind; skip ahead instead of bunching up steps.
+        g_sweep.next_us = now + g_sweep.dwell_us;
+    }
+    scheduler_wake_at(SCHEDULER_TASK_CONTROL, from_us_since_boot(g_sweep.next_us));
+}
@@ -0,0 +1,28 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SWEEP_DWELL_MIN_US 1000u
+
+typedef struct {
+    uint32_t start_hz;
+    uint32_t stop_hz; // may lie below start_hz to sweep downwards
+    uint32_t step_hz;
+    uint32_t dwell_us;
+} sweep_plan_t;
+
+// Steps CLK0 from start to stop, holding each frequency for the dwell. Each
+// step is due one dwell after the previous deadline, so bus time does not
+// stretch the sweep. Starting replaces a running sweep or sequence; returns
+// false when the plan is out of range. Call with the lwIP lock held, like sweep_stop().
+bool sweep_start(const sweep_plan_t *plan);
+void sweep_stop(void);
+bool sweep_active(void);
+
+// Posts the step that is due, if any; call from the control task with the
+// lwIP lock held.
+void sweep_task(void);
+
+#endif // SWEEP_H
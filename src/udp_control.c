@@ -0,0 +1,393 @@
+#include "udp_control.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+
+#include "control_coalesce.h"
+#include "logging.h"
+#include "sequence.h"
+#include "signal_controller.h"
+#include "sweep.h"
+
+#define UDP_CONTROL_FREQ_MIN_HZ 8000u
+#define UDP_CONTROL_FREQ_MAX_HZ 200000000u
+#define UDP_CONTROL_CLIENTS 4
+#define UDP_CONTROL_PAYLOAD_MAX 16
+
+typedef struct {
+    bool in_use;
+    bool pending;     // a command recorded but not yet handed to the queue
+    bool pending_ack; // ... and one of those asked for a reply
+    bool due;         // a command in the job being applied
+    bool due_ack;
+    uint8_t pending_opcode;
+    uint8_t due_opcode;
+    uint8_t done_opcode;
+    uint8_t status; // outcome of done_seq
+    u16_t port;
+    ip_addr_t addr;
+    uint32_t seq;         // newest sequence number accepted
+    uint32_t pending_seq; // newest command waiting for the queue
+    uint32_t due_seq;     // newest command the queued job covers
+    uint32_t done_seq;    // newest command finished
+    uint32_t last_used;
+} udp_client_t;
+
+static const uint8_t k_payload_len[] = {
+    [UDP_CONTROL_PING] = 0,
+    [UDP_CONTROL_TUNE] = 4,
+    [UDP_CONTROL_DRIVE] = 1,
+    [UDP_CONTROL_KEY] = 1,
+    [UDP_CONTROL_PRESET_STORE] = 7,
+    [UDP_CONTROL_PRESET_RECALL] = 1,
+    [UDP_CONTROL_SWEEP] = 16,
+};
+
+#define UDP_CONTROL_OPCODE_MAX (sizeof(k_payload_len) / sizeof(k_payload_len[0]))
+
+static struct udp_pcb *g_pcb = NULL;
+static udp_client_t g_clients[UDP_CONTROL_CLIENTS];
+static uint32_t g_use_counter = 0;
+static control_signal_request_t g_request;
+static udp_control_stats_t g_stats;
+
+static void udp_posted(control_coalescer_t *c);
+static void udp_done(control_coalescer_t *c, const control_result_t *result);
+
+static control_coalescer_t g_coalescer = {
+    .request = &g_request,
+    .request_size = sizeof(g_request),
+    .apply = control_coalesce_apply_signal,
+    .posted = udp_posted,
+    .done = udp_done,
+};
+
+static uint32_t get_u32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put_u32(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+static bool seq_after(uint32_t a, uint32_t b) { return (int32_t)(a - b) > 0; }
+
+static bool frequency_valid(uint32_t hz) {
+    return hz >= UDP_CONTROL_FREQ_MIN_HZ && hz <= UDP_CONTROL_FREQ_MAX_HZ;
+}
+
+static bool drive_valid(uint8_t ma) { return ma == 2 || ma == 4 || ma == 6 || ma == 8; }
+
+static void udp_reply(const ip_addr_t *addr, u16_t port, uint8_t opcode, uint8_t status,
+                      uint32_t seq) {
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, UDP_CONTROL_REPLY_LEN, PBUF_RAM);
+    if (!p) {
+        return;
+    }
+    uint8_t *out = (uint8_t *)p->payload;
+    out[0] = UDP_CONTROL_MAGIC;
+    out[1] = UDP_CONTROL_VERSION;
+    out[2] = (uint8_t)(opcode | UDP_CONTROL_REPLY_BIT);
+    out[3] = status;
+    const control_signal_state_t *state = control_coalesce_state();
+    put_u32(out + 4, seq);
+    put_u32(out + 8, state->frequency_hz);
+    out[12] = state->drive_ma;
+    out[13] = state->output_enabled ? 1 : 0;
+    out[14] = sweep_active() ? 1 : 0;
+    out[15] = 0;
+    if (udp_sendto(g_pcb, p, addr, port) == ERR_OK) {
+        g_stats.replies++;
+    }
+    pbuf_free(p);
+}
+
+static void udp_client_reply(const udp_client_t *client) {
+    udp_reply(&client->addr, client->port, client->done_opcode, client->status,
+              client->done_seq);
+}
+
+// Senders are told apart by address and port. A new one takes a free slot or
+// the least recently heard from.
+static udp_client_t *udp_client_get(const ip_addr_t *addr, u16_t port, uint32_t seq) {
+    udp_client_t *oldest = &g_clients[0];
+    for (size_t i = 0; i < UDP_CONTROL_CLIENTS; ++i) {
+        udp_client_t *client = &g_clients[i];
+        if (client->in_use && client->port == port && ip_addr_cmp(&client->addr, addr)) {
+            client->last_used = ++g_use_counter;
+            return client;
+        }
+        if (!client->in_use) {
+            oldest = client;
+        } else if (oldest->in_use && client->last_used < oldest->last_used) {
+            oldest = client;
+        }
+    }
+    // Starts one below the first sequence number so that command is new.
+    *oldest = (udp_client_t){
+        .in_use = true,
+        .port = port,
+        .seq = seq - 1,
+        .done_seq = seq - 1,
+        .last_used = ++g_use_counter,
+    };
+    ip_addr_copy(oldest->addr, *addr);
+    return oldest;
+}
+
+// Checks one command and records what it asks for. Returns the outcome, with
+// *queued set when it waits for the control task to program the Si5351.
+static uint8_t udp_record(uint8_t opcode, const uint8_t *payload, bool *queued) {
+    *queued = false;
+    signal_settings_t preset;
+    switch (opcode) {
+    case UDP_CONTROL_TUNE: {
+        const uint32_t hz = get_u32(payload);
+        if (!frequency_valid(hz)) {
+            return UDP_CONTROL_ERR_RANGE;
+        }
+        sweep_stop();
+        g_request.tune = true;
+        g_request.frequency_hz = hz;
+        break;
+    }
+    case UDP_CONTROL_DRIVE:
+        if (!drive_valid(payload[0])) {
+            return UDP_CONTROL_ERR_RANGE;
+        }
+        g_request.drive = true;
+        g_request.drive_ma = payload[0];
+        break;
+    case UDP_CONTROL_KEY:
+        if (payload[0] > 1) {
+            return UDP_CONTROL_ERR_RANGE;
+        }
+        g_request.key = true;
+        g_request.key_on = payload[0] == 1;
+        break;
+    case UDP_CONTROL_PRESET_STORE:
+        preset = (signal_settings_t){
+            .frequency_hz = get_u32(payload + 1),
+            .drive_ma = payload[5],
+            .output_enabled = payload[6] == 1,
+        };
+        if (!frequency_valid((uint32_t)preset.frequency_hz) || !drive_valid(preset.drive_ma) ||
+            payload[6] > 1 || !signal_controller_preset_store(payload[0], &preset)) {
+            return UDP_CONTROL_ERR_RANGE;
+        }
+        return UDP_CONTROL_OK;
+    case UDP_CONTROL_PRESET_RECALL:
+        if (!signal_controller_preset_get(payload[0], &preset)) {
+            return UDP_CONTROL_ERR_NO_PRESET;
+        }
+        sweep_stop();
+        g_request = (control_signal_request_t){
+            .tune = true,
+            .drive = true,
+            .key = true,
+            .key_on = preset.output_enabled,
+            .drive_ma = preset.drive_ma,
+            .frequency_hz = preset.frequency_hz,
+        };
+        break;
+    case UDP_CONTROL_SWEEP: {
+        const sweep_plan_t plan = {
+            .start_hz = get_u32(payload),
+            .stop_hz = get_u32(payload + 4),
+            .step_hz = get_u32(payload + 8),
+            .dwell_us = get_u32(payload + 12),
+        };
+        if (plan.step_hz == 0) {
+            sweep_stop();
+            return UDP_CONTROL_OK;
+        }
+        return sweep_start(&plan) ? UDP_CONTROL_OK : UDP_CONTROL_ERR_RANGE;
+    }
+    default:
+        return UDP_CONTROL_ERR_MALFORMED;
+    }
+    *queued = true;
+    return UDP_CONTROL_OK;
+}
+
+static void udp_control_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+                             const ip_addr_t *addr, u16_t port) {
+    (void)arg;
+    (void)pcb;
+    if (!p) {
+        return;
+    }
+    g_stats.packets++;
+    uint8_t msg[UDP_CONTROL_HEADER_LEN + UDP_CONTROL_PAYLOAD_MAX];
+    const u16_t len = pbuf_copy_partial(p, msg, sizeof(msg), 0);
+    const bool whole = len == p->tot_len;
+    pbuf_free(p);
+
+    const uint8_t opcode = len >= UDP_CONTROL_HEADER_LEN ? msg[2] : 0;
+    if (!whole || len < UDP_CONTROL_HEADER_LEN || msg[0] != UDP_CONTROL_MAGIC ||
+        msg[1] != UDP_CONTROL_VERSION || opcode == 0 || opcode >= UDP_CONTROL_OPCODE_MAX ||
+        len != UDP_CONTROL_HEADER_LEN + k_payload_len[opcode]) {
+        g_stats.malformed++;
+        return;
+    }
+    const uint32_t seq = get_u32(msg + 4);
+    const bool ack = (msg[3] & UDP_CONTROL_FLAG_ACK) != 0;
+
+    // PING changes nothing, so it bypasses sequence tracking entirely.
+    if (opcode == UDP_CONTROL_PING) {
+        udp_reply(addr, port, opcode, UDP_CONTROL_OK, seq);
+        return;
+    }
+
+    udp_client_t *client = udp_client_get(addr, port, seq);
+    if (seq == client->seq) {
+        // A retry: answer it once the original is finished, never run it again.
+        g_stats.retries++;
+        if (client->done_seq == seq) {
+            if (ack) {
+                udp_client_reply(client);
+            }
+        } else if (client->pending && client->pending_seq == seq) {
+            client->pending_ack = client->pending_ack || ack;
+        } else if (client->due && client->due_seq == seq) {
+            client->due_ack = client->due_ack || ack;
+        }
+        return;
+    }
+    if (!seq_after(seq, client->seq)) {
+        g_stats.stale++;
+        if (ack) {
+            udp_reply(addr, port, opcode, UDP_CONTROL_ERR_STALE, seq);
+        }
+        return;
+    }
+
+    g_stats.commands++;
+    client->seq = seq;
+    bool queued = false;
+    const uint8_t status = udp_record(opcode, msg + UDP_CONTROL_HEADER_LEN, &queued);
+    if (queued) {
+        // Every queued command changes CLK0 by hand, which ends a sequence.
+        sequence_stop();
+        client->pending = true;
+        client->pending_ack = client->pending_ack || ack;
+        client->pending_opcode = opcode;
+        client->pending_seq = seq;
+        g_coalescer.recorded = true;
+        control_coalesce_post(&g_coalescer);
+        return;
+    }
+    if (status != UDP_CONTROL_OK) {
+        g_stats.rejected++;
+    }
+    client->done_seq = seq;
+    client->done_opcode = opcode;
+    client->status = status;
+    if (ack) {
+        udp_client_reply(client);
+    }
+}
+
+static uint8_t udp_status(uint8_t status) {
+    switch (status) {
+    case CONTROL_STATUS_OK:
+        return UDP_CONTROL_OK;
+    case CONTROL_STATUS_LOCKED:
+        return UDP_CONTROL_ERR_LOCKED;
+    default:
+        return UDP_CONTROL_ERR_BUS;
+    }
+}
+
+// The outcome of the parts of the job a command asked for; a preset recall
+// asks for both and reports the first that failed.
+static uint8_t udp_job_status(const control_result_t *result, uint8_t opcode) {
+    switch (opcode) {
+    case UDP_CONTROL_TUNE:
+    case UDP_CONTROL_DRIVE:
+        return udp_status(result->signal);
+    case UDP_CONTROL_KEY:
+        return udp_status(result->key);
+    default:
+        return udp_status(result->signal != CONTROL_STATUS_OK ? result->signal : result->key);
+    }
+}
+
+static void udp_posted(control_coalescer_t *c) {
+    (void)c;
+    g_stats.jobs++;
+    for (size_t i = 0; i < UDP_CONTROL_CLIENTS; ++i) {
+        udp_client_t *client = &g_clients[i];
+        if (client->in_use && client->pending) {
+            client->pending = false;
+            client->due = true;
+            client->due_ack = client->pending_ack;
+            client->pending_ack = false;
+            client->due_opcode = client->pending_opcode;
+            client->due_seq = client->pending_seq;
+        }
+    }
+}
+
+static void udp_done(control_coalescer_t *c, const control_result_t *result) {
+    (void)c;
+    if (result->signal != CONTROL_STATUS_OK || result->key != CONTROL_STATUS_OK) {
+        LOG_WARN(LOG_CAT_USER, "udp control: job failed (signal %u, key %u)",
+                 (unsigned)udp_status(result->signal), (unsigned)udp_status(result->key));
+    }
+
+    for (size_t i = 0; i < UDP_CONTROL_CLIENTS; ++i) {
+        udp_client_t *client = &g_clients[i];
+        if (!client->in_use || !client->due) {
+            continue;
+        }
+        client->due = false;
+        if (!seq_after(client->due_seq, client->done_seq)) {
+            continue;
+        }
+        client->done_seq = client->due_seq;
+        client->done_opcode = client->due_opcode;
+        client->status = udp_job_status(result, client->due_opcode);
+        if (client->status != UDP_CONTROL_OK) {
+            g_stats.rejected++;
+        }
+        if (client->due_ack) {
+            udp_client_reply(client);
+        }
+    }
+}
+
+void udp_control_task(void) { control_coalesce_post(&g_coalescer); }
+
+bool udp_control_start(void) {
+    memset(g_clients, 0, sizeof(g_clients));
+    g_stats = (udp_control_stats_t){0};
+
+    g_pcb = udp_new_ip_type(IPADDR_TYPE_V4);
+    if (!g_pcb) {
+        LOG_ERROR(LOG_CAT_SYSTEM, "udp control: failed to allocate PCB");
+        return false;
+    }
+    if (udp_bind(g_pcb, IP_ADDR_ANY, UDP_CONTROL_PORT) != ERR_OK) {
+        LOG_ERROR(LOG_CAT_SYSTEM, "udp control: bind failed on port %u",
+                  (unsigned)UDP_CONTROL_PORT);
+        udp_remove(g_pcb);
+        g_pcb = NULL;
+        return false;
+    }
+    udp_recv(g_pcb, udp_control_recv, NULL);
+    LOG_INFO(LOG_CAT_SYSTEM, "udp control listening on port %u", (unsigned)UDP_CONTROL_PORT);
+    return true;
+}
+
+void udp_control_get_stats(udp_control_stats_t *out) {
+    if (out) {
+        *out = g_stats;
+    }
+}
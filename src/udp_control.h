@@ -0,0 +1,67 @@
+#ifndef UDP_CONTROL_H
+#define UDP_CONTROL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Binary control protocol on UDP for measurement rigs. One datagram carries
+// one command; multi-byte fields are big-endian.
+//
+//   request  magic 'C' | version | opcode | flags | seq:u32 | payload
+//   reply    magic 'C' | version | opcode|0x80 | status | seq:u32 |
+//            hz:u32 | drive_ma:u8 | output:u8 | sweeping:u8 | 0
+//
+// Sequence numbers are per sender and must increase. A repeated sequence
+// number is a retry: it is never carried out twice, and its reply is sent
+// again; an older one is answered with ERR_STALE. Replies are sent once a
+// command is finished, and only when UDP_CONTROL_FLAG_ACK is set (PING always
+// answers). Commands arriving faster than the Si5351 can be programmed
+// coalesce, and the reply to the newest covers the ones it superseded. Its
+// status is that of its own command: keying refused during Morse playback
+// does not fail a tune carried out in the same Si5351 update.
+#define UDP_CONTROL_PORT 5005
+#define UDP_CONTROL_MAGIC 0x43
+#define UDP_CONTROL_VERSION 1
+#define UDP_CONTROL_HEADER_LEN 8
+#define UDP_CONTROL_REPLY_LEN 16
+#define UDP_CONTROL_REPLY_BIT 0x80
+#define UDP_CONTROL_FLAG_ACK 0x01
+
+typedef enum {
+    UDP_CONTROL_PING = 1,          // no payload; replies with the current state
+    UDP_CONTROL_TUNE = 2,          // hz:u32
+    UDP_CONTROL_DRIVE = 3,         // ma:u8, 2/4/6/8
+    UDP_CONTROL_KEY = 4,           // on:u8
+    UDP_CONTROL_PRESET_STORE = 5,  // slot:u8 | hz:u32 | ma:u8 | output:u8
+    UDP_CONTROL_PRESET_RECALL = 6, // slot:u8
+    UDP_CONTROL_SWEEP = 7,         // start:u32 | stop:u32 | step:u32 | dwell_us:u32; step 0 stops
+} udp_control_opcode_t;
+
+typedef enum {
+    UDP_CONTROL_OK = 0,
+    UDP_CONTROL_ERR_MALFORMED,
+    UDP_CONTROL_ERR_RANGE,
+    UDP_CONTROL_ERR_NO_PRESET,
+    UDP_CONTROL_ERR_LOCKED, // output held by Morse playback
+    UDP_CONTROL_ERR_BUS,    // Si5351 programming failed
+    UDP_CONTROL_ERR_STALE,  // older than a sequence number already seen
+} udp_control_status_t;
+
+typedef struct {
+    uint32_t packets;
+    uint32_t malformed;
+    uint32_t commands;
+    uint32_t retries;
+    uint32_t stale;
+    uint32_t rejected; // answered with an error status
+    uint32_t replies;
+    uint32_t jobs; // Si5351 updates the commands coalesced into
+} udp_control_stats_t;
+
+bool udp_control_start(void);
+// Starts whatever commands are waiting; call from the control task with the
+// lwIP lock held.
+void udp_control_task(void);
+void udp_control_get_stats(udp_control_stats_t *out);
+
+#endif // UDP_CONTROL_H
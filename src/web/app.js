@@ -0,0 +1,261 @@
+let submitTimer=null;
+let tuneInFlight=false;
+let tunePending=false;
+let applyStateHook=null;
+let controlSocket=null;
+let controlSeq=0;
+const controlSent={t:null,d:null};
+function controlSend(op,value){
+  if(controlSent[op]===value) return;
+  controlSent[op]=value;
+  controlSocket.send(op+value+'@'+(++controlSeq));
+}
+// Tuning goes over the WebSocket while it is up: no debounce, no reload.
+// Out-of-range values still take the form path, which clamps and reports.
+function sendControl(){
+  if(!controlSocket||controlSocket.readyState!==1) return false;
+  const form=document.getElementById('signal-form');
+  if(!form) return false;
+  const freq=parseInt(form.elements.frequency.value,10);
+  if(!(freq>=8000&&freq<=200000000)) return false;
+  controlSend('t',String(freq));
+  controlSend('d',form.elements.drive.value);
+  return true;
+}
+function openControlSocket(){
+  if(typeof WebSocket!=='function') return;
+  const ws=new WebSocket((location.protocol==='https:'?'wss://':'ws://')+location.host+'/ws');
+  ws.onopen=function(){controlSocket=ws;controlSent.t=null;controlSent.d=null;};
+  ws.onclose=function(){
+    if(controlSocket===ws) controlSocket=null;
+    setTimeout(openControlSocket,2000);
+  };
+}
+function putJson(path,data){
+  return fetch(path,{method:'PUT',headers:{'Content-Type':'application/json'},body:JSON.stringify(data)}).then(function(resp){
+    if(!resp.ok) throw new Error(path);
+    return resp.json();
+  });
+}
+// Without the WebSocket, tuning is a small JSON PUT whose answer patches the
+// page. One request at a time; whatever changed meanwhile goes out next.
+function sendTune(){
+  if(typeof fetch!=='function') return false;
+  const form=document.getElementById('signal-form');
+  if(!form) return false;
+  const freq=parseInt(form.elements.frequency.value,10);
+  if(!(freq>=8000&&freq<=200000000)) return false;
+  if(tuneInFlight){tunePending=true;return true;}
+  tuneInFlight=true;
+  tunePending=false;
+  putJson('/api/v1/signal',{frequency_hz:freq,drive_ma:parseInt(form.elements.drive.value,10)}).then(function(data){
+    tuneInFlight=false;
+    if(tunePending){sendTune();}
+    else if(applyStateHook){applyStateHook(data);}
+  }).catch(function(){
+    // The full page reports whatever went wrong.
+    tuneInFlight=false;
+    form.submit();
+  });
+  return true;
+}
+function scheduleSubmit(){
+  if(submitTimer) clearTimeout(submitTimer);
+  submitTimer=null;
+  if(sendControl()||sendTune()) return;
+  submitTimer=setTimeout(function(){
+    submitTimer=null;
+    const form=document.getElementById('signal-form');
+    if(form) form.requestSubmit();
+  },150);
+}
+window.addEventListener('DOMContentLoaded',function(){
+  openControlSocket();
+  const spinner=document.getElementById('frequency-spinner');
+  let suppressSubmit=false;
+  let manualEdit=false;
+  const display=document.getElementById('frequency-display');
+  const formatWithSeparators=function(value){
+    if(value===undefined||value===null) return '';
+    const digits=String(value).replace(/[^0-9]/g,'');
+    if(!digits.length) return '';
+    return digits.replace(/\B(?=(\d{3})+(?!\d))/g,'.');
+  };
+  const syncDisplay=function(){
+    if(display&&spinner){
+      display.textContent=formatWithSeparators(spinner.value);
+    }
+  };
+  const updateStep=function(stepValue){
+    if(!spinner) return;
+    const numeric=parseInt(stepValue,10);
+    if(numeric>=1){
+      spinner.step=numeric;
+    }
+  };
+  if(spinner){
+    spinner.addEventListener('focus',function(){
+      manualEdit=false;
+      if(!suppressSubmit){
+        syncDisplay();
+      }
+    });
+    spinner.addEventListener('pointerdown',function(){
+      manualEdit=false;
+      suppressSubmit=false;
+    });
+    spinner.addEventListener('keydown',function(event){
+      if(event.key==='Enter'){
+        event.preventDefault();
+        manualEdit=false;
+        suppressSubmit=false;
+        syncDisplay();
+        scheduleSubmit();
+        return;
+      }
+      const manualKeys=['Backspace','Delete'];
+      const isDigit=event.key.length===1 && event.key>='0' && event.key<='9';
+      if(isDigit || manualKeys.indexOf(event.key)!==-1){
+        manualEdit=true;
+        suppressSubmit=true;
+      }
+    });
+    spinner.addEventListener('input',function(){
+      syncDisplay();
+      if(!suppressSubmit){
+        scheduleSubmit();
+      }
+    });
+    spinner.addEventListener('change',function(){
+      syncDisplay();
+      suppressSubmit=false;
+      manualEdit=false;
+      scheduleSubmit();
+    });
+    spinner.addEventListener('blur',function(){
+      if(manualEdit){
+        manualEdit=false;
+        suppressSubmit=false;
+        syncDisplay();
+        scheduleSubmit();
+      }
+    });
+    spinner.addEventListener('wheel',function(event){event.preventDefault();},{passive:false});
+    syncDisplay();
+  }
+  const stepRadios=document.querySelectorAll('input[name="step"]');
+  if(stepRadios.length){
+    const savedStep=window.localStorage?localStorage.getItem('clockgen-step'):null;
+    let selectedValue=null;
+    stepRadios.forEach(function(radio){
+      if(savedStep && radio.value===savedStep){
+        radio.checked=true;
+        selectedValue=radio.value;
+      } else if(radio.checked && !selectedValue){
+        selectedValue=radio.value;
+      }
+    });
+    if(selectedValue){
+      updateStep(selectedValue);
+    } else if(spinner){
+      updateStep(spinner.step || '1000');
+    }
+    stepRadios.forEach(function(radio){
+      radio.addEventListener('change',function(){
+        if(radio.checked){
+          updateStep(radio.value);
+          if(window.localStorage){
+            localStorage.setItem('clockgen-step', radio.value);
+          }
+        }
+      });
+    });
+  }
+  const morseStatus=document.getElementById('morse-status');
+  const morseStatusText=document.getElementById('morse-status-text');
+  const morsePlay=document.getElementById('morse-play');
+  const morseStop=document.getElementById('morse-stop');
+  const morseDetails=document.getElementById('morse-details');
+  const outputToggle=document.getElementById('output-toggle');
+  if(outputToggle && morseStatus && morseStatus.getAttribute('data-hold')==='true'){outputToggle.disabled=true;}
+  if(morseDetails && typeof fetch==='function'){
+    morseDetails.addEventListener('toggle',function(){
+      const open=morseDetails.open;
+      if(outputToggle){outputToggle.disabled=open;}
+      const body='active='+(open?'1':'0');
+      fetch('/morse/hold',{method:'POST',headers:{'Content-Type':'application/x-www-form-urlencoded'},body:body}).catch(function(){});
+    });
+  }
+  const statusBanner=document.getElementById('status-banner');
+  const driveSelect=document.getElementById('drive-select');
+  const applyControlState=function(data){
+    if(outputToggle && typeof data.output_enabled==='boolean'){
+      outputToggle.classList.remove('on','off');
+      outputToggle.classList.add(data.output_enabled?'on':'off');
+      outputToggle.setAttribute('aria-pressed', data.output_enabled?'true':'false');
+      outputToggle.textContent=data.output_enabled?'Output ON':'Output OFF';
+    }
+    // Never overwrite a value the user is still editing or about to submit.
+    if(spinner && typeof data.frequency_hz==='number' && document.activeElement!==spinner && !submitTimer && !tunePending){
+      spinner.value=data.frequency_hz;
+      syncDisplay();
+    }
+    if(driveSelect && typeof data.drive_ma==='number' && document.activeElement!==driveSelect){
+      driveSelect.value=String(data.drive_ma);
+    }
+    if(statusBanner && typeof data.message==='string'){
+      statusBanner.className=(data.message && data.error)?'status error':'status ok';
+      const text=statusBanner.querySelector('span');
+      if(text){text.textContent=data.message||'Clock generator ready';}
+    }
+  };
+  applyStateHook=applyControlState;
+  const signalForm=document.getElementById('signal-form');
+  if(outputToggle && signalForm && typeof fetch==='function'){
+    outputToggle.addEventListener('click',function(event){
+      event.preventDefault();
+      const enable=outputToggle.getAttribute('aria-pressed')!=='true';
+      putJson('/api/v1/output',{output_enabled:enable}).then(applyControlState).catch(function(){
+        signalForm.requestSubmit(outputToggle);
+      });
+    });
+  }
+  if(morseStatus && morseStatusText){
+    const applyMorseStatus=function(data){
+      const statusText=(data && typeof data.status==='string')?data.status:'Idle';
+      const playing=!!(data && data.playing);
+      const holdActive=!!(data && data.hold);
+      morseStatusText.textContent=statusText;
+      morseStatus.classList.remove('playing','stopped','idle');
+      const className=playing?'playing':(statusText==='Stopped'?'stopped':'idle');
+      morseStatus.classList.add(className);
+      morseStatus.setAttribute('data-playing', playing?'true':'false');
+      morseStatus.setAttribute('data-hold', holdActive?'true':'false');
+      if(morsePlay){morsePlay.disabled=playing;}
+      if(morseStop){morseStop.disabled=!playing;}
+      if(outputToggle){outputToggle.disabled=holdActive;}
+      if(morseDetails && (playing || holdActive) && !morseDetails.open){morseDetails.open=true;}
+      if(morseDetails && morseDetails.open){try{morseDetails.scrollIntoView({behavior:'auto',block:'start'});}catch(e){}}
+    };
+    applyMorseStatus({playing:morseStatus.getAttribute('data-playing')==='true',status:morseStatusText.textContent,hold:morseStatus.getAttribute('data-hold')==='true'});
+    // One long-lived event stream replaces polling; it pushes only changes.
+    if(typeof EventSource==='function'){
+      const events=new EventSource('/events');
+      events.addEventListener('state',function(event){
+        let data=null;
+        try{data=JSON.parse(event.data);}catch(e){return;}
+        applyControlState(data);
+        applyMorseStatus(data);
+      });
+    } else if(typeof fetch==='function'){
+      const pollMorse=function(){
+        fetch('/morse/status',{cache:'no-store'}).then(function(resp){
+          if(!resp.ok) throw new Error('status');
+          return resp.json();
+        }).then(function(data){applyMorseStatus(data);}).catch(function(){});
+      };
+      pollMorse();
+      setInterval(pollMorse,1000);
+    }
+  }
+});
@@ -0,0 +1,20 @@
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Static assets are gzip-compressed at build time (cmake/web_assets.cmake) and
+// live in flash, so they can be handed to lwIP without copying.
+typedef struct {
+    const char *path;
+    const uint8_t *data;
+    uint32_t length;
+    const char *content_type;
+    const char *version; // content hash, used as ?v= in page links
+    const char *etag;    // strong validator: the quoted content hash
+} web_asset_t;
+
+const web_asset_t *web_assets_find(const char *path, size_t path_len);
+
+#endif // WEB_ASSETS_H
@@ -0,0 +1,143 @@
+#include "web_template.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char *html_entity(char c) {
+    switch (c) {
+    case '&':
+        return "&amp;";
+    case '<':
+        return "&lt;";
+    case '>':
+        return "&gt;";
+    case '"':
+        return "&quot;";
+    case '\'':
+        return "&#39;";
+    default:
+        return NULL;
+    }
+}
+
+static size_t format_uint(uint64_t value, char *out, size_t out_len) {
+    int len = snprintf(out, out_len, "%llu", (unsigned long long)value);
+    if (len <= 0 || (size_t)len >= out_len) {
+        out[0] = '\0';
+        return 0;
+    }
+    return (size_t)len;
+}
+
+static size_t value_length(const web_value_t *value) {
+    if (value->type == WEB_VALUE_UINT) {
+        char digits[24];
+        return format_uint(value->number, digits, sizeof(digits));
+    }
+    if (!value->str) {
+        return 0;
+    }
+    if (value->type == WEB_VALUE_RAW) {
+        return strlen(value->str);
+    }
+    size_t len = 0;
+    for (const char *p = value->str; *p; ++p) {
+        const char *entity = html_entity(*p);
+        len += entity ? strlen(entity) : 1;
+    }
+    return len;
+}
+
+void web_template_begin(web_template_cursor_t *cursor, const web_template_t *tmpl,
+                        web_slot_resolver_fn resolve, const void *model) {
+    *cursor = (web_template_cursor_t){.tmpl = tmpl, .resolve = resolve, .model = model};
+}
+
+size_t web_template_measure(const web_template_t *tmpl, web_slot_resolver_fn resolve,
+                            const void *model) {
+    size_t total = 0;
+    for (size_t i = 0; i < tmpl->count; ++i) {
+        const web_template_part_t *part = &tmpl->parts[i];
+        if (part->slot == WEB_TEMPLATE_LITERAL) {
+            total += part->length;
+        } else {
+            web_value_t value = {0};
+            resolve(model, part->slot, &value);
+            total += value_length(&value);
+        }
+    }
+    return total;
+}
+
+// Fills scratch from value, resuming at *offset source bytes. Escapes are
+// never split, so a long value simply spans several calls.
+static size_t render_value(const web_value_t *value, size_t *offset, char *scratch,
+                           size_t scratch_len) {
+    char digits[24];
+    const char *str = value->str;
+    if (value->type == WEB_VALUE_UINT) {
+        format_uint(value->number, digits, sizeof(digits));
+        str = digits;
+    }
+    if (!str) {
+        return 0;
+    }
+
+    const char *src = str + *offset;
+    size_t used = 0;
+    while (*src) {
+        const char *entity = value->type == WEB_VALUE_TEXT ? html_entity(*src) : NULL;
+        const size_t need = entity ? strlen(entity) : 1;
+        if (used + need > scratch_len) {
+            break;
+        }
+        if (entity) {
+            memcpy(scratch + used, entity, need);
+        } else {
+            scratch[used] = *src;
+        }
+        used += need;
+        ++src;
+    }
+    *offset = (size_t)(src - str);
+    return used;
+}
+
+bool web_value_render(const web_value_t *value, char *out, size_t out_len, size_t *written) {
+    size_t offset = 0;
+    *written = render_value(value, &offset, out, out_len);
+    return *written == value_length(value);
+}
+
+bool web_template_next(web_template_cursor_t *cursor, char *scratch, size_t scratch_len,
+                       const char **data, size_t *len, bool *in_flash) {
+    while (cursor->part < cursor->tmpl->count) {
+        const web_template_part_t *part = &cursor->tmpl->parts[cursor->part];
+
+        if (part->slot == WEB_TEMPLATE_LITERAL) {
+            *data = part->text;
+            *len = part->length;
+            *in_flash = true;
+            cursor->part++;
+            cursor->offset = 0;
+            if (*len > 0) {
+                return true;
+            }
+            continue;
+        }
+
+        web_value_t value = {0};
+        cursor->resolve(cursor->model, part->slot, &value);
+        size_t produced = render_value(&value, &cursor->offset, scratch, scratch_len);
+        if (produced == 0) {
+            cursor->part++;
+            cursor->offset = 0;
+            continue;
+        }
+        *data = scratch;
+        *len = produced;
+        *in_flash = false;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,65 @@
+#ifndef WEB_TEMPLATE_H
+#define WEB_TEMPLATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Templates are compiled at build time (cmake/web_templates.cmake) into
+// constant segments in flash interleaved with numbered slots. Rendering never
+// builds the page in RAM: segments are handed out in place and slot values
+// are formatted a few bytes at a time into a caller-provided scratch buffer.
+
+#define WEB_TEMPLATE_LITERAL 0xFFFFu
+
+typedef struct {
+    const char *text; // NULL for slots
+    uint16_t length;
+    uint16_t slot;    // WEB_TEMPLATE_LITERAL for constant segments
+} web_template_part_t;
+
+typedef struct {
+    const web_template_part_t *parts;
+    size_t count;
+} web_template_t;
+
+typedef enum {
+    WEB_VALUE_RAW,  // trusted markup, emitted as is
+    WEB_VALUE_TEXT, // HTML-escaped on output
+    WEB_VALUE_UINT,
+} web_value_type_t;
+
+typedef struct {
+    web_value_type_t type;
+    const char *str;
+    uint64_t number;
+} web_value_t;
+
+// Must return the same value for the same model every time it is asked; the
+// renderer resolves slots once to measure and again while streaming.
+typedef void (*web_slot_resolver_fn)(const void *model, uint16_t slot, web_value_t *out);
+
+typedef struct {
+    const web_template_t *tmpl;
+    web_slot_resolver_fn resolve;
+    const void *model;
+    size_t part;
+    size_t offset; // bytes of the current part (source bytes for slots) already emitted
+} web_template_cursor_t;
+
+void web_template_begin(web_template_cursor_t *cursor, const web_template_t *tmpl,
+                        web_slot_resolver_fn resolve, const void *model);
+size_t web_template_measure(const web_template_t *tmpl, web_slot_resolver_fn resolve,
+                            const void *model);
+
+// Renders a whole value (escaped as its type requires). Returns false if it
+// does not fit in out_len bytes; out is not NUL-terminated.
+bool web_value_render(const web_value_t *value, char *out, size_t out_len, size_t *written);
+
+// Returns the next piece of output, or false once the template is exhausted.
+// Constant segments come back as pointers into flash (*in_flash = true); slot
+// output is written to scratch, which must hold at least one escape (6 bytes).
+bool web_template_next(web_template_cursor_t *cursor, char *scratch, size_t scratch_len,
+                       const char **data, size_t *len, bool *in_flash);
+
+#endif // WEB_TEMPLATE_H
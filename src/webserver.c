@@ -6,284 +6,436 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
+#include <strings.h>
+
+#include "app_state.h"
+#include "boot_profile.h"
+#include "control_queue.h"
+#include "control_ws.h"
+#include "event_stream.h"
+#include "json.h"
+#include "log_stream.h"
 #include "logging.h"
+#include "memory_stats.h"
+#include "metrics.h"
 #include "morse_player.h"
+#include "sequence.h"
 #include "signal_controller.h"
+#include "sweep.h"
+#include "web_assets.h"
+#include "webserver_api.h"
+#include "webserver_form.h"
 #include "webserver_pages.h"
 #include "webserver_utils.h"
+#include "websocket.h"
 
+#include "lwip/opt.h"
 #include "lwip/tcp.h"
 
-typedef struct {
-    bool responded;
-} web_connection_t;
+// Pages ride along in a connection's response slot as a model snapshot.
+_Static_assert(sizeof(webserver_page_fragments_t) <= WEBSERVER_RESPONSE_EXTRA_MAX,
+               "page fragments exceed a response slot");
+_Static_assert(sizeof(webserver_page_model_t) <= WEBSERVER_RESPONSE_EXTRA_MAX,
+               "page model exceeds a response slot");
+
+// Every connection slot, stream and WebSocket holds a PCB of its own.
+#if WEBSERVER_MAX_CONNECTIONS + WEBSERVER_MAX_STREAMS + WEBSOCKET_MAX_CLIENTS > MEMP_NUM_TCP_PCB
+#error "MEMP_NUM_TCP_PCB is too small for the webserver's connection limits"
+#endif
 
 static err_t webserver_accept(void *arg, struct tcp_pcb *pcb, err_t err);
-static err_t webserver_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err);
-static void webserver_err(void *arg, err_t err);
-static err_t webserver_sent(void *arg, struct tcp_pcb *pcb, u16_t len);
-static void webserver_close(struct tcp_pcb *pcb, web_connection_t *state);
-static void respond_with_form(struct tcp_pcb *pcb, web_connection_t *state);
-static void handle_form_submission(const char *body);
-static void handle_morse_submission(const char *body);
-static void handle_morse_stop(void);
-static void handle_morse_hold(const char *body);
-static void respond_morse_status(struct tcp_pcb *pcb, web_connection_t *state);
+static void webserver_handle_request(struct tcp_pcb *pcb, char *request, size_t request_len);
+static void respond_with_form(struct tcp_pcb *pcb, const char *conditional_request);
+static void send_page(struct tcp_pcb *pcb, const webserver_template_response_t *response);
+
+typedef enum {
+    FORM_JOB_TOGGLE_OUTPUT,
+    FORM_JOB_SIGNAL,
+    FORM_JOB_MORSE_START,
+    FORM_JOB_MORSE_STOP,
+    FORM_JOB_MORSE_HOLD,
+} form_job_kind_t;
+
+// A validated form post that touches the Si5351. The control queue carries it
+// out in the main loop; run fills in the outcome and done reports it.
+typedef struct {
+    form_job_kind_t kind;
+    bool flag; // toggle: new output state; stop: was playing; hold: activate
+    bool ok;
+    bool changed; // signal: settings differed; hold: output was on before
+    uint8_t drive_ma;
+    uint8_t text_len;
+    uint16_t wpm;
+    int16_t fwpm;
+    uint64_t frequency_hz;
+    char text[MORSE_MAX_CHARS + 1];
+} form_job_t;
+
+_Static_assert(sizeof(form_job_t) <= CONTROL_JOB_DATA_MAX, "form job exceeds the job payload");
+
+static bool handle_form_submission(const char *body, form_job_t *job);
+static bool handle_morse_submission(const char *body, form_job_t *job);
+static bool handle_morse_hold(const char *body, form_job_t *job);
+static bool defer_form_job(struct tcp_pcb *pcb, const form_job_t *job);
+static void respond_morse_status(struct tcp_pcb *pcb);
+static void respond_boot_profile(struct tcp_pcb *pcb);
+static void respond_log_stream(struct tcp_pcb *pcb);
+static void respond_event_stream(struct tcp_pcb *pcb);
+static void respond_metrics(struct tcp_pcb *pcb);
+static void respond_memory(struct tcp_pcb *pcb);
+static void respond_control_socket(struct tcp_pcb *pcb, const char *request);
+static void respond_asset(struct tcp_pcb *pcb, const web_asset_t *asset, const char *request);
+static bool request_etag_matches(const char *request, const char *etag);
+static bool request_accepts_gzip(const char *request);
+static void send_json_response(struct tcp_pcb *pcb, const char *body, size_t body_len);
 static uint64_t clamp_frequency(uint64_t freq);
-static bool parse_uint64(const char *value, uint64_t *out);
-static bool extract_form_value(const char *body, const char *key, char *out, size_t out_len);
-static int hex_digit_value(char c);
-
-static int hex_digit_value(char c) {
-    if (c >= '0' && c <= '9') {
-        return c - '0';
-    }
-    if (c >= 'a' && c <= 'f') {
-        return 10 + (c - 'a');
-    }
-    if (c >= 'A' && c <= 'F') {
-        return 10 + (c - 'A');
-    }
-    return -1;
-}
-
-static bool extract_form_value(const char *body, const char *key, char *out, size_t out_len) {
-    if (!body || !key || !out || out_len == 0) {
-        return false;
-    }
-
-    const char *key_pos = strstr(body, key);
-    if (!key_pos) {
-        out[0] = '\0';
-        return false;
-    }
-
-    key_pos += strlen(key);
-    size_t idx = 0;
-
-    while (*key_pos && *key_pos != '&' && idx < out_len - 1) {
-        char c = *key_pos++;
-        if (c == '+') {
-            c = ' ';
-        } else if (c == '%' && key_pos[0] && key_pos[1]) {
-            int hi = hex_digit_value(key_pos[0]);
-            int lo = hex_digit_value(key_pos[1]);
-            if (hi >= 0 && lo >= 0) {
-                c = (char)((hi << 4) | lo);
-                key_pos += 2;
-            }
-        }
-        out[idx++] = c;
-    }
-
-    out[idx] = '\0';
-    return true;
-}
 
-static char g_status_message[128] = "";
+static char g_status_message[WEBSERVER_STATUS_MAX] = "";
 static bool g_status_is_error = false;
-static char g_status_prev_message[128] = "";
+static char g_status_prev_message[WEBSERVER_STATUS_MAX] = "";
 static bool g_status_prev_is_error = false;
 static bool g_status_prev_valid = false;
 static bool g_morse_hold_active = false;
 static bool g_morse_hold_prev_enabled = false;
 
+// Last rendered landing page fragments, reused while the state generation holds.
+static webserver_page_fragments_t g_page_cache;
+static bool g_page_cache_valid = false;
+
 void webserver_init(void) {
     struct tcp_pcb *pcb = tcp_new_ip_type(IPADDR_TYPE_V4);
     if (!pcb) {
-        log_error("Failed to allocate TCP PCB for webserver");
+        LOG_ERROR(LOG_CAT_HTTP, "Failed to allocate TCP PCB for webserver");
         return;
     }
 
     const u16_t port = 80;
     err_t err = tcp_bind(pcb, IP_ADDR_ANY, port);
     if (err != ERR_OK) {
-        log_error("tcp_bind failed on port %u: %d", port, err);
+        LOG_ERROR(LOG_CAT_HTTP, "tcp_bind failed on port %u: %d", port, err);
         tcp_close(pcb);
         return;
     }
 
     pcb = tcp_listen_with_backlog(pcb, 2);
     tcp_accept(pcb, webserver_accept);
-    log_info("Webserver listening on port %u", port);
+    LOG_INFO(LOG_CAT_HTTP, "Webserver listening on port %u", port);
 }
 
+// Bumps the state generation after the change, as every other writer does,
+// so a page rendered in between is never tagged with the new generation.
 void webserver_set_status(const char *message, bool is_error) {
-    if (!message || !*message) {
-        g_status_message[0] = '\0';
-        g_status_is_error = false;
+    if (!message) {
+        message = "";
+    }
+    is_error = is_error && *message;
+    if (g_status_is_error == is_error && strcmp(g_status_message, message) == 0) {
         return;
     }
-
     snprintf(g_status_message, sizeof(g_status_message), "%s", message);
     g_status_is_error = is_error;
+    app_state_bump();
+}
+
+bool webserver_morse_hold_active(void) { return g_morse_hold_active; }
+
+const char *webserver_status_message(bool *is_error) {
+    if (is_error) {
+        *is_error = g_status_is_error;
+    }
+    return g_status_message;
 }
 
 static err_t webserver_accept(void *arg, struct tcp_pcb *pcb, err_t err) {
+    (void)arg;
     if (err != ERR_OK || !pcb) {
         return ERR_VAL;
     }
+    return webserver_http_accept(pcb, webserver_handle_request);
+}
 
-    web_connection_t *state = calloc(1, sizeof(web_connection_t));
-    if (!state) {
-        log_error("Out of memory allocating connection state");
-        tcp_arg(pcb, NULL);
-        return ERR_MEM;
+static void webserver_handle_request(struct tcp_pcb *pcb, char *request, size_t request_len) {
+    if (webserver_api_handle(pcb, request, request_len)) {
+        return;
     }
+    // Anything not routed below is answered with the page.
+    webserver_http_tag(pcb, METRICS_ROUTE_PAGE);
+    if (strncmp(request, "GET ", 4) == 0) {
+        const char *path_start = request + 4;
+        const char *path_end = strchr(path_start, ' ');
+        if (path_end) {
+            size_t path_len = (size_t)(path_end - path_start);
+            const char *query = memchr(path_start, '?', path_len);
+            const size_t resource_len = query ? (size_t)(query - path_start) : path_len;
+            const web_asset_t *asset = web_assets_find(path_start, resource_len);
+            if (asset) {
+                webserver_http_tag(pcb, METRICS_ROUTE_ASSET);
+                respond_asset(pcb, asset, request);
+                return;
+            }
+            if (path_len == strlen("/morse/status") &&
+                strncmp(path_start, "/morse/status", path_len) == 0) {
+                webserver_http_tag(pcb, METRICS_ROUTE_STATUS);
+                respond_morse_status(pcb);
+                return;
+            }
+            if (path_len == strlen("/boot") && strncmp(path_start, "/boot", path_len) == 0) {
+                webserver_http_tag(pcb, METRICS_ROUTE_STATUS);
+                respond_boot_profile(pcb);
+                return;
+            }
+            if (path_len == strlen("/memory") && strncmp(path_start, "/memory", path_len) == 0) {
+                webserver_http_tag(pcb, METRICS_ROUTE_STATUS);
+                respond_memory(pcb);
+                return;
+            }
+            if (path_len == strlen("/metrics") && strncmp(path_start, "/metrics", path_len) == 0) {
+                webserver_http_tag(pcb, METRICS_ROUTE_METRICS);
+                respond_metrics(pcb);
+                return;
+            }
+            if (path_len == strlen("/logs") && strncmp(path_start, "/logs", path_len) == 0) {
+                webserver_http_tag(pcb, METRICS_ROUTE_STREAM);
+                respond_log_stream(pcb);
+                return;
+            }
+            if (path_len == strlen("/events") && strncmp(path_start, "/events", path_len) == 0) {
+                webserver_http_tag(pcb, METRICS_ROUTE_STREAM);
+                respond_event_stream(pcb);
+                return;
+            }
+            if (path_len == strlen("/ws") && strncmp(path_start, "/ws", path_len) == 0) {
+                webserver_http_tag(pcb, METRICS_ROUTE_STREAM);
+                respond_control_socket(pcb, request);
+                return;
+            }
+        }
+    } else if (strncmp(request, "POST ", 5) == 0) {
+        const char *path_start = request + 5;
+        const char *path_end = strchr(path_start, ' ');
+        if (path_end) {
+            size_t path_len = (size_t)(path_end - path_start);
+            const char *body = strstr(request, "\r\n\r\n");
+            if (body) {
+                body += 4;
+            }
 
-    tcp_arg(pcb, state);
-    tcp_recv(pcb, webserver_recv);
-    tcp_err(pcb, webserver_err);
-    tcp_sent(pcb, webserver_sent);
+            form_job_t job = {0};
+            bool queued = false;
+            if (path_len == strlen("/signal") &&
+                strncmp(path_start, "/signal", path_len) == 0) {
+                queued = body && handle_form_submission(body, &job);
+            } else if (path_len == strlen("/morse") &&
+                       strncmp(path_start, "/morse", path_len) == 0) {
+                queued = body && handle_morse_submission(body, &job);
+            } else if (path_len == strlen("/morse/stop") &&
+                       strncmp(path_start, "/morse/stop", path_len) == 0) {
+                job.kind = FORM_JOB_MORSE_STOP;
+                queued = true;
+            } else if (path_len == strlen("/morse/hold") &&
+                       strncmp(path_start, "/morse/hold", path_len) == 0) {
+                queued = body && handle_morse_hold(body, &job);
+            }
+            if (queued && defer_form_job(pcb, &job)) {
+                return;
+            }
+        }
+    }
 
-    return ERR_OK;
+    // Only a plain GET of the page may be answered from the browser's copy.
+    const bool is_get = strncmp(request, "GET ", 4) == 0;
+    respond_with_form(pcb, is_get ? request : NULL);
 }
 
-static err_t webserver_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
-    web_connection_t *state = (web_connection_t *)arg;
+static void respond_with_form(struct tcp_pcb *pcb, const char *conditional_request) {
+    // Read the generation before the state it describes: a change that races
+    // with the snapshot then leaves the cache tagged stale, never fresh.
+    const uint32_t generation = app_state_generation();
+    char etag[32];
+    app_state_etag(generation, etag, sizeof(etag));
 
-    if (!pcb) {
-        if (p) {
-            pbuf_free(p);
-        }
-        return ERR_OK;
+    if (conditional_request && request_etag_matches(conditional_request, etag)) {
+        webserver_send_not_modified(pcb, etag);
+        return;
     }
 
-    if (err != ERR_OK) {
-        if (p) {
-            pbuf_free(p);
-        }
-        webserver_close(pcb, state);
-        return err;
+    webserver_template_response_t response = {
+        .tmpl = webserver_landing_page,
+        .etag = etag,
+    };
+    if (g_page_cache_valid && g_page_cache.generation == generation) {
+        response.resolve = webserver_page_fragments_resolve;
+        response.model = &g_page_cache;
+        response.model_size = webserver_page_fragments_size(&g_page_cache);
+        response.content_length = g_page_cache.content_length;
+        send_page(pcb, &response);
+        return;
     }
 
-    if (!p) {
-        webserver_close(pcb, state);
-        return ERR_OK;
+    webserver_page_model_t model = {
+        .frequency_hz = signal_controller_get_frequency_hz(),
+        .drive_ma = signal_controller_get_drive_ma(),
+        .output_enabled = signal_controller_is_output_enabled(),
+        .status_is_error = g_status_is_error,
+        .morse_playing = morse_is_playing(),
+        .morse_hold_active = g_morse_hold_active,
+        .morse_wpm = 0,
+        .morse_fwpm = -1,
+        .morse_status = morse_status_text(),
+    };
+    snprintf(model.status_message, sizeof(model.status_message), "%s", g_status_message);
+    morse_get_form_defaults(model.morse_text, sizeof(model.morse_text), &model.morse_wpm,
+                            &model.morse_fwpm);
+
+    g_page_cache_valid = webserver_page_fragments_build(&g_page_cache, &model, generation);
+    if (g_page_cache_valid) {
+        response.resolve = webserver_page_fragments_resolve;
+        response.model = &g_page_cache;
+        response.model_size = webserver_page_fragments_size(&g_page_cache);
+        response.content_length = g_page_cache.content_length;
+    } else {
+        // Unusually long status text: stream straight from the model instead.
+        response.resolve = webserver_landing_page_resolve;
+        response.model = &model;
+        response.model_size = sizeof(model);
     }
+    send_page(pcb, &response);
+}
 
-    tcp_recved(pcb, p->tot_len);
-
-    char request[1024] = {0};
-    const u16_t copy_len = p->tot_len < sizeof(request) - 1 ? p->tot_len : sizeof(request) - 1;
-    pbuf_copy_partial(p, request, copy_len, 0);
+static void send_page(struct tcp_pcb *pcb, const webserver_template_response_t *response) {
+    if (webserver_send_template(pcb, response) == ERR_OK) {
+        boot_profile_mark(BOOT_PHASE_FIRST_HTTP_RESPONSE);
+    }
+}
 
-    pbuf_free(p);
+static bool request_etag_matches(const char *request, const char *etag) {
+    size_t line_len = 0;
+    const char *header = webserver_request_header(request, "If-None-Match", &line_len);
+    if (!header) {
+        return false;
+    }
+    if (line_len == 1 && header[0] == '*') {
+        return true;
+    }
+    const size_t etag_len = strlen(etag);
+    const char *end = header + line_len;
 
-    if (!state->responded) {
-        if (strncmp(request, "GET ", 4) == 0) {
-            const char *path_start = request + 4;
-            const char *path_end = strchr(path_start, ' ');
-            if (path_end) {
-                size_t path_len = (size_t)(path_end - path_start);
-                if (path_len == strlen("/morse/status") &&
-                    strncmp(path_start, "/morse/status", path_len) == 0) {
-                    respond_morse_status(pcb, state);
-                    return ERR_OK;
-                }
-            }
-        } else if (strncmp(request, "POST ", 5) == 0) {
-            const char *path_start = request + 5;
-            const char *path_end = strchr(path_start, ' ');
-            if (path_end) {
-                size_t path_len = (size_t)(path_end - path_start);
-                const char *body = strstr(request, "\r\n\r\n");
-                if (body) {
-                    body += 4;
-                }
-
-                if (path_len == strlen("/signal") &&
-                    strncmp(path_start, "/signal", path_len) == 0) {
-                    if (body) {
-                        handle_form_submission(body);
-                    }
-                } else if (path_len == strlen("/morse") &&
-                           strncmp(path_start, "/morse", path_len) == 0) {
-                    if (body) {
-                        handle_morse_submission(body);
-                    }
-                } else if (path_len == strlen("/morse/stop") &&
-                           strncmp(path_start, "/morse/stop", path_len) == 0) {
-                    handle_morse_stop();
-                } else if (path_len == strlen("/morse/hold") &&
-                           strncmp(path_start, "/morse/hold", path_len) == 0) {
-                    if (body) {
-                        handle_morse_hold(body);
-                    }
-                }
-            }
+    // A comma-separated list of quoted tags; GET compares them weakly, so a
+    // W/ prefix is ignored, but each tag has to match as a whole.
+    for (const char *p = header; p < end;) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+            ++p;
+        }
+        const char *tag = p;
+        if (end - tag >= 2 && tag[0] == 'W' && tag[1] == '/') {
+            tag += 2;
+        }
+        const char *tag_end = tag;
+        if (tag_end < end && *tag_end == '"') {
+            const char *close = memchr(tag_end + 1, '"', (size_t)(end - tag_end - 1));
+            tag_end = close ? close + 1 : end;
+        }
+        p = tag_end;
+        while (p < end && *p != ',') {
+            ++p;
+        }
+        if ((size_t)(tag_end - tag) == etag_len && memcmp(tag, etag, etag_len) == 0) {
+            return true;
         }
-
-        respond_with_form(pcb, state);
-    } else {
-        webserver_close(pcb, state);
     }
-    return ERR_OK;
+    return false;
 }
 
-static void respond_with_form(struct tcp_pcb *pcb, web_connection_t *state) {
-    char page[16384];
-    uint64_t current_frequency = signal_controller_get_frequency_hz();
-    uint8_t current_drive = signal_controller_get_drive_ma();
-    bool current_output = signal_controller_is_output_enabled();
-    char morse_text[MORSE_MAX_CHARS + 1] = {0};
-    uint16_t morse_wpm = 0;
-    int16_t morse_fwpm = -1;
-    morse_get_form_defaults(morse_text, sizeof(morse_text), &morse_wpm, &morse_fwpm);
-
-    webserver_build_landing_page(page, sizeof(page), current_frequency, current_drive,
-                                 current_output, g_status_message, g_status_is_error, morse_text,
-                                 morse_wpm, morse_fwpm, morse_is_playing(), morse_status_text(),
-                                 g_morse_hold_active);
-
-    if (webserver_send_response(pcb, page) == ERR_OK) {
-        state->responded = true;
-    } else {
-        webserver_close(pcb, state);
+// A quality value of zero, "0" to "0.000", refuses the coding.
+static bool quality_is_zero(const char *q, const char *end) {
+    if (q >= end || *q != '0') {
+        return false;
+    }
+    for (++q; q < end && (*q == '.' || *q == '0'); ++q) {
     }
+    return q == end || *q == ' ' || *q == '\t' || *q == ';';
 }
 
-static bool parse_uint64(const char *value, uint64_t *out) {
-    if (!value || !*value) {
+// Assets only exist gzip-compressed, so the client has to say it takes gzip,
+// by name or through "*". A missing header counts as a refusal here: it is
+// what clients that cannot decompress, such as a plain curl, send.
+static bool request_accepts_gzip(const char *request) {
+    size_t line_len = 0;
+    const char *header = webserver_request_header(request, "Accept-Encoding", &line_len);
+    if (!header) {
         return false;
     }
-
-    char *end = NULL;
-    unsigned long long parsed = strtoull(value, &end, 10);
-    if (end == value || (*end != '\0' && *end != '&')) {
-        return false;
+    const char *end = header + line_len;
+    int gzip = -1; // -1 not listed, 0 refused, 1 accepted
+    int any = -1;
+    for (const char *p = header; p < end;) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+            ++p;
+        }
+        const char *name = p;
+        while (p < end && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') {
+            ++p;
+        }
+        const size_t name_len = (size_t)(p - name);
+        const char *item_end = p;
+        while (item_end < end && *item_end != ',') {
+            ++item_end;
+        }
+        bool accepted = true;
+        for (const char *q = p; q + 2 <= item_end; ++q) {
+            if ((q[0] == 'q' || q[0] == 'Q') && q[1] == '=' && (q[-1] == ';' || q[-1] == ' ')) {
+                accepted = !quality_is_zero(q + 2, item_end);
+                break;
+            }
+        }
+        if ((name_len == 4 && strncasecmp(name, "gzip", 4) == 0) ||
+            (name_len == 6 && strncasecmp(name, "x-gzip", 6) == 0)) {
+            gzip = accepted;
+        } else if (name_len == 1 && name[0] == '*') {
+            any = accepted;
+        }
+        p = item_end;
     }
+    return gzip == 1 || (gzip == -1 && any == 1);
+}
 
-    *out = (uint64_t)parsed;
-    return true;
+static void respond_asset(struct tcp_pcb *pcb, const web_asset_t *asset, const char *request) {
+    if (!request_accepts_gzip(request)) {
+        webserver_send_error(pcb, 406, "Not Acceptable");
+        return;
+    }
+    webserver_send_asset(pcb, asset, request_etag_matches(request, asset->etag));
 }
 
-static err_t webserver_sent(void *arg, struct tcp_pcb *pcb, u16_t len) {
-    (void)arg;
-    (void)len;
-    if (!pcb) {
-        return ERR_OK;
+static void respond_log_stream(struct tcp_pcb *pcb) {
+    if (log_stream_open(pcb) == ERR_OK) {
+        // The stream owns the pcb and its callbacks from here on.
+        return;
     }
-    tcp_close(pcb);
-    return ERR_OK;
+    LOG_WARN(LOG_CAT_HTTP, "log stream rejected: all %u slots busy", LOG_STREAM_MAX_CLIENTS);
+    webserver_send_error(pcb, 503, "Service Unavailable");
 }
 
-static void webserver_err(void *arg, err_t err) {
-    (void)err;
-    web_connection_t *state = (web_connection_t *)arg;
-    free(state);
+static void respond_event_stream(struct tcp_pcb *pcb) {
+    if (event_stream_open(pcb, webserver_api_format_state) == ERR_OK) {
+        return;
+    }
+    LOG_WARN(LOG_CAT_HTTP, "event stream rejected: all %u slots busy", EVENT_STREAM_MAX_CLIENTS);
+    webserver_send_error(pcb, 503, "Service Unavailable");
 }
 
-static void webserver_close(struct tcp_pcb *pcb, web_connection_t *state) {
-    if (pcb) {
-        tcp_arg(pcb, NULL);
-        tcp_recv(pcb, NULL);
-        tcp_sent(pcb, NULL);
-        tcp_err(pcb, NULL);
-        tcp_close(pcb);
+static void respond_control_socket(struct tcp_pcb *pcb, const char *request) {
+    if (!websocket_is_upgrade(request)) {
+        webserver_send_error(pcb, 426, "Upgrade Required");
+        return;
+    }
+    const err_t err = control_ws_open(pcb, request);
+    if (err == ERR_ARG) {
+        webserver_send_error(pcb, 400, "Bad Request");
+    } else if (err != ERR_OK) {
+        LOG_WARN(LOG_CAT_HTTP, "control socket rejected: %d", err);
+        webserver_send_error(pcb, 503, "Service Unavailable");
     }
-    free(state);
 }
 
 static uint64_t clamp_frequency(uint64_t freq) {
@@ -296,97 +448,81 @@ static uint64_t clamp_frequency(uint64_t freq) {
     return freq;
 }
 
-static void handle_form_submission(const char *body) {
+// Form handlers validate in the lwIP callback and return true when job holds
+// work for the control queue; otherwise the status already says why not.
+static bool handle_form_submission(const char *body, form_job_t *job) {
     char action_buf[32] = {0};
-    extract_form_value(body, "action=", action_buf, sizeof(action_buf));
+    webserver_form_value(body, "action=", action_buf, sizeof(action_buf));
 
     if (strcmp(action_buf, "toggle-output") == 0) {
         if (g_morse_hold_active) {
             webserver_set_status("Output locked for Morse", true);
-            return;
+            return false;
         }
-        bool desired = !signal_controller_is_output_enabled();
-        if (signal_controller_enable_output(desired)) {
-            webserver_set_status(desired ? "Output enabled" : "Output disabled", false);
-        } else {
-            webserver_set_status("Error: failed to toggle output", true);
-        }
-        return;
+        job->kind = FORM_JOB_TOGGLE_OUTPUT;
+        return true;
     }
 
     char freq_buf[32] = {0};
     char drive_buf[8] = {0};
 
-    bool freq_found = extract_form_value(body, "frequency=", freq_buf, sizeof(freq_buf));
-    bool drive_found = extract_form_value(body, "drive=", drive_buf, sizeof(drive_buf));
-
-    uint64_t previous_frequency = signal_controller_get_frequency_hz();
-    uint8_t previous_drive = signal_controller_get_drive_ma();
+    bool freq_found = webserver_form_value(body, "frequency=", freq_buf, sizeof(freq_buf));
+    bool drive_found = webserver_form_value(body, "drive=", drive_buf, sizeof(drive_buf));
 
     uint64_t freq = 0;
     uint64_t drive_val = 0;
 
-    bool freq_ok = freq_found && parse_uint64(freq_buf, &freq);
-    bool drive_ok = drive_found && parse_uint64(drive_buf, &drive_val);
+    bool freq_ok = freq_found && webserver_form_uint64(freq_buf, &freq);
+    bool drive_ok = drive_found && webserver_form_uint64(drive_buf, &drive_val);
 
     if (!freq_ok || !drive_ok) {
         webserver_set_status("Error: invalid form data", true);
-        log_error("[USER] invalid form data (freq='%s', drive='%s')", freq_buf, drive_buf);
-        return;
+        LOG_ERROR(LOG_CAT_USER, "invalid form data (freq='%s', drive='%s')", freq_buf,
+                  drive_buf);
+        return false;
     }
 
     freq = clamp_frequency(freq);
 
     if (!(drive_val == 2 || drive_val == 4 || drive_val == 6 || drive_val == 8)) {
         webserver_set_status("Error: drive must be 2, 4, 6 or 8 mA", true);
-        log_error("[USER] drive out of range: %llu", (unsigned long long)drive_val);
-        return;
-    }
-
-    if (!signal_controller_set(freq, (uint8_t)drive_val)) {
-        webserver_set_status("Error: failed to program Si5351", true);
-        return;
+        LOG_ERROR(LOG_CAT_USER, "drive out of range: %llu", (unsigned long long)drive_val);
+        return false;
     }
 
-    bool freq_changed = (previous_frequency != freq) || (previous_drive != drive_val);
-
-    char status[128];
-    if (freq_changed) {
-        snprintf(status, sizeof(status), "Applied %llu Hz @ %u mA", (unsigned long long)freq,
-                 (unsigned)drive_val);
-    } else {
-        strcpy(status, "No parameter change");
-    }
-    webserver_set_status(status, false);
+    job->kind = FORM_JOB_SIGNAL;
+    job->frequency_hz = freq;
+    job->drive_ma = (uint8_t)drive_val;
+    return true;
 }
 
-static void handle_morse_submission(const char *body) {
+static bool handle_morse_submission(const char *body, form_job_t *job) {
     char text_buf[MORSE_MAX_CHARS * 3] = {0};
     char wpm_buf[8] = {0};
     char fwpm_buf[8] = {0};
 
-    extract_form_value(body, "text=", text_buf, sizeof(text_buf));
-    extract_form_value(body, "wpm=", wpm_buf, sizeof(wpm_buf));
-    extract_form_value(body, "fwpm=", fwpm_buf, sizeof(fwpm_buf));
+    webserver_form_value(body, "text=", text_buf, sizeof(text_buf));
+    webserver_form_value(body, "wpm=", wpm_buf, sizeof(wpm_buf));
+    webserver_form_value(body, "fwpm=", fwpm_buf, sizeof(fwpm_buf));
 
     size_t text_len = strlen(text_buf);
     if (text_len == 0) {
         webserver_set_status("Error: text is required", true);
-        return;
+        return false;
     }
     if (text_len > MORSE_MAX_CHARS) {
         char msg[64];
         snprintf(msg, sizeof(msg), "Error: text must be %u characters or fewer",
                  (unsigned)MORSE_MAX_CHARS);
         webserver_set_status(msg, true);
-        return;
+        return false;
     }
 
     char *end = NULL;
     long wpm_long = strtol(wpm_buf, &end, 10);
     if (end == wpm_buf || wpm_long < 1 || wpm_long > 1000) {
         webserver_set_status("Error: WPM must be 1-1000", true);
-        return;
+        return false;
     }
 
     int farnsworth = -1;
@@ -395,54 +531,154 @@ static void handle_morse_submission(const char *body) {
         long fwpm_long = strtol(fwpm_buf, &end, 10);
         if (end == fwpm_buf || fwpm_long < 1 || fwpm_long > wpm_long) {
             webserver_set_status("Error: Farnsworth must be 1-<=WPM", true);
-            return;
+            return false;
         }
         farnsworth = (int)fwpm_long;
     }
 
     if (morse_is_playing()) {
         webserver_set_status("Morse playback busy", true);
-        return;
+        return false;
     }
 
-    if (!morse_start(text_buf, (uint8_t)text_len, (uint16_t)wpm_long, (int16_t)farnsworth)) {
-        const char *err = morse_last_error();
-        if (err && *err) {
-            webserver_set_status(err, true);
-        } else {
-            webserver_set_status("Error: failed to start Morse playback", true);
+    job->kind = FORM_JOB_MORSE_START;
+    memcpy(job->text, text_buf, text_len + 1);
+    job->text_len = (uint8_t)text_len;
+    job->wpm = (uint16_t)wpm_long;
+    job->fwpm = (int16_t)farnsworth;
+    return true;
+}
+
+static bool handle_morse_hold(const char *body, form_job_t *job) {
+    char active_buf[8] = {0};
+    webserver_form_value(body, "active=", active_buf, sizeof(active_buf));
+    job->kind = FORM_JOB_MORSE_HOLD;
+    job->flag = active_buf[0] == '1' || active_buf[0] == 't' || active_buf[0] == 'T';
+    return true;
+}
+
+// Main loop, lwIP lock not held: only the bus work happens here.
+static void form_job_run(control_job_t *control) {
+    form_job_t *job = (form_job_t *)control->data;
+    switch (job->kind) {
+    case FORM_JOB_TOGGLE_OUTPUT:
+        job->flag = !signal_controller_is_output_enabled();
+        job->ok = signal_controller_enable_output(job->flag);
+        break;
+    case FORM_JOB_SIGNAL:
+        job->changed = signal_controller_get_frequency_hz() != job->frequency_hz ||
+                       signal_controller_get_drive_ma() != job->drive_ma;
+        job->ok = signal_controller_set(job->frequency_hz, job->drive_ma);
+        break;
+    case FORM_JOB_MORSE_START:
+        job->ok = morse_start(job->text, job->text_len, job->wpm, job->fwpm);
+        break;
+    case FORM_JOB_MORSE_STOP:
+        job->flag = morse_is_playing();
+        if (job->flag) {
+            morse_stop();
         }
-        return;
+        break;
+    case FORM_JOB_MORSE_HOLD:
+        job->changed = webserver_morse_hold_output(job->flag);
+        break;
     }
+}
 
-    if (!g_morse_hold_active) {
-        webserver_set_status("Morse playback started", false);
+static void form_job_report(const form_job_t *job) {
+    char status[128];
+    switch (job->kind) {
+    case FORM_JOB_TOGGLE_OUTPUT:
+        if (job->ok) {
+            webserver_set_status(job->flag ? "Output enabled" : "Output disabled", false);
+        } else {
+            webserver_set_status("Error: failed to toggle output", true);
+        }
+        break;
+    case FORM_JOB_SIGNAL:
+        if (!job->ok) {
+            webserver_set_status("Error: failed to program Si5351", true);
+        } else if (job->changed) {
+            snprintf(status, sizeof(status), "Applied %llu Hz @ %u mA",
+                     (unsigned long long)job->frequency_hz, (unsigned)job->drive_ma);
+            webserver_set_status(status, false);
+        } else {
+            webserver_set_status("No parameter change", false);
+        }
+        break;
+    case FORM_JOB_MORSE_START:
+        if (!job->ok) {
+            const char *err = morse_last_error();
+            webserver_set_status((err && *err) ? err : "Error: failed to start Morse playback",
+                                 true);
+        } else if (!g_morse_hold_active) {
+            webserver_set_status("Morse playback started", false);
+        }
+        break;
+    case FORM_JOB_MORSE_STOP:
+        if (!g_morse_hold_active) {
+            webserver_set_status(job->flag ? "Stop requested" : "Morse playback idle", false);
+        }
+        break;
+    case FORM_JOB_MORSE_HOLD:
+        webserver_morse_hold_commit(job->flag, job->changed);
+        break;
     }
 }
 
-static void handle_morse_stop(void) {
-    if (morse_is_playing()) {
-        morse_stop();
-        if (!g_morse_hold_active) {
-            webserver_set_status("Stop requested", false);
+static void respond_form_page(struct tcp_pcb *pcb, void *ctx) {
+    (void)ctx;
+    respond_with_form(pcb, NULL);
+}
+
+// With the lwIP lock held. The status is kept even if the browser left.
+static void form_job_done(control_job_t *control) {
+    form_job_report((const form_job_t *)control->data);
+    webserver_http_resume(control->owner, respond_form_page, NULL);
+}
+
+// The page is rendered once the control queue has carried the job out.
+static bool defer_form_job(struct tcp_pcb *pcb, const form_job_t *job) {
+    const webserver_conn_handle_t handle = webserver_http_defer(pcb);
+    if (handle && control_queue_post(form_job_run, form_job_done, handle, job, sizeof(*job))) {
+        // Manual settings take the output from a running program.
+        if (job->kind == FORM_JOB_SIGNAL) {
+            sweep_stop();
+        }
+        if (job->kind == FORM_JOB_SIGNAL || job->kind == FORM_JOB_TOGGLE_OUTPUT ||
+            (job->kind == FORM_JOB_MORSE_HOLD && job->flag)) {
+            sequence_stop();
         }
-    } else if (!g_morse_hold_active) {
-        webserver_set_status("Morse playback idle", false);
+        return true;
     }
+    webserver_set_status("Error: controller busy, try again", true);
+    return false;
 }
 
-static void handle_morse_hold(const char *body) {
-    char active_buf[8] = {0};
-    extract_form_value(body, "active=", active_buf, sizeof(active_buf));
-    bool activate = (active_buf[0] == '1' || active_buf[0] == 't' || active_buf[0] == 'T');
+// Main loop, lwIP lock not held. The hold flags only change in the done
+// step, which the main loop runs right after, so reading them here is safe.
+bool webserver_morse_hold_output(bool activate) {
+    if (activate) {
+        if (g_morse_hold_active) {
+            return g_morse_hold_prev_enabled;
+        }
+        const bool output_enabled = signal_controller_is_output_enabled();
+        if (output_enabled) {
+            signal_controller_enable_output(false);
+        }
+        return output_enabled;
+    }
+    if (g_morse_hold_active && g_morse_hold_prev_enabled) {
+        signal_controller_enable_output(true);
+    }
+    return false;
+}
 
+// With the lwIP lock held.
+void webserver_morse_hold_commit(bool activate, bool prev_enabled) {
     if (activate) {
         if (!g_morse_hold_active) {
-            bool output_enabled = signal_controller_is_output_enabled();
-            g_morse_hold_prev_enabled = output_enabled;
-            if (output_enabled) {
-                signal_controller_enable_output(false);
-            }
+            g_morse_hold_prev_enabled = prev_enabled;
             if (g_status_message[0]) {
                 snprintf(g_status_prev_message, sizeof(g_status_prev_message), "%s",
                          g_status_message);
@@ -455,9 +691,6 @@ static void handle_morse_hold(const char *body) {
         g_morse_hold_active = true;
         webserver_set_status("Morse mode", false);
     } else {
-        if (g_morse_hold_active && g_morse_hold_prev_enabled) {
-            signal_controller_enable_output(true);
-        }
         g_morse_hold_active = false;
         g_morse_hold_prev_enabled = false;
         if (g_status_prev_valid) {
@@ -469,52 +702,72 @@ static void handle_morse_hold(const char *body) {
     }
 }
 
-static void respond_morse_status(struct tcp_pcb *pcb, web_connection_t *state) {
-    if (!pcb) {
-        if (state) {
-            free(state);
-        }
-        return;
-    }
-
-    bool playing = morse_is_playing();
+static void respond_morse_status(struct tcp_pcb *pcb) {
     const char *status = morse_status_text();
-    if (!status || !*status) {
-        status = "Idle";
-    }
+    char body[192];
+    json_writer_t w;
+    json_writer_init(&w, body, sizeof(body));
+    json_writer_begin_object(&w);
+    json_writer_key(&w, "playing");
+    json_writer_bool(&w, morse_is_playing());
+    json_writer_key(&w, "status");
+    json_writer_string(&w, (status && *status) ? status : "Idle");
+    json_writer_key(&w, "hold");
+    json_writer_bool(&w, g_morse_hold_active);
+    json_writer_key(&w, "output_enabled");
+    json_writer_bool(&w, signal_controller_is_output_enabled());
+    json_writer_end_object(&w);
+    send_json_response(pcb, body, json_writer_finish(&w));
+}
 
-    bool output_enabled = signal_controller_is_output_enabled();
+static void respond_boot_profile(struct tcp_pcb *pcb) {
+    char body[384];
+    json_writer_t w;
+    json_writer_init(&w, body, sizeof(body));
+    json_writer_begin_object(&w);
+    json_writer_key(&w, "unit");
+    json_writer_string(&w, "us");
+    json_writer_key(&w, "phases");
+    json_writer_begin_object(&w);
+    for (int phase = 0; phase < BOOT_PHASE_COUNT; ++phase) {
+        json_writer_key(&w, boot_profile_phase_name((boot_phase_t)phase));
+        json_writer_uint(&w, boot_profile_get_us((boot_phase_t)phase));
+    }
+    json_writer_end_object(&w);
+    json_writer_end_object(&w);
+    send_json_response(pcb, body, json_writer_finish(&w));
+}
 
-    char body[192];
-    int body_len = snprintf(
-        body, sizeof(body), "{\"playing\":%s,\"status\":\"%s\",\"hold\":%s,\"output_enabled\":%s}",
-        playing ? "true" : "false", status, g_morse_hold_active ? "true" : "false",
-        output_enabled ? "true" : "false");
-    if (body_len < 0 || body_len >= (int)sizeof(body)) {
-        const char fallback[] =
-            "{\"playing\":false,\"status\":\"Idle\",\"hold\":false,\"output_enabled\":false}";
-        memcpy(body, fallback, sizeof(fallback));
-        body_len = (int)sizeof(fallback) - 1;
-    }
-
-    char header[256];
-    int header_len = snprintf(header, sizeof(header),
-                              "HTTP/1.1 200 OK\r\n"
-                              "Content-Type: application/json; charset=utf-8\r\n"
-                              "Cache-Control: no-store\r\n"
-                              "Content-Length: %d\r\n"
-                              "Connection: close\r\n\r\n",
-                              body_len);
-
-    if (header_len > 0 && header_len < (int)sizeof(header)) {
-        err_t err = tcp_write(pcb, header, (u16_t)header_len, TCP_WRITE_FLAG_COPY);
-        if (err == ERR_OK) {
-            err = tcp_write(pcb, body, (u16_t)body_len, TCP_WRITE_FLAG_COPY);
-            if (err == ERR_OK) {
-                tcp_output(pcb);
-            }
-        }
+// Prometheus text exposition, rendered a line at a time from one snapshot.
+static void respond_metrics(struct tcp_pcb *pcb) {
+    const webserver_generated_response_t response = {
+        .content_type = "text/plain; version=0.0.4; charset=utf-8",
+        .snapshot = metrics_snapshot,
+        .line = metrics_line,
+    };
+    if (webserver_send_generated(pcb, &response) != ERR_OK) {
+        webserver_send_error(pcb, 500, "Internal Server Error");
+    }
+}
+
+// High-water marks of the stacks, heaps and lwIP pools, for sizing lwipopts.h.
+static void respond_memory(struct tcp_pcb *pcb) {
+    const webserver_generated_response_t response = {
+        .content_type = "application/json; charset=utf-8",
+        .snapshot = memory_stats_snapshot,
+        .line = memory_stats_line,
+    };
+    if (webserver_send_generated(pcb, &response) != ERR_OK) {
+        webserver_send_error(pcb, 500, "Internal Server Error");
     }
+}
 
-    webserver_close(pcb, state);
+static void send_json_response(struct tcp_pcb *pcb, const char *body, size_t body_len) {
+    if (body_len == 0) {
+        webserver_send_error(pcb, 500, "Internal Server Error");
+        return;
+    }
+    if (webserver_send_json(pcb, 200, "OK", NULL, body, body_len) == ERR_OK) {
+        boot_profile_mark(BOOT_PHASE_FIRST_HTTP_RESPONSE);
+    }
 }
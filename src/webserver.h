@@ -5,5 +5,14 @@
 
 void webserver_init(void);
 void webserver_set_status(const char *message, bool is_error);
+// True while the Morse panel holds the output for keying.
+bool webserver_morse_hold_active(void);
+// Takes the output for Morse keying, or hands it back as it was before, in
+// two halves: the bus work from a control job's run step, returning whether
+// the output was on, then the hold state and status from its done step.
+bool webserver_morse_hold_output(bool activate);
+void webserver_morse_hold_commit(bool activate, bool prev_enabled);
+// Message shown above the form; empty when there is none.
+const char *webserver_status_message(bool *is_error);
 
 #endif // WEBSERVER_H
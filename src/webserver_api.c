@@ -0,0 +1,773 @@
+#include "webserver_api.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "app_state.h"
+#include "control_queue.h"
+#include "json.h"
+#include "logging.h"
+#include "morse_player.h"
+#include "sequence.h"
+#include "signal_controller.h"
+#include "sweep.h"
+#include "webserver.h"
+#include "webserver_utils.h"
+
+#define API_FREQ_MIN_HZ 8000ull
+#define API_FREQ_MAX_HZ 200000000ull
+#define API_DOCUMENT_MAX 384
+
+#define API_BATCH_MAX 16
+#define API_LARGE_DOCUMENT_MAX 1536
+
+enum {
+    API_FIELD_FREQUENCY = 1u << 0,
+    API_FIELD_DRIVE = 1u << 1,
+    API_FIELD_OUTPUT = 1u << 2,
+    API_FIELD_TEXT = 1u << 3,
+    API_FIELD_WPM = 1u << 4,
+    API_FIELD_FWPM = 1u << 5,
+    API_FIELD_PLAYING = 1u << 6,
+    API_FIELD_HOLD = 1u << 7,
+};
+
+#define API_SIGNAL_FIELDS (API_FIELD_FREQUENCY | API_FIELD_DRIVE | API_FIELD_OUTPUT)
+
+// Members of a PUT body; fields records which ones were present.
+typedef struct {
+    uint32_t fields;
+    uint64_t frequency_hz;
+    uint64_t drive_ma;
+    bool output_enabled;
+    bool playing;
+    bool hold;
+    uint64_t wpm;
+    int64_t fwpm; // -1 for null
+    size_t text_len;
+    char text[MORSE_MAX_CHARS + 1];
+} api_request_t;
+
+typedef struct {
+    int status;
+    const char *reason;
+    const char *message;
+} api_error_t;
+
+typedef struct {
+    const char *name;
+    uint32_t writable; // members PUT may carry; 0 for read-only resources
+    void (*write)(json_writer_t *w);
+} api_resource_t;
+
+static void api_write_state(json_writer_t *w);
+static void api_write_signal(json_writer_t *w);
+static void api_write_output(json_writer_t *w);
+static void api_write_drive(json_writer_t *w);
+static void api_write_morse(json_writer_t *w);
+
+static const api_resource_t k_api_resources[] = {
+    {"state", 0, api_write_state},
+    {"signal", API_SIGNAL_FIELDS, api_write_signal},
+    {"output", API_FIELD_OUTPUT, api_write_output},
+    {"drive", API_FIELD_DRIVE, api_write_drive},
+    {"morse", API_FIELD_TEXT | API_FIELD_WPM | API_FIELD_FWPM | API_FIELD_PLAYING | API_FIELD_HOLD,
+     api_write_morse},
+};
+
+static const struct {
+    const char *name;
+    uint32_t field;
+} k_api_fields[] = {
+    {"frequency_hz", API_FIELD_FREQUENCY},
+    {"drive_ma", API_FIELD_DRIVE},
+    {"output_enabled", API_FIELD_OUTPUT},
+    {"text", API_FIELD_TEXT},
+    {"wpm", API_FIELD_WPM},
+    {"fwpm", API_FIELD_FWPM},
+    {"playing", API_FIELD_PLAYING},
+    {"hold", API_FIELD_HOLD},
+};
+
+// A PUT carried out by the control queue; run records whether it applied.
+typedef struct {
+    api_request_t request;
+    api_error_t error;
+    uint8_t resource; // index into k_api_resources
+    bool ok;
+    bool hold_prev_enabled; // handed from run to done with the hold field
+} api_put_job_t;
+
+// A batch that passed validation, folded into the settings to flush.
+typedef struct {
+    signal_settings_t settings;
+    uint8_t count;
+    bool applied;
+} api_batch_job_t;
+
+// Loads the uploaded sequence; error stays NULL once it started.
+typedef struct {
+    const char *error;
+} api_sequence_job_t;
+
+_Static_assert(sizeof(api_put_job_t) <= CONTROL_JOB_DATA_MAX, "PUT job exceeds the job payload");
+_Static_assert(sizeof(api_batch_job_t) <= CONTROL_JOB_DATA_MAX,
+               "batch job exceeds the job payload");
+
+// Answers are built one at a time under the lwIP lock, and full batch and
+// sequence answers are larger than the other documents, so they are built
+// here rather than on the stack.
+static char g_large_document[API_LARGE_DOCUMENT_MAX];
+
+static bool api_fail(api_error_t *error, int status, const char *message) {
+    error->status = status;
+    error->reason = status == 409 ? "Conflict"
+                    : status == 500 ? "Internal Server Error"
+                                    : "Bad Request";
+    error->message = message;
+    return false;
+}
+
+static void api_write_signal_members(json_writer_t *w) {
+    json_writer_key(w, "frequency_hz");
+    json_writer_uint(w, signal_controller_get_frequency_hz());
+    json_writer_key(w, "drive_ma");
+    json_writer_uint(w, signal_controller_get_drive_ma());
+    json_writer_key(w, "output_enabled");
+    json_writer_bool(w, signal_controller_is_output_enabled());
+}
+
+static void api_write_signal(json_writer_t *w) { api_write_signal_members(w); }
+
+static void api_write_output(json_writer_t *w) {
+    json_writer_key(w, "output_enabled");
+    json_writer_bool(w, signal_controller_is_output_enabled());
+}
+
+static void api_write_drive(json_writer_t *w) {
+    json_writer_key(w, "drive_ma");
+    json_writer_uint(w, signal_controller_get_drive_ma());
+}
+
+static const char *api_morse_status(void) {
+    const char *status = morse_status_text();
+    return (status && *status) ? status : "Idle";
+}
+
+static void api_write_morse(json_writer_t *w) {
+    char text[MORSE_MAX_CHARS + 1];
+    uint16_t wpm = 0;
+    int16_t fwpm = -1;
+    morse_get_form_defaults(text, sizeof(text), &wpm, &fwpm);
+
+    json_writer_key(w, "playing");
+    json_writer_bool(w, morse_is_playing());
+    json_writer_key(w, "status");
+    json_writer_string(w, api_morse_status());
+    json_writer_key(w, "hold");
+    json_writer_bool(w, webserver_morse_hold_active());
+    json_writer_key(w, "text");
+    json_writer_string(w, text);
+    json_writer_key(w, "wpm");
+    json_writer_uint(w, wpm);
+    json_writer_key(w, "fwpm");
+    if (fwpm > 0) {
+        json_writer_uint(w, (uint64_t)fwpm);
+    } else {
+        json_writer_null(w);
+    }
+    json_writer_key(w, "error");
+    json_writer_string(w, morse_last_error());
+}
+
+// The status message goes last so an oversized one is cut short instead of
+// the rest of the document.
+static void api_write_state(json_writer_t *w) {
+    bool status_is_error = false;
+    const char *message = webserver_status_message(&status_is_error);
+
+    api_write_signal_members(w);
+    json_writer_key(w, "playing");
+    json_writer_bool(w, morse_is_playing());
+    json_writer_key(w, "status");
+    json_writer_string(w, api_morse_status());
+    json_writer_key(w, "hold");
+    json_writer_bool(w, webserver_morse_hold_active());
+    json_writer_key(w, "error");
+    json_writer_bool(w, status_is_error);
+    json_writer_key(w, "message");
+    json_writer_string_clipped(w, message, 1);
+}
+
+size_t webserver_api_format_state(char *out, size_t out_len) {
+    json_writer_t w;
+    json_writer_init(&w, out, out_len);
+    json_writer_begin_object(&w);
+    api_write_state(&w);
+    json_writer_end_object(&w);
+    return json_writer_finish(&w);
+}
+
+static bool api_parse_members(json_reader_t *reader, uint32_t writable, api_request_t *request,
+                              api_error_t *error) {
+    json_value_t key;
+    json_value_t value;
+    *request = (api_request_t){.fwpm = -1};
+
+    while (json_reader_next(reader, &key, &value)) {
+        uint32_t field = 0;
+        for (size_t i = 0; i < sizeof(k_api_fields) / sizeof(k_api_fields[0]); ++i) {
+            if (json_value_equals(&key, k_api_fields[i].name)) {
+                field = k_api_fields[i].field;
+                break;
+            }
+        }
+        if (!(field & writable)) {
+            return api_fail(error, 400, "unknown member");
+        }
+        if (request->fields & field) {
+            return api_fail(error, 400, "duplicate member");
+        }
+        request->fields |= field;
+
+        bool ok = false;
+        switch (field) {
+        case API_FIELD_FREQUENCY:
+            ok = json_value_uint(&value, &request->frequency_hz);
+            break;
+        case API_FIELD_DRIVE:
+            ok = json_value_uint(&value, &request->drive_ma);
+            break;
+        case API_FIELD_WPM:
+            ok = json_value_uint(&value, &request->wpm);
+            break;
+        case API_FIELD_FWPM: {
+            uint64_t fwpm = 0;
+            ok = value.type == JSON_VALUE_NULL || (json_value_uint(&value, &fwpm) && fwpm <= 1000);
+            request->fwpm = value.type == JSON_VALUE_NULL ? -1 : (int64_t)fwpm;
+            break;
+        }
+        case API_FIELD_OUTPUT:
+            ok = json_value_bool(&value, &request->output_enabled);
+            break;
+        case API_FIELD_PLAYING:
+            ok = json_value_bool(&value, &request->playing);
+            break;
+        case API_FIELD_HOLD:
+            ok = json_value_bool(&value, &request->hold);
+            break;
+        case API_FIELD_TEXT:
+            ok = json_value_copy_string(&value, request->text, sizeof(request->text),
+                                        &request->text_len);
+            if (!ok) {
+                return api_fail(error, 400, "text must be 1-20 characters");
+            }
+            break;
+        default:
+            break;
+        }
+        if (!ok) {
+            return api_fail(error, 400, "member has the wrong type");
+        }
+    }
+    if (reader->error) {
+        return api_fail(error, 400, "body must be a flat JSON object");
+    }
+    if (request->fields == 0) {
+        return api_fail(error, 400, "nothing to change");
+    }
+    return true;
+}
+
+static bool api_parse(const char *body, size_t body_len, uint32_t writable,
+                      api_request_t *request, api_error_t *error) {
+    json_reader_t reader;
+    json_reader_init(&reader, body, body_len);
+    if (!api_parse_members(&reader, writable, request, error)) {
+        return false;
+    }
+    if (!json_reader_ok(&reader)) {
+        return api_fail(error, 400, "body must be a flat JSON object");
+    }
+    return true;
+}
+
+// Later members override earlier ones, as if each had been applied in turn.
+static void api_fold_signal(const api_request_t *request, signal_settings_t *settings) {
+    if (request->fields & API_FIELD_FREQUENCY) {
+        settings->frequency_hz = request->frequency_hz;
+    }
+    if (request->fields & API_FIELD_DRIVE) {
+        settings->drive_ma = (uint8_t)request->drive_ma;
+    }
+    if (request->fields & API_FIELD_OUTPUT) {
+        settings->output_enabled = request->output_enabled;
+    }
+}
+
+// Everything is checked before anything is applied, so a rejected request
+// changes nothing.
+static bool api_validate(api_request_t *request, api_error_t *error) {
+    const uint32_t fields = request->fields;
+    if ((fields & API_FIELD_FREQUENCY) &&
+        (request->frequency_hz < API_FREQ_MIN_HZ || request->frequency_hz > API_FREQ_MAX_HZ)) {
+        return api_fail(error, 400, "frequency_hz must be 8000-200000000");
+    }
+    if ((fields & API_FIELD_DRIVE) && request->drive_ma != 2 && request->drive_ma != 4 &&
+        request->drive_ma != 6 && request->drive_ma != 8) {
+        return api_fail(error, 400, "drive_ma must be 2, 4, 6 or 8");
+    }
+    if ((fields & API_FIELD_OUTPUT) && (morse_is_playing() || webserver_morse_hold_active())) {
+        return api_fail(error, 409, "output is held for Morse");
+    }
+
+    const bool start = (fields & API_FIELD_TEXT) ||
+                       ((fields & API_FIELD_PLAYING) && request->playing);
+    if ((fields & (API_FIELD_WPM | API_FIELD_FWPM)) && !start) {
+        return api_fail(error, 400, "wpm and fwpm need text or playing:true");
+    }
+    if ((fields & API_FIELD_TEXT) && (fields & API_FIELD_PLAYING) && !request->playing) {
+        return api_fail(error, 400, "text conflicts with playing:false");
+    }
+    if (!start) {
+        return true;
+    }
+
+    // Whatever the request leaves out comes from the last playback.
+    uint16_t wpm = 0;
+    int16_t fwpm = -1;
+    char text[MORSE_MAX_CHARS + 1];
+    morse_get_form_defaults(text, sizeof(text), &wpm, &fwpm);
+    if (!(fields & API_FIELD_TEXT)) {
+        memcpy(request->text, text, sizeof(text));
+        request->text_len = strlen(request->text);
+    }
+    if (!(fields & API_FIELD_WPM)) {
+        request->wpm = wpm;
+    }
+    if (!(fields & API_FIELD_FWPM) && !(fields & API_FIELD_WPM)) {
+        request->fwpm = fwpm;
+    }
+
+    if (request->text_len == 0 || request->text_len > MORSE_MAX_CHARS) {
+        return api_fail(error, 400, "text must be 1-20 characters");
+    }
+    if (request->wpm < 1 || request->wpm > 1000) {
+        return api_fail(error, 400, "wpm must be 1-1000");
+    }
+    if (request->fwpm == 0 || request->fwpm > (int64_t)request->wpm) {
+        return api_fail(error, 400, "fwpm must be 1-wpm or null");
+    }
+    if (morse_is_playing()) {
+        return api_fail(error, 409, "Morse playback busy");
+    }
+    return true;
+}
+
+// Bus work only; a hold field is committed by api_put_done().
+static bool api_apply(const api_request_t *request, bool *hold_prev_enabled,
+                      api_error_t *error) {
+    const uint32_t fields = request->fields;
+    if (fields & API_FIELD_HOLD) {
+        *hold_prev_enabled = webserver_morse_hold_output(request->hold);
+    }
+    if (fields & API_SIGNAL_FIELDS) {
+        signal_settings_t settings;
+        signal_controller_get(&settings);
+        api_fold_signal(request, &settings);
+        if (!signal_controller_apply(&settings)) {
+            return api_fail(error, 500, "failed to program Si5351");
+        }
+    }
+    if ((fields & API_FIELD_PLAYING) && !request->playing) {
+        morse_stop();
+    } else if ((fields & API_FIELD_TEXT) || (fields & API_FIELD_PLAYING)) {
+        if (!morse_start(request->text, (uint8_t)request->text_len, (uint16_t)request->wpm,
+                         (int16_t)request->fwpm)) {
+            const char *err = morse_last_error();
+            return api_fail(error, 400, (err && *err) ? err : "failed to start Morse playback");
+        }
+    }
+    LOG_DEBUG(LOG_CAT_USER, "api update fields=0x%02lx", (unsigned long)fields);
+    return true;
+}
+
+static void api_send_error(struct tcp_pcb *pcb, const api_error_t *error) {
+    char body[128];
+    json_writer_t w;
+    json_writer_init(&w, body, sizeof(body));
+    json_writer_begin_object(&w);
+    json_writer_key(&w, "error");
+    json_writer_string_clipped(&w, error->message, 1);
+    json_writer_end_object(&w);
+    webserver_send_json(pcb, error->status, error->reason, NULL, body, json_writer_finish(&w));
+}
+
+// generation must be read before the state it describes, as for the page ETag.
+static void api_send_resource(struct tcp_pcb *pcb, const api_resource_t *resource,
+                              uint32_t generation, const char *etag) {
+    char body[API_DOCUMENT_MAX];
+    json_writer_t w;
+    json_writer_init(&w, body, sizeof(body));
+    json_writer_begin_object(&w);
+    json_writer_key(&w, "generation");
+    json_writer_uint(&w, generation);
+    resource->write(&w);
+    json_writer_end_object(&w);
+
+    const size_t len = json_writer_finish(&w);
+    if (len == 0) {
+        const api_error_t error = {500, "Internal Server Error", "document too large"};
+        api_send_error(pcb, &error);
+        return;
+    }
+    webserver_send_json(pcb, 200, "OK", etag, body, len);
+}
+
+// Answers a batch. results holds the reason each refused operation was
+// refused, or is NULL when all passed; error is NULL once they were applied.
+static void api_send_batch(struct tcp_pcb *pcb, const char *const *results, size_t count,
+                           const api_error_t *error) {
+    const uint32_t generation = app_state_generation();
+
+    json_writer_t w;
+    json_writer_init(&w, g_large_document, sizeof(g_large_document));
+    json_writer_begin_object(&w);
+    json_writer_key(&w, "generation");
+    json_writer_uint(&w, generation);
+    json_writer_key(&w, "applied");
+    json_writer_bool(&w, !error);
+    json_writer_key(&w, "results");
+    json_writer_begin_array(&w);
+    for (size_t i = 0; i < count; ++i) {
+        json_writer_string(&w, (results && results[i]) ? results[i] : "ok");
+    }
+    json_writer_end_array(&w);
+    if (!error) {
+        api_write_signal_members(&w);
+    } else if (!results) {
+        json_writer_key(&w, "error");
+        json_writer_string(&w, error->message);
+    }
+    json_writer_end_object(&w);
+
+    const size_t len = json_writer_finish(&w);
+    if (len == 0) {
+        const api_error_t overflow = {500, "Internal Server Error", "document too large"};
+        api_send_error(pcb, &overflow);
+        return;
+    }
+    webserver_send_json(pcb, error ? error->status : 200, error ? error->reason : "OK", NULL,
+                        g_large_document, len);
+}
+
+// Bus work runs from the control queue and the answer follows once it is
+// done; a full queue is answered right away and reported with false.
+static bool api_defer(struct tcp_pcb *pcb, control_job_fn run, control_job_fn done,
+                      const void *job, size_t job_len) {
+    const webserver_conn_handle_t handle = webserver_http_defer(pcb);
+    if (!handle || !control_queue_post(run, done, handle, job, job_len)) {
+        const api_error_t error = {503, "Service Unavailable", "control queue full"};
+        api_send_error(pcb, &error);
+        return false;
+    }
+    return true;
+}
+
+// Manual settings take the output from a running sweep or sequence once
+// their job is queued; the sweep only yields to a new frequency.
+static void api_take_output(uint32_t fields, bool hold) {
+    if (fields & API_FIELD_FREQUENCY) {
+        sweep_stop();
+    }
+    if ((fields & API_SIGNAL_FIELDS) || ((fields & API_FIELD_HOLD) && hold)) {
+        sequence_stop();
+    }
+}
+
+static void api_batch_run(control_job_t *control) {
+    api_batch_job_t *job = (api_batch_job_t *)control->data;
+    job->applied = signal_controller_apply(&job->settings);
+}
+
+static void api_batch_respond(struct tcp_pcb *pcb, void *ctx) {
+    const api_batch_job_t *job = (const api_batch_job_t *)ctx;
+    const api_error_t error = {500, "Internal Server Error", "failed to program Si5351"};
+    api_send_batch(pcb, NULL, job->count, job->applied ? NULL : &error);
+}
+
+static void api_batch_done(control_job_t *control) {
+    webserver_http_resume(control->owner, api_batch_respond, control->data);
+}
+
+// Every operation is parsed and validated before anything is applied. If all
+// pass they are folded into one target state and flushed to the Si5351 at
+// once. One result per operation: "ok" or the reason it was refused.
+static void api_handle_batch(struct tcp_pcb *pcb, const char *body, size_t body_len) {
+    const char *errors[API_BATCH_MAX];
+    size_t count = 0;
+    api_error_t first_error = {0};
+    api_batch_job_t job = {0};
+    uint32_t fields = 0;
+    signal_controller_get(&job.settings);
+
+    json_reader_t reader;
+    json_reader_t element;
+    json_reader_init(&reader, body, body_len);
+    while (json_reader_next_object(&reader, &element)) {
+        if (count == API_BATCH_MAX) {
+            const api_error_t error = {400, "Bad Request", "too many operations"};
+            api_send_error(pcb, &error);
+            return;
+        }
+        api_request_t op;
+        api_error_t error = {0};
+        if (api_parse_members(&element, API_SIGNAL_FIELDS, &op, &error) &&
+            api_validate(&op, &error)) {
+            api_fold_signal(&op, &job.settings);
+            fields |= op.fields;
+            errors[count++] = NULL;
+            continue;
+        }
+        errors[count++] = error.message;
+        if (!first_error.status) {
+            first_error = error;
+        }
+        // Skip the rest of a refused operation so the next one can be read.
+        json_value_t key;
+        json_value_t value;
+        while (json_reader_next(&element, &key, &value)) {
+        }
+    }
+    if (!json_reader_ok(&reader) || count == 0) {
+        const api_error_t error = {400, "Bad Request", "body must be an array of objects"};
+        api_send_error(pcb, &error);
+        return;
+    }
+    if (first_error.status) {
+        api_send_batch(pcb, errors, count, &first_error);
+        return;
+    }
+
+    job.count = (uint8_t)count;
+    if (api_defer(pcb, api_batch_run, api_batch_done, &job, sizeof(job))) {
+        api_take_output(fields, false);
+    }
+}
+
+static void api_put_run(control_job_t *control) {
+    api_put_job_t *job = (api_put_job_t *)control->data;
+    job->ok = api_apply(&job->request, &job->hold_prev_enabled, &job->error);
+}
+
+static void api_put_respond(struct tcp_pcb *pcb, void *ctx) {
+    const api_put_job_t *job = (const api_put_job_t *)ctx;
+    if (!job->ok) {
+        api_send_error(pcb, &job->error);
+        return;
+    }
+    api_send_resource(pcb, &k_api_resources[job->resource], app_state_generation(), NULL);
+}
+
+static void api_put_done(control_job_t *control) {
+    const api_put_job_t *job = (const api_put_job_t *)control->data;
+    if (job->request.fields & API_FIELD_HOLD) {
+        webserver_morse_hold_commit(job->request.hold, job->hold_prev_enabled);
+    }
+    webserver_http_resume(control->owner, api_put_respond, control->data);
+}
+
+static const char *api_request_body(const char *request, size_t request_len, size_t *body_len) {
+    const char *crlf = strstr(request, "\r\n\r\n");
+    const char *lf = strstr(request, "\n\n");
+    const char *body = NULL;
+    if (crlf && (!lf || crlf < lf)) {
+        body = crlf + 4;
+    } else if (lf) {
+        body = lf + 2;
+    }
+    *body_len = body ? request_len - (size_t)(body - request) : 0;
+    return body;
+}
+
+// steps holds [line, runs, mean_us, max_us] for every boundary of the
+// compiled program: how far behind its deadline it ran.
+static void api_send_sequence(struct tcp_pcb *pcb) {
+    json_writer_t w;
+    json_writer_init(&w, g_large_document, sizeof(g_large_document));
+    json_writer_begin_object(&w);
+    json_writer_key(&w, "generation");
+    json_writer_uint(&w, app_state_generation());
+    json_writer_key(&w, "status");
+    json_writer_string(&w, sequence_status_text());
+    json_writer_key(&w, "error");
+    json_writer_string(&w, sequence_last_error());
+    json_writer_key(&w, "images");
+    json_writer_uint(&w, sequence_image_count());
+    json_writer_key(&w, "steps");
+    json_writer_begin_array(&w);
+    for (size_t i = 0; i < sequence_entry_count(); ++i) {
+        sequence_step_timing_t timing;
+        if (!sequence_get_step_timing(i, &timing)) {
+            continue;
+        }
+        json_writer_begin_array(&w);
+        json_writer_uint(&w, timing.line);
+        json_writer_uint(&w, timing.runs);
+        json_writer_uint(&w, timing.mean_late_us);
+        json_writer_uint(&w, timing.max_late_us);
+        json_writer_end_array(&w);
+    }
+    json_writer_end_array(&w);
+    json_writer_end_object(&w);
+
+    const size_t len = json_writer_finish(&w);
+    if (len == 0) {
+        const api_error_t error = {500, "Internal Server Error", "document too large"};
+        api_send_error(pcb, &error);
+        return;
+    }
+    webserver_send_json(pcb, 200, "OK", NULL, g_large_document, len);
+}
+
+static void api_sequence_run(control_job_t *control) {
+    api_sequence_job_t *job = (api_sequence_job_t *)control->data;
+    if (morse_is_playing() || webserver_morse_hold_active()) {
+        sequence_discard();
+        job->error = "Morse keying holds the output";
+        return;
+    }
+    job->error = sequence_load();
+}
+
+static void api_sequence_respond(struct tcp_pcb *pcb, void *ctx) {
+    const api_sequence_job_t *job = (const api_sequence_job_t *)ctx;
+    if (job->error) {
+        const api_error_t error = {409, "Conflict", job->error};
+        api_send_error(pcb, &error);
+        return;
+    }
+    api_send_sequence(pcb);
+}
+
+static void api_sequence_done(control_job_t *control) {
+    const api_sequence_job_t *job = (const api_sequence_job_t *)control->data;
+    if (!job->error) {
+        sweep_stop();
+    }
+    webserver_http_resume(control->owner, api_sequence_respond, control->data);
+}
+
+// GET reports the program and its timing, POST uploads a program as plain
+// text and starts it, DELETE stops it.
+static void api_handle_sequence(struct tcp_pcb *pcb, const char *request, size_t request_len,
+                                size_t method_len) {
+    if (method_len == 3 && strncmp(request, "GET", 3) == 0) {
+        api_send_sequence(pcb);
+        return;
+    }
+    if (method_len == 6 && strncmp(request, "DELETE", 6) == 0) {
+        sequence_stop();
+        api_send_sequence(pcb);
+        return;
+    }
+    if (method_len != 4 || strncmp(request, "POST", 4) != 0) {
+        const api_error_t error = {405, "Method Not Allowed", "method not allowed"};
+        api_send_error(pcb, &error);
+        return;
+    }
+    size_t body_len = 0;
+    const char *body = api_request_body(request, request_len, &body_len);
+    const char *message = sequence_parse(body, body_len);
+    if (message) {
+        const api_error_t error = {400, "Bad Request", message};
+        api_send_error(pcb, &error);
+        return;
+    }
+    const api_sequence_job_t job = {0};
+    if (!api_defer(pcb, api_sequence_run, api_sequence_done, &job, sizeof(job))) {
+        sequence_discard();
+    }
+}
+
+bool webserver_api_handle(struct tcp_pcb *pcb, const char *request, size_t request_len) {
+    const char *method_end = strchr(request, ' ');
+    if (!method_end) {
+        return false;
+    }
+    const char *path = method_end + 1;
+    const size_t prefix_len = sizeof(WEBSERVER_API_PREFIX) - 1;
+    if (strncmp(path, WEBSERVER_API_PREFIX, prefix_len) != 0) {
+        return false;
+    }
+    webserver_http_tag(pcb, METRICS_ROUTE_API);
+    const char *name = path + prefix_len;
+    const size_t name_len = strcspn(name, " ?");
+    const size_t method_len = (size_t)(method_end - request);
+
+    if (name_len == 5 && strncmp(name, "batch", 5) == 0) {
+        if (method_len != 4 || strncmp(request, "POST", 4) != 0) {
+            const api_error_t error = {405, "Method Not Allowed", "method not allowed"};
+            api_send_error(pcb, &error);
+            return true;
+        }
+        size_t body_len = 0;
+        const char *body = api_request_body(request, request_len, &body_len);
+        api_handle_batch(pcb, body, body_len);
+        return true;
+    }
+
+    if (name_len == 8 && strncmp(name, "sequence", 8) == 0) {
+        api_handle_sequence(pcb, request, request_len, method_len);
+        return true;
+    }
+
+    const api_resource_t *resource = NULL;
+    for (size_t i = 0; i < sizeof(k_api_resources) / sizeof(k_api_resources[0]); ++i) {
+        if (strlen(k_api_resources[i].name) == name_len &&
+            strncmp(k_api_resources[i].name, name, name_len) == 0) {
+            resource = &k_api_resources[i];
+            break;
+        }
+    }
+    if (!resource) {
+        const api_error_t error = {404, "Not Found", "no such resource"};
+        api_send_error(pcb, &error);
+        return true;
+    }
+
+    if (method_len == 3 && strncmp(request, "GET", 3) == 0) {
+        // Pollers send back the ETag and get a bodyless 304 until something changes.
+        const uint32_t generation = app_state_generation();
+        char etag[32];
+        app_state_etag(generation, etag, sizeof(etag));
+        size_t match_len = 0;
+        const char *match = webserver_request_header(request, "If-None-Match", &match_len);
+        if (match && match_len == strlen(etag) && memcmp(match, etag, match_len) == 0) {
+            webserver_send_not_modified(pcb, etag);
+        } else {
+            api_send_resource(pcb, resource, generation, etag);
+        }
+        return true;
+    }
+    if (method_len != 3 || strncmp(request, "PUT", 3) != 0 || resource->writable == 0) {
+        const api_error_t error = {405, "Method Not Allowed", "method not allowed"};
+        api_send_error(pcb, &error);
+        return true;
+    }
+
+    size_t body_len = 0;
+    const char *body = api_request_body(request, request_len, &body_len);
+    api_put_job_t job = {.resource = (uint8_t)(resource - k_api_resources)};
+    api_error_t error = {0};
+    if (!api_parse(body, body_len, resource->writable, &job.request, &error) ||
+        !api_validate(&job.request, &error)) {
+        api_send_error(pcb, &error);
+        return true;
+    }
+    if (api_defer(pcb, api_put_run, api_put_done, &job, sizeof(job))) {
+        api_take_output(job.request.fields, job.request.hold);
+    }
+    return true;
+}
@@ -0,0 +1,20 @@
+#ifndef WEBSERVER_API_H
+#define WEBSERVER_API_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "lwip/tcp.h"
+
+#define WEBSERVER_API_PREFIX "/api/v1/"
+
+// Answers a request under /api/v1/ with a small JSON document: GET returns a
+// resource, PUT applies the members given and returns that resource again.
+// POST /api/v1/batch applies an array of signal updates in one step.
+// Returns false, without responding, for paths outside the API.
+bool webserver_api_handle(struct tcp_pcb *pcb, const char *request, size_t request_len);
+
+// Everything the page shows that can change without a reload, as one object.
+size_t webserver_api_format_state(char *out, size_t out_len);
+
+#endif // WEBSERVER_API_H
@@ -0,0 +1,65 @@
+#include "webserver_form.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int hex_digit_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return 10 + (c - 'a');
+    }
+    if (c >= 'A' && c <= 'F') {
+        return 10 + (c - 'A');
+    }
+    return -1;
+}
+
+bool webserver_form_value(const char *body, const char *key, char *out, size_t out_len) {
+    if (!body || !key || !out || out_len == 0) {
+        return false;
+    }
+
+    const char *key_pos = strstr(body, key);
+    if (!key_pos) {
+        out[0] = '\0';
+        return false;
+    }
+
+    key_pos += strlen(key);
+    size_t idx = 0;
+
+    while (*key_pos && *key_pos != '&' && idx < out_len - 1) {
+        char c = *key_pos++;
+        if (c == '+') {
+            c = ' ';
+        } else if (c == '%' && key_pos[0] && key_pos[1]) {
+            int hi = hex_digit_value(key_pos[0]);
+            int lo = hex_digit_value(key_pos[1]);
+            if (hi >= 0 && lo >= 0) {
+                c = (char)((hi << 4) | lo);
+                key_pos += 2;
+            }
+        }
+        out[idx++] = c;
+    }
+
+    out[idx] = '\0';
+    return true;
+}
+
+bool webserver_form_uint64(const char *value, uint64_t *out) {
+    if (!value || !*value) {
+        return false;
+    }
+
+    char *end = NULL;
+    unsigned long long parsed = strtoull(value, &end, 10);
+    if (end == value || (*end != '\0' && *end != '&')) {
+        return false;
+    }
+
+    *out = (uint64_t)parsed;
+    return true;
+}
@@ -0,0 +1,20 @@
+#ifndef WEBSERVER_FORM_H
+#define WEBSERVER_FORM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// application/x-www-form-urlencoded bodies as the landing page posts them.
+// Nothing here touches the network, so it also builds off-target.
+
+// Copies the value after key (which includes its '='), decoding '+' and %XX,
+// truncated to out_len - 1 bytes. Returns false and empties out when the key
+// is not in body.
+bool webserver_form_value(const char *body, const char *key, char *out, size_t out_len);
+
+// Parses a decimal number that must run to the end of value or to the
+// next field.
+bool webserver_form_uint64(const char *value, uint64_t *out);
+
+#endif // WEBSERVER_FORM_H
@@ -5,10 +5,48 @@
 #include <stddef.h>
 #include <stdint.h>
 
-void webserver_build_landing_page(char *buffer, size_t max_len, uint64_t frequency_hz,
-                                  uint8_t drive_ma, bool output_enabled, const char *status_message,
-                                  bool is_error, const char *morse_text, uint16_t morse_wpm,
-                                  int16_t morse_fwpm, bool morse_playing, const char *morse_status,
-                                  bool morse_hold_active);
+#include "morse_player.h"
+#include "web_template.h"
+#include "web_templates.h"
+
+#define WEBSERVER_STATUS_MAX 128
+#define WEBSERVER_PAGE_FRAGMENT_BYTES 1024
+
+// Snapshot of everything the landing page shows, taken when the request
+// arrives so the page stays consistent while it streams out.
+typedef struct {
+    uint64_t frequency_hz;
+    uint8_t drive_ma;
+    bool output_enabled;
+    bool status_is_error;
+    bool morse_playing;
+    bool morse_hold_active;
+    uint16_t morse_wpm;
+    int16_t morse_fwpm;
+    const char *morse_status; // static string from morse_status_text()
+    char status_message[WEBSERVER_STATUS_MAX];
+    char morse_text[MORSE_MAX_CHARS + 1];
+} webserver_page_model_t;
+
+// Every slot of the landing page rendered and escaped once, so repeat
+// requests for the same state generation skip resolving and escaping. Only
+// the first webserver_page_fragments_size() bytes are meaningful.
+typedef struct {
+    uint32_t generation;
+    uint32_t content_length;
+    uint16_t offsets[WEB_SLOT_COUNT];
+    uint16_t used;
+    char text[WEBSERVER_PAGE_FRAGMENT_BYTES];
+} webserver_page_fragments_t;
+
+extern const web_template_t *const webserver_landing_page;
+
+void webserver_landing_page_resolve(const void *model, uint16_t slot, web_value_t *out);
+
+// Returns false if the rendered slots do not fit; render from the model then.
+bool webserver_page_fragments_build(webserver_page_fragments_t *fragments,
+                                    const webserver_page_model_t *model, uint32_t generation);
+size_t webserver_page_fragments_size(const webserver_page_fragments_t *fragments);
+void webserver_page_fragments_resolve(const void *fragments, uint16_t slot, web_value_t *out);
 
 #endif // WEBSERVER_PAGES_H
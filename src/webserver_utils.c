@@ -1,147 +1,1186 @@
 #include "webserver_utils.h"
 
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
+#include "http_parser.h"
 #include "logging.h"
+#include "metrics.h"
+#include "web_template.h"
+
+#include "lwip/sys.h"
 
 #define TCP_CHUNK_SIZE 1024
+#define WEBSERVER_TEMPLATE_SCRATCH 128 // a template slot or one generated line
+#define WEBSERVER_HEADER_MAX 320
+#define WEBSERVER_ASSET_CACHE_CONTROL "public, max-age=31536000, immutable"
+#define WEBSERVER_POLL_INTERVAL 2 // tcp_poll ticks of 500 ms
+#define WEBSERVER_BUSY_LINGER_POLLS 4 // a refused client gets 2 s to read its 503
 
 typedef struct {
-    struct tcp_pcb *pcb;
-    const char *cursor;
+    const char *cursor; // next bytes to write: header, flash, or the scratch buffer
     size_t remaining;
-    char *body_copy;
+    u8_t write_flags;   // 0 when the bytes live in flash and can be referenced in place
+    bool templated;
+    bool generated;
+    const char *body; // queued behind the header, if any
+    size_t body_len;
+    u8_t body_flags;
+    u16_t header_len;
+    u16_t line_index;
+    webserver_line_fn line;
+    web_template_cursor_t render;
+    char header[WEBSERVER_HEADER_MAX];
+    char scratch[WEBSERVER_TEMPLATE_SCRATCH];
+    uint64_t extra[WEBSERVER_RESPONSE_EXTRA_MAX / sizeof(uint64_t)]; // model snapshot or body
 } web_response_state_t;
 
-static err_t webserver_send_next_chunk(void *arg, struct tcp_pcb *pcb, u16_t len);
-static err_t webserver_poll_callback(void *arg, struct tcp_pcb *pcb);
-static void webserver_response_free(web_response_state_t *state);
+typedef struct {
+    bool in_use;
+    bool keep_alive;  // decided per request
+    bool peer_closed; // FIN seen: answer what is buffered, then close
+    bool closing;     // tcp_close ran out of memory; the poll callback retries
+    bool dispatching;
+    bool responded;
+    bool deferred; // the handler parked its request; see webserver_http_defer()
+    bool in_body;  // head of the current request complete, body still arriving
+    u16_t serial;  // tells a reused slot from the connection a handle was made for
+    u8_t route;    // metrics_route_t of the current request
+    u32_t started_us;  // when the current request was dispatched, for its latency
+    u32_t phase_ms;    // when the current wait began: idle, head, body or response
+    u32_t progress_ms; // last time bytes arrived or were acknowledged
+    u16_t requests;
+    u16_t parsed; // bytes of rx already fed to the parser
+    struct tcp_pcb *pcb;
+    struct pbuf *rx; // received but unconsumed bytes, possibly several requests
+    webserver_request_fn handler;
+    web_response_state_t *response;
+    http_parser_t parser;
+} webserver_conn_t;
+
+typedef struct {
+    bool in_use;
+    struct tcp_pcb *pcb;
+    webserver_stream_fill_fn fill;
+    webserver_stream_close_fn on_close;
+    void *ctx;
+    u16_t pending_len;
+    u16_t pending_off;
+    u32_t progress_ms; // last acknowledgement, for the send-stall deadline
+    char pending[WEBSERVER_STREAM_CHUNK];
+} webserver_stream_t;
+
+static webserver_conn_t g_conns[WEBSERVER_MAX_CONNECTIONS];
+// A connection answers one request at a time, so each slot owns one response.
+static web_response_state_t g_responses[WEBSERVER_MAX_CONNECTIONS];
+static webserver_stream_t g_streams[WEBSERVER_MAX_STREAMS];
+static webserver_http_stats_t g_http_stats;
+static u16_t g_conn_serial = 0;
+
+static const char k_busy_response[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                     "Content-Length: 0\r\n"
+                                     "Retry-After: 1\r\n"
+                                     "Connection: close\r\n\r\n";
+
+static void webserver_conn_hook(webserver_conn_t *conn);
+static void webserver_conn_unhook(struct tcp_pcb *pcb);
+static void webserver_conn_close(webserver_conn_t *conn);
+static void webserver_conn_drop_data(webserver_conn_t *conn);
+static void webserver_conn_release(webserver_conn_t *conn);
+static void webserver_conn_process(webserver_conn_t *conn);
+static bool webserver_conn_dispatch(webserver_conn_t *conn);
+static bool webserver_conn_handled(webserver_conn_t *conn, struct tcp_pcb *pcb);
+static void webserver_conn_reject(webserver_conn_t *conn, int status, const char *reason);
+static err_t webserver_conn_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err);
+static err_t webserver_conn_sent(void *arg, struct tcp_pcb *pcb, u16_t len);
+static err_t webserver_conn_poll(void *arg, struct tcp_pcb *pcb);
+static void webserver_conn_err(void *arg, err_t err);
+static web_response_state_t *webserver_response_new(webserver_conn_t *conn, size_t extra,
+                                                    const char *fmt, ...);
+static err_t webserver_response_start(webserver_conn_t *conn, web_response_state_t *state);
+static void webserver_response_pump(webserver_conn_t *conn);
+static err_t webserver_stream_pump(webserver_stream_t *stream);
+static bool webserver_stream_release(webserver_stream_t *stream, bool close_pcb);
+
+static webserver_conn_t *webserver_conn_find(const struct tcp_pcb *pcb) {
+    for (size_t i = 0; i < WEBSERVER_MAX_CONNECTIONS; ++i) {
+        if (g_conns[i].in_use && g_conns[i].pcb == pcb) {
+            return &g_conns[i];
+        }
+    }
+    return NULL;
+}
+
+static bool webserver_elapsed(u32_t now, u32_t since, u32_t limit_ms) {
+    return (u32_t)(now - since) >= limit_ms;
+}
+
+// Frees the slot and the pcb at once; lwIP sends a reset.
+static void webserver_conn_abort(webserver_conn_t *conn, uint32_t *counter) {
+    struct tcp_pcb *pcb = conn->pcb;
+    (*counter)++;
+    webserver_conn_drop_data(conn);
+    webserver_conn_unhook(pcb);
+    conn->in_use = false;
+    conn->pcb = NULL;
+    tcp_abort(pcb);
+}
+
+// The connection that has gone longest without progress, if any has stalled
+// for WEBSERVER_RECLAIM_STALL_MS. One still failing to close goes first.
+static webserver_conn_t *webserver_conn_slowest(u32_t now) {
+    webserver_conn_t *slowest = NULL;
+    for (size_t i = 0; i < WEBSERVER_MAX_CONNECTIONS; ++i) {
+        webserver_conn_t *conn = &g_conns[i];
+        if (!conn->in_use || conn->deferred) {
+            continue;
+        }
+        if (conn->closing) {
+            return conn;
+        }
+        if (!webserver_elapsed(now, conn->progress_ms, WEBSERVER_RECLAIM_STALL_MS)) {
+            continue;
+        }
+        if (!slowest || (u32_t)(now - conn->progress_ms) > (u32_t)(now - slowest->progress_ms)) {
+            slowest = conn;
+        }
+    }
+    return slowest;
+}
+
+// A free slot; failing that the longest-idle keep-alive connection is closed,
+// or the slowest stalled one aborted, to make one.
+static webserver_conn_t *webserver_conn_claim(void) {
+    const u32_t now = sys_now();
+    webserver_conn_t *idlest = NULL;
+    for (size_t i = 0; i < WEBSERVER_MAX_CONNECTIONS; ++i) {
+        webserver_conn_t *conn = &g_conns[i];
+        if (!conn->in_use) {
+            return conn;
+        }
+        if (conn->response || conn->rx || conn->closing || conn->deferred ||
+            conn->requests == 0) {
+            continue;
+        }
+        if (!idlest || (u32_t)(now - conn->phase_ms) > (u32_t)(now - idlest->phase_ms)) {
+            idlest = conn;
+        }
+    }
+    if (idlest) {
+        g_http_stats.idle_closed++;
+        webserver_conn_close(idlest);
+        if (!idlest->in_use) {
+            return idlest;
+        }
+    }
+
+    webserver_conn_t *slowest = webserver_conn_slowest(now);
+    if (!slowest) {
+        return NULL;
+    }
+    LOG_WARN(LOG_CAT_HTTP, "reclaiming a connection stalled for %lu ms",
+             (unsigned long)(now - slowest->progress_ms));
+    webserver_conn_abort(slowest, &g_http_stats.reclaimed);
+    return slowest;
+}
+
+// A refused client's request is read and dropped so that no reset overtakes
+// the 503; whatever is left after the linger time is aborted.
+static err_t webserver_busy_poll(void *arg, struct tcp_pcb *pcb) {
+    (void)arg;
+    tcp_abort(pcb);
+    return ERR_ABRT;
+}
+
+static err_t webserver_busy_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
+    (void)arg;
+    (void)err;
+    if (p) {
+        tcp_recved(pcb, p->tot_len);
+        pbuf_free(p);
+        return ERR_OK;
+    }
+    tcp_recv(pcb, NULL);
+    tcp_poll(pcb, NULL, 0);
+    if (tcp_close(pcb) != ERR_OK) {
+        // Out of memory; the linger poll aborts it instead.
+        tcp_poll(pcb, webserver_busy_poll, WEBSERVER_BUSY_LINGER_POLLS);
+    }
+    return ERR_OK;
+}
+
+// Answers 503 straight from flash; no slot or heap is involved.
+static err_t webserver_refuse(struct tcp_pcb *pcb) {
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, webserver_busy_recv);
+    tcp_poll(pcb, webserver_busy_poll, WEBSERVER_BUSY_LINGER_POLLS);
+    if (tcp_write(pcb, k_busy_response, sizeof(k_busy_response) - 1, 0) != ERR_OK ||
+        tcp_shutdown(pcb, 0, 1) != ERR_OK) {
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    g_http_stats.bytes_sent += sizeof(k_busy_response) - 1;
+    return ERR_OK;
+}
 
-err_t webserver_send_response(struct tcp_pcb *pcb, const char *body) {
-    if (!pcb || !body) {
+err_t webserver_http_accept(struct tcp_pcb *pcb, webserver_request_fn handler) {
+    if (!pcb || !handler) {
         return ERR_VAL;
     }
 
-    const size_t body_len = strlen(body);
-    char *copy = NULL;
-    if (body_len > 0) {
-        copy = (char *)malloc(body_len);
-        if (!copy) {
-            log_error("Failed to allocate response buffer (%zu bytes)", body_len);
-            return ERR_MEM;
+    webserver_conn_t *conn = webserver_conn_claim();
+    if (!conn) {
+        g_http_stats.rejected++;
+        LOG_WARN(LOG_CAT_HTTP, "connection refused: all %u slots busy",
+                 (unsigned)WEBSERVER_MAX_CONNECTIONS);
+        return webserver_refuse(pcb);
+    }
+
+    if (++g_conn_serial == 0) {
+        g_conn_serial = 1;
+    }
+    const u32_t now = sys_now();
+    *conn = (webserver_conn_t){
+        .in_use = true,
+        .serial = g_conn_serial,
+        .phase_ms = now,
+        .progress_ms = now,
+        .pcb = pcb,
+        .handler = handler,
+    };
+    http_parser_init(&conn->parser, WEBSERVER_REQUEST_MAX - 1, WEBSERVER_REQUEST_MAX - 1);
+    g_http_stats.accepted++;
+    // Responses are queued whole and flushed at once, so Nagle only adds a
+    // delayed-ACK round trip between requests on a kept-alive connection.
+    tcp_nagle_disable(pcb);
+    webserver_conn_hook(conn);
+    return ERR_OK;
+}
+
+static void webserver_conn_observe(const webserver_conn_t *conn) {
+    metrics_observe_request((metrics_route_t)conn->route, metrics_now_us() - conn->started_us);
+}
+
+void webserver_http_detach(struct tcp_pcb *pcb) {
+    webserver_conn_t *conn = webserver_conn_find(pcb);
+    if (conn) {
+        if (conn->dispatching) {
+            // Handed over to a stream: the request ends here.
+            webserver_conn_observe(conn);
         }
-        memcpy(copy, body, body_len);
+        webserver_conn_release(conn);
     }
+}
 
-    char header[192];
-    int header_len = snprintf(header, sizeof(header),
-                              "HTTP/1.1 200 OK\r\n"
-                              "Content-Type: text/html; charset=utf-8\r\n"
-                              "Content-Length: %zu\r\n"
-                              "Connection: close\r\n\r\n",
-                              body_len);
-    if (header_len <= 0 || header_len >= (int)sizeof(header)) {
-        free(copy);
-        log_error("Failed to build HTTP header");
-        return ERR_MEM;
+void webserver_http_tag(struct tcp_pcb *pcb, metrics_route_t route) {
+    webserver_conn_t *conn = webserver_conn_find(pcb);
+    if (conn) {
+        conn->route = (u8_t)route;
     }
+}
 
-    err_t err = tcp_write(pcb, header, header_len, TCP_WRITE_FLAG_COPY);
-    if (err != ERR_OK) {
-        log_error("tcp_write header failed: %d", err);
-        free(copy);
-        return err;
+void webserver_http_get_stats(webserver_http_stats_t *out) {
+    if (!out) {
+        return;
+    }
+    *out = g_http_stats;
+    out->active = 0;
+    for (size_t i = 0; i < WEBSERVER_MAX_CONNECTIONS; ++i) {
+        if (g_conns[i].in_use) {
+            out->active++;
+        }
     }
+}
 
-    web_response_state_t *state = (web_response_state_t *)calloc(1, sizeof(web_response_state_t));
-    if (!state) {
-        log_error("Failed to allocate response state");
-        free(copy);
-        return ERR_MEM;
+static void webserver_conn_hook(webserver_conn_t *conn) {
+    tcp_arg(conn->pcb, conn);
+    tcp_recv(conn->pcb, webserver_conn_recv);
+    tcp_sent(conn->pcb, webserver_conn_sent);
+    tcp_err(conn->pcb, webserver_conn_err);
+    tcp_poll(conn->pcb, webserver_conn_poll, WEBSERVER_POLL_INTERVAL);
+}
+
+static void webserver_conn_unhook(struct tcp_pcb *pcb) {
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_err(pcb, NULL);
+    tcp_poll(pcb, NULL, 0);
+}
+
+static void webserver_conn_drop_data(webserver_conn_t *conn) {
+    if (conn->rx) {
+        pbuf_free(conn->rx);
+        conn->rx = NULL;
     }
+    conn->response = NULL;
+}
 
-    state->pcb = pcb;
-    state->cursor = copy;
-    state->remaining = body_len;
-    state->body_copy = copy;
+static void webserver_conn_close(webserver_conn_t *conn) {
+    struct tcp_pcb *pcb = conn->pcb;
+    // lwIP answers a close with a reset, losing the queued response, while
+    // any received byte is unacknowledged; pipelined leftovers count too.
+    if (conn->rx) {
+        tcp_recved(pcb, conn->rx->tot_len);
+    }
+    webserver_conn_drop_data(conn);
+    webserver_conn_unhook(pcb);
+    // Queued data still drains before the FIN.
+    if (tcp_close(pcb) != ERR_OK) {
+        conn->closing = true;
+        webserver_conn_hook(conn);
+        return;
+    }
+    LOG_DEBUG(LOG_CAT_HTTP, "connection closed after %u requests", (unsigned)conn->requests);
+    conn->in_use = false;
+    conn->pcb = NULL;
+}
 
-    tcp_arg(pcb, state);
-    tcp_sent(pcb, webserver_send_next_chunk);
-    tcp_poll(pcb, webserver_poll_callback, 2);
+// Hands the pcb to another owner without closing it.
+static void webserver_conn_release(webserver_conn_t *conn) {
+    if (conn->rx) {
+        tcp_recved(conn->pcb, conn->rx->tot_len);
+    }
+    webserver_conn_drop_data(conn);
+    conn->in_use = false;
+    conn->pcb = NULL;
+}
 
-    return webserver_send_next_chunk(state, pcb, 0);
+// Serves buffered requests one at a time: the next is only parsed once the
+// previous response is fully queued, so pipelined responses stay in order.
+static void webserver_conn_process(webserver_conn_t *conn) {
+    if (conn->dispatching) {
+        return;
+    }
+    while (conn->in_use && !conn->closing && !conn->response && !conn->deferred && conn->rx) {
+        if (!webserver_conn_dispatch(conn)) {
+            break;
+        }
+    }
+    if (conn->in_use && !conn->closing && !conn->response && !conn->deferred &&
+        conn->peer_closed) {
+        webserver_conn_close(conn);
+    }
 }
 
-static err_t webserver_send_next_chunk(void *arg, struct tcp_pcb *pcb, u16_t len) {
-    (void)len;
+static bool webserver_conn_dispatch(webserver_conn_t *conn) {
+    // Feed the parser only bytes it has not seen, straight from the payloads.
+    http_parse_status_t status = HTTP_PARSE_INCOMPLETE;
+    u16_t offset = 0;
+    for (struct pbuf *q = conn->rx; q && status == HTTP_PARSE_INCOMPLETE; q = q->next) {
+        if (conn->parsed < offset + q->len) {
+            const u16_t start = conn->parsed - offset;
+            conn->parsed += (u16_t)http_parser_feed(
+                &conn->parser, (const char *)q->payload + start, q->len - start, &status);
+        }
+        offset += q->len;
+    }
+    if (status == HTTP_PARSE_ERROR) {
+        const char *reason = NULL;
+        const int code = http_parser_error_status(&conn->parser, &reason);
+        webserver_conn_reject(conn, code, reason);
+        return false;
+    }
+    if (status != HTTP_PARSE_DONE) {
+        if (!conn->in_body && http_parser_in_body(&conn->parser)) {
+            conn->in_body = true;
+            conn->phase_ms = sys_now();
+        }
+        return false;
+    }
 
-    web_response_state_t *state = (web_response_state_t *)arg;
-    if (!state || !pcb) {
-        return ERR_OK;
+    // Routes work on one contiguous string, so the framed request is copied once.
+    char request[WEBSERVER_REQUEST_MAX];
+    const u16_t total = conn->parsed;
+    pbuf_copy_partial(conn->rx, request, total, 0);
+    request[total] = '\0';
+    const bool keep_alive = http_parser_keep_alive(&conn->parser);
+    http_parser_reset(&conn->parser);
+    conn->parsed = 0;
+
+    // Unconsumed bytes keep the window shut, which paces an eager pipeliner.
+    conn->rx = pbuf_free_header(conn->rx, total);
+    tcp_recved(conn->pcb, total);
+
+    conn->requests++;
+    g_http_stats.requests++;
+    if (conn->requests > 1) {
+        g_http_stats.reused++;
+    }
+    conn->keep_alive = keep_alive && conn->requests < WEBSERVER_MAX_REQUESTS_PER_CONNECTION;
+    conn->responded = false;
+    conn->in_body = false;
+    conn->phase_ms = sys_now();
+    conn->route = METRICS_ROUTE_OTHER;
+    conn->started_us = metrics_now_us();
+
+    struct tcp_pcb *pcb = conn->pcb;
+    conn->dispatching = true;
+    conn->handler(pcb, request, total);
+    return webserver_conn_handled(conn, pcb);
+}
+
+// Whether the next buffered request may be served after a handler returned.
+static bool webserver_conn_handled(webserver_conn_t *conn, struct tcp_pcb *pcb) {
+    if (!conn->in_use || conn->pcb != pcb) {
+        // Closed, or handed over to a stream.
+        return false;
     }
+    conn->dispatching = false;
+    if (conn->deferred) {
+        return false;
+    }
+
+    if (!conn->responded) {
+        conn->keep_alive = false;
+        if (webserver_send_error(pcb, 500, "Internal Server Error") != ERR_OK) {
+            webserver_conn_close(conn);
+            return false;
+        }
+    }
+    return conn->in_use && !conn->response;
+}
+
+webserver_conn_handle_t webserver_http_defer(struct tcp_pcb *pcb) {
+    webserver_conn_t *conn = webserver_conn_find(pcb);
+    if (!conn || !conn->dispatching || conn->responded) {
+        return 0;
+    }
+    conn->deferred = true;
+    return ((uint32_t)conn->serial << 8) | (uint32_t)(conn - g_conns);
+}
+
+bool webserver_http_resume(webserver_conn_handle_t handle, webserver_resume_fn respond,
+                           void *ctx) {
+    const size_t index = handle & 0xffu;
+    if (handle == 0 || index >= WEBSERVER_MAX_CONNECTIONS) {
+        return false;
+    }
+    webserver_conn_t *conn = &g_conns[index];
+    if (!conn->in_use || !conn->deferred || conn->serial != (u16_t)(handle >> 8)) {
+        // Reset meanwhile; the answer has nobody to go to.
+        return false;
+    }
+
+    struct tcp_pcb *pcb = conn->pcb;
+    conn->deferred = false;
+    conn->dispatching = true;
+    // Time spent in the control queue is neither a stall nor idling.
+    conn->phase_ms = sys_now();
+    conn->progress_ms = conn->phase_ms;
+    respond(pcb, ctx);
+    if (webserver_conn_handled(conn, pcb)) {
+        // Pipelined requests waited behind this one, and a FIN may have too.
+        webserver_conn_process(conn);
+    }
+    return true;
+}
+
+// Framing is lost after a malformed request, so the connection ends with it.
+static void webserver_conn_reject(webserver_conn_t *conn, int status, const char *reason) {
+    LOG_WARN(LOG_CAT_HTTP, "rejecting request: %d %s", status, reason);
+    conn->keep_alive = false;
+    conn->route = METRICS_ROUTE_OTHER;
+    conn->started_us = metrics_now_us();
+    if (webserver_send_error(conn->pcb, status, reason) != ERR_OK) {
+        webserver_conn_close(conn);
+    }
+}
+
+// The request took too long to arrive; whatever came of it is dropped.
+static void webserver_conn_timeout(webserver_conn_t *conn) {
+    if (conn->rx) {
+        tcp_recved(conn->pcb, conn->rx->tot_len);
+        pbuf_free(conn->rx);
+        conn->rx = NULL;
+    }
+    conn->in_body = false;
+    conn->parsed = 0;
+    http_parser_reset(&conn->parser);
+    webserver_conn_reject(conn, 408, "Request Timeout");
+}
 
-    if (state->remaining == 0) {
-        err_t flush_err = tcp_output(pcb);
-        if (flush_err != ERR_OK) {
-            log_warn("tcp_output flush failed: %d", flush_err);
+static err_t webserver_conn_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
+    webserver_conn_t *conn = (webserver_conn_t *)arg;
+    if (!conn || conn->closing) {
+        if (p) {
+            tcp_recved(pcb, p->tot_len);
+            pbuf_free(p);
         }
-        webserver_response_free(state);
         return ERR_OK;
     }
 
-    u16_t sndbuf = tcp_sndbuf(pcb);
-    if (sndbuf == 0) {
+    if (!p || err != ERR_OK) {
+        if (p) {
+            tcp_recved(pcb, p->tot_len);
+            pbuf_free(p);
+        }
+        conn->peer_closed = true;
+        webserver_conn_process(conn);
         return ERR_OK;
     }
 
-    u16_t chunk = (state->remaining > TCP_CHUNK_SIZE) ? TCP_CHUNK_SIZE : (u16_t)state->remaining;
-    if (chunk > sndbuf) {
-        chunk = sndbuf;
+    conn->progress_ms = sys_now();
+    g_http_stats.bytes_received += p->tot_len;
+    if (conn->rx) {
+        pbuf_cat(conn->rx, p);
+    } else {
+        if (!conn->response && !conn->deferred) {
+            // First byte of a new request: its head deadline starts now.
+            conn->phase_ms = conn->progress_ms;
+        }
+        conn->rx = p;
+    }
+    webserver_conn_process(conn);
+    return ERR_OK;
+}
+
+static err_t webserver_conn_sent(void *arg, struct tcp_pcb *pcb, u16_t len) {
+    (void)pcb;
+    (void)len;
+    webserver_conn_t *conn = (webserver_conn_t *)arg;
+    if (conn) {
+        conn->progress_ms = sys_now();
+    }
+    if (conn && conn->response) {
+        webserver_response_pump(conn);
     }
+    return ERR_OK;
+}
 
-    if (chunk == 0) {
+static err_t webserver_conn_poll(void *arg, struct tcp_pcb *pcb) {
+    (void)pcb;
+    webserver_conn_t *conn = (webserver_conn_t *)arg;
+    if (!conn) {
+        return ERR_OK;
+    }
+    if (conn->closing) {
+        webserver_conn_close(conn);
+        return ERR_OK;
+    }
+    if (conn->deferred) {
+        // The control queue always answers; waiting on it is not idling.
         return ERR_OK;
     }
 
-    u16_t flags = TCP_WRITE_FLAG_COPY;
-    if (chunk < state->remaining) {
-        flags |= TCP_WRITE_FLAG_MORE;
+    const u32_t now = sys_now();
+    if (conn->response) {
+        // A client that stops reading would otherwise hold the slot forever.
+        if (webserver_elapsed(now, conn->progress_ms, WEBSERVER_SEND_STALL_MS)) {
+            LOG_WARN(LOG_CAT_HTTP, "aborting connection: response stalled");
+            webserver_conn_abort(conn, &g_http_stats.send_stalls);
+            return ERR_ABRT;
+        }
+        webserver_response_pump(conn);
+        return ERR_OK;
     }
+    if (conn->in_body) {
+        if (webserver_elapsed(now, conn->phase_ms, WEBSERVER_BODY_TIMEOUT_MS)) {
+            g_http_stats.body_timeouts++;
+            webserver_conn_timeout(conn);
+        }
+    } else if (conn->rx || conn->requests == 0) {
+        // Counted from the first byte, not the last, so a trickle cannot stretch it.
+        if (webserver_elapsed(now, conn->phase_ms, WEBSERVER_HEADER_TIMEOUT_MS)) {
+            g_http_stats.header_timeouts++;
+            webserver_conn_timeout(conn);
+        }
+    } else if (webserver_elapsed(now, conn->phase_ms, WEBSERVER_IDLE_TIMEOUT_MS)) {
+        g_http_stats.idle_closed++;
+        webserver_conn_close(conn);
+    }
+    return ERR_OK;
+}
 
-    err_t err = tcp_write(pcb, state->cursor, chunk, flags);
-    if (err != ERR_OK) {
+static void webserver_conn_err(void *arg, err_t err) {
+    (void)err;
+    webserver_conn_t *conn = (webserver_conn_t *)arg;
+    if (conn) {
+        // The pcb is already gone; only release our own memory.
+        webserver_conn_drop_data(conn);
+        conn->in_use = false;
+        conn->pcb = NULL;
+    }
+}
+
+const char *webserver_request_header(const char *request, const char *name, size_t *value_len) {
+    const size_t name_len = strlen(name);
+    const char *line = strstr(request, "\r\n");
+    while (line && line[2] != '\r' && line[2] != '\0') {
+        line += 2;
+        const char *line_end = strstr(line, "\r\n");
+        if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+            const char *value = line + name_len + 1;
+            while (*value == ' ' || *value == '\t') {
+                ++value;
+            }
+            const char *end = line_end ? line_end : value + strlen(value);
+            while (end > value && (end[-1] == ' ' || end[-1] == '\t')) {
+                --end;
+            }
+            if (value_len) {
+                *value_len = (size_t)(end - value);
+            }
+            return value;
+        }
+        line = line_end;
+    }
+    return NULL;
+}
+
+// Takes the connection's response slot and formats its header; the
+// Connection field is added here. extra bytes must fit the slot.
+static web_response_state_t *webserver_response_new(webserver_conn_t *conn, size_t extra,
+                                                    const char *fmt, ...) {
+    if (extra > WEBSERVER_RESPONSE_EXTRA_MAX) {
+        g_http_stats.oversized++;
+        LOG_ERROR(LOG_CAT_HTTP, "response of %zu bytes exceeds the %u byte slot", extra,
+                  (unsigned)WEBSERVER_RESPONSE_EXTRA_MAX);
+        return NULL;
+    }
+    web_response_state_t *state = &g_responses[conn - g_conns];
+    memset(state, 0, offsetof(web_response_state_t, extra));
+
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(state->header, sizeof(state->header), fmt, args);
+    va_end(args);
+    if (len > 0 && len < (int)sizeof(state->header)) {
+        len += snprintf(state->header + len, sizeof(state->header) - (size_t)len,
+                        "Connection: %s\r\n\r\n", conn->keep_alive ? "keep-alive" : "close");
+    }
+    if (len <= 0 || len >= (int)sizeof(state->header)) {
+        LOG_ERROR(LOG_CAT_HTTP, "Failed to build HTTP header");
+        return NULL;
+    }
+    state->header_len = (u16_t)len;
+    return state;
+}
+
+// The connection a handler may answer on: known, and not already answering.
+static webserver_conn_t *webserver_conn_for_response(const struct tcp_pcb *pcb) {
+    webserver_conn_t *conn = pcb ? webserver_conn_find(pcb) : NULL;
+    if (!conn || conn->response || conn->closing) {
+        return NULL;
+    }
+    return conn;
+}
+
+static err_t webserver_response_start(webserver_conn_t *conn, web_response_state_t *state) {
+    state->cursor = state->header;
+    state->remaining = state->header_len;
+    state->write_flags = TCP_WRITE_FLAG_COPY;
+    conn->response = state;
+    conn->responded = true;
+    // Answering right away cancels a deferral, e.g. when the work was not queued.
+    conn->deferred = false;
+    webserver_response_pump(conn);
+    return ERR_OK;
+}
+
+err_t webserver_send_template(struct tcp_pcb *pcb, const webserver_template_response_t *response) {
+    if (!response || !response->tmpl || !response->resolve) {
+        return ERR_VAL;
+    }
+    webserver_conn_t *conn = webserver_conn_for_response(pcb);
+    if (!conn) {
+        return ERR_VAL;
+    }
+
+    // Measured against the caller's model, which the snapshot below copies.
+    const size_t body_len =
+        response->content_length
+            ? response->content_length
+            : web_template_measure(response->tmpl, response->resolve, response->model);
+
+    // The model snapshot rides along with the response state; the page itself
+    // is never materialised, only measured. With a validator the browser may
+    // keep the page but must revalidate it.
+    const size_t model_size = response->model_size;
+    web_response_state_t *state =
+        webserver_response_new(conn, model_size,
+                               "HTTP/1.1 200 OK\r\n"
+                               "Content-Type: text/html; charset=utf-8\r\n"
+                               "Content-Length: %zu\r\n"
+                               "%s%s%s"
+                               "Cache-Control: %s\r\n",
+                               body_len, response->etag ? "ETag: " : "",
+                               response->etag ? response->etag : "",
+                               response->etag ? "\r\n" : "",
+                               response->etag ? "no-cache" : "no-store");
+    if (!state) {
+        return ERR_MEM;
+    }
+    if (model_size > 0) {
+        memcpy(state->extra, response->model, model_size);
+    }
+    const void *snapshot = model_size > 0 ? (const void *)state->extra : response->model;
+
+    state->templated = true;
+    web_template_begin(&state->render, response->tmpl, response->resolve, snapshot);
+    return webserver_response_start(conn, state);
+}
+
+err_t webserver_send_generated(struct tcp_pcb *pcb,
+                               const webserver_generated_response_t *response) {
+    if (!response || !response->content_type || !response->snapshot || !response->line) {
+        return ERR_VAL;
+    }
+    webserver_conn_t *conn = webserver_conn_for_response(pcb);
+    if (!conn) {
+        return ERR_VAL;
+    }
+
+    // The snapshot goes straight into the slot; webserver_response_new()
+    // leaves extra untouched.
+    web_response_state_t *slot = &g_responses[conn - g_conns];
+    const size_t model_size = response->snapshot(slot->extra, sizeof(slot->extra));
+    if (model_size == 0) {
+        return ERR_MEM;
+    }
+    char line[WEBSERVER_TEMPLATE_SCRATCH];
+    size_t body_len = 0;
+    for (u16_t i = 0;; ++i) {
+        const size_t len = response->line(slot->extra, i, line, sizeof(line));
+        if (len == 0) {
+            break;
+        }
+        body_len += len;
+    }
+
+    web_response_state_t *state = webserver_response_new(conn, model_size,
+                                                         "HTTP/1.1 200 OK\r\n"
+                                                         "Content-Type: %s\r\n"
+                                                         "Content-Length: %zu\r\n"
+                                                         "Cache-Control: no-store\r\n",
+                                                         response->content_type, body_len);
+    if (!state) {
+        return ERR_MEM;
+    }
+    state->generated = true;
+    state->line = response->line;
+    return webserver_response_start(conn, state);
+}
+
+err_t webserver_send_not_modified(struct tcp_pcb *pcb, const char *etag) {
+    webserver_conn_t *conn = webserver_conn_for_response(pcb);
+    if (!conn || !etag) {
+        return ERR_VAL;
+    }
+
+    web_response_state_t *state = webserver_response_new(conn, 0,
+                                                         "HTTP/1.1 304 Not Modified\r\n"
+                                                         "ETag: %s\r\n"
+                                                         "Cache-Control: no-cache\r\n",
+                                                         etag);
+    if (!state) {
+        return ERR_MEM;
+    }
+    return webserver_response_start(conn, state);
+}
+
+err_t webserver_send_asset(struct tcp_pcb *pcb, const web_asset_t *asset, bool not_modified) {
+    webserver_conn_t *conn = webserver_conn_for_response(pcb);
+    if (!conn || !asset) {
+        return ERR_VAL;
+    }
+
+    web_response_state_t *state;
+    if (not_modified) {
+        state = webserver_response_new(conn, 0,
+                                       "HTTP/1.1 304 Not Modified\r\n"
+                                       "ETag: %s\r\n"
+                                       "Cache-Control: " WEBSERVER_ASSET_CACHE_CONTROL "\r\n",
+                                       asset->etag);
+    } else {
+        state = webserver_response_new(conn, 0,
+                                       "HTTP/1.1 200 OK\r\n"
+                                       "Content-Type: %s\r\n"
+                                       "Content-Encoding: gzip\r\n"
+                                       "Content-Length: %lu\r\n"
+                                       "ETag: %s\r\n"
+                                       "Cache-Control: " WEBSERVER_ASSET_CACHE_CONTROL "\r\n"
+                                       "Vary: Accept-Encoding\r\n",
+                                       asset->content_type, (unsigned long)asset->length,
+                                       asset->etag);
+    }
+    if (!state) {
+        LOG_ERROR(LOG_CAT_HTTP, "Failed to build asset response for %s", asset->path);
+        return ERR_MEM;
+    }
+
+    // Asset bytes are const data in flash: lwIP references them instead of copying.
+    if (!not_modified) {
+        state->body = (const char *)asset->data;
+        state->body_len = asset->length;
+        state->body_flags = 0;
+    }
+    return webserver_response_start(conn, state);
+}
+
+// Copies body into the response so it may live on the caller's stack. With
+// an ETag the client may cache the body but must revalidate it.
+static err_t webserver_send_copy(struct tcp_pcb *pcb, int status, const char *reason,
+                                 const char *content_type, const char *etag, const char *body,
+                                 size_t body_len) {
+    webserver_conn_t *conn = webserver_conn_for_response(pcb);
+    if (!conn || !reason || !content_type || (!body && body_len > 0)) {
+        return ERR_VAL;
+    }
+
+    web_response_state_t *state = webserver_response_new(conn, body_len,
+                                                         "HTTP/1.1 %d %s\r\n"
+                                                         "Content-Type: %s\r\n"
+                                                         "Content-Length: %zu\r\n"
+                                                         "%s%s%s"
+                                                         "Cache-Control: %s\r\n",
+                                                         status, reason, content_type, body_len,
+                                                         etag ? "ETag: " : "", etag ? etag : "",
+                                                         etag ? "\r\n" : "",
+                                                         etag ? "no-cache" : "no-store");
+    if (!state) {
+        return ERR_MEM;
+    }
+    if (body_len > 0) {
+        memcpy(state->extra, body, body_len);
+        state->body = (const char *)state->extra;
+        state->body_len = body_len;
+        state->body_flags = TCP_WRITE_FLAG_COPY;
+    }
+    return webserver_response_start(conn, state);
+}
+
+err_t webserver_send_body(struct tcp_pcb *pcb, int status, const char *reason,
+                          const char *content_type, const char *body, size_t body_len) {
+    return webserver_send_copy(pcb, status, reason, content_type, NULL, body, body_len);
+}
+
+err_t webserver_send_json(struct tcp_pcb *pcb, int status, const char *reason, const char *etag,
+                          const char *body, size_t body_len) {
+    return webserver_send_copy(pcb, status, reason, "application/json; charset=utf-8", etag,
+                               body, body_len);
+}
+
+err_t webserver_send_error(struct tcp_pcb *pcb, int status, const char *reason) {
+    if (!reason) {
+        return ERR_VAL;
+    }
+    return webserver_send_body(pcb, status, reason, "text/plain; charset=utf-8", reason,
+                               strlen(reason));
+}
+
+// Moves on to the next piece of the response: the body after the header, or
+// the next template segment or generated line.
+static void webserver_refill(web_response_state_t *state) {
+    if (state->body) {
+        state->cursor = state->body;
+        state->remaining = state->body_len;
+        state->write_flags = state->body_flags;
+        state->body = NULL;
+        return;
+    }
+    if (state->generated) {
+        const size_t len = state->line(state->extra, state->line_index++, state->scratch,
+                                       sizeof(state->scratch));
+        if (len == 0) {
+            state->generated = false;
+            return;
+        }
+        state->cursor = state->scratch;
+        state->remaining = len;
+        state->write_flags = TCP_WRITE_FLAG_COPY;
+        return;
+    }
+    if (!state->templated) {
+        return;
+    }
+
+    const char *data = NULL;
+    size_t data_len = 0;
+    bool in_flash = false;
+    if (!web_template_next(&state->render, state->scratch, sizeof(state->scratch), &data,
+                           &data_len, &in_flash)) {
+        state->templated = false;
+        return;
+    }
+    state->cursor = data;
+    state->remaining = data_len;
+    state->write_flags = in_flash ? 0 : TCP_WRITE_FLAG_COPY;
+}
+
+static void webserver_response_pump(webserver_conn_t *conn) {
+    web_response_state_t *state = conn->response;
+    struct tcp_pcb *pcb = conn->pcb;
+
+    // Keep queueing until the send buffer is full; the sent callback resumes.
+    bool wrote = false;
+    while (true) {
+        if (state->remaining == 0) {
+            webserver_refill(state);
+        }
+        if (state->remaining == 0) {
+            break;
+        }
+
+        u16_t sndbuf = tcp_sndbuf(pcb);
+        u16_t chunk =
+            (state->remaining > TCP_CHUNK_SIZE) ? TCP_CHUNK_SIZE : (u16_t)state->remaining;
+        if (chunk > sndbuf) {
+            chunk = sndbuf;
+        }
+        if (chunk == 0) {
+            break;
+        }
+
+        u8_t flags = state->write_flags;
+        if (chunk < state->remaining || state->body || state->templated || state->generated) {
+            flags |= TCP_WRITE_FLAG_MORE;
+        }
+
+        err_t err = tcp_write(pcb, state->cursor, chunk, flags);
         if (err == ERR_MEM) {
-            return ERR_OK;
+            break;
+        }
+        if (err != ERR_OK) {
+            LOG_ERROR(LOG_CAT_HTTP, "tcp_write chunk failed: %d", err);
+            webserver_conn_close(conn);
+            return;
+        }
+
+        state->cursor += chunk;
+        state->remaining -= chunk;
+        g_http_stats.bytes_sent += chunk;
+        wrote = true;
+    }
+
+    if (state->remaining > 0 || state->body || state->templated || state->generated) {
+        if (wrote) {
+            err_t err = tcp_output(pcb);
+            if (err != ERR_OK) {
+                LOG_WARN(LOG_CAT_HTTP, "tcp_output returned %d after chunk", err);
+            }
+        }
+        return;
+    }
+
+    err_t flush_err = tcp_output(pcb);
+    if (flush_err != ERR_OK) {
+        LOG_WARN(LOG_CAT_HTTP, "tcp_output flush failed: %d", flush_err);
+    }
+
+    // Everything is queued. Either wait for the next request or let the FIN
+    // follow the data once it drains.
+    conn->response = NULL;
+    conn->phase_ms = sys_now();
+    webserver_conn_observe(conn);
+    if (!conn->keep_alive) {
+        webserver_conn_close(conn);
+        return;
+    }
+    webserver_conn_process(conn);
+}
+
+// Closes a stream whose write failed, from one of its own callbacks. lwIP
+// must hear ERR_ABRT if the close had to abort the pcb.
+static err_t webserver_stream_fail(webserver_stream_t *stream) {
+    return webserver_stream_release(stream, true) ? ERR_ABRT : ERR_OK;
+}
+
+static err_t webserver_stream_sent(void *arg, struct tcp_pcb *pcb, u16_t len) {
+    (void)pcb;
+    (void)len;
+    webserver_stream_t *stream = (webserver_stream_t *)arg;
+    if (stream) {
+        stream->progress_ms = sys_now();
+    }
+    return webserver_stream_pump(stream) == ERR_OK ? ERR_OK : webserver_stream_fail(stream);
+}
+
+static err_t webserver_stream_poll(void *arg, struct tcp_pcb *pcb) {
+    webserver_stream_t *stream = (webserver_stream_t *)arg;
+    if (stream && stream->in_use && stream->pending_off < stream->pending_len &&
+        webserver_elapsed(sys_now(), stream->progress_ms, WEBSERVER_SEND_STALL_MS)) {
+        // Output is piling up for a subscriber that stopped reading.
+        LOG_WARN(LOG_CAT_HTTP, "aborting stream: subscriber stalled");
+        g_http_stats.stream_stalls++;
+        webserver_stream_release(stream, false);
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    return webserver_stream_pump(stream) == ERR_OK ? ERR_OK : webserver_stream_fail(stream);
+}
+
+static err_t webserver_stream_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
+    webserver_stream_t *stream = (webserver_stream_t *)arg;
+    if (!p || err != ERR_OK) {
+        if (p) {
+            pbuf_free(p);
         }
-        log_error("tcp_write chunk failed: %d", err);
-        webserver_response_free(state);
+        return webserver_stream_release(stream, true) ? ERR_ABRT : ERR_OK;
+    }
+    // Streams are one-way; anything the client sends is discarded.
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+    return ERR_OK;
+}
+
+static void webserver_stream_err(void *arg, err_t err) {
+    (void)err;
+    webserver_stream_t *stream = (webserver_stream_t *)arg;
+    if (stream) {
+        stream->pcb = NULL;
+        webserver_stream_release(stream, false);
+    }
+}
+
+err_t webserver_stream_open(struct tcp_pcb *pcb, const char *content_type,
+                            webserver_stream_fill_fn fill, webserver_stream_close_fn on_close,
+                            void *ctx) {
+    if (!pcb || !fill) {
+        return ERR_VAL;
+    }
+
+    webserver_stream_t *stream = NULL;
+    for (size_t i = 0; i < WEBSERVER_MAX_STREAMS; ++i) {
+        if (!g_streams[i].in_use) {
+            stream = &g_streams[i];
+            break;
+        }
+    }
+    if (!stream) {
+        return ERR_MEM;
+    }
+    const webserver_conn_t *conn = webserver_conn_find(pcb);
+    if (conn && conn->response) {
+        return ERR_INPROGRESS;
+    }
+
+    char header[160];
+    int header_len = snprintf(header, sizeof(header),
+                              "HTTP/1.1 200 OK\r\n"
+                              "Content-Type: %s\r\n"
+                              "Cache-Control: no-store\r\n"
+                              "Connection: close\r\n\r\n",
+                              content_type);
+    if (header_len <= 0 || header_len >= (int)sizeof(header)) {
+        return ERR_MEM;
+    }
+    err_t err = tcp_write(pcb, header, (u16_t)header_len, TCP_WRITE_FLAG_COPY);
+    if (err != ERR_OK) {
         return err;
     }
+    g_http_stats.bytes_sent += (uint64_t)header_len;
+
+    webserver_http_detach(pcb);
+    *stream = (webserver_stream_t){
+        .in_use = true,
+        .pcb = pcb,
+        .fill = fill,
+        .on_close = on_close,
+        .ctx = ctx,
+        .progress_ms = sys_now(),
+    };
 
-    state->cursor += chunk;
-    state->remaining -= chunk;
+    tcp_arg(pcb, stream);
+    tcp_recv(pcb, webserver_stream_recv);
+    tcp_sent(pcb, webserver_stream_sent);
+    tcp_err(pcb, webserver_stream_err);
+    tcp_poll(pcb, webserver_stream_poll, 2);
 
-    err = tcp_output(pcb);
+    // Still inside the handler's recv callback, which must not see the pcb
+    // aborted; hand it back to the caller to answer instead.
+    err = webserver_stream_pump(stream);
     if (err != ERR_OK) {
-        log_warn("tcp_output returned %d after chunk", err);
+        webserver_stream_release(stream, false);
     }
+    return err;
+}
 
+// Copies as much pending data as the send buffer takes. A slow peer simply
+// leaves data pending here; producers upstream are never made to wait.
+// Returns the error of a failed write; the caller closes the stream.
+static err_t webserver_stream_pump(webserver_stream_t *stream) {
+    if (!stream || !stream->in_use || !stream->pcb) {
+        return ERR_OK;
+    }
+    struct tcp_pcb *pcb = stream->pcb;
+    bool wrote = false;
+
+    while (true) {
+        if (stream->pending_off >= stream->pending_len) {
+            stream->pending_off = 0;
+            stream->pending_len =
+                (u16_t)stream->fill(stream->ctx, stream->pending, sizeof(stream->pending));
+            if (stream->pending_len == 0) {
+                break;
+            }
+        }
+
+        u16_t chunk = stream->pending_len - stream->pending_off;
+        u16_t sndbuf = tcp_sndbuf(pcb);
+        if (chunk > sndbuf) {
+            chunk = sndbuf;
+        }
+        if (chunk == 0) {
+            break;
+        }
+
+        err_t err = tcp_write(pcb, stream->pending + stream->pending_off, chunk,
+                              TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE);
+        if (err == ERR_MEM) {
+            break;
+        }
+        if (err != ERR_OK) {
+            LOG_WARN(LOG_CAT_HTTP, "stream write failed: %d", err);
+            return err;
+        }
+        stream->pending_off += chunk;
+        g_http_stats.bytes_sent += chunk;
+        wrote = true;
+    }
+
+    if (wrote) {
+        tcp_output(pcb);
+    }
     return ERR_OK;
 }
 
-static void webserver_response_free(web_response_state_t *state) {
-    if (!state) {
-        return;
+// Main loop, outside any callback of the pcbs, so aborting one is safe here.
+void webserver_stream_pump_all(void) {
+    for (size_t i = 0; i < WEBSERVER_MAX_STREAMS; ++i) {
+        if (g_streams[i].in_use && webserver_stream_pump(&g_streams[i]) != ERR_OK) {
+            webserver_stream_release(&g_streams[i], true);
+        }
     }
-    tcp_arg(state->pcb, NULL);
-    tcp_sent(state->pcb, NULL);
-    tcp_poll(state->pcb, NULL, 0);
-    free(state->body_copy);
-    free(state);
 }
 
-static err_t webserver_poll_callback(void *arg, struct tcp_pcb *pcb) {
-    return webserver_send_next_chunk(arg, pcb, 0);
+// Returns true when closing failed and the pcb was aborted instead; a
+// callback of that pcb must then return ERR_ABRT.
+static bool webserver_stream_release(webserver_stream_t *stream, bool close_pcb) {
+    if (!stream || !stream->in_use) {
+        return false;
+    }
+    bool aborted = false;
+    struct tcp_pcb *pcb = stream->pcb;
+    if (pcb) {
+        tcp_arg(pcb, NULL);
+        tcp_recv(pcb, NULL);
+        tcp_sent(pcb, NULL);
+        tcp_err(pcb, NULL);
+        tcp_poll(pcb, NULL, 0);
+        if (close_pcb && tcp_close(pcb) != ERR_OK) {
+            tcp_abort(pcb);
+            aborted = true;
+        }
+    }
+    if (stream->on_close) {
+        stream->on_close(stream->ctx);
+    }
+    stream->in_use = false;
+    stream->pcb = NULL;
+    return aborted;
 }
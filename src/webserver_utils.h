@@ -1,9 +1,127 @@
 #ifndef WEBSERVER_UTILS_H
 #define WEBSERVER_UTILS_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #include "lwip/err.h"
 #include "lwip/tcp.h"
 
-err_t webserver_send_response(struct tcp_pcb *pcb, const char *body);
+#include "metrics.h"
+#include "web_assets.h"
+#include "web_template.h"
+
+// Sizes every per-connection pool; nothing is allocated per request.
+#define WEBSERVER_MAX_CONNECTIONS 4
+#define WEBSERVER_MAX_REQUESTS_PER_CONNECTION 100
+#define WEBSERVER_IDLE_TIMEOUT_MS 5000   // kept-alive connection waiting for a request
+#define WEBSERVER_HEADER_TIMEOUT_MS 5000 // a request's head, from its first byte
+#define WEBSERVER_BODY_TIMEOUT_MS 10000  // a request's body, from the end of its head
+#define WEBSERVER_SEND_STALL_MS 10000    // response or stream without acknowledged progress
+#define WEBSERVER_RECLAIM_STALL_MS 1000  // stalled this long, a slot may go to a newcomer
+#define WEBSERVER_REQUEST_MAX 1024      // request line, headers and body
+#define WEBSERVER_MAX_STREAMS 4
+#define WEBSERVER_STREAM_CHUNK 448
+#define WEBSERVER_RESPONSE_EXTRA_MAX 1280 // copied body or template model per response
+
+// Answers one request. request is NUL-terminated and holds exactly one message;
+// the handler must send exactly one response on pcb or hand it to a stream.
+typedef void (*webserver_request_fn)(struct tcp_pcb *pcb, char *request, size_t request_len);
+
+// Names a connection across callbacks; 0 is never a valid handle.
+typedef uint32_t webserver_conn_handle_t;
+typedef void (*webserver_resume_fn)(struct tcp_pcb *pcb, void *ctx);
+
+typedef struct {
+    uint32_t accepted;
+    uint32_t rejected;  // no connection slot free; answered 503
+    uint32_t oversized; // body or model larger than a response slot
+    uint32_t requests;
+    uint32_t reused; // requests served on an already used connection
+    uint32_t idle_closed;
+    uint32_t header_timeouts; // 408, head not complete in time
+    uint32_t body_timeouts;   // 408, body not complete in time
+    uint32_t send_stalls;     // aborted, response not read
+    uint32_t stream_stalls;   // aborted, stream subscriber not reading
+    uint32_t reclaimed;       // aborted while stalled to admit a new connection
+    uint16_t active;
+    uint64_t bytes_sent; // HTTP responses and streams; WebSocket frames not included
+    uint64_t bytes_received;
+} webserver_http_stats_t;
+
+// Produces the next piece of a long-lived response into out. Returning 0 means
+// nothing is pending right now; the stream stays open until the peer leaves.
+typedef size_t (*webserver_stream_fill_fn)(void *ctx, char *out, size_t out_len);
+typedef void (*webserver_stream_close_fn)(void *ctx);
+
+typedef struct {
+    const web_template_t *tmpl;
+    web_slot_resolver_fn resolve;
+    const void *model;
+    size_t model_size;     // bytes of model copied into the response
+    size_t content_length; // 0 to measure the template against the model
+    const char *etag;      // optional quoted validator
+} webserver_template_response_t;
+
+// Fills the response's own copy of a model; returns its size, or 0 on failure.
+typedef size_t (*webserver_snapshot_fn)(void *model, size_t model_cap);
+// Renders line index of a body from that copy. Returning 0 ends the body.
+typedef size_t (*webserver_line_fn)(const void *model, uint16_t index, char *out, size_t out_len);
+
+typedef struct {
+    const char *content_type;
+    webserver_snapshot_fn snapshot;
+    webserver_line_fn line;
+} webserver_generated_response_t;
+
+// Takes ownership of an accepted pcb and serves requests on it until either
+// side closes. Returns ERR_ABRT, after aborting the pcb, when every slot is busy.
+err_t webserver_http_accept(struct tcp_pcb *pcb, webserver_request_fn handler);
+// Forgets the connection without closing it, for a handler that takes the pcb
+// over (streams, WebSocket). The new owner must install its own callbacks.
+void webserver_http_detach(struct tcp_pcb *pcb);
+void webserver_http_get_stats(webserver_http_stats_t *out);
+// Names the route the request being handled is counted under in /metrics.
+void webserver_http_tag(struct tcp_pcb *pcb, metrics_route_t route);
+
+// Parks the request being handled so it can be answered later, from the main
+// loop. The connection reads no further requests meanwhile. Call from inside
+// the handler; returns 0 if there is no such request to park.
+webserver_conn_handle_t webserver_http_defer(struct tcp_pcb *pcb);
+// Answers a parked request: respond gets the pcb and must send exactly one
+// response, as a handler would. Returns false, without calling respond, if the
+// connection went away meanwhile. Must be called with the lwIP lock held.
+bool webserver_http_resume(webserver_conn_handle_t handle, webserver_resume_fn respond, void *ctx);
+
+// Case-insensitive header lookup; the value is trimmed but not terminated.
+const char *webserver_request_header(const char *request, const char *name, size_t *value_len);
+
+// Streams a compiled template. The model is copied so the page renders from
+// a consistent snapshot; no full-page buffer is ever built.
+err_t webserver_send_template(struct tcp_pcb *pcb, const webserver_template_response_t *response);
+// Streams a body rendered line by line from a snapshot held in the response
+// slot. Every line is rendered once to measure and once to send, so lines
+// must depend on the snapshot alone.
+err_t webserver_send_generated(struct tcp_pcb *pcb,
+                               const webserver_generated_response_t *response);
+// Bodyless 304 for a request whose If-None-Match matched etag.
+err_t webserver_send_not_modified(struct tcp_pcb *pcb, const char *etag);
+// Asset URLs carry their content hash, so responses may be cached indefinitely.
+err_t webserver_send_asset(struct tcp_pcb *pcb, const web_asset_t *asset, bool not_modified);
+// The body is copied, so it may live on the caller's stack.
+err_t webserver_send_body(struct tcp_pcb *pcb, int status, const char *reason,
+                          const char *content_type, const char *body, size_t body_len);
+// As webserver_send_body for JSON; etag may be NULL.
+err_t webserver_send_json(struct tcp_pcb *pcb, int status, const char *reason, const char *etag,
+                          const char *body, size_t body_len);
+err_t webserver_send_error(struct tcp_pcb *pcb, int status, const char *reason);
+
+// Takes over the connection; on failure the caller still owns the pcb.
+err_t webserver_stream_open(struct tcp_pcb *pcb, const char *content_type,
+                            webserver_stream_fill_fn fill, webserver_stream_close_fn on_close,
+                            void *ctx);
+// Pushes pending data on every open stream. Must be called with the lwIP lock held.
+void webserver_stream_pump_all(void);
 
 #endif // WEBSERVER_UTILS_H
@@ -0,0 +1,359 @@
+#include "websocket.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "logging.h"
+#include "sha1.h"
+#include "webserver_utils.h"
+
+#include "lwip/sys.h"
+
+#define WEBSOCKET_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WEBSOCKET_KEY_MAX 32
+#define WEBSOCKET_FRAME_MAX (2 + 4 + WEBSOCKET_PAYLOAD_MAX) // client frames are masked
+#define WEBSOCKET_POLL_INTERVAL 2                          // tcp_poll ticks of 500 ms
+
+enum {
+    WS_OP_CONTINUATION = 0x0,
+    WS_OP_TEXT = 0x1,
+    WS_OP_BINARY = 0x2,
+    WS_OP_CLOSE = 0x8,
+    WS_OP_PING = 0x9,
+    WS_OP_PONG = 0xA,
+};
+
+enum {
+    WS_CLOSE_NORMAL = 1000,
+    WS_CLOSE_PROTOCOL_ERROR = 1002,
+    WS_CLOSE_TOO_BIG = 1009,
+};
+
+struct websocket {
+    bool in_use;
+    bool closing;   // close frame sent; waiting for the peer's FIN
+    bool pinged;    // a ping went out after the peer fell silent
+    u32_t heard_ms; // last bytes from the peer
+    u32_t since_ms; // when the ping or the close frame went out
+    struct tcp_pcb *pcb;
+    const websocket_handlers_t *handlers;
+    void *user;
+    size_t rx_len;
+    uint8_t rx[WEBSOCKET_FRAME_MAX];
+};
+
+static websocket_t g_sockets[WEBSOCKET_MAX_CLIENTS];
+static uint32_t g_timeouts = 0;
+
+static bool websocket_release(websocket_t *ws, bool close_pcb);
+
+static size_t base64_encode(const uint8_t *in, size_t len, char *out) {
+    static const char k_alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t used = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        const uint32_t chunk = ((uint32_t)in[i] << 16) |
+                               (i + 1 < len ? (uint32_t)in[i + 1] << 8 : 0) |
+                               (i + 2 < len ? (uint32_t)in[i + 2] : 0);
+        out[used++] = k_alphabet[(chunk >> 18) & 0x3F];
+        out[used++] = k_alphabet[(chunk >> 12) & 0x3F];
+        out[used++] = i + 1 < len ? k_alphabet[(chunk >> 6) & 0x3F] : '=';
+        out[used++] = i + 2 < len ? k_alphabet[chunk & 0x3F] : '=';
+    }
+    out[used] = '\0';
+    return used;
+}
+
+static bool header_has_token(const char *request, const char *name, const char *token) {
+    size_t len = 0;
+    const char *value = webserver_request_header(request, name, &len);
+    const size_t token_len = strlen(token);
+    for (size_t i = 0; value && i + token_len <= len; ++i) {
+        if (strncasecmp(value + i, token, token_len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool websocket_is_upgrade(const char *request) {
+    return header_has_token(request, "Upgrade", "websocket") &&
+           header_has_token(request, "Connection", "upgrade");
+}
+
+static err_t websocket_send_frame(websocket_t *ws, uint8_t opcode, const void *data,
+                                  size_t len) {
+    if (!ws || !ws->in_use || !ws->pcb || len > WEBSOCKET_PAYLOAD_MAX) {
+        return ERR_VAL;
+    }
+    // Server frames are never masked; payloads this small need no extended length.
+    uint8_t frame[2 + WEBSOCKET_PAYLOAD_MAX];
+    frame[0] = (uint8_t)(0x80 | opcode);
+    frame[1] = (uint8_t)len;
+    if (len > 0) {
+        memcpy(frame + 2, data, len);
+    }
+    if (tcp_sndbuf(ws->pcb) < len + 2) {
+        return ERR_MEM;
+    }
+    err_t err = tcp_write(ws->pcb, frame, (u16_t)(len + 2), TCP_WRITE_FLAG_COPY);
+    if (err == ERR_OK) {
+        tcp_output(ws->pcb);
+    }
+    return err;
+}
+
+err_t websocket_send_text(websocket_t *ws, const char *text, size_t len) {
+    if (ws && ws->closing) {
+        return ERR_CLSD;
+    }
+    return websocket_send_frame(ws, WS_OP_TEXT, text, len);
+}
+
+void *websocket_user(const websocket_t *ws) { return ws ? ws->user : NULL; }
+
+uint32_t websocket_timeouts(void) { return g_timeouts; }
+
+static void websocket_send_close(websocket_t *ws, uint16_t code) {
+    const uint8_t payload[2] = {(uint8_t)(code >> 8), (uint8_t)code};
+    websocket_send_frame(ws, WS_OP_CLOSE, payload, sizeof(payload));
+    if (!ws->closing) {
+        ws->since_ms = sys_now();
+    }
+    ws->closing = true;
+}
+
+// Handles every complete frame in rx; a partial frame stays buffered.
+// Returns true when a close frame ended the socket by aborting its pcb.
+static bool websocket_process(websocket_t *ws) {
+    while (ws->in_use && ws->rx_len >= 2) {
+        const uint8_t b0 = ws->rx[0];
+        const uint8_t b1 = ws->rx[1];
+        const uint8_t opcode = b0 & 0x0F;
+        const size_t len = b1 & 0x7F;
+
+        // Clients must mask; messages here always fit one small frame.
+        if (!(b1 & 0x80) || !(b0 & 0x80) || opcode == WS_OP_CONTINUATION) {
+            websocket_send_close(ws, WS_CLOSE_PROTOCOL_ERROR);
+            ws->rx_len = 0;
+            return false;
+        }
+        if (len > WEBSOCKET_PAYLOAD_MAX) {
+            websocket_send_close(ws, WS_CLOSE_TOO_BIG);
+            ws->rx_len = 0;
+            return false;
+        }
+        const size_t frame_len = 2 + 4 + len;
+        if (ws->rx_len < frame_len) {
+            return false;
+        }
+
+        char payload[WEBSOCKET_PAYLOAD_MAX + 1];
+        const uint8_t *mask = ws->rx + 2;
+        for (size_t i = 0; i < len; ++i) {
+            payload[i] = (char)(ws->rx[6 + i] ^ mask[i & 3]);
+        }
+        payload[len] = '\0';
+        ws->rx_len -= frame_len;
+        memmove(ws->rx, ws->rx + frame_len, ws->rx_len);
+
+        switch (opcode) {
+        case WS_OP_TEXT:
+        case WS_OP_BINARY:
+            if (!ws->closing && ws->handlers->on_message) {
+                ws->handlers->on_message(ws, payload, len);
+            }
+            break;
+        case WS_OP_PING:
+            websocket_send_frame(ws, WS_OP_PONG, payload, len);
+            break;
+        case WS_OP_CLOSE:
+            // Echo the close, then let TCP finish the job.
+            if (!ws->closing) {
+                websocket_send_close(ws, WS_CLOSE_NORMAL);
+            }
+            return websocket_release(ws, true);
+        case WS_OP_PONG:
+        default:
+            break;
+        }
+    }
+    return false;
+}
+
+static err_t websocket_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
+    websocket_t *ws = (websocket_t *)arg;
+    if (!p || err != ERR_OK) {
+        if (p) {
+            pbuf_free(p);
+        }
+        return websocket_release(ws, true) ? ERR_ABRT : ERR_OK;
+    }
+
+    tcp_recved(pcb, p->tot_len);
+    ws->heard_ms = sys_now();
+    ws->pinged = false;
+    u16_t offset = 0;
+    while (ws->in_use && offset < p->tot_len) {
+        const size_t room = sizeof(ws->rx) - ws->rx_len;
+        const u16_t chunk = (p->tot_len - offset) < room ? (u16_t)(p->tot_len - offset)
+                                                          : (u16_t)room;
+        pbuf_copy_partial(p, ws->rx + ws->rx_len, chunk, offset);
+        ws->rx_len += chunk;
+        offset += chunk;
+        if (websocket_process(ws)) {
+            pbuf_free(p);
+            return ERR_ABRT;
+        }
+    }
+    pbuf_free(p);
+    return ERR_OK;
+}
+
+static err_t websocket_sent(void *arg, struct tcp_pcb *pcb, u16_t len) {
+    (void)pcb;
+    (void)len;
+    websocket_t *ws = (websocket_t *)arg;
+    if (ws && ws->in_use && !ws->closing && ws->handlers->on_writable) {
+        ws->handlers->on_writable(ws);
+    }
+    return ERR_OK;
+}
+
+// A peer that vanished would otherwise hold its slot forever: an idle one is
+// pinged, and one that ignores the ping or the close handshake is aborted.
+static err_t websocket_poll(void *arg, struct tcp_pcb *pcb) {
+    websocket_t *ws = (websocket_t *)arg;
+    if (!ws || !ws->in_use) {
+        return ERR_OK;
+    }
+    const u32_t now = sys_now();
+    const bool expired =
+        ws->closing  ? (u32_t)(now - ws->since_ms) >= WEBSOCKET_CLOSE_TIMEOUT_MS
+        : ws->pinged ? (u32_t)(now - ws->since_ms) >= WEBSOCKET_PONG_TIMEOUT_MS
+                     : false;
+    if (expired) {
+        LOG_WARN(LOG_CAT_HTTP, "aborting websocket: peer %s",
+                 ws->closing ? "ignored the close" : "stopped answering");
+        g_timeouts++;
+        websocket_release(ws, false);
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    if (!ws->closing && !ws->pinged &&
+        (u32_t)(now - ws->heard_ms) >= WEBSOCKET_PING_IDLE_MS) {
+        // A full send buffer drops the ping; the deadline runs regardless.
+        websocket_send_frame(ws, WS_OP_PING, NULL, 0);
+        ws->pinged = true;
+        ws->since_ms = now;
+    }
+    return ERR_OK;
+}
+
+static void websocket_err(void *arg, err_t err) {
+    (void)err;
+    websocket_t *ws = (websocket_t *)arg;
+    if (ws) {
+        ws->pcb = NULL;
+        websocket_release(ws, false);
+    }
+}
+
+err_t websocket_accept(struct tcp_pcb *pcb, const char *request,
+                       const websocket_handlers_t *handlers, void *user, websocket_t **out) {
+    if (!pcb || !request || !handlers || !out) {
+        return ERR_VAL;
+    }
+
+    size_t key_len = 0;
+    const char *key = webserver_request_header(request, "Sec-WebSocket-Key", &key_len);
+    size_t version_len = 0;
+    const char *version = webserver_request_header(request, "Sec-WebSocket-Version", &version_len);
+    if (!key || key_len == 0 || key_len > WEBSOCKET_KEY_MAX || !version || version_len != 2 ||
+        memcmp(version, "13", 2) != 0) {
+        return ERR_ARG;
+    }
+
+    websocket_t *ws = NULL;
+    for (size_t i = 0; i < WEBSOCKET_MAX_CLIENTS; ++i) {
+        if (!g_sockets[i].in_use) {
+            ws = &g_sockets[i];
+            break;
+        }
+    }
+    if (!ws) {
+        return ERR_MEM;
+    }
+
+    char challenge[WEBSOCKET_KEY_MAX + sizeof(WEBSOCKET_GUID)];
+    memcpy(challenge, key, key_len);
+    memcpy(challenge + key_len, WEBSOCKET_GUID, sizeof(WEBSOCKET_GUID) - 1);
+    uint8_t digest[SHA1_DIGEST_SIZE];
+    sha1(challenge, key_len + sizeof(WEBSOCKET_GUID) - 1, digest);
+    char accept[32];
+    base64_encode(digest, sizeof(digest), accept);
+
+    char header[160];
+    int header_len = snprintf(header, sizeof(header),
+                              "HTTP/1.1 101 Switching Protocols\r\n"
+                              "Upgrade: websocket\r\n"
+                              "Connection: Upgrade\r\n"
+                              "Sec-WebSocket-Accept: %s\r\n\r\n",
+                              accept);
+    if (header_len <= 0 || header_len >= (int)sizeof(header)) {
+        return ERR_MEM;
+    }
+    err_t err = tcp_write(pcb, header, (u16_t)header_len, TCP_WRITE_FLAG_COPY);
+    if (err != ERR_OK) {
+        return err;
+    }
+    tcp_output(pcb);
+
+    webserver_http_detach(pcb);
+    *ws = (websocket_t){
+        .in_use = true,
+        .pcb = pcb,
+        .handlers = handlers,
+        .user = user,
+        .heard_ms = sys_now(),
+    };
+    // Control messages are tiny; don't let Nagle hold acks back.
+    tcp_nagle_disable(pcb);
+    tcp_arg(pcb, ws);
+    tcp_recv(pcb, websocket_recv);
+    tcp_sent(pcb, websocket_sent);
+    tcp_err(pcb, websocket_err);
+    tcp_poll(pcb, websocket_poll, WEBSOCKET_POLL_INTERVAL);
+    *out = ws;
+    LOG_INFO(LOG_CAT_HTTP, "websocket client connected");
+    return ERR_OK;
+}
+
+// Returns true when closing failed and the pcb was aborted instead; a
+// callback of that pcb must then return ERR_ABRT.
+static bool websocket_release(websocket_t *ws, bool close_pcb) {
+    if (!ws || !ws->in_use) {
+        return false;
+    }
+    bool aborted = false;
+    struct tcp_pcb *pcb = ws->pcb;
+    if (pcb) {
+        tcp_arg(pcb, NULL);
+        tcp_recv(pcb, NULL);
+        tcp_sent(pcb, NULL);
+        tcp_err(pcb, NULL);
+        tcp_poll(pcb, NULL, 0);
+        if (close_pcb && tcp_close(pcb) != ERR_OK) {
+            tcp_abort(pcb);
+            aborted = true;
+        }
+    }
+    ws->in_use = false;
+    ws->pcb = NULL;
+    if (ws->handlers->on_close) {
+        ws->handlers->on_close(ws);
+    }
+    return aborted;
+}
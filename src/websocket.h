@@ -0,0 +1,38 @@
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lwip/tcp.h"
+
+#define WEBSOCKET_MAX_CLIENTS 2
+#define WEBSOCKET_PAYLOAD_MAX 125 // single-frame messages only, no extended lengths
+#define WEBSOCKET_PING_IDLE_MS 20000    // a silent client is pinged after this long
+#define WEBSOCKET_PONG_TIMEOUT_MS 10000 // ... and aborted if it still says nothing
+#define WEBSOCKET_CLOSE_TIMEOUT_MS 5000 // close frame sent, peer neither answers nor leaves
+
+typedef struct websocket websocket_t;
+
+typedef struct {
+    // Complete, unmasked text or binary message.
+    void (*on_message)(websocket_t *ws, const char *data, size_t len);
+    // Send buffer space was freed; a deferred reply can be retried.
+    void (*on_writable)(websocket_t *ws);
+    void (*on_close)(websocket_t *ws);
+} websocket_handlers_t;
+
+bool websocket_is_upgrade(const char *request);
+
+// Answers the upgrade request and takes the pcb over from the HTTP layer.
+// ERR_ARG means the request is not a valid version 13 handshake.
+err_t websocket_accept(struct tcp_pcb *pcb, const char *request,
+                       const websocket_handlers_t *handlers, void *user, websocket_t **out);
+// Sends one unfragmented text frame. ERR_MEM means the send buffer is full.
+err_t websocket_send_text(websocket_t *ws, const char *text, size_t len);
+void *websocket_user(const websocket_t *ws);
+// Sockets aborted because the peer stopped answering.
+uint32_t websocket_timeouts(void);
+
+#endif // WEBSOCKET_H
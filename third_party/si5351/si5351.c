@@ -27,6 +27,7 @@
 #include "si5351.h"
 #include "debug.h"
 #include <stdint.h>
+#include <string.h>
 
 struct Si5351Status dev_status = {0, 0, 0, 0, 0};
 struct Si5351IntStatus dev_int_status = {0, 0, 0, 0};
@@ -1809,8 +1810,40 @@ uint8_t select_r_div_ms67(uint64_t *freq)
 
 // Rebuild functions for Raspberry Pi Pico
 
-uint8_t si5351_write_bulk(uint8_t regAddr, uint8_t length, uint8_t *data) {
-  int num_bytes_read = 0;
+/*
+ * Register batching
+ *
+ * Between si5351_batch_begin() and si5351_batch_commit() writes only update a
+ * RAM image of the register file and reads are answered from it, so a whole
+ * retune costs one read per register at most and the writes go out together:
+ * one bulk transfer per run of consecutive changed registers.
+ */
+static bool batch_active;
+static uint8_t batch_image[256];
+static uint32_t batch_known[8];
+static uint32_t batch_dirty[8];
+
+#define BATCH_TEST(map, reg) (((map)[(reg) >> 5] >> ((reg) & 31)) & 1u)
+#define BATCH_SET(map, reg) ((map)[(reg) >> 5] |= 1u << ((reg) & 31))
+
+static struct Si5351BusStats bus_stats;
+
+// Plain increments: only the main loop talks to the chip.
+static void si5351_bus_account(uint64_t start, int32_t rc, uint32_t bytes) {
+  bus_stats.bus_us += time_us_64() - start;
+  bus_stats.transactions++;
+  if (rc < 0) {
+    bus_stats.errors++;
+  } else {
+    bus_stats.bytes += bytes;
+  }
+}
+
+void si5351_get_bus_stats(struct Si5351BusStats *stats) {
+  *stats = bus_stats;
+}
+
+static int si5351_i2c_write(uint8_t regAddr, uint8_t length, const uint8_t *data) {
   uint8_t msg[length + 1];
 
   // Append register address to front of data packet
@@ -1820,9 +1853,183 @@ uint8_t si5351_write_bulk(uint8_t regAddr, uint8_t length, uint8_t *data) {
   }
 
   // Write data to register(s) over I2C
-  i2c_write_blocking(i2c0, i2c_bus_addr, msg, (length + 1), false);
+  const uint64_t start = time_us_64();
+  int rc = i2c_write_blocking(i2c0, i2c_bus_addr, msg, (length + 1), false);
+  si5351_bus_account(start, rc, length + 1);
+  return rc;
+}
+
+void si5351_batch_begin(void) {
+  batch_active = true;
+  for (int i = 0; i < 8; i++) {
+    batch_known[i] = 0;
+    batch_dirty[i] = 0;
+  }
+}
+
+void si5351_batch_cancel(void) {
+  batch_active = false;
+}
+
+typedef bool (*si5351_run_fn)(uint16_t first, uint16_t end, void *ctx);
+
+static bool si5351_batch_flush_run(uint16_t first, uint16_t end, void *ctx) {
+  if (si5351_i2c_write((uint8_t)first, (uint8_t)(end - first), &batch_image[first]) < 0) {
+    return false;
+  }
+  (*(uint8_t *)ctx)++;
+  return true;
+}
+
+/*
+ * Hands every register changed since si5351_batch_begin() to emit as runs of
+ * consecutive registers, in ascending order, so PLL and multisynth parameters
+ * land before a PLL reset. The output enable register goes first when it
+ * switches outputs off against oe_before and last when it switches them on,
+ * so no output runs on half-written settings.
+ */
+static bool si5351_batch_walk(uint8_t oe_before, si5351_run_fn emit, void *ctx) {
+  bool ok = true;
+
+  const uint8_t oe = SI5351_OUTPUT_ENABLE_CTRL;
+  bool oe_last = false;
+  if (BATCH_TEST(batch_dirty, oe)) {
+    // A set bit disables its output.
+    oe_last = (batch_image[oe] & (uint8_t)~oe_before) == 0;
+    if (!oe_last) {
+      ok &= emit(oe, oe + 1, ctx);
+    }
+  }
+
+  uint16_t run = 0;
+  bool in_run = false;
+  for (uint16_t reg = 0; reg <= 256; reg++) {
+    bool dirty = reg < 256 && reg != oe && BATCH_TEST(batch_dirty, reg);
+    // Rewriting one unchanged register whose value is known is cheaper than
+    // the address and pointer bytes of starting another transfer.
+    if (!dirty && in_run && reg + 1 < 256 && reg != oe && reg + 1 != oe &&
+        BATCH_TEST(batch_known, reg) && BATCH_TEST(batch_dirty, reg + 1)) {
+      dirty = true;
+    }
+    if (dirty && !in_run) {
+      run = reg;
+      in_run = true;
+    } else if (!dirty && in_run) {
+      ok &= emit(run, reg, ctx);
+      in_run = false;
+    }
+  }
+
+  if (oe_last) {
+    ok &= emit(oe, oe + 1, ctx);
+  }
+  return ok;
+}
+
+/*
+ * si5351_batch_commit(uint8_t *transfers)
+ *
+ * Writes every register changed since si5351_batch_begin() in the order
+ * described above, one transfer per run. Returns false if any transfer
+ * failed.
+ */
+bool si5351_batch_commit(uint8_t *transfers) {
+  uint8_t count = 0;
+  batch_active = false;
+
+  const uint8_t oe = SI5351_OUTPUT_ENABLE_CTRL;
+  const uint8_t oe_before = BATCH_TEST(batch_dirty, oe) ? si5351_read(oe) : 0;
+  const bool ok = si5351_batch_walk(oe_before, si5351_batch_flush_run, &count);
+  if (transfers) {
+    *transfers = count;
+  }
+  return ok;
+}
+
+typedef struct {
+  uint8_t *image;
+  uint8_t cap;
+  uint8_t len;
+} si5351_image_cursor_t;
+
+static bool si5351_image_append(uint16_t first, uint16_t end, void *ctx) {
+  si5351_image_cursor_t *cursor = (si5351_image_cursor_t *)ctx;
+  const uint8_t count = (uint8_t)(end - first);
+  if (cursor->len + 2u + count > cursor->cap) {
+    return false;
+  }
+  cursor->image[cursor->len++] = (uint8_t)first;
+  cursor->image[cursor->len++] = count;
+  memcpy(&cursor->image[cursor->len], &batch_image[first], count);
+  cursor->len += count;
+  return true;
+}
+
+/*
+ * si5351_batch_export(uint8_t oe_before, uint8_t *image, uint8_t cap, uint8_t *len)
+ *
+ * Ends the batch without writing anything and stores its writes instead, as
+ * (first register, count, values...) records in commit order, for
+ * si5351_write_image() to replay later without any math. oe_before is the
+ * output enable register the image will be written over. Returns false if
+ * the records do not fit in cap bytes.
+ */
+bool si5351_batch_export(uint8_t oe_before, uint8_t *image, uint8_t cap, uint8_t *len) {
+  batch_active = false;
 
-  return num_bytes_read;
+  si5351_image_cursor_t cursor = {image, cap, 0};
+  const bool ok = si5351_batch_walk(oe_before, si5351_image_append, &cursor);
+  *len = ok ? cursor.len : 0;
+  return ok;
+}
+
+/*
+ * si5351_write_image(const uint8_t *image, uint8_t len, uint8_t *transfers)
+ *
+ * Writes records made by si5351_batch_export(), one transfer each. Returns
+ * false if a transfer failed or the records are malformed.
+ */
+bool si5351_write_image(const uint8_t *image, uint8_t len, uint8_t *transfers) {
+  uint8_t count = 0;
+  bool ok = true;
+  uint16_t pos = 0;
+  while (pos + 2u <= len) {
+    const uint8_t first = image[pos];
+    const uint8_t n = image[pos + 1];
+    if (n == 0 || pos + 2u + n > len) {
+      ok = false;
+      break;
+    }
+    if (si5351_i2c_write(first, n, &image[pos + 2]) < 0) {
+      ok = false;
+    } else {
+      count++;
+    }
+    pos += 2u + n;
+  }
+  if (transfers) {
+    *transfers = count;
+  }
+  return ok && pos == len;
+}
+
+uint8_t si5351_write_bulk(uint8_t regAddr, uint8_t length, uint8_t *data) {
+  if (batch_active) {
+    for (uint16_t i = 0; i < length && regAddr + i < 256; i++) {
+      const uint16_t reg = regAddr + i;
+      // A register already known to hold the value has nothing to send.
+      if (BATCH_TEST(batch_known, reg) && batch_image[reg] == data[i]) {
+        continue;
+      }
+      batch_image[reg] = data[i];
+      BATCH_SET(batch_known, reg);
+      BATCH_SET(batch_dirty, reg);
+    }
+    return 0;
+  }
+
+  si5351_i2c_write(regAddr, length, data);
+  return 0;
 }
 
 uint8_t si5351_write(uint8_t regAddr, uint8_t data) {
@@ -1834,16 +2041,27 @@ uint8_t si5351_write(uint8_t regAddr, uint8_t data) {
 uint8_t si5351_read(uint8_t regAddr) {
   uint8_t buf = 0xFF;
 
+  if (batch_active && BATCH_TEST(batch_known, regAddr)) {
+    return batch_image[regAddr];
+  }
+
+  const uint64_t start = time_us_64();
   int32_t rc = i2c_write_blocking(i2c0, i2c_bus_addr, &regAddr, 1, true);
   if (rc < 0) {
+    si5351_bus_account(start, rc, 0);
     debug_log_with_color(COLOR_BOLD_RED, "[SI5351] i2c write failed (reg=0x%02X rc=%d)\n", regAddr, rc);
     return 0xFF;
   }
   rc = i2c_read_blocking(i2c0, i2c_bus_addr, &buf, 1, false);
+  si5351_bus_account(start, rc, 2);
   if (rc < 0) {
     debug_log_with_color(COLOR_BOLD_RED, "[SI5351] i2c read failed (reg=0x%02X rc=%d)\n", regAddr, rc);
     return 0xFF;
   }
 
+  if (batch_active) {
+    batch_image[regAddr] = buf;
+    BATCH_SET(batch_known, regAddr);
+  }
   return buf;
 }
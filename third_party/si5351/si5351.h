@@ -284,6 +284,15 @@ struct Si5351IntStatus
 	uint8_t LOS_STKY;
 };
 
+// I2C traffic since boot; bus_us is time spent inside transfers.
+struct Si5351BusStats
+{
+	uint32_t transactions;
+	uint32_t bytes;
+	uint32_t errors;
+	uint64_t bus_us;
+};
+
 // Si5351(uint8_t i2c_addr = SI5351_BUS_BASE_ADDR);
 bool si5351_init(uint8_t, uint8_t, uint32_t, int32_t);
 void si5351_reset(void);
@@ -311,5 +320,11 @@ void set_ref_freq(uint32_t, enum si5351_pll_input);
 uint8_t si5351_write_bulk(uint8_t, uint8_t, uint8_t *);
 uint8_t si5351_write(uint8_t, uint8_t);
 uint8_t si5351_read(uint8_t);
+void si5351_batch_begin(void);
+bool si5351_batch_commit(uint8_t *);
+void si5351_batch_cancel(void);
+bool si5351_batch_export(uint8_t, uint8_t *, uint8_t, uint8_t *);
+bool si5351_write_image(const uint8_t *, uint8_t, uint8_t *);
+void si5351_get_bus_stats(struct Si5351BusStats *);
 
 #endif /* SI5351_H_ */
@@ -0,0 +1,329 @@
+// Host harness for src/http_parser.c.
+//
+//   http_parser_bench check [rounds]  framing of random pipelined streams, random splits
+//   http_parser_bench fuzz [rounds]   mutated input; split feeding must match one-shot
+//   http_parser_bench bench [MiB]     parse throughput at several segment sizes
+//
+// Exits non-zero on the first mismatch.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "http_parser.h"
+
+#define MAX_HEAD 1023
+#define MAX_MESSAGE 1023
+#define STREAM_MAX 16384
+#define MESSAGES_MAX 64
+
+typedef struct {
+    const char *text;
+    bool keep_alive;
+} sample_t;
+
+static const sample_t k_samples[] = {
+    {"GET / HTTP/1.1\r\nHost: 192.168.4.1\r\n\r\n", true},
+    {"GET /morse/status HTTP/1.1\r\nHost: 192.168.4.1\r\nAccept: */*\r\n"
+     "Connection: keep-alive\r\n\r\n",
+     true},
+    {"GET /app.css?v=1a2b3c4d HTTP/1.1\r\nHost: 192.168.4.1\r\n"
+     "If-None-Match: \"1a2b3c4d5e6f\"\r\nAccept-Encoding: gzip, deflate\r\n\r\n",
+     true},
+    {"POST /signal HTTP/1.1\r\nHost: 192.168.4.1\r\n"
+     "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: 32\r\n\r\n"
+     "frequency=14070000&drive=8&x=yyy",
+     true},
+    {"POST /morse HTTP/1.1\r\nContent-Length: 24\r\nConnection: close\r\n\r\n"
+     "text=CQ+CQ&wpm=20&fwpm=1",
+     false},
+    {"GET / HTTP/1.0\r\n\r\n", false},
+    {"GET / HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n", true},
+    {"POST /morse/stop HTTP/1.1\r\ncontent-length:0\r\n\r\n", true},
+    {"GET /boot HTTP/1.1\nHost: bare-lf\n\n", true},
+    {"GET /events HTTP/1.1\r\nUser-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) "
+     "Gecko/20100101 Firefox/128.0\r\nAccept: text/event-stream\r\nAccept-Language: en-US,"
+     "en;q=0.5\r\nCache-Control: no-cache\r\nX-Very-Long-Header-Name-That-Is-Ignored: 1\r\n\r\n",
+     true},
+};
+
+#define SAMPLE_COUNT (sizeof(k_samples) / sizeof(k_samples[0]))
+
+typedef struct {
+    http_parse_status_t status;
+    size_t length;
+    bool keep_alive;
+    int error_status;
+} outcome_t;
+
+static uint64_t g_rng = 0x9E3779B97F4A7C15ull;
+
+static uint32_t rng(void) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return (uint32_t)(g_rng >> 11);
+}
+
+// Runs a whole stream through one parser, feeding segments of at most
+// max_segment bytes (random sizes when random_split). Returns outcomes.
+static size_t run_stream(const char *data, size_t len, size_t max_segment, bool random_split,
+                         outcome_t *out, size_t out_max) {
+    http_parser_t parser;
+    http_parser_init(&parser, MAX_HEAD, MAX_MESSAGE);
+    size_t count = 0;
+    size_t pos = 0;
+    size_t message_start = 0;
+
+    while (pos < len && count < out_max) {
+        size_t segment = random_split ? 1 + rng() % max_segment : max_segment;
+        if (segment > len - pos) {
+            segment = len - pos;
+        }
+        // A segment may hold the end of one request and the start of the next.
+        size_t offset = 0;
+        while (offset < segment && count < out_max) {
+            http_parse_status_t status;
+            const size_t used = http_parser_feed(&parser, data + pos + offset, segment - offset,
+                                                 &status);
+            if (used > segment - offset) {
+                fprintf(stderr, "parser consumed %zu of %zu bytes\n", used, segment - offset);
+                exit(1);
+            }
+            offset += used;
+            if (status == HTTP_PARSE_INCOMPLETE) {
+                if (used != segment - (offset - used)) {
+                    fprintf(stderr, "incomplete parse left bytes unconsumed\n");
+                    exit(1);
+                }
+                continue;
+            }
+            const size_t consumed = pos + offset - message_start;
+            out[count].status = status;
+            out[count].length = consumed;
+            out[count].keep_alive = status == HTTP_PARSE_DONE && http_parser_keep_alive(&parser);
+            out[count].error_status =
+                status == HTTP_PARSE_ERROR ? http_parser_error_status(&parser, NULL) : 0;
+            if (status == HTTP_PARSE_DONE && http_parser_message_len(&parser) != consumed) {
+                fprintf(stderr, "message_len %zu != consumed %zu\n",
+                        http_parser_message_len(&parser), consumed);
+                exit(1);
+            }
+            count++;
+            if (status == HTTP_PARSE_ERROR) {
+                return count;
+            }
+            message_start = pos + offset;
+            http_parser_reset(&parser);
+        }
+        pos += segment;
+    }
+    return count;
+}
+
+static size_t build_stream(char *stream, size_t *lengths, bool *keep, size_t *count) {
+    size_t len = 0;
+    *count = 0;
+    const size_t messages = 1 + rng() % 12;
+    for (size_t i = 0; i < messages; ++i) {
+        const sample_t *sample = &k_samples[rng() % SAMPLE_COUNT];
+        const size_t n = strlen(sample->text);
+        memcpy(stream + len, sample->text, n);
+        len += n;
+        lengths[*count] = n;
+        keep[*count] = sample->keep_alive;
+        (*count)++;
+    }
+    return len;
+}
+
+static int cmd_check(unsigned rounds) {
+    static char stream[STREAM_MAX];
+    size_t lengths[MESSAGES_MAX];
+    bool keep[MESSAGES_MAX];
+    outcome_t outcomes[MESSAGES_MAX];
+
+    for (unsigned round = 0; round < rounds; ++round) {
+        size_t expected = 0;
+        const size_t len = build_stream(stream, lengths, keep, &expected);
+        const size_t max_segment = 1 + rng() % 1460;
+        const size_t got = run_stream(stream, len, max_segment, true, outcomes, MESSAGES_MAX);
+        if (got != expected) {
+            fprintf(stderr, "round %u: %zu requests framed, expected %zu\n", round, got,
+                    expected);
+            return 1;
+        }
+        for (size_t i = 0; i < got; ++i) {
+            if (outcomes[i].status != HTTP_PARSE_DONE || outcomes[i].length != lengths[i] ||
+                outcomes[i].keep_alive != keep[i]) {
+                fprintf(stderr, "round %u request %zu: status %d length %zu/%zu keep %d/%d\n",
+                        round, i, outcomes[i].status, outcomes[i].length, lengths[i],
+                        outcomes[i].keep_alive, keep[i]);
+                return 1;
+            }
+        }
+    }
+
+    // Limits and malformed input, each as a single request.
+    static const struct {
+        const char *text;
+        int status;
+    } k_errors[] = {
+        {"GET / HTTP/2.0\r\n\r\n", 505},
+        {"GET / HTTP/1.1\r\nContent-Length: x\r\n\r\n", 400},
+        {"POST / HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 6\r\n\r\n", 400},
+        {"POST / HTTP/1.1\r\nContent-Length: 5000\r\n\r\n", 413},
+        {"POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n", 411},
+        {"GET / HTTP/1.1\r\n folded: value\r\n\r\n", 400},
+        {"GET / HTTP/1.1\r\nBad Header: 1\r\n\r\n", 400},
+        {"G@T / HTTP/1.1\r\n\r\n", 400},
+    };
+    for (size_t i = 0; i < sizeof(k_errors) / sizeof(k_errors[0]); ++i) {
+        outcome_t outcome;
+        const size_t got =
+            run_stream(k_errors[i].text, strlen(k_errors[i].text), 3, false, &outcome, 1);
+        if (got != 1 || outcome.status != HTTP_PARSE_ERROR ||
+            outcome.error_status != k_errors[i].status) {
+            fprintf(stderr, "error case %zu: got status %d, expected %d\n", i,
+                    got ? outcome.error_status : -1, k_errors[i].status);
+            return 1;
+        }
+    }
+    static char huge[2048];
+    memcpy(huge, "GET /", 5);
+    memset(huge + 5, 'a', sizeof(huge) - 5);
+    outcome_t outcome;
+    if (run_stream(huge, sizeof(huge), 512, false, &outcome, 1) != 1 ||
+        outcome.error_status != 414) {
+        fprintf(stderr, "overlong target not rejected with 414\n");
+        return 1;
+    }
+    memcpy(huge, "GET / HTTP/1.1\r\nX: ", 19);
+    if (run_stream(huge, sizeof(huge), 512, false, &outcome, 1) != 1 ||
+        outcome.error_status != 431) {
+        fprintf(stderr, "oversized header not rejected with 431\n");
+        return 1;
+    }
+
+    printf("check: %u random streams and %zu error cases passed\n", rounds,
+           sizeof(k_errors) / sizeof(k_errors[0]) + 2);
+    return 0;
+}
+
+static int cmd_fuzz(unsigned rounds) {
+    static char stream[STREAM_MAX];
+    size_t lengths[MESSAGES_MAX];
+    bool keep[MESSAGES_MAX];
+    outcome_t whole[MESSAGES_MAX];
+    outcome_t split[MESSAGES_MAX];
+
+    for (unsigned round = 0; round < rounds; ++round) {
+        size_t count = 0;
+        size_t len = build_stream(stream, lengths, keep, &count);
+        const unsigned mutations = 1 + rng() % 8;
+        for (unsigned m = 0; m < mutations; ++m) {
+            const size_t at = rng() % len;
+            switch (rng() % 4) {
+            case 0:
+                stream[at] = (char)rng();
+                break;
+            case 1:
+                stream[at] = "\r\n :0123456789"[rng() % 14];
+                break;
+            case 2:
+                if (len + 1 < STREAM_MAX) {
+                    memmove(stream + at + 1, stream + at, len - at);
+                    stream[at] = (char)rng();
+                    len++;
+                }
+                break;
+            default:
+                memmove(stream + at, stream + at + 1, len - at - 1);
+                len--;
+                break;
+            }
+            if (len == 0) {
+                break;
+            }
+        }
+
+        // Framing must not depend on how the bytes were segmented.
+        const size_t a = run_stream(stream, len, len ? len : 1, false, whole, MESSAGES_MAX);
+        const size_t b = run_stream(stream, len, 1 + rng() % 64, true, split, MESSAGES_MAX);
+        if (a != b) {
+            fprintf(stderr, "round %u: %zu outcomes whole, %zu split\n", round, a, b);
+            return 1;
+        }
+        for (size_t i = 0; i < a; ++i) {
+            if (whole[i].status != split[i].status || whole[i].length != split[i].length ||
+                whole[i].keep_alive != split[i].keep_alive ||
+                whole[i].error_status != split[i].error_status) {
+                fprintf(stderr, "round %u outcome %zu differs between whole and split\n", round,
+                        i);
+                return 1;
+            }
+        }
+    }
+    printf("fuzz: %u mutated streams, split feeding matched one-shot\n", rounds);
+    return 0;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int cmd_bench(unsigned mebibytes) {
+    static char stream[STREAM_MAX];
+    size_t len = 0;
+    size_t messages = 0;
+    while (messages < SAMPLE_COUNT * 8) {
+        const char *text = k_samples[messages % SAMPLE_COUNT].text;
+        const size_t n = strlen(text);
+        memcpy(stream + len, text, n);
+        len += n;
+        messages++;
+    }
+
+    static const size_t k_segments[] = {1460, 536, 64};
+    const size_t target = (size_t)mebibytes << 20;
+    outcome_t *outcomes = malloc(sizeof(outcome_t) * messages);
+    if (!outcomes) {
+        return 1;
+    }
+    for (size_t s = 0; s < sizeof(k_segments) / sizeof(k_segments[0]); ++s) {
+        size_t bytes = 0;
+        size_t requests = 0;
+        const double start = now_seconds();
+        while (bytes < target) {
+            requests += run_stream(stream, len, k_segments[s], false, outcomes, messages);
+            bytes += len;
+        }
+        const double elapsed = now_seconds() - start;
+        printf("bench: segment %4zu B  %8.1f MiB/s  %10.0f requests/s\n", k_segments[s],
+               (double)bytes / (1 << 20) / elapsed, (double)requests / elapsed);
+    }
+    free(outcomes);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *mode = argc > 1 ? argv[1] : "check";
+    const unsigned count = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 10) : 0;
+
+    if (strcmp(mode, "check") == 0) {
+        return cmd_check(count ? count : 20000);
+    }
+    if (strcmp(mode, "fuzz") == 0) {
+        return cmd_fuzz(count ? count : 200000);
+    }
+    if (strcmp(mode, "bench") == 0) {
+        return cmd_bench(count ? count : 64);
+    }
+    fprintf(stderr, "usage: %s [check|fuzz|bench] [count]\n", argv[0]);
+    return 2;
+}
@@ -0,0 +1,328 @@
+// Linux client for the binary UDP control protocol (src/udp_control.h).
+//
+//   udp_control_client <host> ping
+//   udp_control_client <host> tune <hz> | drive <ma> | key <0|1>
+//   udp_control_client <host> store <slot> <hz> <ma> <0|1> | recall <slot>
+//   udp_control_client <host> sweep <start> <stop> <step> <dwell_us>   (step 0 stops)
+//   udp_control_client <host> bench [count] [window]   acknowledged tune commands
+//   udp_control_client <host> pingbench [count] [window]
+//
+// <host> may carry a port as host:port. Single commands are retried with the
+// same sequence number until answered.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "udp_control.h"
+
+#define RETRY_TIMEOUT_MS 200
+#define RETRIES_MAX 5
+#define BENCH_TIMEOUT_MS 50
+#define BENCH_FREQ_BASE_HZ 10000000u
+
+typedef struct {
+    uint8_t opcode;
+    uint8_t status;
+    uint32_t seq;
+    uint32_t frequency_hz;
+    uint8_t drive_ma;
+    bool output;
+    bool sweeping;
+} reply_t;
+
+static const char *const k_status_names[] = {
+    "ok", "malformed", "out of range", "no such preset", "locked by Morse", "bus error", "stale",
+};
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static void put_u32(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static int open_socket(const char *target) {
+    char host[256];
+    snprintf(host, sizeof(host), "%s", target);
+    char port[8];
+    snprintf(port, sizeof(port), "%u", (unsigned)UDP_CONTROL_PORT);
+    char *colon = strrchr(host, ':');
+    if (colon) {
+        *colon = '\0';
+        snprintf(port, sizeof(port), "%s", colon + 1);
+    }
+
+    const struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_DGRAM};
+    struct addrinfo *info = NULL;
+    const int rc = getaddrinfo(host, port, &hints, &info);
+    if (rc != 0) {
+        fprintf(stderr, "%s: %s\n", target, gai_strerror(rc));
+        return -1;
+    }
+    const int fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    // Connected, so stray datagrams from anyone else are filtered out.
+    if (fd < 0 || connect(fd, info->ai_addr, info->ai_addrlen) != 0) {
+        perror("socket");
+        freeaddrinfo(info);
+        return -1;
+    }
+    freeaddrinfo(info);
+    return fd;
+}
+
+static size_t encode(uint8_t *out, uint8_t opcode, uint8_t flags, uint32_t seq,
+                     const uint8_t *payload, size_t payload_len) {
+    out[0] = UDP_CONTROL_MAGIC;
+    out[1] = UDP_CONTROL_VERSION;
+    out[2] = opcode;
+    out[3] = flags;
+    put_u32(out + 4, seq);
+    memcpy(out + UDP_CONTROL_HEADER_LEN, payload, payload_len);
+    return UDP_CONTROL_HEADER_LEN + payload_len;
+}
+
+static bool decode(const uint8_t *in, ssize_t len, reply_t *out) {
+    if (len != UDP_CONTROL_REPLY_LEN || in[0] != UDP_CONTROL_MAGIC ||
+        in[1] != UDP_CONTROL_VERSION || !(in[2] & UDP_CONTROL_REPLY_BIT)) {
+        return false;
+    }
+    *out = (reply_t){
+        .opcode = (uint8_t)(in[2] & ~UDP_CONTROL_REPLY_BIT),
+        .status = in[3],
+        .seq = get_u32(in + 4),
+        .frequency_hz = get_u32(in + 8),
+        .drive_ma = in[12],
+        .output = in[13] != 0,
+        .sweeping = in[14] != 0,
+    };
+    return true;
+}
+
+// Waits up to timeout_ms for one well-formed reply.
+static bool receive(int fd, int timeout_ms, reply_t *out) {
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    while (poll(&pfd, 1, timeout_ms) > 0) {
+        uint8_t buf[64];
+        const ssize_t len = recv(fd, buf, sizeof(buf), 0);
+        if (len < 0 && errno != EINTR) {
+            return false;
+        }
+        if (decode(buf, len, out)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t initial_seq(void) { return (uint32_t)now_us(); }
+
+static const char *status_name(uint8_t status) {
+    const size_t count = sizeof(k_status_names) / sizeof(k_status_names[0]);
+    return status < count ? k_status_names[status] : "unknown";
+}
+
+static int run_single(int fd, uint8_t opcode, const uint8_t *payload, size_t payload_len) {
+    uint8_t msg[64];
+    const uint32_t seq = initial_seq();
+    const size_t len = encode(msg, opcode, UDP_CONTROL_FLAG_ACK, seq, payload, payload_len);
+    for (int attempt = 0; attempt < RETRIES_MAX; ++attempt) {
+        const uint64_t start = now_us();
+        if (send(fd, msg, len, 0) < 0) {
+            perror("send");
+            return 1;
+        }
+        reply_t reply;
+        while (receive(fd, RETRY_TIMEOUT_MS, &reply)) {
+            if (reply.seq != seq) {
+                continue;
+            }
+            printf("%s in %.3f ms: %u Hz, %u mA, output %s%s\n", status_name(reply.status),
+                   (double)(now_us() - start) / 1000.0, reply.frequency_hz,
+                   (unsigned)reply.drive_ma, reply.output ? "on" : "off",
+                   reply.sweeping ? ", sweeping" : "");
+            return reply.status == UDP_CONTROL_OK ? 0 : 1;
+        }
+    }
+    fprintf(stderr, "no reply after %d attempts\n", RETRIES_MAX);
+    return 1;
+}
+
+static int compare_u32(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *)a;
+    const uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Bench commands tune through 1000 channels, so consecutive ones differ.
+static bool send_bench(int fd, uint8_t opcode, uint32_t seq, uint32_t index) {
+    uint8_t payload[4];
+    uint8_t msg[UDP_CONTROL_HEADER_LEN + sizeof(payload)];
+    put_u32(payload, BENCH_FREQ_BASE_HZ + (index % 1000u) * 10u);
+    const size_t len = encode(msg, opcode, UDP_CONTROL_FLAG_ACK, seq, payload,
+                              opcode == UDP_CONTROL_TUNE ? sizeof(payload) : 0);
+    return send(fd, msg, len, 0) >= 0;
+}
+
+// Keeps up to window commands in flight. Replies are cumulative, so one
+// covers every earlier command; on a timeout the newest command is sent again,
+// which makes the device answer for everything before it too.
+static int run_bench(int fd, uint8_t opcode, uint32_t count, uint32_t window) {
+    uint64_t *sent_us = calloc(count, sizeof(*sent_us));
+    uint32_t *latency_us = calloc(count, sizeof(*latency_us));
+    if (!sent_us || !latency_us) {
+        free(sent_us);
+        free(latency_us);
+        return 1;
+    }
+    const uint32_t base = initial_seq();
+    uint32_t next = 0;  // index of the next command to send
+    uint32_t acked = 0; // commands below this index are answered
+    uint32_t retries = 0;
+    uint32_t replies = 0;
+    uint32_t errors = 0;
+    bool failed = false;
+    uint64_t last_progress = now_us();
+    const uint64_t start = now_us();
+
+    while (acked < count && !failed) {
+        while (next < count && next - acked < window) {
+            sent_us[next] = now_us();
+            if (!send_bench(fd, opcode, base + next, next)) {
+                perror("send");
+                failed = true;
+                break;
+            }
+            next++;
+        }
+
+        reply_t reply;
+        if (receive(fd, BENCH_TIMEOUT_MS, &reply)) {
+            replies++;
+            const uint32_t index = reply.seq - base;
+            if (index >= count) {
+                continue;
+            }
+            if (reply.status != UDP_CONTROL_OK && reply.status != UDP_CONTROL_ERR_STALE) {
+                errors++;
+            }
+            const uint64_t now = now_us();
+            // PING is not sequenced, so its replies only answer themselves.
+            const uint32_t from = opcode == UDP_CONTROL_PING ? index : acked;
+            for (uint32_t i = from; i <= index; ++i) {
+                if (!latency_us[i]) { // the low bit keeps a 0 us answer distinct
+                    latency_us[i] = (uint32_t)(now - sent_us[i]) | 1u;
+                }
+            }
+            while (acked < count && latency_us[acked]) {
+                acked++;
+            }
+            last_progress = now;
+            continue;
+        }
+        if (now_us() - last_progress > 5000000u) {
+            fprintf(stderr, "no progress for 5 s; %u of %u answered\n", acked, count);
+            break;
+        }
+        // Retries reuse the sequence number, so the device never runs them twice.
+        const uint32_t resend = opcode == UDP_CONTROL_PING ? acked : next - 1;
+        if (send_bench(fd, opcode, base + resend, resend)) {
+            retries++;
+        }
+    }
+
+    const double seconds = (double)(now_us() - start) / 1e6;
+    qsort(latency_us, acked, sizeof(*latency_us), compare_u32);
+    printf("%u commands, window %u: %.3f s, %.0f commands/s\n", acked, window, seconds,
+           seconds > 0 ? acked / seconds : 0.0);
+    printf("replies %u, retries %u, errors %u\n", replies, retries, errors);
+    if (acked) {
+        printf("latency us: p50 %u, p90 %u, p99 %u, max %u\n", latency_us[acked / 2],
+               latency_us[(uint64_t)acked * 9 / 10], latency_us[(uint64_t)acked * 99 / 100],
+               latency_us[acked - 1]);
+    }
+    free(sent_us);
+    free(latency_us);
+    return !failed && acked == count && errors == 0 ? 0 : 1;
+}
+
+static uint32_t arg_u32(int argc, char **argv, int index, uint32_t fallback) {
+    return index < argc ? (uint32_t)strtoul(argv[index], NULL, 0) : fallback;
+}
+
+static int usage(void) {
+    fprintf(stderr, "usage: udp_control_client <host[:port]> ping | tune <hz> | drive <ma> |"
+                    " key <0|1>\n"
+                    "       | store <slot> <hz> <ma> <0|1> | recall <slot>\n"
+                    "       | sweep <start> <stop> <step> <dwell_us>\n"
+                    "       | bench [count] [window] | pingbench [count] [window]\n");
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        return usage();
+    }
+    const int fd = open_socket(argv[1]);
+    if (fd < 0) {
+        return 1;
+    }
+    const char *command = argv[2];
+    uint8_t payload[16];
+    int rc;
+    if (strcmp(command, "ping") == 0) {
+        rc = run_single(fd, UDP_CONTROL_PING, payload, 0);
+    } else if (strcmp(command, "tune") == 0 && argc == 4) {
+        put_u32(payload, arg_u32(argc, argv, 3, 0));
+        rc = run_single(fd, UDP_CONTROL_TUNE, payload, 4);
+    } else if ((strcmp(command, "drive") == 0 || strcmp(command, "key") == 0 ||
+                strcmp(command, "recall") == 0) &&
+               argc == 4) {
+        payload[0] = (uint8_t)arg_u32(argc, argv, 3, 0);
+        const uint8_t opcode = command[0] == 'd'   ? UDP_CONTROL_DRIVE
+                               : command[0] == 'k' ? UDP_CONTROL_KEY
+                                                   : UDP_CONTROL_PRESET_RECALL;
+        rc = run_single(fd, opcode, payload, 1);
+    } else if (strcmp(command, "store") == 0 && argc == 7) {
+        payload[0] = (uint8_t)arg_u32(argc, argv, 3, 0);
+        put_u32(payload + 1, arg_u32(argc, argv, 4, 0));
+        payload[5] = (uint8_t)arg_u32(argc, argv, 5, 0);
+        payload[6] = (uint8_t)arg_u32(argc, argv, 6, 0);
+        rc = run_single(fd, UDP_CONTROL_PRESET_STORE, payload, 7);
+    } else if (strcmp(command, "sweep") == 0 && argc == 7) {
+        for (int i = 0; i < 4; ++i) {
+            put_u32(payload + 4 * i, arg_u32(argc, argv, 3 + i, 0));
+        }
+        rc = run_single(fd, UDP_CONTROL_SWEEP, payload, 16);
+    } else if (strcmp(command, "bench") == 0 || strcmp(command, "pingbench") == 0) {
+        const uint32_t count = arg_u32(argc, argv, 3, 10000);
+        const uint32_t window = arg_u32(argc, argv, 4, 16);
+        if (count == 0 || window == 0) {
+            return usage();
+        }
+        rc = run_bench(fd, command[0] == 'b' ? UDP_CONTROL_TUNE : UDP_CONTROL_PING, count, window);
+    } else {
+        rc = usage();
+    }
+    close(fd);
+    return rc;
+}